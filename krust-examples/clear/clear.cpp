@@ -73,6 +73,8 @@ public:
       return false;
     }
 
+    mLastSubmits.resize(mSwapChainImages.size());
+
     // Allocate a command buffer per swapchain entry:
     KRUST_ASSERT1(mCommandBuffers.size() == 0, "Double init of command buffers.");
     kr::CommandBuffer::Allocate(*mCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, unsigned(mSwapChainImageViews.size()), mCommandBuffers);
@@ -191,35 +193,34 @@ public:
     static unsigned frame_no = 0;
     KRUST_LOG_INFO << "   -------------------------- Clear Example draw frame! currImage: " << mCurrentTargetImage << " (handle: " << mSwapChainImages[mCurrentTargetImage] << "), frame " << frame_no++ << "  --------------------------\n";
 
-    auto submitFence = mSwapChainFences[mCurrentTargetImage];
-    const VkResult fenceWaitResult = vkWaitForFences(*mGpuInterface, 1, submitFence->GetVkFenceAddress(), true, 1000000000); // Wait one second.
-    if(VK_SUCCESS != fenceWaitResult)
+    // Wait up to one second for the frame to complete for the previous time it was submitted:
+    const VkResult waitResult = mDefaultGraphicsQueue->WaitComplete(mLastSubmits[mCurrentTargetImage], 1000000000);
+    if(VK_SUCCESS != waitResult)
     {
-      KRUST_LOG_ERROR << "Wait for queue submit of main commandbuffer did not succeed: " << fenceWaitResult << Krust::endlog;
+      KRUST_LOG_ERROR << "Wait for queue submit of main commandbuffer did not succeed: " << waitResult << Krust::endlog;
     }
-    vkResetFences(*mGpuInterface, 1, submitFence->GetVkFenceAddress());
-
-    //auto submitFence = kr::Fence::New(*mGpuInterface, 0);
-    constexpr VkPipelineStageFlags pipelineFlags = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT; // VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    auto submitInfo = kr::SubmitInfo();
-      submitInfo.waitSemaphoreCount = 1,
-      submitInfo.pWaitSemaphores = mSwapChainSemaphore->GetVkSemaphoreAddress(),
-      submitInfo.pWaitDstStageMask = &pipelineFlags,
-      submitInfo.commandBufferCount = 1,
-      // We have one command buffer per presentable image, so submit the right one:
-      submitInfo.pCommandBuffers = mCommandBuffers[mCurrentTargetImage]->GetVkCommandBufferAddress(),
-      submitInfo.signalSemaphoreCount = 0,
-      submitInfo.pSignalSemaphores = nullptr;
 
     KRUST_LOG_DEBUG << "Submitting command buffer " << mCurrentTargetImage << "(" << *(mCommandBuffers[mCurrentTargetImage]) << ")." << Krust::endlog;
-    // Execute command buffer on main queue:
-    VK_CALL(vkQueueSubmit, *mDefaultGraphicsQueue, 1, &submitInfo, *submitFence);
+    // Execute command buffer on main queue.
+    // We have one command buffer per presentable image, so submit the right one:
+    const kr::SubmitResult submitResult = mDefaultGraphicsQueue->Submit(*mSwapChainSemaphore, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, *mCommandBuffers[mCurrentTargetImage]);
+    if(submitResult.result() != VK_SUCCESS)
+    {
+      KRUST_LOG_ERROR << "Failed to submit command buffer. Result: " << submitResult.result() << Krust::endlog;
+      return;
+    }
+    mLastSubmits[mCurrentTargetImage] = submitResult.counter();
   }
 
   ~ClearApplication()
   {
     KRUST_LOG_DEBUG << "ClearApplication::~ClearApplication()" << Krust::endlog;
   }
+
+private:
+  // Data:
+  /// The submit which last used each swapchain image's command buffer.
+  std::vector<kr::SubmitCounter> mLastSubmits;
 };
 
 int main()
@@ -22,8 +22,10 @@
 #include "krust-io/public-api/krust-io.h"
 #include "krust/public-api/krust.h"
 #include "krust/public-api/queue_janitor.h"
+#include "krust/public-api/render-graph.h"
 #include "krust/public-api/conditional-value.h"
-#include <fstream>
+// Generated at build time from the compiled shader:
+#include "spirv/compute1.comp.spv.h"
 
 namespace kr = Krust;
 
@@ -34,20 +36,6 @@ constexpr VkSampleCountFlagBits NUM_SAMPLES = VK_SAMPLE_COUNT_1_BIT;
 constexpr VkAllocationCallbacks* ALLOCATION_CALLBACKS = nullptr;
 constexpr unsigned WORKGROUP_X = 8u;
 constexpr unsigned WORKGROUP_Y = 8u;
-
-kr::ShaderBuffer loadSpirV(const char* const filename)
-{
-  kr::ShaderBuffer spirv;
-  if(std::ifstream is{filename, std::ios::binary | std::ios::ate}) {
-    auto size = is.tellg();
-    spirv.resize(size / sizeof(kr::ShaderBuffer::value_type));
-    is.seekg(0);
-    is.read((char*)&spirv[0], size);
-  } else {
-    KRUST_LOG_ERROR << "Failed to open shader file \"" << filename << "\"." << Krust::endlog;
-  }
-  return spirv;
-}
 }
 
 /**
@@ -55,6 +43,29 @@ kr::ShaderBuffer loadSpirV(const char* const filename)
  */
 class Compute1Application : public Krust::IO::Application
 {
+  void DoAddRequiredDeviceExtensions(std::vector<const char*>& extensionNames) const override
+  {
+    // The render graph records its barriers with synchronization2:
+    extensionNames.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    // The framebuffer descriptor is pushed rather than written to a set:
+    extensionNames.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+  }
+
+  void DoExtendDeviceFeatureChain(VkPhysicalDeviceFeatures2 &features) override
+  {
+    mDeviceSynchronization2Features.pNext = features.pNext;
+    features.pNext = &mDeviceSynchronization2Features;
+  }
+
+  void DoCustomizeDeviceFeatureChain(VkPhysicalDeviceFeatures2 &) override
+  {
+    if(!mDeviceSynchronization2Features.synchronization2)
+    {
+      KRUST_LOG_ERROR << "Synchronization2 is used for the render graph's barriers." << Krust::endlog;
+    }
+    mDeviceSynchronization2Features.synchronization2 = VK_TRUE;
+  }
+
 public:
   /**
    * Called by the default initialization once Krust is initialised and a window
@@ -64,7 +75,7 @@ public:
   {
     KRUST_LOG_DEBUG << "DoPostInit() entered." << Krust::endlog;
 
-    BuildFences(*mGpuInterface, VK_FENCE_CREATE_SIGNALED_BIT, mSwapChainImageViews.size(), mSwapChainFences);
+    mLastSubmits.resize(mSwapChainImages.size());
 
     // Allocate a command buffer per swapchain entry:
     KRUST_ASSERT1(mCommandBuffers.size() == 0, "Double init of command buffers.");
@@ -72,12 +83,8 @@ public:
 
     // Build all resources required to run the compute shader:
 
-    // Load the spir-v shader code into a module:
-    kr::ShaderBuffer spirv { loadSpirV("compute1.comp.spv") };
-    if(spirv.empty()){
-      return false;
-    }
-    auto shaderModule = kr::ShaderModule::New(*mGpuInterface, 0, spirv);
+    // The spir-v shader code is built into the executable:
+    auto shaderModule = kr::ShaderModule::New(*mGpuInterface, 0, kr::Spirv::compute1_comp);
 
     const auto ssci = kr::PipelineShaderStageCreateInfo(
       0,
@@ -97,9 +104,13 @@ public:
       nullptr // No immutable samplers.
     );
 
-    auto descriptorSetLayout = kr::DescriptorSetLayout::New(*mGpuInterface, 0, 1, &fbBinding);
+    auto descriptorSetLayout = kr::DescriptorSetLayout::New(*mGpuInterface, VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR, 1, &fbBinding);
     mPipelineLayout = kr::PipelineLayout::New(*mGpuInterface, 0, 1, descriptorSetLayout->GetDescriptorSetLayoutAddress());
 
+    // The framebuffer is pushed each frame straight from a VkDescriptorImageInfo:
+    const auto fbEntry = kr::DescriptorUpdateTemplateEntry(0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, sizeof(VkDescriptorImageInfo));
+    mPushTemplate = kr::DescriptorUpdateTemplate::NewPush(*mGpuInterface, VK_PIPELINE_BIND_POINT_COMPUTE, *mPipelineLayout, 0, 1, &fbEntry);
+
     // Construct our compute pipeline:
     mComputePipeline = kr::ComputePipeline::New(*mGpuInterface, kr::ComputePipelineCreateInfo(
       0,    // no flags
@@ -107,19 +118,7 @@ public:
       *mPipelineLayout,
       VK_NULL_HANDLE, // no base pipeline
       -1 // No index of a base pipeline.
-    ));
-
-    // Create a descriptor pool and allocate a matching descriptorSet for each image:
-    VkDescriptorPoolSize poolSizes[1] = {{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, uint32_t(mSwapChainImages.size())}};
-    mDescriptorPool = kr::DescriptorPool::New(*mGpuInterface, 0, uint32_t(mSwapChainImages.size()), uint32_t(1), poolSizes);
-    for(unsigned i = 0; i < mSwapChainImages.size(); ++i)
-    {
-      auto set = kr::DescriptorSet::Allocate(*mDescriptorPool, *descriptorSetLayout);
-      mDescriptorSets.push_back(set);
-      auto imageInfo = kr::DescriptorImageInfo(VK_NULL_HANDLE, mSwapChainImageViews[i], VK_IMAGE_LAYOUT_GENERAL);
-      auto write = kr::WriteDescriptorSet(*set, 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &imageInfo, nullptr, nullptr);
-      vkUpdateDescriptorSets(*mGpuInterface, 1, &write, 0, nullptr);
-    }
+    ), *mPipelineCache);
 
     return true;
   }
@@ -128,8 +127,7 @@ public:
   {
     mComputePipeline.Reset();
     mPipelineLayout.Reset();;
-    mDescriptorSets.clear();
-    mDescriptorPool.Reset();
+    mPushTemplate.Reset();
 
     return true;
   }
@@ -146,21 +144,12 @@ public:
     static unsigned frameNumber = 0;
     KRUST_LOG_INFO << "   ------------ Compute Example 1: draw frame! frame: " << frameNumber++ << ". currImage: " << mCurrentTargetImage << ". handle: " << mSwapChainImages[mCurrentTargetImage] << "  ------------\n";
 
-    auto submitFence = mSwapChainFences[mCurrentTargetImage];
-    const VkResult fenceWaitResult = vkWaitForFences(*mGpuInterface, 1, submitFence->GetVkFenceAddress(), true, 1000000000); // Wait one second.
-    if(VK_SUCCESS != fenceWaitResult)
+    // Wait up to one second for the frame to complete for the previous time it was submitted:
+    const VkResult waitResult = mDefaultGraphicsQueue->WaitComplete(mLastSubmits[mCurrentTargetImage], 1000000000);
+    if(VK_SUCCESS != waitResult)
     {
-      KRUST_LOG_ERROR << "Wait for queue submit of main commandbuffer did not succeed: " << fenceWaitResult << Krust::endlog;
+      KRUST_LOG_ERROR << "Wait for queue submit of main commandbuffer did not succeed: " << waitResult << Krust::endlog;
     }
-    vkResetFences(*mGpuInterface, 1, submitFence->GetVkFenceAddress());
-
-    constexpr VkPipelineStageFlags pipelineFlags = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    auto submitInfo = kr::SubmitInfo(
-      1, mSwapChainSemaphore->GetVkSemaphoreAddress(),
-      &pipelineFlags,
-      // We have one command buffer per presentable image, so submit the right one:
-      1, mCommandBuffers[mCurrentTargetImage]->GetVkCommandBufferAddress(),
-      0, nullptr);
 
     // Build a command buffer for the current swapchain entry:
 
@@ -187,64 +176,34 @@ public:
       return;
     }
 
-    // Assume the image is returned from being presented and fix it up using
-    // an image memory barrier:
-    auto postPresentImageMemoryBarrier = kr::ImageMemoryBarrier( 0,
-      VK_ACCESS_SHADER_READ_BIT |
-      VK_ACCESS_SHADER_WRITE_BIT |
-      VK_ACCESS_MEMORY_READ_BIT |
-      VK_ACCESS_MEMORY_WRITE_BIT,
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-      VK_IMAGE_LAYOUT_GENERAL,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
-      framebufferImage,
-      { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-    vkCmdPipelineBarrier(
-        *commandBuffer,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        0, // VkDependencyFlags
-        0, nullptr,
-        0, nullptr,
-        1, &postPresentImageMemoryBarrier);
-
-    // Bind the Descriptor set to the current command buffer:
-    vkCmdBindDescriptorSets(
-      *commandBuffer,
-      VK_PIPELINE_BIND_POINT_COMPUTE,
-      *mPipelineLayout,
-      0,
-      1,
-      mDescriptorSets[mCurrentTargetImage]->GetHandleAddress(),
-      0, nullptr // No dynamic offsets.
-      );
+    // The graph places the transitions out of and back into the presentable
+    // layout around the pass. The acquire semaphore is waited on at the
+    // compute stage so the first transition waits on that:
+    mRenderGraph.Reset();
+    const auto framebuffer = mRenderGraph.ImportImage("framebuffer", framebufferImage,
+      { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+      { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR },
+      kr::Usage::Present);
 
-    // Here is where we kick off our compute shader.
+    const auto imageInfo = kr::DescriptorImageInfo(VK_NULL_HANDLE, mSwapChainImageViews[mCurrentTargetImage], VK_IMAGE_LAYOUT_GENERAL);
 
-    vkCmdBindPipeline(*commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, *mComputePipeline);
+    // Here is where we kick off our compute shader.
     const unsigned win_width  { mWindow->GetPlatformWindow().GetWidth()};
     const unsigned win_height { mWindow->GetPlatformWindow().GetHeight()};
-    vkCmdDispatch(*commandBuffer,
-      win_width / WORKGROUP_X + (win_width % WORKGROUP_X ? 1 : 0 ),
-      win_height / WORKGROUP_Y + (win_width % WORKGROUP_Y ? 1 : 0 ),
-      1);
-
-    // Assume the framebuffer will be presented so insert an image memory
-    // barrier here first:
-    auto presentBarrier = kr::ImageMemoryBarrier(
-      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-      VK_ACCESS_MEMORY_READ_BIT,
-      VK_IMAGE_LAYOUT_GENERAL,
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
-      framebufferImage,
-      { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-    vkCmdPipelineBarrier(*commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
-                         nullptr, 0, nullptr, 1, &presentBarrier);
+    const auto pattern = mRenderGraph.AddPass("pattern", [&](VkCommandBuffer commandBuffer)
+    {
+      // Push the framebuffer descriptor into the current command buffer:
+      mPushTemplate->Push(commandBuffer, &imageInfo);
+      vkCmdBindPipeline(commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, *mComputePipeline);
+      vkCmdDispatch(commandBuffer,
+        win_width / WORKGROUP_X + (win_width % WORKGROUP_X ? 1 : 0 ),
+        win_height / WORKGROUP_Y + (win_height % WORKGROUP_Y ? 1 : 0 ),
+        1);
+    });
+    mRenderGraph.Write(pattern, framebuffer, kr::Usage::ComputeWrite);
+
+    mRenderGraph.Compile();
+    mRenderGraph.Execute(*commandBuffer);
 
     const VkResult endCommandBufferResult = vkEndCommandBuffer(*commandBuffer);
     if(endCommandBufferResult != VK_SUCCESS)
@@ -253,14 +212,16 @@ public:
       return;
     }
 
-    // Execute command buffer on main queue:
+    // Execute command buffer on main queue. Only the compute shader touches the
+    // swapchain image, so that is all the acquire semaphore has to hold back:
     KRUST_LOG_DEBUG << "Submitting command buffer " << mCurrentTargetImage << "(" << *(mCommandBuffers[mCurrentTargetImage]) << ")." << Krust::endlog;
-    const VkResult submitResult = vkQueueSubmit(*mDefaultGraphicsQueue, 1, &submitInfo, *submitFence);
-    if(submitResult != VK_SUCCESS)
+    const kr::SubmitResult submitResult = mDefaultGraphicsQueue->Submit(*mSwapChainSemaphore, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, *commandBuffer);
+    if(submitResult.result() != VK_SUCCESS)
     {
-      KRUST_LOG_ERROR << "Failed to submit command buffer. Result: " << submitResult << Krust::endlog;
+      KRUST_LOG_ERROR << "Failed to submit command buffer. Result: " << submitResult.result() << Krust::endlog;
       return;
     }
+    mLastSubmits[mCurrentTargetImage] = submitResult.counter();
 
   }
 
@@ -271,11 +232,14 @@ public:
 
 private:
   // Data:
+  VkPhysicalDeviceSynchronization2FeaturesKHR mDeviceSynchronization2Features = kr::PhysicalDeviceSynchronization2FeaturesKHR();
+  /// Rebuilt each frame, reusing its storage.
+  kr::RenderGraph mRenderGraph;
   kr::PipelineLayoutPtr mPipelineLayout;
-  kr::DescriptorPoolPtr mDescriptorPool;
-  /// One descriptor set per swapchain image.
-  std::vector<kr::DescriptorSetPtr> mDescriptorSets;
+  kr::DescriptorUpdateTemplatePtr mPushTemplate;
   kr::ComputePipelinePtr mComputePipeline;
+  /// The submit which last used each swapchain image's command buffer.
+  std::vector<kr::SubmitCounter> mLastSubmits;
 };
 
 int main()
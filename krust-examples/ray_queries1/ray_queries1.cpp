@@ -23,13 +23,32 @@
 #include "krust-gm/public-api/vec3_inl.h"
 #include "krust-gm/public-api/vec4_inl.h"
 #include "krust/public-api/krust.h"
+#include "krust/public-api/bindless-table.h"
+#include "krust/public-api/compute-kernel.h"
+#include "krust/public-api/descriptor-allocator.h"
+#include "krust/public-api/frame-statistics.h"
+#include "krust/public-api/gpu-profiler.h"
+#include "krust/public-api/host-allocators.h"
+#include "krust/public-api/barriers.h"
+#include "krust/public-api/render-graph.h"
 #include "krust/public-api/queue_janitor.h"
+#include "krust/public-api/layout-cache.h"
 #include "krust/public-api/line-printer.h"
+#include "krust/public-api/pipeline-compiler.h"
 #include "krust/public-api/device-memory-mapper.h"
 #include "krust/public-api/vulkan-utils.h"
+#include "krust/public-api/workgroup-tuner.h"
 #include "krust/public-api/conditional-value.h"
 #include "krust-kernel/public-api/floats.h"
+// Generated at build time from the compiled shaders:
+#include "spirv/rt1.comp.spv.h"
+#include "spirv/rt2.comp.spv.h"
+#include "spirv/rtow_diffuse_grey.comp.spv.h"
+#include "spirv/rtow_ray_query.comp.spv.h"
+#include "spirv/text_print.comp.spv.h"
+#include "spirv/spheres_to_aabbs.comp.spv.h"
 #include <chrono>
+#include <cstddef>
 
 namespace kr = Krust;
 
@@ -39,20 +58,21 @@ namespace
 /** Number of samples per framebuffer pixel. */
 constexpr VkSampleCountFlagBits NUM_SAMPLES = VK_SAMPLE_COUNT_1_BIT;
 constexpr VkAllocationCallbacks* ALLOCATION_CALLBACKS = nullptr;
-constexpr unsigned WORKGROUP_X = 8u;
-constexpr unsigned WORKGROUP_Y = 8u;
 constexpr const char* const RT1_SHADER = "rt1.comp.spv";
 constexpr const char* const RT2_SHADER = "rt2.comp.spv";
 constexpr const char* const GREY_SHADER = "rtow_diffuse_grey.comp.spv";
 constexpr const char* const MATERIALS_SHADER = "rtow_ray_query.comp.spv";
-constexpr const char* const SPHERE_TO_AABB_SHADER_NAME = "spheres_to_aabbs.comp.spv";
+/// Room in the bindless table for the swapchain's images, which don't exist
+/// yet when the pipeline layout is made.
+constexpr uint32_t MAX_SWAPCHAIN_IMAGES = 8u;
 
 struct Pushed
 {
     uint32_t fb_width;
     uint32_t fb_height;
     uint32_t frame_no;
-    float pad0;
+    /// Index of the framebuffer in the bindless table's image array.
+    uint32_t fb_index;
     float ray_origin[3];
     float padding1;
     float ray_target_origin[3];
@@ -64,10 +84,31 @@ struct Pushed
 };
 KRUST_COMPILE_ASSERT(sizeof(Pushed) <= 128u, "Push Constants are larger than the minimum guaranteed space.")
 
+/// The descriptors of the main shader's scene set, laid out for its update template.
+struct SceneDescriptors
+{
+  VkDescriptorBufferInfo spheres;
+  VkAccelerationStructureKHR tlas;
+  VkDescriptorBufferInfo stats;
+};
+
+/// The counters of header.inc.glsl which rtow_ray_query.comp.glsl adds to when
+/// built with KRUST_SHADER_STATS defined.
+enum ShaderStat : uint32_t
+{
+  STAT_RAYS,
+  STAT_TRAVERSAL_STEPS,
+  STAT_SPHERE_TESTS,
+  STAT_SPHERE_HITS,
+  NUM_STATS
+};
+
 /// Values which vary between shaders that this app can run.
 struct ShaderParams {
   Pushed push_defaults;
   float  move_scale;
+  /// The shader built into the executable, or empty to load it from a file.
+  kr::span<const uint32_t> spirv;
 };
 
 void viewVecsFromAngles(
@@ -124,6 +165,28 @@ inline std::vector<AABBf> spheresToAABBs(kr::span<const kr::Vec4InMemory, kr::dy
   return aabbs;
 }
 
+/// Allocate a dedicated block of memory for the buffer and bind it.
+/// @return true on success, else false.
+inline bool bindDedicatedMemory(
+  kr::Buffer& buffer,
+  const VkDeviceSize size,
+  const uint32_t memory_type,
+  VkMemoryAllocateFlags memoryFlags)
+{
+  kr::Device& device = buffer.GetDevice();
+  auto flagsInfo = kr::MemoryAllocateFlagsInfo(memoryFlags, 0u);
+  auto dedicatedInfo = kr::MemoryDedicatedAllocateInfo(VK_NULL_HANDLE, buffer);
+  auto memoryAllocateInfo = kr::MemoryAllocateInfo(size, memory_type);
+  memoryAllocateInfo.pNext = &dedicatedInfo;
+  dedicatedInfo.pNext = &flagsInfo;
+  auto memory = kr::DeviceMemory::New(device, memoryAllocateInfo);
+  if(!memory.Get() || VK_NULL_HANDLE == VkDeviceMemory(*memory)){
+    KRUST_LOG_ERROR << "Failed to allocate memory for a buffer in function \"" << __FUNCTION__ << "\"." << kr::endlog;
+    return false;
+  }
+  return VK_SUCCESS == buffer.BindMemory(*memory, 0);
+}
+
 inline kr::BufferPtr createSingleAllocBuffer(
   kr::Device& device,
   const uint32_t memory_type,
@@ -142,15 +205,47 @@ inline kr::BufferPtr createSingleAllocBuffer(
     buffer.Reset();
     KRUST_LOG_ERROR << "Can't put buffer in requested memory_type (" << memory_type << ')' << kr::endlog;
     kr::ThreadBase::Get().GetErrorPolicy().Error(kr::Errors::IllegalArgument, "Buffer not compatible with memory_type requested.", __FUNCTION__, __FILE__, __LINE__);
-  } else {
-    auto flagsInfo = kr::MemoryAllocateFlagsInfo(memoryFlags, 0u);
-    auto dedicatedInfo = kr::MemoryDedicatedAllocateInfo(VK_NULL_HANDLE, *buffer);
-    auto memoryAllocateInfo = kr::MemoryAllocateInfo(memReq.size, memory_type);
-    memoryAllocateInfo.pNext = &dedicatedInfo;
-    dedicatedInfo.pNext = &flagsInfo;
-    auto memory = kr::DeviceMemory::New(device, memoryAllocateInfo);
-    buffer->BindMemory(*memory, 0);
+  } else if(!bindDedicatedMemory(*buffer, memReq.size, memory_type, memoryFlags)){
+    buffer.Reset();
+  }
+  return buffer;
+}
+
+/**
+ * Try to create a buffer directly in device-local memory that the host can
+ * write to (e.g. the whole of VRAM when resizable BAR is enabled) and copy the
+ * host data straight into it through a persistent mapping, with no staging
+ * buffer and no transfer on a queue.
+ * @return The buffer, or a null pointer if there is no suitable memory type
+ * with a heap large enough for the buffer, in which case the caller should
+ * fall back to staging.
+ */
+inline kr::BufferPtr uploadDirectToDeviceBuffer(
+  kr::Device& device,
+  const VkPhysicalDeviceMemoryProperties& memoryProperties,
+  const VkDeviceSize size,
+  const void* hostData,
+  VkBufferUsageFlags bufferUsages,
+  const VkMemoryAllocateFlags memoryFlags,
+  const uint32_t queueFamilyIndex)
+{
+  auto buffer = kr::Buffer::New(device, 0, size, bufferUsages, VkSharingMode::VK_SHARING_MODE_EXCLUSIVE, queueFamilyIndex);
+  VkMemoryRequirements memReq;
+  vkGetBufferMemoryRequirements(device, *buffer, &memReq);
+  const auto memory_type = kr::FindDirectUploadMemoryType(memoryProperties, memReq.memoryTypeBits, memReq.size);
+  if(!memory_type){
+    return nullptr;
+  }
+  if(!bindDedicatedMemory(*buffer, memReq.size, memory_type, memoryFlags)){
+    return nullptr;
   }
+  kr::DeviceMemory& memory = buffer->GetMemory();
+  if(!memory.GetPersistentMapping()){
+    return nullptr;
+  }
+  // The mapper reuses the persistent mapping and flushes if memory is not coherent:
+  kr::DeviceMemoryMapper mapper(memory, 0, VK_WHOLE_SIZE);
+  memcpy(mapper.GetHostAccess(), hostData, size);
   return buffer;
 }
 
@@ -233,7 +328,7 @@ inline bool CopyBuffer(
 {
   KRUST_ASSERT1(&sourceBuffer.GetDevice() == &destBuffer.GetDevice(), "Buffers must belong to same device when copying.");
 
-  auto commandBuffer = kr::CommandBuffer::New(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  auto commandBuffer = kr::CommandBuffer::New(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, kr::RefCountPolicy::ThreadConfined);
   auto beginInfo = kr::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr);
   VkResult result = VK_SUCCESS;
   if(VK_SUCCESS == (result = vkBeginCommandBuffer(*commandBuffer, &beginInfo)))
@@ -346,10 +441,14 @@ inline kr::BufferPtr downloadToStagingBuffer(
   return stagingBuffer;
 }
 
+/// Write the data directly into device-local memory if the host can see a
+/// big enough heap of it, otherwise stage it and copy on the GPU.
 /// @return A buffer with a dedicated memory allocation backing it, or a null
 /// pointer if a step in the process failed.
 inline kr::BufferPtr uploadToDeviceBuffer(
   kr::Device& device,
+  /// Used to look for device-local memory the host can write to directly.
+  const VkPhysicalDeviceMemoryProperties& memoryProperties,
   /// Queue to schedule the copy on.
   VkQueue queue,
   /// Pool to get a command buffer to run the copy from.
@@ -363,6 +462,12 @@ inline kr::BufferPtr uploadToDeviceBuffer(
   const VkMemoryAllocateFlags device_memory_flags,
   uint32_t queueFamilyIndex)
 {
+  auto directBuffer = uploadDirectToDeviceBuffer(device, memoryProperties, size, hostData, bufferUsages, device_memory_flags, queueFamilyIndex);
+  if(directBuffer.Get())
+  {
+    return directBuffer;
+  }
+  KRUST_LOG_DEBUG << "Falling back to staging for upload of " << size << " bytes." << kr::endlog;
   auto stagingBuffer = uploadToStagingBuffer(device, size, hostData, staging_memory_type, queueFamilyIndex);
   if(!stagingBuffer.Get())
   {
@@ -375,6 +480,8 @@ inline kr::BufferPtr uploadToDeviceBuffer(
 template<typename T>
 inline kr::BufferPtr uploadToDeviceBuffer(
   kr::Device& device,
+  /// Used to look for device-local memory the host can write to directly.
+  const VkPhysicalDeviceMemoryProperties& memoryProperties,
   /// Queue to schedule the copy on.
   VkQueue queue,
   /// Pool to get a command buffer to run the copy from.
@@ -387,7 +494,7 @@ inline kr::BufferPtr uploadToDeviceBuffer(
   const VkMemoryAllocateFlags device_memory_flags,
   const uint32_t queueFamilyIndex)
 {
-  return uploadToDeviceBuffer(device, queue, commandPool, hostData.size_bytes(), bufferUsages, hostData.data(), staging_memory_type, device_memory_type, device_memory_flags, queueFamilyIndex);
+  return uploadToDeviceBuffer(device, memoryProperties, queue, commandPool, hostData.size_bytes(), bufferUsages, hostData.data(), staging_memory_type, device_memory_type, device_memory_flags, queueFamilyIndex);
 }
 
 /// Slow, basic utility for getting data from device to host.
@@ -441,17 +548,15 @@ inline bool downloadFromDeviceBuffer(
 /// @return A buffer with a dedicated memory allocation backing it and the
 /// min/max extents of a set of bounding boxes in i, or a null pointer if a step
 /// in the process failed.
-/// @note This function has horrendous overheads for running a simple kernel on
-/// the GPU. It would be faster to run the algorithm on the CPU ad uploasd the
-/// result. Doing things this way does, however, allow evolving towards the most
-/// optimal variant that would upload using mostly resources that were created
-/// once at startup and reused.
-/// @todo FixMe: hoist all this one-time stuff like pipeline creation out of the function so it can be reused to turn many sets of spheres into AABBoxes.
+/// @note The pipeline and layouts live in the kernel so the cost of a call is
+/// the buffer, one command buffer and the wait for the queue to idle.
 inline kr::BufferPtr spheresToAABBs(
   /// Queue to schedule the upload and compute shader on.
   VkQueue queue,
   /// Pool to get a command buffer to run on.
   kr::CommandPool& commandPool,
+  /// The sphere-to-AABB shader.
+  kr::ComputeKernel& kernel,
   /// Number of spheres in sphereBuffer we care about (byte size is 16 times this).
   const VkDeviceSize numSpheres,
   /// A packed list of x,y,z,radius vec4s representing spheres.
@@ -475,71 +580,6 @@ inline kr::BufferPtr spheresToAABBs(
   if(!aabbBuffer.Get()){
     KRUST_LOG_ERROR << "Failed to create a new buffer to generate AABBs into in function \"" << __FUNCTION__ << "\"." << kr::endlog;
   } else {
-    // Build all resources required to run the compute shader:
-
-    // Load the spir-v shader code into a module:
-    kr::ShaderBuffer spirv { kr::loadSpirV(SPHERE_TO_AABB_SHADER_NAME) };
-    if(spirv.empty()){
-      return nullptr;
-    }
-
-    auto shaderModule = kr::ShaderModule::New(device, 0, spirv);
-
-    const auto ssci = kr::PipelineShaderStageCreateInfo(
-      0,
-      VK_SHADER_STAGE_COMPUTE_BIT,
-      *shaderModule,
-      "main",
-      nullptr // VkSpecializationInfo
-    );
-
-    // Define the descriptor and pipeline layouts:
-
-    const VkDescriptorSetLayoutBinding bindings[] {
-      kr::DescriptorSetLayoutBinding(
-        0, // Binding to the first location
-        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        1,
-        VK_SHADER_STAGE_COMPUTE_BIT,
-        nullptr // No immutable samplers.
-      ),
-
-      kr::DescriptorSetLayoutBinding(
-        1, // Binding to the second location
-        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        1,
-        VK_SHADER_STAGE_COMPUTE_BIT,
-        nullptr // No immutable samplers.
-      )
-    };
-
-    auto descriptorSetLayout = kr::DescriptorSetLayout::New(device, 0, 2, bindings);
-    auto pipelineLayout = kr::PipelineLayout::New(device,
-      0,
-      *descriptorSetLayout
-    );
-
-    // Construct our compute pipeline:
-    auto computePipeline = kr::ComputePipeline::New(device, kr::ComputePipelineCreateInfo(
-      0,    // no flags
-      ssci,
-      *pipelineLayout,
-      VK_NULL_HANDLE, // No base pipeline
-      -1              // No index of a base pipeline.
-    ));
-
-    auto descriptorPool = kr::DescriptorPool::New(device, 0, 2, {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2});
-    auto set = kr::DescriptorSet::Allocate(*descriptorPool, *descriptorSetLayout);
-    VkDescriptorBufferInfo bufferInfos[] = {
-      kr::DescriptorBufferInfo(sphereBuffer, 0, VK_WHOLE_SIZE),
-      kr::DescriptorBufferInfo(*aabbBuffer, 0, VK_WHOLE_SIZE),
-    };
-    VkWriteDescriptorSet writes[] = {
-      kr::WriteDescriptorSet(*set, 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &bufferInfos[0], nullptr),
-      kr::WriteDescriptorSet(*set, 1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &bufferInfos[1], nullptr)
-    };
-    vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
-
     auto commandBuffer = kr::CommandBuffer::New(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
     auto commandBufferInheritanceInfo = kr::CommandBufferInheritanceInfo(nullptr, 0,
       nullptr, VK_FALSE, 0, 0);
@@ -554,34 +594,21 @@ inline kr::BufferPtr spheresToAABBs(
 
     // Barrier at start to make sure the spheres are ready to be accessed:
     /// @note Design-wise this is commiting special knowledge of what has previously happened to the buffer to fixed code. we shouldn't have to know that a barrier is needed inside this function.
-    /*auto barrier = kr::BufferMemoryBarrier2KHR(
-      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
-      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
-      queueFamilyIndex, queueFamilyIndex, sphereBuffer, 0, VK_WHOLE_SIZE);*/
-    auto barrier = kr::BufferMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, queueFamilyIndex, queueFamilyIndex, sphereBuffer, 0, VK_WHOLE_SIZE);
-    vkCmdPipelineBarrier(
-        *commandBuffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        0, // VkDependencyFlags
-        0, nullptr,
-        1, &barrier,
-        0, nullptr);
-
-    /// bind descriptors
-    vkCmdBindDescriptorSets(
-      *commandBuffer,
-      VK_PIPELINE_BIND_POINT_COMPUTE,
-      *pipelineLayout,
-      0,
-      1,
-      set->GetHandleAddress(),
-      0, nullptr // No dynamic offsets.
-      );
+    kr::BarrierBatch().Buffer(sphereBuffer,
+      VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR
+    ).Record(*commandBuffer);
 
     /// Run shader kernel
-    vkCmdBindPipeline(*commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, *computePipeline);
-    vkCmdDispatch(*commandBuffer, numSpheres, 1, 1);
+    const kr::KernelResource resources[] {
+      kr::KernelResource::Buffer(sphereBuffer),
+      kr::KernelResource::Buffer(*aabbBuffer),
+    };
+    if(!kernel.Dispatch(*commandBuffer, resources, uint32_t(numSpheres)))
+    {
+      KRUST_LOG_ERROR << "Failed to record the sphere to AABB kernel in " << __FUNCTION__ << "." << Krust::endlog;
+      return nullptr;
+    }
 
     if(VK_SUCCESS != (result = vkEndCommandBuffer(*commandBuffer)))
     {
@@ -620,7 +647,7 @@ inline kr::AccelerationStructurePtr buildSingleGeomAABBBLAS(
   kr::CommandPool& commandPool,
   VkDeviceSize numAabbs,
   /// A buffer of AABBs that is already in device memory and has VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR set.
-  kr::BufferPtr aabbs,
+  kr::Buffer& aabbs,
   const uint32_t staging_memory_type,
   uint32_t device_memory_type,
   uint32_t queueFamilyIndex)
@@ -628,7 +655,7 @@ inline kr::AccelerationStructurePtr buildSingleGeomAABBBLAS(
   kr::Device& device = commandPool.GetDevice();
 
   // Get device address of aabb buffer memory:
-  VkDeviceOrHostAddressConstKHR aabbsAddress = getBufferAddress(device, *aabbs);
+  VkDeviceOrHostAddressConstKHR aabbsAddress = getBufferAddress(device, aabbs);
 
   VkAccelerationStructureGeometryDataKHR geodata;
   geodata.aabbs = kr::AccelerationStructureGeometryAabbsDataKHR(
@@ -757,7 +784,7 @@ inline kr::AccelerationStructurePtr buildTLAS(
   kr::CommandPool& commandPool,
   VkDeviceSize numInstances,
   /// A buffer of AABBs that is already in device memory and has VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR set.
-  kr::BufferPtr instances,
+  kr::Buffer& instances,
   const uint32_t staging_memory_type,
   uint32_t device_memory_type,
   uint32_t queueFamilyIndex)
@@ -766,7 +793,7 @@ inline kr::AccelerationStructurePtr buildTLAS(
 
   // Work out the storage and scratch space required:
 
-  const VkDeviceOrHostAddressConstKHR instancesAddress = getBufferAddress(device, *instances);
+  const VkDeviceOrHostAddressConstKHR instancesAddress = getBufferAddress(device, instances);
 
   VkAccelerationStructureGeometryDataKHR geodata;
   geodata.instances = kr::AccelerationStructureGeometryInstancesDataKHR(
@@ -971,6 +998,7 @@ class RayQueries1Application : public Krust::IO::Application
     extensionNames.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
     extensionNames.push_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME); ///< @todo Do I need this for queries or just for pipeline?
     extensionNames.push_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+    extensionNames.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
   }
 
   void DoExtendDeviceFeatureChain(VkPhysicalDeviceFeatures2 &features) override
@@ -978,7 +1006,8 @@ class RayQueries1Application : public Krust::IO::Application
     mDeviceFeature11.pNext = &mDeviceFeature12;
     mDeviceFeature12.pNext = &mDeviceRayQueryFeatures;
     mDeviceRayQueryFeatures.pNext = &mDeviceAccelerationStructureFeatures;
-    mDeviceAccelerationStructureFeatures.pNext = features.pNext;
+    mDeviceAccelerationStructureFeatures.pNext = &mDeviceSynchronization2Features;
+    mDeviceSynchronization2Features.pNext = features.pNext;
     features.pNext = &mDeviceFeature11;
   }
 
@@ -997,6 +1026,15 @@ class RayQueries1Application : public Krust::IO::Application
     REQUIRE_VK_FEATURE(mDeviceFeature12.shaderInt8, "Eight bit integers in shader code required.");
     REQUIRE_VK_FEATURE(mDeviceRayQueryFeatures.rayQuery, "This is a ray query demo so we gotta have the ray query extension.");
     REQUIRE_VK_FEATURE(mDeviceAccelerationStructureFeatures.accelerationStructure, "Ray tracing acceleration structures required.");
+    REQUIRE_VK_FEATURE(mDeviceSynchronization2Features.synchronization2, "Synchronization2 barriers and submits are used throughout.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.runtimeDescriptorArray, "The bindless table's arrays are unsized in shaders.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.descriptorBindingPartiallyBound, "The bindless table's arrays are partially bound.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.descriptorBindingStorageImageUpdateAfterBind, "The bindless table's images are updated after bind.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.descriptorBindingStorageBufferUpdateAfterBind, "The bindless table's buffers are updated after bind.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.descriptorBindingUpdateUnusedWhilePending, "The bindless table's slots are updated while other slots are in use.");
+    REQUIRE_VK_FEATURE(f2.features.shaderStorageImageArrayDynamicIndexing, "Shaders index the bindless table's image array.");
+    // Left on where supported: f2.features.pipelineStatisticsQuery counts the
+    // compute shader invocations of each frame for the statistics overlay.
     // Need them?
     //VkBool32           accelerationStructureCaptureReplay;
     //VkBool32           accelerationStructureIndirectBuild;
@@ -1041,6 +1079,90 @@ class RayQueries1Application : public Krust::IO::Application
 
 
 public:
+  /**
+   * Called as soon as the device exists to start the main shader compiling
+   * while the swapchain is set up.
+   */
+  bool DoEnqueuePipelines() override
+  {
+    // Define the descriptor and pipeline layouts for the main rendering compute shader:
+
+    // The swapchain images are registered in a bindless table bound at set 0
+    // and the shader picks the one to write with an index pushed each frame:
+    mBindlessTable = kr::BindlessTable::New(*mGpuInterface, 1u, MAX_SWAPCHAIN_IMAGES);
+
+    // The scene is in set 1:
+    const VkDescriptorSetLayoutBinding bindings[] {
+      // The sphere positions and radii in a uniform buffer:
+      // It would make more sense to have this in a storage buffer as uniforms and uniform cache are a limited resource.
+      kr::DescriptorSetLayoutBinding(
+        0, // Binding to the first location
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        1,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        nullptr // No immutable samplers.
+      ),
+
+      // The TLAS built over the spheres in the scene:
+      kr::DescriptorSetLayoutBinding(
+        1, // Binding to the second location
+        VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+        1,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        nullptr // No immutable samplers.
+      ),
+
+      // The counters of work done, offset to the current frame's when bound.
+      // Only touched by shaders built with KRUST_SHADER_STATS:
+      kr::DescriptorSetLayoutBinding(
+        2,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+        1,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        nullptr // No immutable samplers.
+      )
+
+    };
+
+    /// @todo Make a kr::DescriptorSetLayout::New / vkCreateDescriptorSetLayout wrapper that takes a span so the count can't be wrong.
+    mDescriptorSetLayout = kr::DescriptorSetLayout::New(*mGpuInterface, 0, 3, bindings);
+
+    const VkDescriptorSetLayout setLayouts[] { mBindlessTable->GetLayout(), *mDescriptorSetLayout };
+    const auto pushConstantRange = kr::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Pushed));
+    mPipelineLayout = kr::PipelineLayout::New(*mGpuInterface, 0, 2, setLayouts, 1, &pushConstantRange);
+
+    // Shaders named on the command line which aren't built in are loaded from files:
+    const kr::span<const uint32_t> spirv = mShaderParamsOptions[mShaderName].spirv;
+    if(spirv.empty())
+    {
+      // These can't be assumed to take their workgroup size as specialization
+      // constants, so are run with the 8x8 the built-in ones default to:
+      mWorkgroupSizes = { kr::WorkgroupSize{} };
+      mComputePipelines.push_back(mPipelineCompiler->CompileCompute(mShaderName, *mPipelineLayout));
+      return true;
+    }
+
+    // Use the workgroup size found fastest on this GPU by an earlier run, or
+    // compile every candidate the GPU can run so the first frames can find it:
+    kr::WorkgroupSize tunedSize;
+    if(kr::LoadWorkgroupSize(mGpuDeviceUUID, mPipelineCacheDirectory, mShaderName, tunedSize) &&
+       kr::WorkgroupSizeFits(tunedSize, mGpuProperties.limits))
+    {
+      mWorkgroupSizes = { tunedSize };
+      mWorkgroupSizeSaved = true;
+    }
+    else
+    {
+      mWorkgroupSizes = kr::WorkgroupSizeCandidates(mGpuProperties.limits);
+    }
+    for(const kr::WorkgroupSize size : mWorkgroupSizes)
+    {
+      mComputePipelines.push_back(mPipelineCompiler->CompileCompute(spirv, *mPipelineLayout, kr::WorkgroupSpecialization{size}.Get()));
+    }
+
+    return true;
+  }
+
   /**
    * Called by the default initialization once Krust is initialised and a window
    * has been created. Now is the time to do any additional setup.
@@ -1074,29 +1196,12 @@ public:
       return false;
     }
 
-    BuildFences(*mGpuInterface, VK_FENCE_CREATE_SIGNALED_BIT, mSwapChainImageViews.size(), mSwapChainFences);
+    mLastSubmits.resize(mSwapChainImages.size());
 
     // Allocate a command buffer per swapchain entry:
     KRUST_ASSERT1(mCommandBuffers.size() == 0, "Double init of command buffers.");
     kr::CommandBuffer::Allocate(*mCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, unsigned(mSwapChainImageViews.size()), mCommandBuffers);
 
-    // Build all resources required to run the compute shader:
-
-    // Load the spir-v shader code into a module:
-    kr::ShaderBuffer spirv { kr::loadSpirV(mShaderName) };
-    if(spirv.empty()){
-      return false;
-    }
-    auto shaderModule = kr::ShaderModule::New(*mGpuInterface, 0, spirv);
-
-    const auto ssci = kr::PipelineShaderStageCreateInfo(
-      0,
-      VK_SHADER_STAGE_COMPUTE_BIT,
-      *shaderModule,
-      "main",
-      nullptr // VkSpecializationInfo
-    );
-
     // Examine heaps and decide on staging and on-device storage types and heaps:
     const auto staging_mem_type = kr::FindFirstMemoryTypeWithProperties(mGpuMemoryProperties, 0xffffffff, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
     if(!staging_mem_type){
@@ -1109,6 +1214,11 @@ public:
       return false;
     }
 
+    // Transient descriptor sets are allocated each frame, from pools recycled
+    // once the wait for the swapchain image's last submit shows the GPU is
+    // done with them:
+    mDescriptorAllocator = kr::DescriptorAllocator::New(*mGpuInterface, uint32_t(mSwapChainImages.size()));
+
     // Upload the spheres to GPU memory and build the acceleration structures for
     // the scene:
 
@@ -1116,6 +1226,7 @@ public:
     auto aabbs = spheresToAABBs(spheresSpan);
     auto sphereBuffer = uploadToDeviceBuffer<kr::Vec4InMemory>(
       *mGpuInterface,
+      mGpuMemoryProperties,
       *mDefaultQueue,
       *mCommandPool,
       spheresSpan,
@@ -1152,9 +1263,11 @@ public:
     }
     KRUST_END_DEBUG_BLOCK
 
+    auto aabbKernel = kr::ComputeKernel::New(*mGpuInterface, *mLayoutCache, kr::Spirv::spheres_to_aabbs_comp, *mPipelineCache);
     kr::BufferPtr aabbBuffer = spheresToAABBs(
       *mDefaultQueue,
       *mCommandPool,
+      *aabbKernel,
       spheresSpan.size(),
       *sphereBuffer,
       VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
@@ -1214,6 +1327,7 @@ public:
     auto instanceSpan = kr::span<const VkAccelerationStructureInstanceKHR, kr::dynamic_extent>(&instance, 1);
     auto instanceBuffer = uploadToDeviceBuffer<VkAccelerationStructureInstanceKHR>(
       *mGpuInterface,
+      mGpuMemoryProperties,
       *mDefaultQueue,
       *mCommandPool,
       instanceSpan,
@@ -1261,79 +1375,65 @@ public:
     mBlas = blas;
     mTlas = tlas;
 
-    // Define the descriptor and pipeline layouts for the main rendering compute shader:
-
-    const VkDescriptorSetLayoutBinding bindings[] {
-      // Framebuffer colour buffer as a R/W storage buffer:
-      kr::DescriptorSetLayoutBinding(
-        0, // Binding to the first location
-        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-        1,
-        VK_SHADER_STAGE_COMPUTE_BIT,
-        nullptr // No immutable samplers.
-      ),
-
-      // The sphere positions and radii in a uniform buffer:
-      // It would make more sense to have this in a storage buffer as uniforms and uniform cache are a limited resource.
-      kr::DescriptorSetLayoutBinding(
-        1, // Binding to the second location
-        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        1,
-        VK_SHADER_STAGE_COMPUTE_BIT,
-        nullptr // No immutable samplers.
-      ),
-
-      // The TLAS built over the spheres in the scene:
-      kr::DescriptorSetLayoutBinding(
-        2, // Binding to the third location
-        VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
-        1,
-        VK_SHADER_STAGE_COMPUTE_BIT,
-        nullptr // No immutable samplers.
-      )
+    // Register the swapchain images with the table the main shader's pipeline
+    // layout was built around:
+    for(const VkImageView view : mSwapChainImageViews)
+    {
+      const uint32_t index = mBindlessTable->AddImage(view);
+      if(index == kr::BindlessTable::INVALID_INDEX)
+      {
+        KRUST_LOG_ERROR << "The swapchain has " << mSwapChainImageViews.size() << " images but the bindless table only has room for " << MAX_SWAPCHAIN_IMAGES << "." << kr::endlog;
+        return false;
+      }
+      mFramebufferIndices.push_back(index);
+    }
 
+    // Count the work of each frame to normalize its time by:
+    mFrameStatistics = kr::FrameStatistics::New(*mGpuInterface,
+      mGpuMemoryProperties,
+      mGpuProperties.limits.minStorageBufferOffsetAlignment,
+      uint32_t(mSwapChainImages.size()),
+      NUM_STATS,
+      mGpuFeatures.features.pipelineStatisticsQuery);
+
+    // The scene doesn't change so its set 1 is written once:
+    const auto& scenePoolSizes = mDescriptorSetLayout->GetPoolSizes();
+    mScenePool = kr::DescriptorPool::New(*mGpuInterface, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, 1, uint32_t(scenePoolSizes.size()), scenePoolSizes.data());
+    mSceneSet = kr::DescriptorSet::Allocate(*mScenePool, *mDescriptorSetLayout);
+    const VkDescriptorUpdateTemplateEntry entries[] {
+      kr::DescriptorUpdateTemplateEntry(0, 0, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(SceneDescriptors, spheres), 0),
+      kr::DescriptorUpdateTemplateEntry(1, 0, 1, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, offsetof(SceneDescriptors, tlas), 0),
+      kr::DescriptorUpdateTemplateEntry(2, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, offsetof(SceneDescriptors, stats), 0)
+    };
+    auto updateTemplate = kr::DescriptorUpdateTemplate::New(*mGpuInterface, *mDescriptorSetLayout, 3, entries);
+    const SceneDescriptors descriptors {
+      kr::DescriptorBufferInfo(*mSphereBuffer, 0, VK_WHOLE_SIZE),
+      *mTlas,
+      kr::DescriptorBufferInfo(mFrameStatistics->GetBuffer(), 0, mFrameStatistics->GetRange())
     };
+    updateTemplate->Update(*mSceneSet, &descriptors);
 
-    /// @todo Make a kr::DescriptorSetLayout::New / vkCreateDescriptorSetLayout wrapper that takes a span so the count can't be wrong.
-    auto descriptorSetLayout = kr::DescriptorSetLayout::New(*mGpuInterface, 0, 3, bindings);
-    mPipelineLayout = kr::PipelineLayout::New(*mGpuInterface,
-      0,
-      *descriptorSetLayout,
-      kr::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Pushed))
-      );
-
-    // Construct our compute pipeline:
-    mComputePipeline = kr::ComputePipeline::New(*mGpuInterface, kr::ComputePipelineCreateInfo(
-      0,    // no flags
-      ssci,
-      *mPipelineLayout,
-      VK_NULL_HANDLE, // no base pipeline
-      -1 // No index of a base pipeline.
-    ));
-
-    // Create a descriptor pool and allocate a matching descriptorSet for each image:
-    VkDescriptorPoolSize poolSizes[1] = {{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, uint32_t(mSwapChainImages.size())}};
-    mDescriptorPool = kr::DescriptorPool::New(*mGpuInterface, 0, uint32_t(mSwapChainImages.size()), uint32_t(1), poolSizes);
-    for(unsigned i = 0; i < mSwapChainImages.size(); ++i)
+    mLinePrinter = std::make_unique<kr::LinePrinter>(*mGpuInterface, *mDescriptorAllocator, *mLayoutCache, *mPipelineCompiler, kr::Spirv::text_print_comp);
+
+    // Time the candidate workgroup sizes on the first frames if there are any.
+    // Without timestamps on the queue the default 8x8 is all we can run:
+    const uint32_t timestampValidBits = mPhysicalQueueFamilyProperties[mDefaultDrawingQueueFamily].timestampValidBits;
+    if(mWorkgroupSizes.size() > 1 && timestampValidBits > 0)
     {
-      auto set = kr::DescriptorSet::Allocate(*mDescriptorPool, *descriptorSetLayout);
-      mDescriptorSets.push_back(set);
-      auto imageInfo  = kr::DescriptorImageInfo(VK_NULL_HANDLE, mSwapChainImageViews[i], VK_IMAGE_LAYOUT_GENERAL);
-      auto bufferInfo = kr::DescriptorBufferInfo(*sphereBuffer, 0, spheresSpan.size_bytes());
-      VkAccelerationStructureKHR raw_tlas = *tlas;
-      auto tlasWrite = kr::WriteDescriptorSetAccelerationStructureKHR(1, &raw_tlas);
-      auto tlasWrite2 = kr::WriteDescriptorSet(*set, 2, 0, 1, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, nullptr, nullptr, nullptr);
-      tlasWrite2.pNext = &tlasWrite;
-      VkWriteDescriptorSet write[] = {
-        kr::WriteDescriptorSet(*set, 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &imageInfo, nullptr, nullptr),
-        kr::WriteDescriptorSet(*set, 1, 0, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, nullptr, &bufferInfo, nullptr),
-        tlasWrite2
-      };
-      /// @todo Make a vkUpdateDescriptorSets wrapper that takes a span so the count can't be wrong.
-      vkUpdateDescriptorSets(*mGpuInterface, 3, write, 0, nullptr);
+      mWorkgroupTuner = kr::WorkgroupTuner::New(*mGpuInterface,
+        uint32_t(mWorkgroupSizes.size()),
+        uint32_t(mSwapChainImages.size()),
+        mGpuProperties.limits.timestampPeriod,
+        timestampValidBits);
+    }
+    // Time the passes of each frame on the GPU for the overlay:
+    if(timestampValidBits > 0)
+    {
+      mGpuProfiler = kr::GpuProfiler::New(*mGpuInterface,
+        uint32_t(mSwapChainImages.size()),
+        mGpuProperties.limits.timestampPeriod,
+        timestampValidBits);
     }
-
-    mLinePrinter = std::make_unique<kr::LinePrinter>(*mGpuInterface, kr::span {mSwapChainImageViews});
 
     return true;
   }
@@ -1343,11 +1443,17 @@ public:
     mSphereBuffer.Reset();
     mBlas.Reset();
     mTlas.Reset();
-    mComputePipeline.Reset();
+    mComputePipelines.clear();
+    mWorkgroupTuner.Reset();
+    mGpuProfiler.Reset();
+    mFrameStatistics.Reset();
     mPipelineLayout.Reset();;
-    mDescriptorSets.clear();
-    mDescriptorPool.Reset();
     mLinePrinter.reset();
+    mDescriptorAllocator.Reset();
+    mSceneSet.Reset();
+    mScenePool.Reset();
+    mDescriptorSetLayout.Reset();
+    mBindlessTable.Reset();
 
     return true;
   }
@@ -1394,6 +1500,14 @@ public:
         mKeyDown = !up;
         break;
       }
+      case 33:{
+        // P toggles the GPU timings overlay:
+        if(up)
+        {
+          mShowGpuTimings = !mShowGpuTimings;
+        }
+        break;
+      }
       default:
         KRUST_LOG_WARN << "Unknown key with scancode " << unsigned(keycode) << (up ? " up" : " down") << kr::endlog;
     }
@@ -1438,21 +1552,23 @@ public:
     ++frameNumber;
     // KRUST_LOG_INFO << "   ------------ Ray Tracing Example 1: draw frame! frame: " << frameNumber << ". currImage: " << mCurrentTargetImage << ". handle: " << mSwapChainImages[mCurrentTargetImage] << "  ------------\n";
 
-    auto submitFence = mSwapChainFences[mCurrentTargetImage];
-    const VkResult fenceWaitResult = vkWaitForFences(*mGpuInterface, 1, submitFence->GetVkFenceAddress(), true, 1000000000); // Wait one second.
-    if(VK_SUCCESS != fenceWaitResult)
+    // Wait up to one second for the frame to complete for the previous time it was submitted:
+    const VkResult waitResult = mDefaultGraphicsQueue->WaitComplete(mLastSubmits[mCurrentTargetImage], 1000000000);
+    if(VK_SUCCESS != waitResult)
     {
-      KRUST_LOG_ERROR << "Wait for queue submit of main commandbuffer did not succeed: " << fenceWaitResult << Krust::endlog;
+      KRUST_LOG_ERROR << "Wait for queue submit of main commandbuffer did not succeed: " << waitResult << Krust::endlog;
+    }
+    mDescriptorAllocator->BeginFrame(mCurrentTargetImage);
+    // Once the size is picked the tuner is left alone. It is only released at
+    // shutdown as frames still in flight may be writing its timestamps:
+    if(mWorkgroupTuner.Get() && !mWorkgroupSizeSaved)
+    {
+      mWorkgroupTuner->Collect(mCurrentTargetImage);
+      if(!mWorkgroupTuner->IsTuning())
+      {
+        SaveTunedWorkgroupSize();
+      }
     }
-    vkResetFences(*mGpuInterface, 1, submitFence->GetVkFenceAddress());
-
-    constexpr VkPipelineStageFlags pipelineFlags = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    auto submitInfo = kr::SubmitInfo(
-      1, mSwapChainSemaphore->GetVkSemaphoreAddress(),
-      &pipelineFlags,
-      // We have one command buffer per presentable image, so submit the right one:
-      1, mCommandBuffers[mCurrentTargetImage]->GetVkCommandBufferAddress(),
-      0, nullptr);
 
     // Build a command buffer for the current swapchain entry:
 
@@ -1479,49 +1595,23 @@ public:
       return;
     }
 
-    // Assume the image is returned from being presented and fix it up using
-    // an image memory barrier:
-    auto postPresentImageMemoryBarrier = kr::ImageMemoryBarrier( 0,
-      VK_ACCESS_SHADER_READ_BIT |
-      VK_ACCESS_SHADER_WRITE_BIT |
-      VK_ACCESS_MEMORY_READ_BIT |
-      VK_ACCESS_MEMORY_WRITE_BIT,
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-      VK_IMAGE_LAYOUT_GENERAL,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
-      framebufferImage,
-      { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-    vkCmdPipelineBarrier(
-        *commandBuffer,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        0, // VkDependencyFlags
-        0, nullptr,
-        0, nullptr,
-        1, &postPresentImageMemoryBarrier);
-
-    // Bind the Descriptor set to the current command buffer:
-    vkCmdBindDescriptorSets(
-      *commandBuffer,
-      VK_PIPELINE_BIND_POINT_COMPUTE,
-      *mPipelineLayout,
-      0,
-      1,
-      mDescriptorSets[mCurrentTargetImage]->GetHandleAddress(),
-      0, nullptr // No dynamic offsets.
-      );
+    // Describe the frame as passes over the swapchain image and let the graph
+    // place the barriers between them, including the transitions out of and
+    // back into the presentable layout. The acquire semaphore is waited on at
+    // the compute stage so the first transition waits on that:
+    mRenderGraph.Reset();
+    const auto framebuffer = mRenderGraph.ImportImage("framebuffer", framebufferImage,
+      { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+      { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR },
+      kr::Usage::Present);
 
-    // Here is where we kick off our compute shader.
-
-    vkCmdBindPipeline(*commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, *mComputePipeline);
     const unsigned win_width  { mWindow->GetPlatformWindow().GetWidth()};
     const unsigned win_height { mWindow->GetPlatformWindow().GetHeight()};
 
     mPushed.fb_width  = win_width;
     mPushed.fb_height = win_height;
     mPushed.frame_no = frameNumber;
+    mPushed.fb_index = mFramebufferIndices[mCurrentTargetImage];
     const float MOVE_SCALE = mMoveScale;
 
     if(mKeyLeft) {
@@ -1560,46 +1650,81 @@ public:
     kr::store(right,             mPushed.ray_target_right);
     kr::store(up,                mPushed.ray_target_up);
 
-
-    vkCmdPushConstants(*commandBuffer, *mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Pushed), &mPushed);
-
-    vkCmdDispatch(*commandBuffer,
-      win_width / WORKGROUP_X + (win_width % WORKGROUP_X ? 1 : 0 ),
-      win_height / WORKGROUP_Y + (win_width % WORKGROUP_Y ? 1 : 0 ),
-      1);
-
-    /// @todo Memory barrier here waiting for writes to the framebuffer from the main kernel to complete.
-
-    mLinePrinter->SetFramebuffer(mSwapChainImageViews[mCurrentTargetImage], mCurrentTargetImage);
-    mLinePrinter->BindCommandBuffer(*commandBuffer, mCurrentTargetImage);
+    // Here is where we kick off our compute shader.
+    const auto scenePass = mRenderGraph.AddPass("scene", [&](VkCommandBuffer commandBuffer)
+    {
+      mBindlessTable->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, *mPipelineLayout);
+      // The dynamic offset picks out this frame's statistics counters:
+      const uint32_t statsOffset = mFrameStatistics->GetDynamicOffset(mCurrentTargetImage);
+      vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        *mPipelineLayout,
+        1,
+        1,
+        mSceneSet->GetHandleAddress(),
+        1, &statsOffset
+        );
+      // While tuning, each frame runs the next candidate workgroup size:
+      const bool tuning = mWorkgroupTuner.Get() && !mWorkgroupSizeSaved;
+      const uint32_t pipeline = tuning ? mWorkgroupTuner->Begin(commandBuffer, mCurrentTargetImage) : mPipelineIndex;
+      const kr::WorkgroupSize workgroupSize = mWorkgroupSizes[pipeline];
+      // The first frame to use each pipeline can have to wait for it to compile:
+      vkCmdBindPipeline(commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, *mComputePipelines[pipeline].get());
+      vkCmdPushConstants(commandBuffer, *mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Pushed), &mPushed);
+      vkCmdDispatch(commandBuffer,
+        kr::NumWorkgroups(win_width, workgroupSize.x),
+        kr::NumWorkgroups(win_height, workgroupSize.y),
+        1);
+      if(tuning)
+      {
+        mWorkgroupTuner->End(commandBuffer, mCurrentTargetImage);
+      }
+    });
+    mRenderGraph.Write(scenePass, framebuffer, kr::Usage::ComputeWrite);
 
     std::chrono::duration<double> diff = start - mFrameInstant;
     const float fps = 1.0f / diff.count();
     mAmortisedFPS = (mAmortisedFPS * 255 + fps) * (1.0f / 256.0f);
-    char buffer[126];
-    snprintf(buffer, sizeof(buffer)-1, "FPS: %.1f", mAmortisedFPS);
-    mLinePrinter->PrintLine(*commandBuffer, 0, 0, 3, 0, true, true, buffer);
-    snprintf(buffer, sizeof(buffer)-1, "MS: %.2f", float(diff.count() * 1000));
-    mLinePrinter->PrintLine(*commandBuffer, 0, 1, 3, 0, true, true, buffer);
-    strcpy(buffer, "GPU: ");
-    std::copy(&mGpuProperties.deviceName[0], &(mGpuProperties.deviceName[120]), &buffer[5]);
-    buffer[125] = 0;
-    mLinePrinter->PrintLine(*commandBuffer, 0, 2, 2, 0, true, true, buffer);
-
-    // Assume the framebuffer will be presented so insert an image memory
-    // barrier here first:
-    auto presentBarrier = kr::ImageMemoryBarrier(
-      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-      VK_ACCESS_MEMORY_READ_BIT,
-      VK_IMAGE_LAYOUT_GENERAL,
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
-      framebufferImage,
-      { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-    vkCmdPipelineBarrier(*commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
-                         nullptr, 0, nullptr, 1, &presentBarrier);
+
+    // The text is drawn over the pixels the main kernel wrote:
+    const auto textPass = mRenderGraph.AddPass("text", [&](VkCommandBuffer commandBuffer)
+    {
+      mLinePrinter->SetFramebuffer(mSwapChainImageViews[mCurrentTargetImage]);
+      mLinePrinter->BindCommandBuffer(commandBuffer);
+
+      char buffer[126];
+      snprintf(buffer, sizeof(buffer)-1, "FPS: %.1f", mAmortisedFPS);
+      mLinePrinter->PrintLine(commandBuffer, 0, 0, 3, 0, true, true, buffer);
+      snprintf(buffer, sizeof(buffer)-1, "MS: %.2f", float(diff.count() * 1000));
+      mLinePrinter->PrintLine(commandBuffer, 0, 1, 3, 0, true, true, buffer);
+      strcpy(buffer, "GPU: ");
+      std::copy(&mGpuProperties.deviceName[0], &(mGpuProperties.deviceName[120]), &buffer[5]);
+      buffer[125] = 0;
+      mLinePrinter->PrintLine(commandBuffer, 0, 2, 2, 0, true, true, buffer);
+      if(mShowGpuTimings && mGpuProfiler.Get())
+      {
+        const unsigned lines = mGpuProfiler->PrintTimings(*mLinePrinter, commandBuffer, 0, 4);
+        PrintStatistics(commandBuffer, uint8_t(5 + lines));
+      }
+    });
+    mRenderGraph.Read(textPass, framebuffer, kr::Usage::ComputeRead);
+    mRenderGraph.Write(textPass, framebuffer, kr::Usage::ComputeWrite);
+
+    mRenderGraph.Compile();
+    // The wait for the swapchain image's last submit showed the GPU is done
+    // with the last frame recorded for it, so the profiler can read back that
+    // frame's timings:
+    if(mGpuProfiler.Get())
+    {
+      mGpuProfiler->BeginFrame(*commandBuffer, mCurrentTargetImage);
+    }
+    mFrameStatistics->BeginFrame(*commandBuffer, mCurrentTargetImage);
+    {
+      const kr::GpuProfiler::Scope frameScope { mGpuProfiler.Get(), *commandBuffer, "frame" };
+      mRenderGraph.Execute(*commandBuffer, mGpuProfiler.Get());
+    }
+    mFrameStatistics->EndFrame(*commandBuffer);
 
     const VkResult endCommandBufferResult = vkEndCommandBuffer(*commandBuffer);
     if(endCommandBufferResult != VK_SUCCESS)
@@ -1608,14 +1733,17 @@ public:
       return;
     }
 
-    // Execute command buffer on main queue:
+    // Execute command buffer on main queue. Only the compute shaders touch the
+    // swapchain image, so that is all the acquire semaphore has to hold back:
     // KRUST_LOG_DEBUG << "Submitting command buffer " << mCurrentTargetImage << "(" << *(mCommandBuffers[mCurrentTargetImage]) << ")." << Krust::endlog;
-    const VkResult submitResult = vkQueueSubmit(*mDefaultGraphicsQueue, 1, &submitInfo, *submitFence);
-    if(submitResult != VK_SUCCESS)
+    kr::SemaphoreStages acquireWait[1] { { mSwapChainSemaphore, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR } };
+    const kr::SubmitResult submitResult = mDefaultGraphicsQueue->Submit2({ acquireWait, { &commandBuffer, 1u }, {} });
+    if(submitResult.result() != VK_SUCCESS)
     {
-      KRUST_LOG_ERROR << "Failed to submit command buffer. Result: " << submitResult << Krust::endlog;
+      KRUST_LOG_ERROR << "Failed to submit command buffer. Result: " << submitResult.result() << Krust::endlog;
       return;
     }
+    mLastSubmits[mCurrentTargetImage] = submitResult.counter();
 
     mFrameInstant = start;
   }
@@ -1626,19 +1754,95 @@ public:
   }
 
 private:
+  /// Switch to the fastest workgroup size and remember it for the next run.
+  void SaveTunedWorkgroupSize()
+  {
+    mPipelineIndex = mWorkgroupTuner->GetBest();
+    for(uint32_t i = 0; i < mWorkgroupSizes.size(); ++i)
+    {
+      KRUST_LOG_INFO << "Workgroup " << mWorkgroupSizes[i].x << "x" << mWorkgroupSizes[i].y << ": "
+        << mWorkgroupTuner->GetMedianMilliseconds(i) << " ms" << (i == mPipelineIndex ? " (fastest)." : ".") << Krust::endlog;
+    }
+    kr::SaveWorkgroupSize(mGpuDeviceUUID, mPipelineCacheDirectory, mShaderName, mWorkgroupSizes[mPipelineIndex]);
+    mWorkgroupSizeSaved = true;
+  }
+
+  /**
+   * Print the work counted in the last frame collected, normalized by the GPU
+   * time of that frame, or of its scene pass for the rays it traced.
+   */
+  void PrintStatistics(VkCommandBuffer commandBuffer, uint8_t y)
+  {
+    const kr::FrameCounts& counts = mFrameStatistics->GetLastFrame();
+    double frameMilliseconds = 0;
+    double sceneMilliseconds = 0;
+    for(const kr::GpuScopeTimings& timings : mGpuProfiler->GetTimings())
+    {
+      if(timings.name == "frame")
+      {
+        frameMilliseconds = timings.lastMilliseconds;
+      }
+      else if(timings.name == "scene")
+      {
+        sceneMilliseconds = timings.lastMilliseconds;
+      }
+    }
+    char buffer[126];
+    if(counts.computeInvocations > 0)
+    {
+      snprintf(buffer, sizeof(buffer), "Invocations %.2f M  %.3f ns each", counts.computeInvocations * 1e-6,
+        kr::NanosecondsPerItem(frameMilliseconds, counts.computeInvocations));
+      mLinePrinter->PrintLine(commandBuffer, 0, y++, 7, 0, true, true, buffer);
+    }
+    // The counters stay at zero unless the shader was built with KRUST_SHADER_STATS:
+    const uint64_t rays = counts.counters[STAT_RAYS];
+    if(rays > 0)
+    {
+      snprintf(buffer, sizeof(buffer), "Rays %.2f M  %.3f ns/ray  %.2f steps/ray  %.2f tests/ray  %.2f hits/ray",
+        rays * 1e-6, kr::NanosecondsPerItem(sceneMilliseconds, rays),
+        double(counts.counters[STAT_TRAVERSAL_STEPS]) / rays,
+        double(counts.counters[STAT_SPHERE_TESTS]) / rays,
+        double(counts.counters[STAT_SPHERE_HITS]) / rays);
+      mLinePrinter->PrintLine(commandBuffer, 0, y, 7, 0, true, true, buffer);
+    }
+  }
+
   // Data:
   VkPhysicalDeviceVulkan11Features    mDeviceFeature11 = kr::PhysicalDeviceVulkan11Features();
   VkPhysicalDeviceVulkan12Features    mDeviceFeature12 = kr::PhysicalDeviceVulkan12Features();
   VkPhysicalDeviceRayQueryFeaturesKHR mDeviceRayQueryFeatures = kr::PhysicalDeviceRayQueryFeaturesKHR();
   VkPhysicalDeviceAccelerationStructureFeaturesKHR mDeviceAccelerationStructureFeatures = kr::PhysicalDeviceAccelerationStructureFeaturesKHR();
+  VkPhysicalDeviceSynchronization2FeaturesKHR mDeviceSynchronization2Features = kr::PhysicalDeviceSynchronization2FeaturesKHR();
   // Functions from required extensions:
   PFN_vkCmdBuildAccelerationStructuresKHR mCmdBuildAccelerationStructuresKHR = nullptr;
   kr::PipelineLayoutPtr mPipelineLayout;
-  kr::DescriptorPoolPtr mDescriptorPool;
-  /// One descriptor set per swapchain image.
-  std::vector<kr::DescriptorSetPtr> mDescriptorSets;
-  kr::ComputePipelinePtr mComputePipeline;
+  kr::BindlessTablePtr mBindlessTable;
+  /// Index of each swapchain image in the bindless table.
+  std::vector<uint32_t> mFramebufferIndices;
+  /// Layout of the scene's set 1.
+  kr::DescriptorSetLayoutPtr mDescriptorSetLayout;
+  kr::DescriptorPoolPtr mScenePool;
+  kr::DescriptorSetPtr mSceneSet;
+  kr::DescriptorAllocatorPtr mDescriptorAllocator;
+  /// The submit which last used each swapchain image's command buffer.
+  std::vector<kr::SubmitCounter> mLastSubmits;
+  /// The main shader compiled for each workgroup size being tried, or just
+  /// for the one an earlier run found fastest.
+  std::vector<kr::ComputePipelineFuture> mComputePipelines;
+  std::vector<kr::WorkgroupSize> mWorkgroupSizes;
+  /// Times the candidate workgroup sizes over the first frames.
+  kr::WorkgroupTunerPtr mWorkgroupTuner;
+  bool mWorkgroupSizeSaved = false;
+  /// The pipeline to run once tuning is done.
+  uint32_t mPipelineIndex = 0;
+  /// Times the passes of each frame, shown over the image unless toggled off.
+  kr::GpuProfilerPtr mGpuProfiler;
+  bool mShowGpuTimings = true;
+  /// Counts the work done in each frame.
+  kr::FrameStatisticsPtr mFrameStatistics;
   std::unique_ptr<kr::LinePrinter> mLinePrinter;
+  /// Rebuilt each frame, reusing its storage.
+  kr::RenderGraph mRenderGraph;
   std::chrono::time_point<std::chrono::high_resolution_clock> mFrameInstant = std::chrono::high_resolution_clock::now();
   float mAmortisedFPS = 30;
 
@@ -1662,7 +1866,7 @@ public:
     1, // width
     1, // height
     0, //frame number
-    0.0f, // padding
+    0, // framebuffer index
     {0,405,900}, 1,
     {-900,0,0}, 1,
     {1,0,0}, 1,
@@ -1673,7 +1877,7 @@ public:
     1, // width
     1, // height
     0, //frame number
-    0.0f, // padding
+    0, // framebuffer index
     {0,0,0 + 10}, 1, // ray_origin
     {-900,-405,-900 + 10}, 1,  // ray_target_origin
     {1,0,0}, 1,     //  ray_target_right
@@ -1681,10 +1885,10 @@ public:
   };
   float mMoveScale = 0.0625f;
   std::unordered_map<std::string, ShaderParams> mShaderParamsOptions {
-    {RT1_SHADER,  {mPushed1, 7.5f}},
-    {RT2_SHADER,  {mPushed1, 6.5f}},
-    {GREY_SHADER, {mPushed,  0.0625f}},
-    {MATERIALS_SHADER, {mPushed,  0.0625f}},
+    {RT1_SHADER,  {mPushed1, 7.5f, kr::Spirv::rt1_comp}},
+    {RT2_SHADER,  {mPushed1, 6.5f, kr::Spirv::rt2_comp}},
+    {GREY_SHADER, {mPushed,  0.0625f, kr::Spirv::rtow_diffuse_grey_comp}},
+    {MATERIALS_SHADER, {mPushed,  0.0625f, kr::Spirv::rtow_ray_query_comp}},
   };
   ShaderParams* mShaderParams {&mShaderParamsOptions[MATERIALS_SHADER]};
   const char* mShaderName = MATERIALS_SHADER;
@@ -1705,12 +1909,20 @@ int main(const int argc, const char* argv[])
       "3. rt1 compiled_spirv_shader_filename true # To disable vsync\n"
   );
 
+  // Count the implementation's host allocations and serve those made while
+  // recording commands from per-thread arenas. Declared before the application
+  // so they outlive every Vulkan object:
+  kr::TrackingAllocator trackingAllocator;
+  kr::ArenaAllocator arenaAllocator(trackingAllocator.GetCallbacks());
+
   RayQueries1Application application;
+  application.mAllocationCallbacks = arenaAllocator.GetCallbacks();
   application.SetName("Ray Queries 1");
   application.SetVersion(1);
   uint8_t keycodes[] = {
     25, 39, 38, 40, 24, 26, // WSADQE
-    111, 116, 113, 114, 112, 117 // up,down,left,right arrows, pgup, pgdn
+    111, 116, 113, 114, 112, 117, // up,down,left,right arrows, pgup, pgdn
+    33 // P: toggle the GPU timings
   };
   application.ListenToScancodes(keycodes, sizeof(keycodes));
   if(argc > 1){
@@ -1731,6 +1943,10 @@ int main(const int argc, const char* argv[])
   // animation:
   const int status = application.Run(Krust::IO::MainLoopType::Busy, VK_IMAGE_USAGE_STORAGE_BIT, allowTearing);
 
+  const kr::ArenaAllocatorStats arenaStats = arenaAllocator.GetStats();
+  KRUST_LOG_INFO << arenaStats.commandAllocations << " command scoped host allocations (" << arenaStats.commandBytes << " bytes) came from arenas of " << arenaStats.reservedBytes << " bytes." << kr::endlog;
+  trackingAllocator.LogStats();
+
   KRUST_LOG_INFO << "Exiting cleanly with code " << status << ".\n";
   return status;
 }
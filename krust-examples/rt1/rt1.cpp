@@ -23,11 +23,23 @@
 #include "krust-gm/public-api/vec3_fwd.h"
 #include "krust-gm/public-api/vec3_inl.h"
 #include "krust/public-api/krust.h"
+#include "krust/public-api/bindless-table.h"
+#include "krust/public-api/descriptor-allocator.h"
+#include "krust/public-api/gpu-profiler.h"
 #include "krust/public-api/queue_janitor.h"
 #include "krust/public-api/line-printer.h"
+#include "krust/public-api/pipeline-compiler.h"
+#include "krust/public-api/render-graph.h"
 #include "krust/public-api/vulkan-utils.h"
+#include "krust/public-api/workgroup-tuner.h"
 #include "krust/public-api/conditional-value.h"
 #include "krust-kernel/public-api/floats.h"
+// Generated at build time from the compiled shaders:
+#include "spirv/rt1.comp.spv.h"
+#include "spirv/rt2.comp.spv.h"
+#include "spirv/rtow_diffuse_grey.comp.spv.h"
+#include "spirv/rtow_materials.comp.spv.h"
+#include "spirv/text_print.comp.spv.h"
 #include <chrono>
 
 namespace kr = Krust;
@@ -37,8 +49,9 @@ namespace
 /** Number of samples per framebuffer pixel. */
 constexpr VkSampleCountFlagBits NUM_SAMPLES = VK_SAMPLE_COUNT_1_BIT;
 constexpr VkAllocationCallbacks* ALLOCATION_CALLBACKS = nullptr;
-constexpr unsigned WORKGROUP_X = 8u;
-constexpr unsigned WORKGROUP_Y = 8u;
+/// Room in the bindless table for the swapchain's images, which don't exist
+/// yet when the pipeline layout is made.
+constexpr uint32_t MAX_SWAPCHAIN_IMAGES = 8u;
 constexpr const char* const RT1_SHADER = "rt1.comp.spv";
 constexpr const char* const RT2_SHADER = "rt2.comp.spv";
 constexpr const char* const GREY_SHADER = "rtow_diffuse_grey.comp.spv";
@@ -49,7 +62,8 @@ struct Pushed
     uint32_t fb_width;
     uint32_t fb_height;
     uint32_t frame_no;
-    float pad0;
+    /// Index of the framebuffer in the bindless table's image array.
+    uint32_t fb_index;
     float ray_origin[3];
     float padding1;
     float ray_target_origin[3];
@@ -65,6 +79,8 @@ KRUST_COMPILE_ASSERT(sizeof(Pushed) <= 128u, "Push Constants are larger than the
 struct ShaderParams {
   Pushed push_defaults;
   float  move_scale;
+  /// The shader built into the executable, or empty to load it from a file.
+  kr::span<const uint32_t> spirv;
 };
 
 void viewVecsFromAngles(
@@ -97,10 +113,17 @@ class Rt1Application : public Krust::IO::Application
     return VK_API_VERSION_1_2;
   }
 
+  void DoAddRequiredDeviceExtensions(std::vector<const char*>& extensionNames) const override
+  {
+    // The render graph records its barriers with synchronization2:
+    extensionNames.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+  }
+
   void DoExtendDeviceFeatureChain(VkPhysicalDeviceFeatures2 &features) override
   {
     mDeviceFeature11.pNext = &mDeviceFeature12;
-    mDeviceFeature12.pNext = features.pNext;
+    mDeviceFeature12.pNext = &mDeviceSynchronization2Features;
+    mDeviceSynchronization2Features.pNext = features.pNext;
     features.pNext = &mDeviceFeature11;
   }
 
@@ -117,6 +140,13 @@ class Rt1Application : public Krust::IO::Application
     REQUIRE_VK_FEATURE(f2.features.shaderInt16, "16 bit ints are required in shaders.");
     REQUIRE_VK_FEATURE(mDeviceFeature12.storagePushConstant8, "8 bit ints are required in shader push Constant buffers.");
     REQUIRE_VK_FEATURE(mDeviceFeature12.shaderInt8, "Eight bit integers in shader code required.");
+    REQUIRE_VK_FEATURE(mDeviceSynchronization2Features.synchronization2, "Synchronization2 is used for the render graph's barriers.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.runtimeDescriptorArray, "The bindless table's arrays are unsized in shaders.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.descriptorBindingPartiallyBound, "The bindless table's arrays are partially bound.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.descriptorBindingStorageImageUpdateAfterBind, "The bindless table's images are updated after bind.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.descriptorBindingStorageBufferUpdateAfterBind, "The bindless table's buffers are updated after bind.");
+    REQUIRE_VK_FEATURE(mDeviceFeature12.descriptorBindingUpdateUnusedWhilePending, "The bindless table's slots are updated while other slots are in use.");
+    REQUIRE_VK_FEATURE(f2.features.shaderStorageImageArrayDynamicIndexing, "Shaders index the bindless table's image array.");
 
     // Turn off things we don't need:
     f2.features.independentBlend = VK_FALSE;
@@ -156,6 +186,54 @@ class Rt1Application : public Krust::IO::Application
 
 
 public:
+  /**
+   * Called as soon as the device exists to start the main shader compiling
+   * while the swapchain is set up.
+   */
+  bool DoEnqueuePipelines() override
+  {
+    // The swapchain images are registered in a bindless table and the shader
+    // picks the one to write with an index pushed each frame:
+    mBindlessTable = kr::BindlessTable::New(*mGpuInterface, 1u, MAX_SWAPCHAIN_IMAGES);
+
+    mPipelineLayout = kr::PipelineLayout::New(*mGpuInterface,
+      0,
+      mBindlessTable->GetLayout(),
+      kr::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Pushed))
+      );
+
+    // Shaders named on the command line which aren't built in are loaded from files:
+    const kr::span<const uint32_t> spirv = mShaderParamsOptions[mShaderName].spirv;
+    if(spirv.empty())
+    {
+      // These can't be assumed to take their workgroup size as specialization
+      // constants, so are run with the 8x8 the built-in ones default to:
+      mWorkgroupSizes = { kr::WorkgroupSize{} };
+      mComputePipelines.push_back(mPipelineCompiler->CompileCompute(mShaderName, *mPipelineLayout));
+      return true;
+    }
+
+    // Use the workgroup size found fastest on this GPU by an earlier run, or
+    // compile every candidate the GPU can run so the first frames can find it:
+    kr::WorkgroupSize tunedSize;
+    if(kr::LoadWorkgroupSize(mGpuDeviceUUID, mPipelineCacheDirectory, mShaderName, tunedSize) &&
+       kr::WorkgroupSizeFits(tunedSize, mGpuProperties.limits))
+    {
+      mWorkgroupSizes = { tunedSize };
+      mWorkgroupSizeSaved = true;
+    }
+    else
+    {
+      mWorkgroupSizes = kr::WorkgroupSizeCandidates(mGpuProperties.limits);
+    }
+    for(const kr::WorkgroupSize size : mWorkgroupSizes)
+    {
+      mComputePipelines.push_back(mPipelineCompiler->CompileCompute(spirv, *mPipelineLayout, kr::WorkgroupSpecialization{size}.Get()));
+    }
+
+    return true;
+  }
+
   /**
    * Called by the default initialization once Krust is initialised and a window
    * has been created. Now is the time to do any additional setup.
@@ -164,79 +242,67 @@ public:
   {
     KRUST_LOG_DEBUG << "DoPostInit() entered." << Krust::endlog;
 
-    BuildFences(*mGpuInterface, VK_FENCE_CREATE_SIGNALED_BIT, mSwapChainImageViews.size(), mSwapChainFences);
+    mLastSubmits.resize(mSwapChainImages.size());
 
-    // Allocate a command buffer per swapchain entry:
+    // Allocate a command buffer per swapchain entry, and another for the
+    // overlay drawn over it:
     KRUST_ASSERT1(mCommandBuffers.size() == 0, "Double init of command buffers.");
     kr::CommandBuffer::Allocate(*mCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, unsigned(mSwapChainImageViews.size()), mCommandBuffers);
+    kr::CommandBuffer::Allocate(*mCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, unsigned(mSwapChainImageViews.size()), mOverlayCommandBuffers);
 
-    // Build all resources required to run the compute shader:
-
-    // Load the spir-v shader code into a module:
-    kr::ShaderBuffer spirv { kr::loadSpirV(mShaderName) };
-    if(spirv.empty()){
-      return false;
+    // Register the swapchain images with the table the main shader's pipeline
+    // layout was built around:
+    for(const VkImageView view : mSwapChainImageViews)
+    {
+      const uint32_t index = mBindlessTable->AddImage(view);
+      if(index == kr::BindlessTable::INVALID_INDEX)
+      {
+        KRUST_LOG_ERROR << "The swapchain has " << mSwapChainImageViews.size() << " images but the bindless table only has room for " << MAX_SWAPCHAIN_IMAGES << "." << kr::endlog;
+        return false;
+      }
+      mFramebufferIndices.push_back(index);
     }
-    auto shaderModule = kr::ShaderModule::New(*mGpuInterface, 0, spirv);
 
-    const auto ssci = kr::PipelineShaderStageCreateInfo(
-      0,
-      VK_SHADER_STAGE_COMPUTE_BIT,
-      *shaderModule,
-      "main",
-      nullptr // VkSpecializationInfo
-    );
-
-    // Define the descriptor and pipeline layouts:
-
-    const auto fbBinding = kr::DescriptorSetLayoutBinding(
-      0, // Binding to the first location
-      VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-      1,
-      VK_SHADER_STAGE_COMPUTE_BIT,
-      nullptr // No immutable samplers.
-    );
-
-    auto descriptorSetLayout = kr::DescriptorSetLayout::New(*mGpuInterface, 0, 1, &fbBinding);
-    mPipelineLayout = kr::PipelineLayout::New(*mGpuInterface,
-      0,
-      *descriptorSetLayout,
-      kr::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Pushed))
-      );
+    // Descriptor sets for the line printer are allocated each frame, from
+    // pools recycled once the wait for the swapchain image's last submit shows
+    // the GPU is done with them:
+    mDescriptorAllocator = kr::DescriptorAllocator::New(*mGpuInterface, uint32_t(mSwapChainImages.size()));
 
-    // Construct our compute pipeline:
-    mComputePipeline = kr::ComputePipeline::New(*mGpuInterface, kr::ComputePipelineCreateInfo(
-      0,    // no flags
-      ssci,
-      *mPipelineLayout,
-      VK_NULL_HANDLE, // no base pipeline
-      -1 // No index of a base pipeline.
-    ));
-
-    // Create a descriptor pool and allocate a matching descriptorSet for each image:
-    VkDescriptorPoolSize poolSizes[1] = {{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, uint32_t(mSwapChainImages.size())}};
-    mDescriptorPool = kr::DescriptorPool::New(*mGpuInterface, 0, uint32_t(mSwapChainImages.size()), uint32_t(1), poolSizes);
-    for(unsigned i = 0; i < mSwapChainImages.size(); ++i)
+    mLinePrinter = std::make_unique<kr::LinePrinter>(*mGpuInterface, *mDescriptorAllocator, *mLayoutCache, *mPipelineCompiler, kr::Spirv::text_print_comp);
+
+    // Time the candidate workgroup sizes on the first frames if there are any.
+    // Without timestamps on the queue the default 8x8 is all we can run:
+    const uint32_t timestampValidBits = mPhysicalQueueFamilyProperties[mDefaultDrawingQueueFamily].timestampValidBits;
+    if(mWorkgroupSizes.size() > 1 && timestampValidBits > 0)
     {
-      auto set = kr::DescriptorSet::Allocate(*mDescriptorPool, *descriptorSetLayout);
-      mDescriptorSets.push_back(set);
-      auto imageInfo = kr::DescriptorImageInfo(VK_NULL_HANDLE, mSwapChainImageViews[i], VK_IMAGE_LAYOUT_GENERAL);
-      auto write = kr::WriteDescriptorSet(*set, 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &imageInfo, nullptr, nullptr);
-      vkUpdateDescriptorSets(*mGpuInterface, 1, &write, 0, nullptr);
+      mWorkgroupTuner = kr::WorkgroupTuner::New(*mGpuInterface,
+        uint32_t(mWorkgroupSizes.size()),
+        uint32_t(mSwapChainImages.size()),
+        mGpuProperties.limits.timestampPeriod,
+        timestampValidBits);
+    }
+    // Time the passes of each frame on the GPU for the overlay:
+    if(timestampValidBits > 0)
+    {
+      mGpuProfiler = kr::GpuProfiler::New(*mGpuInterface,
+        uint32_t(mSwapChainImages.size()),
+        mGpuProperties.limits.timestampPeriod,
+        timestampValidBits);
     }
-
-    mLinePrinter = std::make_unique<kr::LinePrinter>(*mGpuInterface, kr::span {mSwapChainImageViews});
 
     return true;
   }
 
   bool DoPreDeInit()
   {
-    mComputePipeline.Reset();
+    mComputePipelines.clear();
+    mWorkgroupTuner.Reset();
+    mGpuProfiler.Reset();
     mPipelineLayout.Reset();;
-    mDescriptorSets.clear();
-    mDescriptorPool.Reset();
     mLinePrinter.reset();
+    mOverlayCommandBuffers.clear();
+    mDescriptorAllocator.Reset();
+    mBindlessTable.Reset();
 
     return true;
   }
@@ -283,6 +349,14 @@ public:
         mKeyDown = !up;
         break;
       }
+      case 33:{
+        // P toggles the GPU timings overlay:
+        if(up)
+        {
+          mShowGpuTimings = !mShowGpuTimings;
+        }
+        break;
+      }
       default:
         KRUST_LOG_WARN << "Unknown key with scancode " << unsigned(keycode) << (up ? " up" : " down") << kr::endlog;
     }
@@ -327,90 +401,73 @@ public:
     ++frameNumber;
     // KRUST_LOG_INFO << "   ------------ Ray Tracing Example 1: draw frame! frame: " << frameNumber << ". currImage: " << mCurrentTargetImage << ". handle: " << mSwapChainImages[mCurrentTargetImage] << "  ------------\n";
 
-    auto submitFence = mSwapChainFences[mCurrentTargetImage];
-    const VkResult fenceWaitResult = vkWaitForFences(*mGpuInterface, 1, submitFence->GetVkFenceAddress(), true, 1000000000); // Wait one second.
-    if(VK_SUCCESS != fenceWaitResult)
+    // Wait up to one second for the frame to complete for the previous time it was submitted:
+    const VkResult waitResult = mDefaultGraphicsQueue->WaitComplete(mLastSubmits[mCurrentTargetImage], 1000000000);
+    if(VK_SUCCESS != waitResult)
     {
-      KRUST_LOG_ERROR << "Wait for queue submit of main commandbuffer did not succeed: " << fenceWaitResult << Krust::endlog;
+      KRUST_LOG_ERROR << "Wait for queue submit of main commandbuffer did not succeed: " << waitResult << Krust::endlog;
+    }
+    mDescriptorAllocator->BeginFrame(mCurrentTargetImage);
+    // Once the size is picked the tuner is left alone. It is only released at
+    // shutdown as frames still in flight may be writing its timestamps:
+    if(mWorkgroupTuner.Get() && !mWorkgroupSizeSaved)
+    {
+      mWorkgroupTuner->Collect(mCurrentTargetImage);
+      if(!mWorkgroupTuner->IsTuning())
+      {
+        SaveTunedWorkgroupSize();
+      }
     }
-    vkResetFences(*mGpuInterface, 1, submitFence->GetVkFenceAddress());
-
-    constexpr VkPipelineStageFlags pipelineFlags = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    auto submitInfo = kr::SubmitInfo(
-      1, mSwapChainSemaphore->GetVkSemaphoreAddress(),
-      &pipelineFlags,
-      // We have one command buffer per presentable image, so submit the right one:
-      1, mCommandBuffers[mCurrentTargetImage]->GetVkCommandBufferAddress(),
-      0, nullptr);
 
     // Build a command buffer for the current swapchain entry:
 
     kr::CommandBufferPtr commandBuffer = mCommandBuffers[mCurrentTargetImage];
+    kr::CommandBufferPtr overlayCommandBuffer = mOverlayCommandBuffers[mCurrentTargetImage];
     VkImage framebufferImage = mSwapChainImages[mCurrentTargetImage];
 
-    // Empty the command buffer and begin it again from scratch:
-
-    const VkResult resetBufferResult = vkResetCommandBuffer(*commandBuffer, 0);
-    if(VK_SUCCESS != resetBufferResult)
-    {
-      KRUST_LOG_ERROR << "Failed to reset command buffer. Error: " << resetBufferResult << Krust::endlog;
-      return;
-    }
+    // Empty the command buffers and begin them again from scratch:
 
     auto commandBufferInheritanceInfo = kr::CommandBufferInheritanceInfo(nullptr, 0,
       nullptr, VK_FALSE, 0, 0);
     auto bufferBeginInfo = kr::CommandBufferBeginInfo(0, &commandBufferInheritanceInfo);
-
-    const VkResult beginBufferResult = vkBeginCommandBuffer(*commandBuffer,&bufferBeginInfo);
-    if(VK_SUCCESS != beginBufferResult)
+    for(const kr::CommandBufferPtr& buffer : { commandBuffer, overlayCommandBuffer })
     {
-      KRUST_LOG_ERROR << "Failed to begin command buffer. Error: " << beginBufferResult << Krust::endlog;
-      return;
+      const VkResult resetBufferResult = vkResetCommandBuffer(*buffer, 0);
+      if(VK_SUCCESS != resetBufferResult)
+      {
+        KRUST_LOG_ERROR << "Failed to reset command buffer. Error: " << resetBufferResult << Krust::endlog;
+        return;
+      }
+      const VkResult beginBufferResult = vkBeginCommandBuffer(*buffer, &bufferBeginInfo);
+      if(VK_SUCCESS != beginBufferResult)
+      {
+        KRUST_LOG_ERROR << "Failed to begin command buffer. Error: " << beginBufferResult << Krust::endlog;
+        return;
+      }
     }
 
-    // Assume the image is returned from being presented and fix it up using
-    // an image memory barrier:
-    auto postPresentImageMemoryBarrier = kr::ImageMemoryBarrier( 0,
-      VK_ACCESS_SHADER_READ_BIT |
-      VK_ACCESS_SHADER_WRITE_BIT |
-      VK_ACCESS_MEMORY_READ_BIT |
-      VK_ACCESS_MEMORY_WRITE_BIT,
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-      VK_IMAGE_LAYOUT_GENERAL,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
-      framebufferImage,
-      { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-    vkCmdPipelineBarrier(
-        *commandBuffer,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        0, // VkDependencyFlags
-        0, nullptr,
-        0, nullptr,
-        1, &postPresentImageMemoryBarrier);
-
-    // Bind the Descriptor set to the current command buffer:
-    vkCmdBindDescriptorSets(
-      *commandBuffer,
-      VK_PIPELINE_BIND_POINT_COMPUTE,
-      *mPipelineLayout,
-      0,
-      1,
-      mDescriptorSets[mCurrentTargetImage]->GetHandleAddress(),
-      0, nullptr // No dynamic offsets.
-      );
+    // Describe the frame as passes over the swapchain image and let the graph
+    // place the barriers between them, including the transitions out of and
+    // back into the presentable layout. The acquire semaphore is waited on at
+    // the compute stage so the first transition waits on that.
+    // The overlay has a graph and command buffer of its own, picking the
+    // image up as the scene left it, and both reach the queue in one submit:
+    mRenderGraph.Reset();
+    mOverlayGraph.Reset();
+    const VkImageSubresourceRange wholeImage { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    const auto framebuffer = mRenderGraph.ImportImage("framebuffer", framebufferImage, wholeImage,
+      { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR },
+      kr::Usage::ComputeWrite);
+    const auto overlayFramebuffer = mOverlayGraph.ImportImage("framebuffer", framebufferImage, wholeImage,
+      kr::Usage::ComputeWrite, kr::Usage::Present);
 
-    // Here is where we kick off our compute shader.
-
-    vkCmdBindPipeline(*commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, *mComputePipeline);
     const unsigned win_width  { mWindow->GetPlatformWindow().GetWidth()};
     const unsigned win_height { mWindow->GetPlatformWindow().GetHeight()};
 
     mPushed.fb_width  = win_width;
     mPushed.fb_height = win_height;
     mPushed.frame_no = frameNumber;
+    mPushed.fb_index = mFramebufferIndices[mCurrentTargetImage];
     const float MOVE_SCALE = mMoveScale;
 
     if(mKeyLeft) {
@@ -449,62 +506,95 @@ public:
     kr::store(right,             mPushed.ray_target_right);
     kr::store(up,                mPushed.ray_target_up);
 
-
-    vkCmdPushConstants(*commandBuffer, *mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Pushed), &mPushed);
-
-    vkCmdDispatch(*commandBuffer,
-      win_width / WORKGROUP_X + (win_width % WORKGROUP_X ? 1 : 0 ),
-      win_height / WORKGROUP_Y + (win_width % WORKGROUP_Y ? 1 : 0 ),
-      1);
-
-    /// @todo Memory barrier here waiting for writes to the framebuffer from the main kernel to complete.
-
-    mLinePrinter->SetFramebuffer(mSwapChainImageViews[mCurrentTargetImage], mCurrentTargetImage);
-    mLinePrinter->BindCommandBuffer(*commandBuffer, mCurrentTargetImage);
+    // Here is where we kick off our compute shader.
+    const auto scenePass = mRenderGraph.AddPass("scene", [&](VkCommandBuffer commandBuffer)
+    {
+      mBindlessTable->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, *mPipelineLayout);
+      // While tuning, each frame runs the next candidate workgroup size:
+      const bool tuning = mWorkgroupTuner.Get() && !mWorkgroupSizeSaved;
+      const uint32_t pipeline = tuning ? mWorkgroupTuner->Begin(commandBuffer, mCurrentTargetImage) : mPipelineIndex;
+      const kr::WorkgroupSize workgroupSize = mWorkgroupSizes[pipeline];
+      // The first frame to use each pipeline can have to wait for it to compile:
+      vkCmdBindPipeline(commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, *mComputePipelines[pipeline].get());
+      vkCmdPushConstants(commandBuffer, *mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Pushed), &mPushed);
+      vkCmdDispatch(commandBuffer,
+        kr::NumWorkgroups(win_width, workgroupSize.x),
+        kr::NumWorkgroups(win_height, workgroupSize.y),
+        1);
+      if(tuning)
+      {
+        mWorkgroupTuner->End(commandBuffer, mCurrentTargetImage);
+      }
+    });
+    mRenderGraph.Write(scenePass, framebuffer, kr::Usage::ComputeWrite);
 
     std::chrono::duration<double> diff = start - mFrameInstant;
     const float fps = 1.0f / diff.count();
     mAmortisedFPS = (mAmortisedFPS * 255 + fps) * (1.0f / 256.0f);
-    char buffer[126];
-    snprintf(buffer, sizeof(buffer)-1, "FPS: %.1f", mAmortisedFPS);
-    mLinePrinter->PrintLine(*commandBuffer, 0, 0, 3, 0, true, true, buffer);
-    snprintf(buffer, sizeof(buffer)-1, "MS: %.2f", float(diff.count() * 1000));
-    mLinePrinter->PrintLine(*commandBuffer, 0, 1, 3, 0, true, true, buffer);
-    strcpy(buffer, "GPU: ");
-    std::copy(&mGpuProperties.deviceName[0], &(mGpuProperties.deviceName[120]), &buffer[5]);
-    buffer[125] = 0;
-    mLinePrinter->PrintLine(*commandBuffer, 0, 2, 2, 0, true, true, buffer);
-
-    // Assume the framebuffer will be presented so insert an image memory
-    // barrier here first:
-    auto presentBarrier = kr::ImageMemoryBarrier(
-      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-      VK_ACCESS_MEMORY_READ_BIT,
-      VK_IMAGE_LAYOUT_GENERAL,
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
-      framebufferImage,
-      { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-    vkCmdPipelineBarrier(*commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
-                         nullptr, 0, nullptr, 1, &presentBarrier);
-
-    const VkResult endCommandBufferResult = vkEndCommandBuffer(*commandBuffer);
-    if(endCommandBufferResult != VK_SUCCESS)
+
+    // The text is drawn over the pixels the main kernel wrote:
+    const auto textPass = mOverlayGraph.AddPass("text", [&](VkCommandBuffer commandBuffer)
     {
-      KRUST_LOG_ERROR << "Failed to end command buffer with result: " << endCommandBufferResult << Krust::endlog;
-      return;
+      mLinePrinter->SetFramebuffer(mSwapChainImageViews[mCurrentTargetImage]);
+      mLinePrinter->BindCommandBuffer(commandBuffer);
+
+      char buffer[126];
+      snprintf(buffer, sizeof(buffer)-1, "FPS: %.1f", mAmortisedFPS);
+      mLinePrinter->PrintLine(commandBuffer, 0, 0, 3, 0, true, true, buffer);
+      snprintf(buffer, sizeof(buffer)-1, "MS: %.2f", float(diff.count() * 1000));
+      mLinePrinter->PrintLine(commandBuffer, 0, 1, 3, 0, true, true, buffer);
+      strcpy(buffer, "GPU: ");
+      std::copy(&mGpuProperties.deviceName[0], &(mGpuProperties.deviceName[120]), &buffer[5]);
+      buffer[125] = 0;
+      mLinePrinter->PrintLine(commandBuffer, 0, 2, 2, 0, true, true, buffer);
+      if(mShowGpuTimings && mGpuProfiler.Get())
+      {
+        mGpuProfiler->PrintTimings(*mLinePrinter, commandBuffer, 0, 4);
+      }
+    });
+    mOverlayGraph.Read(textPass, overlayFramebuffer, kr::Usage::ComputeRead);
+    mOverlayGraph.Write(textPass, overlayFramebuffer, kr::Usage::ComputeWrite);
+
+    mRenderGraph.Compile();
+    mOverlayGraph.Compile();
+    // The wait for the swapchain image's last submit showed the GPU is done
+    // with the last frame recorded for it, so the profiler can read back that
+    // frame's timings:
+    if(mGpuProfiler.Get())
+    {
+      mGpuProfiler->BeginFrame(*commandBuffer, mCurrentTargetImage);
+    }
+    {
+      const kr::GpuProfiler::Scope frameScope { mGpuProfiler.Get(), *commandBuffer, "frame" };
+      mRenderGraph.Execute(*commandBuffer, mGpuProfiler.Get());
     }
+    mOverlayGraph.Execute(*overlayCommandBuffer, mGpuProfiler.Get());
 
-    // Execute command buffer on main queue:
+    for(const kr::CommandBufferPtr& buffer : { commandBuffer, overlayCommandBuffer })
+    {
+      const VkResult endCommandBufferResult = vkEndCommandBuffer(*buffer);
+      if(endCommandBufferResult != VK_SUCCESS)
+      {
+        KRUST_LOG_ERROR << "Failed to end command buffer with result: " << endCommandBufferResult << Krust::endlog;
+        return;
+      }
+    }
+
+    // Execute the command buffers on the main queue in one submit. Only the
+    // compute shaders touch the swapchain image, so that is all the acquire
+    // semaphore has to hold back, and the overlay follows the scene in
+    // submission order:
     // KRUST_LOG_DEBUG << "Submitting command buffer " << mCurrentTargetImage << "(" << *(mCommandBuffers[mCurrentTargetImage]) << ")." << Krust::endlog;
-    const VkResult submitResult = vkQueueSubmit(*mDefaultGraphicsQueue, 1, &submitInfo, *submitFence);
-    if(submitResult != VK_SUCCESS)
+    std::pair<kr::SemaphorePtr, const VkPipelineStageFlags> acquireWait[1] { { mSwapChainSemaphore, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT } };
+    mDefaultGraphicsQueue->Enqueue({ acquireWait, { &commandBuffer, 1u }, {} });
+    mDefaultGraphicsQueue->Enqueue({ {}, { &overlayCommandBuffer, 1u }, {} });
+    const kr::SubmitResult submitResult = mDefaultGraphicsQueue->Flush();
+    if(submitResult.result() != VK_SUCCESS)
     {
-      KRUST_LOG_ERROR << "Failed to submit command buffer. Result: " << submitResult << Krust::endlog;
+      KRUST_LOG_ERROR << "Failed to submit command buffer. Result: " << submitResult.result() << Krust::endlog;
       return;
     }
+    mLastSubmits[mCurrentTargetImage] = submitResult.counter();
 
     mFrameInstant = start;
   }
@@ -515,15 +605,48 @@ public:
   }
 
 private:
+  /// Switch to the fastest workgroup size and remember it for the next run.
+  void SaveTunedWorkgroupSize()
+  {
+    mPipelineIndex = mWorkgroupTuner->GetBest();
+    for(uint32_t i = 0; i < mWorkgroupSizes.size(); ++i)
+    {
+      KRUST_LOG_INFO << "Workgroup " << mWorkgroupSizes[i].x << "x" << mWorkgroupSizes[i].y << ": "
+        << mWorkgroupTuner->GetMedianMilliseconds(i) << " ms" << (i == mPipelineIndex ? " (fastest)." : ".") << Krust::endlog;
+    }
+    kr::SaveWorkgroupSize(mGpuDeviceUUID, mPipelineCacheDirectory, mShaderName, mWorkgroupSizes[mPipelineIndex]);
+    mWorkgroupSizeSaved = true;
+  }
+
   // Data:
   VkPhysicalDeviceVulkan11Features mDeviceFeature11 = kr::PhysicalDeviceVulkan11Features();
   VkPhysicalDeviceVulkan12Features mDeviceFeature12 = kr::PhysicalDeviceVulkan12Features();
+  VkPhysicalDeviceSynchronization2FeaturesKHR mDeviceSynchronization2Features = kr::PhysicalDeviceSynchronization2FeaturesKHR();
   kr::PipelineLayoutPtr mPipelineLayout;
-  kr::DescriptorPoolPtr mDescriptorPool;
-  /// One descriptor set per swapchain image.
-  std::vector<kr::DescriptorSetPtr> mDescriptorSets;
-  kr::ComputePipelinePtr mComputePipeline;
+  kr::BindlessTablePtr mBindlessTable;
+  /// Index of each swapchain image in the bindless table.
+  std::vector<uint32_t> mFramebufferIndices;
+  kr::DescriptorAllocatorPtr mDescriptorAllocator;
+  /// The submit which last used each swapchain image's command buffer.
+  std::vector<kr::SubmitCounter> mLastSubmits;
+  /// The main shader compiled for each workgroup size being tried, or just
+  /// for the one an earlier run found fastest.
+  std::vector<kr::ComputePipelineFuture> mComputePipelines;
+  std::vector<kr::WorkgroupSize> mWorkgroupSizes;
+  /// Times the candidate workgroup sizes over the first frames.
+  kr::WorkgroupTunerPtr mWorkgroupTuner;
+  bool mWorkgroupSizeSaved = false;
+  /// The pipeline to run once tuning is done.
+  uint32_t mPipelineIndex = 0;
+  /// Times the passes of each frame, shown over the image unless toggled off.
+  kr::GpuProfilerPtr mGpuProfiler;
+  bool mShowGpuTimings = true;
   std::unique_ptr<kr::LinePrinter> mLinePrinter;
+  /// Rebuilt each frame, reusing their storage.
+  kr::RenderGraph mRenderGraph;
+  kr::RenderGraph mOverlayGraph;
+  /// The text drawn over each swapchain image.
+  std::vector<kr::CommandBufferPtr> mOverlayCommandBuffers;
   std::chrono::time_point<std::chrono::high_resolution_clock> mFrameInstant = std::chrono::high_resolution_clock::now();
   float mAmortisedFPS = 30;
 
@@ -547,7 +670,7 @@ public:
     1, // width
     1, // height
     0, //frame number
-    0.0f, // padding
+    0, // framebuffer index
     {0,405,900}, 1,
     {-900,0,0}, 1,
     {1,0,0}, 1,
@@ -558,7 +681,7 @@ public:
     1, // width
     1, // height
     0, //frame number
-    0.0f, // padding
+    0, // framebuffer index
     {0,0,0 + 10}, 1, // ray_origin
     {-900,-405,-900 + 10}, 1,  // ray_target_origin
     {1,0,0}, 1,     //  ray_target_right
@@ -566,10 +689,10 @@ public:
   };
   float mMoveScale = 0.0625f;
   std::unordered_map<std::string, ShaderParams> mShaderParamsOptions {
-    {RT1_SHADER,  {mPushed1, 7.5f}},
-    {RT2_SHADER,  {mPushed1, 6.5f}},
-    {GREY_SHADER, {mPushed,  0.0625f}},
-    {MATERIALS_SHADER, {mPushed,  0.0625f}},
+    {RT1_SHADER,  {mPushed1, 7.5f, kr::Spirv::rt1_comp}},
+    {RT2_SHADER,  {mPushed1, 6.5f, kr::Spirv::rt2_comp}},
+    {GREY_SHADER, {mPushed,  0.0625f, kr::Spirv::rtow_diffuse_grey_comp}},
+    {MATERIALS_SHADER, {mPushed,  0.0625f, kr::Spirv::rtow_materials_comp}},
   };
   ShaderParams* mShaderParams {&mShaderParamsOptions[MATERIALS_SHADER]};
   const char* mShaderName = MATERIALS_SHADER;
@@ -590,7 +713,8 @@ int main(const int argc, const char* argv[])
   application.SetVersion(1);
   uint8_t keycodes[] = {
     25, 39, 38, 40, 24, 26, // WSADQE
-    111, 116, 113, 114, 112, 117 // up,down,left,right arrows, pgup, pgdn
+    111, 116, 113, 114, 112, 117, // up,down,left,right arrows, pgup, pgdn
+    33 // P: toggle the GPU timings
   };
   application.ListenToScancodes(keycodes, sizeof(keycodes));
   if(argc > 1){
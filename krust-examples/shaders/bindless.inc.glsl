@@ -0,0 +1,12 @@
+#ifndef KRUST_BINDLESS_INC_INCLUDED
+#define KRUST_BINDLESS_INC_INCLUDED
+/// @file The arrays of a Krust::BindlessTable bound at set 0.
+/// Push constants carry the indices of the resources a dispatch should use.
+/// Buffers live at binding 0 but each shader must declare its own block type
+/// there, e.g.:
+///     layout(set = 0, binding = 0) restrict readonly buffer spheres_t { vec4 spheres[]; } bindless_spheres[];
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(rgba8, set = 0, binding = 1) uniform restrict writeonly image2D bindless_images[];
+
+#endif // KRUST_BINDLESS_INC_INCLUDED
@@ -7,6 +7,11 @@ layout(rgba8, set = 0, binding = 0) writeonly lowp uniform image2D framebuffer;
 
 void main()
 {
+    // The last row and column of workgroups can hang off the edge of the image:
+    if(any(greaterThanEqual(gl_GlobalInvocationID.xy, uvec2(imageSize(framebuffer)))))
+    {
+        return;
+    }
     float wg_shade = (gl_WorkGroupID.x*1.0)/gl_NumWorkGroups.x;
     vec4 pixel = vec4(
         (gl_GlobalInvocationID.x % 32u)/31.0,
@@ -4,4 +4,58 @@
 #extension GL_EXT_shader_explicit_arithmetic_types_int16 : require
 #extension GL_EXT_shader_explicit_arithmetic_types_int32 : require
 
+// Kernels over the pixels of an image take their workgroup size from
+// specialization constants 0 and 1 so the application can pick the shape which
+// runs fastest on its GPU (see krust/public-api/workgroup-tuner.h). Left
+// unspecialized they run 8x8 workgroups.
+#define KRUST_IMAGE_KERNEL_WORKGROUP \
+  layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in; \
+  layout(local_size_x_id = 0, local_size_y_id = 1) in;
+
+// Uncomment this, or pass -DKRUST_SHADER_STATS to glslangValidator, to have
+// kernels count the work they do for the application to normalize its timings
+// by (see krust/public-api/frame-statistics.h). It costs a few atomics per
+// invocation so is off by default:
+//#define KRUST_SHADER_STATS
+
+// The counters kernels can add to. The application must make the storage
+// buffer KRUST_SHADER_STATS_BUFFER() declares with room for them all.
+#define KRUST_STAT_RAYS 0
+// Steps of ray query traversal: calls to rayQueryProceedEXT().
+#define KRUST_STAT_TRAVERSAL_STEPS 1
+#define KRUST_STAT_SPHERE_TESTS 2
+#define KRUST_STAT_SPHERE_HITS 3
+#define KRUST_NUM_STATS 4
+
+#ifdef KRUST_SHADER_STATS
+// Counts are kept per invocation and added to the buffer once at the end by
+// KRUST_FLUSH_STATS(). Each counter is 64 bits as a low and a high word with
+// the carry out of the low one added to the high by hand, so only 32 bit
+// atomics are needed.
+#define KRUST_SHADER_STATS_BUFFER(SET, BINDING) \
+  layout(set = SET, binding = BINDING) buffer restrict krust_stats_t { uvec2 counts[KRUST_NUM_STATS]; } krust_stats; \
+  uint krust_local_stats[KRUST_NUM_STATS] = uint[KRUST_NUM_STATS](0u, 0u, 0u, 0u); \
+  void krust_flush_stats() \
+  { \
+    for(uint i = 0u; i < KRUST_NUM_STATS; ++i) \
+    { \
+      const uint count = krust_local_stats[i]; \
+      if(count != 0u) \
+      { \
+        const uint before = atomicAdd(krust_stats.counts[i].x, count); \
+        if(before + count < before) \
+        { \
+          atomicAdd(krust_stats.counts[i].y, 1u); \
+        } \
+      } \
+    } \
+  }
+#define KRUST_COUNT(STAT, N) (krust_local_stats[STAT] += uint(N))
+#define KRUST_FLUSH_STATS() krust_flush_stats()
+#else
+#define KRUST_SHADER_STATS_BUFFER(SET, BINDING)
+#define KRUST_COUNT(STAT, N)
+#define KRUST_FLUSH_STATS()
+#endif
+
 #endif // KRUST_HEADER_INC_INCLUDED
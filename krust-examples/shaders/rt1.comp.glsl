@@ -5,10 +5,10 @@
 #version 450 core
 #extension GL_GOOGLE_include_directive : require
 #include "header.inc.glsl"
+#include "bindless.inc.glsl"
 #include "intersections.inc.glsl"
 
-layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
-layout(rgba8, set = 0, binding = 0) uniform image2D framebuffer;
+KRUST_IMAGE_KERNEL_WORKGROUP
 /// @todo Pack into minimal number of vec4s.
 layout(push_constant) uniform frame_params_t
 {
@@ -16,6 +16,7 @@ layout(push_constant) uniform frame_params_t
     uint32_t fb_width;
     uint32_t fb_height;
     uint32_t frame_no;
+    uint32_t fb_index;
     vec3 ray_origin;
     vec3 ray_target_origin;
     vec3 ray_target_right;
@@ -35,6 +36,11 @@ const vec4 sphere1 = vec4(0,405,-900,405);
 
 void main()
 {
+    // Workgroups at the right and bottom edges can hang off the image:
+    if(gl_GlobalInvocationID.x >= fp.fb_width || gl_GlobalInvocationID.y >= fp.fb_height)
+    {
+        return;
+    }
 
     // Bottom-left relative integer screen cordinates:
     const float screen_coord_x = gl_GlobalInvocationID.x;
@@ -92,5 +98,5 @@ void main()
         pixel = norm;
     }
 
-    imageStore(framebuffer, ivec2(gl_GlobalInvocationID.xy), vec4(pixel, 1.0f));
+    imageStore(bindless_images[fp.fb_index], ivec2(gl_GlobalInvocationID.xy), vec4(pixel, 1.0f));
 }
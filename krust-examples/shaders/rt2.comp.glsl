@@ -3,6 +3,7 @@
 #version 450 core
 #extension GL_GOOGLE_include_directive : require
 #include "header.inc.glsl"
+#include "bindless.inc.glsl"
 #include "intersections.inc.glsl"
 
 // Define the number of samples of each pixel in X and Y by passing a value for this to the
@@ -15,8 +16,7 @@ const float halfpixel_dim = 0.5f;
 const float subpixel_dim = float(double(1.0) / AA);
 const float half_subpixel_dim = subpixel_dim * 0.5f;
 
-layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
-layout(rgba8, set = 0, binding = 0) uniform image2D framebuffer;
+KRUST_IMAGE_KERNEL_WORKGROUP
 /// @todo Pack into minimal number of vec4s.
 layout(push_constant) uniform frame_params_t
 {
@@ -24,6 +24,7 @@ layout(push_constant) uniform frame_params_t
     uint32_t fb_width;
     uint32_t fb_height;
     uint32_t frame_no;
+    uint32_t fb_index;
     vec3 ray_origin;
     vec3 ray_target_origin;
     vec3 ray_target_right;
@@ -137,6 +138,11 @@ vec3 shoot_ray(in vec3 ray_origin, in vec3 ray_dir_unit)
 
 void main()
 {
+    // Workgroups at the right and bottom edges can hang off the image:
+    if(gl_GlobalInvocationID.x >= fp.fb_width || gl_GlobalInvocationID.y >= fp.fb_height)
+    {
+        return;
+    }
     // Bottom-left relative integer screen cordinates:
     const float screen_coord_x = gl_GlobalInvocationID.x;
     const float screen_coord_y = fp.fb_height - gl_GlobalInvocationID.y;
@@ -166,5 +172,5 @@ void main()
     }
     pixel *= INV_NUM_SAMPLES;
 #endif
-    imageStore(framebuffer, ivec2(gl_GlobalInvocationID.xy), vec4(pixel, 1.0f));
+    imageStore(bindless_images[fp.fb_index], ivec2(gl_GlobalInvocationID.xy), vec4(pixel, 1.0f));
 }
@@ -3,6 +3,7 @@
 #version 450 core
 #extension GL_GOOGLE_include_directive : require
 #include "header.inc.glsl"
+#include "bindless.inc.glsl"
 #include "intersections.inc.glsl"
 
 // Are spheres solids or just infinitely thin surface shells?
@@ -43,14 +44,14 @@ const float halfpixel_dim = 0.5f;
 const float subpixel_dim = float(double(1.0) / AA);
 const float half_subpixel_dim = subpixel_dim * 0.5f;
 
-layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
-layout(rgba8, set = 0, binding = 0) uniform restrict writeonly image2D framebuffer;
+KRUST_IMAGE_KERNEL_WORKGROUP
 
 layout(push_constant) uniform frame_params_t
 {
     uint32_t fb_width;
     uint32_t fb_height;
     uint32_t frame_no;
+    uint32_t fb_index;
     vec3 ray_origin;
     // The ray target is the grid we are shooting prmary rays at.
     vec3 ray_target_origin;
@@ -412,6 +413,11 @@ vec3 shoot_ray(inout highp uint32_t seed, in vec3 ray_origin, in vec3 ray_dir_un
 
 void main()
 {
+    // Workgroups at the right and bottom edges can hang off the image:
+    if(gl_GlobalInvocationID.x >= fp.fb_width || gl_GlobalInvocationID.y >= fp.fb_height)
+    {
+        return;
+    }
     // Bottom-left relative integer screen cordinates:
     const highp uint32_t screen_coord_x = gl_GlobalInvocationID.x;
     const highp uint32_t screen_coord_y = fp.fb_height - gl_GlobalInvocationID.y;
@@ -446,7 +452,7 @@ void main()
 #if 0
     const vec4 pixel = mix(vec4(0,0,0,1), vec4(1.0f,1.0f,1.0f,1.0f), randf_zero_to_one(random_seed)); // draw random numbers as gradient to check seed is uncorrelated between neighbours.
     //const vec4 pixel = vec4((random_seed & 255u)/255.0f, ((random_seed >> 8u) & 255u)/255.0f, ((random_seed >> 16u) & 255u)/255.0f, ((random_seed >> 24u) & 255u)/255.0f);
-    imageStore(framebuffer, ivec2(gl_GlobalInvocationID.xy), pixel);
+    imageStore(bindless_images[fp.fb_index], ivec2(gl_GlobalInvocationID.xy), pixel);
 #else
 #if AA < 2
     // Generate the single per-fragment ray:
@@ -486,6 +492,6 @@ void main()
     // Cheaper Gamma of 2:
     // pixel = linear_to_gamma_2_0(pixel);
     // Show that increasing Y coordinates are visually going down the image: pixel.r = gl_GlobalInvocationID.y / float(fp.fb_height); pixel.g *= 0.1; pixel.b *= 0.1;
-    imageStore(framebuffer, ivec2(gl_GlobalInvocationID.xy), vec4(pixel, 1.0f));
+    imageStore(bindless_images[fp.fb_index], ivec2(gl_GlobalInvocationID.xy), vec4(pixel, 1.0f));
 #endif
 }
@@ -11,6 +11,7 @@
 #extension GL_EXT_ray_flags_primitive_culling : require
 #extension GL_GOOGLE_include_directive : require
 #include "header.inc.glsl"
+#include "bindless.inc.glsl"
 #include "intersections.inc.glsl"
 
 #ifndef GL_EXT_ray_query
@@ -62,19 +63,20 @@ const float subpixel_dim = float(double(1.0) / AA);
 const float half_subpixel_dim = subpixel_dim * 0.5f;
 
 layout(primitive_culling); // Apparently having primitive culling enabled is a "layout" (using the culling flags is undefined without this).
-layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
-layout(rgba8, set = 0, binding = 0) uniform restrict writeonly image2D framebuffer;
-layout(set = 0, binding = 1) uniform restrict readonly ub_t
+KRUST_IMAGE_KERNEL_WORKGROUP
+layout(set = 1, binding = 0) uniform restrict readonly ub_t
 {
     vec4 spheres[68];
 } ub;
-layout(set = 0, binding = 2) uniform accelerationStructureEXT sphere_tlas;
+layout(set = 1, binding = 1) uniform accelerationStructureEXT sphere_tlas;
+KRUST_SHADER_STATS_BUFFER(1, 2)
 
 layout(push_constant) uniform frame_params_t
 {
     uint32_t fb_width;
     uint32_t fb_height;
     uint32_t frame_no;
+    uint32_t fb_index;
     vec3 ray_origin;
     // The ray target is the grid we are shooting prmary rays at.
     vec3 ray_target_origin;
@@ -114,16 +116,20 @@ bool closest_sphere_hit(in vec3 ray_origin, in vec3 ray_dir_unit, in float t_min
     bool found_hit = false;
     rayQueryEXT query;
     rayQueryInitializeEXT(query, sphere_tlas, gl_RayFlagsOpaqueEXT | gl_RayFlagsSkipTrianglesEXT, CULL_MASK_ALL_INTERSECTED, ray_origin, t_min, ray_dir_unit, c_t_max);
+    KRUST_COUNT(KRUST_STAT_RAYS, 1);
     bool traversing = true;
     while (traversing)
     {
         traversing = rayQueryProceedEXT(query);
+        KRUST_COUNT(KRUST_STAT_TRAVERSAL_STEPS, 1);
         uint candidate_type = rayQueryGetIntersectionTypeEXT(query, false /* false = candidate, true = committed*/);
         if(candidate_type == gl_RayQueryCandidateIntersectionAABBEXT) // The only other candidate type would be a triangle.
         {
             int sphere_index = rayQueryGetIntersectionPrimitiveIndexEXT(query, false);
             float t1, t2;
+            KRUST_COUNT(KRUST_STAT_SPHERE_TESTS, 1);
             if(sphere_hits(ray_origin, ray_dir_unit, ub.spheres[sphere_index], t1, t2)){
+                KRUST_COUNT(KRUST_STAT_SPHERE_HITS, 1);
 
                 if(t1 >= t_min && t1 < hit.t){
                     hit.t = t1;
@@ -342,6 +348,11 @@ vec3 shoot_ray(inout highp uint32_t seed, in vec3 ray_origin, in vec3 ray_dir_un
 
 void main()
 {
+    // Workgroups at the right and bottom edges can hang off the image:
+    if(gl_GlobalInvocationID.x >= fp.fb_width || gl_GlobalInvocationID.y >= fp.fb_height)
+    {
+        return;
+    }
     // Bottom-left relative integer screen cordinates:
     const highp uint32_t screen_coord_x = gl_GlobalInvocationID.x;
     const highp uint32_t screen_coord_y = fp.fb_height - gl_GlobalInvocationID.y;
@@ -376,7 +387,7 @@ void main()
 #if 0
     const vec4 pixel = mix(vec4(0,0,0,1), vec4(1.0f,1.0f,1.0f,1.0f), randf_zero_to_one(random_seed)); // draw random numbers as gradient to check seed is uncorrelated between neighbours.
     //const vec4 pixel = vec4((random_seed & 255u)/255.0f, ((random_seed >> 8u) & 255u)/255.0f, ((random_seed >> 16u) & 255u)/255.0f, ((random_seed >> 24u) & 255u)/255.0f);
-    imageStore(framebuffer, ivec2(gl_GlobalInvocationID.xy), pixel);
+    imageStore(bindless_images[fp.fb_index], ivec2(gl_GlobalInvocationID.xy), pixel);
 #else
 #if AA < 2
     // Generate the single per-fragment ray:
@@ -419,6 +430,7 @@ void main()
     // pixel.r *= gl_GlobalInvocationID.y / float(fp.fb_height); pixel.g *= 0.1; pixel.b *= 0.1;
 
     /// @todo Look into a subgroup barrier here. Would it be advantageous for the memory system for all stores to kick off together, or in some multiple of adjacent invocations less than whole CU? Or just let the hardware handle them as they come?
-    imageStore(framebuffer, ivec2(gl_GlobalInvocationID.xy), vec4(pixel, 1.0f));
+    imageStore(bindless_images[fp.fb_index], ivec2(gl_GlobalInvocationID.xy), vec4(pixel, 1.0f));
 #endif
+    KRUST_FLUSH_STATS();
 }
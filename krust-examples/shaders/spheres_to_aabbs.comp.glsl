@@ -26,6 +26,10 @@ layout(set = 0, binding = 1) restrict writeonly buffer aabbBuffer {
 void main()
 {
     const highp uint i = gl_GlobalInvocationID.x;
+    // The last workgroup can hang off the end of the arrays:
+    if(i >= aabbs.length()){
+        return;
+    }
     vec4 sphere = spheres[i];
     vec3 centre = sphere.xyz;
     float radius = sphere.w;
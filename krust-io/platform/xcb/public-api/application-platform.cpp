@@ -82,7 +82,7 @@ VkSurfaceKHR Krust::IO::ApplicationPlatform::InitSurface(VkInstance instance)
     .window = mWindow->GetPlatformWindow().mXcbWindow
   };
   VkSurfaceKHR surface = nullptr;
-  const VkResult result = vkCreateXcbSurfaceKHR(instance, &createInfo, KRUST_DEFAULT_ALLOCATION_CALLBACKS, &surface);
+  const VkResult result = vkCreateXcbSurfaceKHR(instance, &createInfo, Krust::GetAllocationCallbacks(), &surface);
   if(result != VK_SUCCESS)
   {
     KRUST_LOG_ERROR << "Failed to create Vk surface for window. Result: " << ResultToString(result) << "." << endlog;
@@ -24,13 +24,18 @@
 // External headers:
 #include "krust/public-api/queue_janitor.h"
 #include "krust/public-api/compiler.h"
+#include "krust/public-api/layout-cache.h"
 #include "krust/public-api/logging.h"
+#include "krust/public-api/pipeline-cache-file.h"
+#include "krust/public-api/pipeline-compiler.h"
+#include "krust/public-api/trace.h"
 #include "krust/public-api/vulkan-logging.h"
 #include "krust/public-api/vulkan-utils.h"
 #include "krust/public-api/vulkan.h"
 #include "krust-kernel/public-api/debug.h"
 #include <iostream>
 #include <algorithm>
+#include <iterator>
 #include <string.h> // for memset.
 
 // Internal headers:
@@ -167,6 +172,14 @@ bool Application::InitVulkan(const VkImageUsageFlags swapchainUsageOverrides, bo
     return false;
   }
 
+  // Start pipelines compiling in the background while the rest is set up:
+  mPipelineCompiler = PipelineCompiler::New(*mGpuInterface, *mPipelineCache);
+  mLayoutCache = LayoutCache::New(*mGpuInterface);
+  if(!DoEnqueuePipelines())
+  {
+    return false;
+  }
+
   // Choose an image space and format compatible with the presentable surface:
   if(!ChoosePresentableSurfaceFormatSpacePair(VK_FORMAT_B8G8R8A8_UNORM)) ///< @todo Let the app tell us what format it wants.
   {
@@ -404,6 +417,16 @@ bool Application::InitVulkanGpus() {
   KRUST_LOG_INFO << "Running on a " << mGpuProperties.deviceName << " GPU." << endlog;
   LogVkPhysicalDeviceLimits(mGpuProperties.limits);
 
+  // The UUID identifies the GPU itself, unlike the pipelineCacheUUID which
+  // changes when its driver does:
+  VkPhysicalDeviceIDProperties idProperties {};
+  idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+  VkPhysicalDeviceProperties2 properties2 {};
+  properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties2.pNext = &idProperties;
+  vkGetPhysicalDeviceProperties2(mGpu, &properties2);
+  std::copy(std::begin(idProperties.deviceUUID), std::end(idProperties.deviceUUID), mGpuDeviceUUID);
+
   DoExtendDeviceFeatureChain(mGpuFeatures);
   vkGetPhysicalDeviceFeatures2(mGpu, &mGpuFeatures);
   /// @todo Log the extended features down the pNext chain.
@@ -470,6 +493,8 @@ bool Application::InitVulkanGpus() {
   // Make dispatches faster as we only ever use one device:
   volkLoadDevice(*mGpuInterface);
 
+  mPipelineCache = LoadPipelineCache(*mGpuInterface, mGpuProperties, mPipelineCacheDirectory);
+
   // Get the device WSI extensions:
   if( 0 == (mAcquireNextImageKHR = KRUST_GET_DEVICE_EXTENSION(*mGpuInterface, AcquireNextImageKHR)) ||
       0 == (mCreateSwapChainKHR = KRUST_GET_DEVICE_EXTENSION(*mGpuInterface, CreateSwapchainKHR)) ||
@@ -511,6 +536,11 @@ bool Application::InitDefaultQueue()
 
   mDefaultPresentQueue = &*mDefaultQueue;
   mDefaultGraphicsQueue = &*mDefaultQueue;
+
+  // Keep destructors of Vulkan objects out of the middle of frames. This relies
+  // on frames being submitted through mDefaultQueue so it can tell when the GPU
+  // is done with what they used:
+  mDefaultQueue->EnableDeferredDestruction();
   return true;
 }
 
@@ -810,6 +840,15 @@ bool Application::DeInit()
     vkDestroySurfaceKHR(*mInstance, mSurface, Krust::GetAllocationCallbacks());
   }
 
+  // Everything the app compiled is in the cache by now:
+  mPipelineCompiler.Reset();
+  mLayoutCache.Reset();
+  if(mPipelineCache.Get())
+  {
+    SavePipelineCache(*mPipelineCache, mGpuProperties, mPipelineCacheDirectory);
+    mPipelineCache.Reset();
+  }
+
   mGpuInterface.Reset(nullptr);
 
 
@@ -831,7 +870,11 @@ bool Application::DeInit()
 int Application::Run(const MainLoopType loopType, const VkImageUsageFlags swapchainUsageOverrides, bool allowTearing)
 {
   // Init the Krust core:
-  InitKrust(/* Default error policy and allocator for CPU structures. */);
+  InitKrust(/* Default error policy. */ nullptr, mAllocationCallbacks);
+  if(StartTraceFile(mTraceFilename))
+  {
+    KRUST_LOG_INFO << "Writing a CPU trace to \"" << mTraceFilename << "\"." << endlog;
+  }
 
   /// Sit on the main thread.
   ThreadBase threadBase(Krust::GetGlobalErrorPolicy());
@@ -906,6 +949,7 @@ int Application::Run(const MainLoopType loopType, const VkImageUsageFlags swapch
   }
 
   DeInit();
+  StopTraceFile();
   return 0;
 }
 
@@ -1046,6 +1090,11 @@ void Application::DoCustomizeDeviceFeatureChain(VkPhysicalDeviceFeatures2 &featu
 {
 }
 
+bool Application::DoEnqueuePipelines()
+{
+  return true;
+}
+
 bool Application::DoPostInit()
 {
   return true;
@@ -1077,6 +1126,9 @@ void Application::OnResize(unsigned w, unsigned h) {
 
 void Application::OnRedraw() {
   // Verbose: KRUST_LOG_INFO << "Default OnRedraw() called.\n";
+  // Write out the trace events of the last frame before timing this one:
+  FlushTrace();
+  KRUST_TRACE_SCOPE("Application::OnRedraw");
 
   if(!mAcquireNextImageKHR || !mQueuePresentKHR)
   {
@@ -1085,13 +1137,18 @@ void Application::OnRedraw() {
   }
 
   // Acquire an image to draw into from the WSI:
-  const VkResult acquireResult = mAcquireNextImageKHR(
-    *mGpuInterface,
-    mSwapChain,
-    PRESENT_IMAGE_ACQUIRE_TIMEOUT,
-    *mSwapChainSemaphore,
-    nullptr, // no fence used!
-    &mCurrentTargetImage);
+  VkResult acquireResult;
+  {
+    // Blocks for up to PRESENT_IMAGE_ACQUIRE_TIMEOUT when no image is free:
+    KRUST_TRACE_SCOPE("vkAcquireNextImageKHR");
+    acquireResult = mAcquireNextImageKHR(
+      *mGpuInterface,
+      mSwapChain,
+      PRESENT_IMAGE_ACQUIRE_TIMEOUT,
+      *mSwapChainSemaphore,
+      nullptr, // no fence used!
+      &mCurrentTargetImage);
+  }
 
   if(VK_SUCCESS != acquireResult)
   {
@@ -1117,6 +1174,7 @@ void Application::OnRedraw() {
   if(acquireResult == VK_SUCCESS || acquireResult == VK_SUBOPTIMAL_KHR)
   {
     // Defer the actual drawing to an overridable template function:
+    KRUST_TRACE_SCOPE("DoDrawFrame");
     DoDrawFrame();
   }
 
@@ -1132,7 +1190,11 @@ void Application::OnRedraw() {
     presentInfo.pResults = &swapResult;
 
 
-  const VkResult presentResult = mQueuePresentKHR(*mDefaultPresentQueue, &presentInfo);
+  VkResult presentResult;
+  {
+    KRUST_TRACE_SCOPE("vkQueuePresentKHR");
+    presentResult = mQueuePresentKHR(*mDefaultPresentQueue, &presentInfo);
+  }
   
   if(presentResult != VK_SUCCESS)
   {
@@ -1149,6 +1211,10 @@ void Application::OnRedraw() {
       KRUST_LOG_ERROR << "Failed to present a swapchain image through WSI. Error: " << presentResult << endlog;
     }
   }
+
+  // Destroy in one batch any Vulkan objects dropped during the frame which the
+  // GPU has finished with:
+  mDefaultQueue->ReapRetired();
 }
 
 void Application::OnKey(const bool up, const KeyCode keycode) {
@@ -1198,7 +1264,7 @@ void Application::DoDrawFrame()
   // Do per-frame work like building dynamic command buffers and updating
   // uniforms here.
 
-  // Your app should call vkQueueSubmit();
+  // Your app should call mDefaultGraphicsQueue->Submit();
 }
 
 } /* namespace IO */
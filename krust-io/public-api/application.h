@@ -41,6 +41,10 @@ namespace Krust {
 
 class QueueJanitor;
 using QueueJanitorPtr = IntrusivePointer<QueueJanitor>;
+class PipelineCompiler;
+using PipelineCompilerPtr = IntrusivePointer<PipelineCompiler>;
+class LayoutCache;
+using LayoutCachePtr = IntrusivePointer<LayoutCache>;
 
 namespace IO {
 
@@ -246,6 +250,13 @@ protected:
    */
   virtual void DoCustomizeDeviceFeatureChain(VkPhysicalDeviceFeatures2 &features);
 
+  /**
+   * @brief Called as soon as the device exists, before the queue and
+   * swapchain are set up, to start pipelines compiling on mPipelineCompiler.
+   * Keep the futures and only wait on them where the pipelines are first used.
+   */
+  virtual bool DoEnqueuePipelines();
+
   /**
    * @brief Called once Vulkan and a window are up and running.
    */
@@ -275,6 +286,11 @@ protected:
    * for the GPU and presentation engine to asynchronously complete its own use
    * of an image in the swapchain and so have it ready to return from the call
    * without blocking.
+   *
+   * Submit the frame's work through mDefaultGraphicsQueue rather than straight
+   * to the VkQueue: Vulkan objects dropped during the frame are destroyed once
+   * the GPU has completed the submits made through it, so work it hasn't seen
+   * can't keep them alive.
    */
   virtual void DoDrawFrame();
 
@@ -294,6 +310,8 @@ public:
   InstancePtr mInstance;
   VkPhysicalDevice  mGpu; ///< Physical GPU
   VkPhysicalDeviceProperties mGpuProperties;
+  /// Identifies the GPU across runs, e.g. to key per-device tuning results.
+  uint8_t mGpuDeviceUUID[VK_UUID_SIZE] = {};
   VkPhysicalDeviceFeatures2 mGpuFeatures = PhysicalDeviceFeatures2();
   std::vector<VkQueueFamilyProperties> mPhysicalQueueFamilyProperties;
   /// Addendum to mPhysicalQueueFamilyProperties: Records whether the
@@ -303,6 +321,22 @@ public:
   unsigned  mDefaultPresentQueueFamily = 0;
   VkPhysicalDeviceMemoryProperties mGpuMemoryProperties;
   DevicePtr mGpuInterface; ///< Logical GPU.
+  /// Pass to pipeline creation. Loaded from mPipelineCacheDirectory at startup
+  /// and saved back there on shutdown so pipelines are only compiled once.
+  PipelineCachePtr mPipelineCache;
+  /// Where the pipeline cache file lives. Set before Init() to change it.
+  const char* mPipelineCacheDirectory = ".";
+  /// Where Run() writes the CPU trace in builds with
+  /// KRUST_BUILD_CONFIG_ENABLE_TRACING. Set before Run() to change it.
+  const char* mTraceFilename = "krust-trace.json";
+  /// Passed to InitKrust() by Run() for the Vulkan implementation's host
+  /// allocations, e.g. those of a TrackingAllocator or ArenaAllocator. Null
+  /// for the implementation's own. Must outlive Run().
+  VkAllocationCallbacks* mAllocationCallbacks = nullptr;
+  /// Worker threads creating pipelines through mPipelineCache.
+  PipelineCompilerPtr mPipelineCompiler;
+  /// Shares descriptor set and pipeline layouts between the app's pipelines.
+  LayoutCachePtr mLayoutCache;
   QueueJanitorPtr   mDefaultQueue;
   /// Draw through this.
   QueueJanitor*  mDefaultGraphicsQueue = 0;
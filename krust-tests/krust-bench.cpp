@@ -0,0 +1,161 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * @file Microbenchmarks for the hot paths of the Krust core which don't need a
+ * Vulkan device.
+ *
+ * Run with no arguments to run everything or pass a substring of benchmark
+ * names to run a subset. Build an optimised configuration before reading
+ * anything into the numbers.
+ */
+
+// Internal includes:
+#include "krust/public-api/ref-object.h"
+#include "krust/public-api/intrusive-pointer.h"
+#include "krust/internal/keep-alive-set.h"
+
+// External includes:
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace
+{
+namespace kr = Krust;
+
+struct BenchObject : public kr::RefObject
+{
+  BenchObject(const kr::RefCountPolicy policy) : kr::RefObject(policy) {}
+};
+
+struct Benchmark
+{
+  const char* name;
+  /// Runs the given number of iterations of the thing being measured.
+  std::function<void(size_t iterations)> body;
+};
+
+constexpr size_t ITERATIONS = 1u << 24u;
+
+void Run(const Benchmark& bench)
+{
+  // Warm up caches and clocks:
+  bench.body(ITERATIONS / 16);
+  const auto start = std::chrono::steady_clock::now();
+  bench.body(ITERATIONS);
+  const auto end = std::chrono::steady_clock::now();
+  const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  printf("%-48s %8.3f ns/iteration\n", bench.name, ns / ITERATIONS);
+}
+
+/// Pairs of Inc() and Dec() on one object from one thread.
+void IncDec(const kr::RefCountPolicy policy, const size_t iterations)
+{
+  BenchObject* object = new BenchObject(policy);
+  object->Inc();
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    object->Inc();
+    object->Dec();
+  }
+  object->Dec();
+}
+
+/// Copy and destroy smart pointers to one object from one thread.
+void PointerCopies(const kr::RefCountPolicy policy, const size_t iterations)
+{
+  kr::IntrusivePointer<BenchObject> original { new BenchObject(policy) };
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    kr::IntrusivePointer<BenchObject> copy = original;
+    kr::IntrusivePointer<BenchObject> moved = std::move(copy);
+  }
+}
+
+/// Pairs of Inc() and Dec() on one shared object from all hardware threads.
+void ContendedIncDec(const size_t iterations)
+{
+  kr::IntrusivePointer<BenchObject> shared { new BenchObject(kr::RefCountPolicy::Shared) };
+  const unsigned numThreads = std::max(2u, std::thread::hardware_concurrency());
+  std::vector<std::thread> threads;
+  for(unsigned t = 0; t < numThreads; ++t)
+  {
+    threads.emplace_back([&shared, iterations, numThreads](){
+      BenchObject& object = *shared;
+      for(size_t i = 0, end = iterations / numThreads; i < end; ++i)
+      {
+        object.Inc();
+        object.Dec();
+      }
+    });
+  }
+  for(auto& thread : threads)
+  {
+    thread.join();
+  }
+}
+
+/// Fill a KeepAliveSet with a command buffer's worth of distinct objects, each
+/// added twice as repeated binds would, then clear it for the next frame.
+void KeepAliveFrames(const size_t iterations)
+{
+  constexpr size_t OBJECTS_PER_FRAME = 4096;
+  std::vector<kr::IntrusivePointer<BenchObject>> objects;
+  for(size_t i = 0; i < OBJECTS_PER_FRAME; ++i)
+  {
+    objects.push_back(new BenchObject(kr::RefCountPolicy::Shared));
+  }
+  kr::KeepAliveSet keepAlives;
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    keepAlives.Add(*objects[(i / 2) % OBJECTS_PER_FRAME]);
+    if((i + 1) % (OBJECTS_PER_FRAME * 2) == 0)
+    {
+      keepAlives.Clear();
+    }
+  }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  const char* filter = argc > 1 ? argv[1] : "";
+  const Benchmark benchmarks[] = {
+    {"RefObject Inc+Dec, Shared", [](size_t n){ IncDec(kr::RefCountPolicy::Shared, n); }},
+    {"RefObject Inc+Dec, ThreadConfined", [](size_t n){ IncDec(kr::RefCountPolicy::ThreadConfined, n); }},
+    {"IntrusivePointer copy+move, Shared", [](size_t n){ PointerCopies(kr::RefCountPolicy::Shared, n); }},
+    {"IntrusivePointer copy+move, ThreadConfined", [](size_t n){ PointerCopies(kr::RefCountPolicy::ThreadConfined, n); }},
+    {"RefObject Inc+Dec, Shared, all threads", [](size_t n){ ContendedIncDec(n); }},
+    {"KeepAliveSet Add, 4096 objects per Clear", [](size_t n){ KeepAliveFrames(n); }},
+  };
+  for(const auto& bench : benchmarks)
+  {
+    if(strstr(bench.name, filter))
+    {
+      Run(bench);
+    }
+  }
+  return 0;
+}
@@ -5,6 +5,7 @@
  * Test of the RefObject class.
  */
 #include "krust/public-api/ref-object.h"
+#include "krust/public-api/intrusive-pointer.h"
 namespace {
   namespace kr = Krust;
   struct TestRefObect : public kr::RefObject
@@ -46,6 +47,31 @@ TEST_CASE("RefObject", "[simple]")
   REQUIRE(destroyed == true);
 }
 
+TEST_CASE("RefObjectThreadConfined", "[simple]")
+{
+  struct ConfinedRefObject : public kr::RefObject
+  {
+    ConfinedRefObject(bool& destroyed) : kr::RefObject(kr::RefCountPolicy::ThreadConfined), mDestroyed(destroyed) {}
+    ~ConfinedRefObject() { mDestroyed = true; }
+    bool& mDestroyed;
+  };
+
+  bool destroyed = false;
+  ConfinedRefObject* obj = new ConfinedRefObject(destroyed);
+  REQUIRE(obj->GetRefCountPolicy() == kr::RefCountPolicy::ThreadConfined);
+  REQUIRE(TestRefObect(destroyed).GetRefCountPolicy() == kr::RefCountPolicy::Shared);
+  destroyed = false;
+  {
+    kr::IntrusivePointer<ConfinedRefObject> first { obj };
+    kr::IntrusivePointer<ConfinedRefObject> second = first;
+    REQUIRE(obj->Count() == 2);
+    second.Reset();
+    REQUIRE(obj->Count() == 1);
+    REQUIRE(destroyed == false);
+  }
+  REQUIRE(destroyed == true);
+}
+
 /// Slam a refcounted object from lots of threads at the same time.
 #include <future>
 TEST_CASE("RefObjectAsync", "[simple]")
@@ -177,4 +203,1093 @@ TEST_CASE("KeepAliveSet", "[simple]")
     }
     REQUIRE(liveObjects == 0);
   }
-}
\ No newline at end of file
+
+  SECTION(" Clearing and reuse across the inline to table transition ")
+  {
+    kr::KeepAliveSet keepalives;
+    std::vector<kr::IntrusivePointer<TestRefObect>> objects;
+    for (unsigned i = 0; i < 100; ++i)
+    {
+      objects.push_back(new TestRefObect(liveObjects));
+    }
+    for (const unsigned count : {5u, 14u, 15u, 100u, 3u})
+    {
+      for (unsigned i = 0; i < count; ++i)
+      {
+        keepalives.Add(*objects[i]);
+        keepalives.Add(*objects[i]);
+      }
+      REQUIRE(keepalives.Size() == count);
+      REQUIRE(objects[0]->Count() == 2);
+      keepalives.Clear();
+      REQUIRE(keepalives.Size() == 0);
+      REQUIRE(objects[0]->Count() == 1);
+    }
+    keepalives.Add(*objects[7]);
+    objects.clear();
+    REQUIRE(liveObjects == 1);
+    keepalives.Clear();
+    REQUIRE(liveObjects == 0);
+  }
+
+  SECTION(" Bulk adds ")
+  {
+    std::vector<kr::IntrusivePointer<TestRefObect>> objects;
+    for (unsigned i = 0; i < 1000; ++i)
+    {
+      objects.push_back(new TestRefObect(liveObjects));
+    }
+    objects.push_back(objects[0]);
+    objects.push_back(nullptr);
+    kr::KeepAliveSet keepalives;
+    keepalives.AddAll(kr::span<kr::IntrusivePointer<TestRefObect>>(objects));
+    REQUIRE(keepalives.Size() == 1000);
+    const kr::RefObject* raw[2] = { objects[1].Get(), objects[2].Get() };
+    keepalives.AddAll(kr::span<const kr::RefObject* const>(raw));
+    REQUIRE(keepalives.Size() == 1000);
+    objects.clear();
+    REQUIRE(liveObjects == 1000);
+  }
+
+  SECTION(" Moving ")
+  {
+    for (const unsigned count : {3u, 50u})
+    {
+      kr::KeepAliveSet source;
+      for (unsigned i = 0; i < count; ++i)
+      {
+        source.Add(*new TestRefObect(liveObjects));
+      }
+      kr::KeepAliveSet moved { std::move(source) };
+      REQUIRE(source.Size() == 0);
+      REQUIRE(moved.Size() == count);
+      kr::KeepAliveSet assigned;
+      assigned.Add(*new TestRefObect(liveObjects));
+      assigned = std::move(moved);
+      REQUIRE(assigned.Size() == count);
+      REQUIRE(liveObjects == count);
+      assigned.Clear();
+      REQUIRE(liveObjects == 0);
+    }
+  }
+}
+/* -----------------------------------------------------------------------------
+ * Test of the object pools.
+ */
+#include "krust/public-api/object-pool.h"
+#include "krust-kernel/public-api/debug.h"
+TEST_CASE("ObjectPool", "[simple]")
+{
+  namespace kr = Krust;
+  struct TestPooled : public kr::RefObject, public kr::PooledObject
+  {
+    TestPooled(std::atomic<size_t>& count) : count(count) { ++count; }
+    ~TestPooled() { --count; }
+    std::atomic<size_t>& count;
+    char payload[40];
+  };
+
+  constexpr unsigned numObjects = 5000;
+  std::atomic<size_t> liveObjects {0};
+  const kr::ObjectPoolStats before = kr::GetObjectPoolStats();
+  KRUST_UNUSED_VAR(before);
+
+  SECTION(" Freed blocks are reused ")
+  {
+    TestPooled* first = new TestPooled(liveObjects);
+    first->Inc();
+    void* const firstAddress = first;
+    first->Dec();
+    REQUIRE(liveObjects == 0);
+    TestPooled* second = new TestPooled(liveObjects);
+    const bool reused = static_cast<void*>(second) == firstAddress;
+    KRUST_UNUSED_VAR(reused);
+    second->Inc();
+    second->Dec();
+  #if !defined(KRUST_BUILD_CONFIG_DISABLE_OBJECT_POOLS)
+    REQUIRE(reused);
+    const kr::ObjectPoolStats after = kr::GetObjectPoolStats();
+    REQUIRE(after.allocations - before.allocations == 2);
+    REQUIRE(after.frees - before.frees == 2);
+    REQUIRE(after.threadHits - before.threadHits >= 1);
+  #endif
+  }
+
+  SECTION(" Objects freed on other threads ")
+  {
+    std::vector<kr::IntrusivePointer<TestPooled>> objects;
+    for (unsigned i = 0; i < numObjects; ++i)
+    {
+      objects.push_back(new TestPooled(liveObjects));
+    }
+    REQUIRE(liveObjects == numObjects);
+
+    std::vector<std::future<void>> futures;
+    constexpr unsigned numThreads = 8;
+    for (unsigned t = 0; t < numThreads; ++t)
+    {
+      futures.push_back(std::async(std::launch::async, [&objects, t](){
+        for (unsigned i = t; i < numObjects; i += numThreads)
+        {
+          objects[i].Reset();
+        }
+      }));
+    }
+    wait_all(futures);
+    REQUIRE(liveObjects == 0);
+  #if !defined(KRUST_BUILD_CONFIG_DISABLE_OBJECT_POOLS)
+    const kr::ObjectPoolStats after = kr::GetObjectPoolStats();
+    REQUIRE(after.allocations - before.allocations == numObjects);
+    REQUIRE(after.frees - before.frees == numObjects);
+  #endif
+  }
+}
+
+/* -----------------------------------------------------------------------------
+ * Test of IntrusivePointer move, release, adopt and swap.
+ */
+#include <type_traits>
+#include <vector>
+TEST_CASE("IntrusivePointerMove", "[simple]")
+{
+  namespace kr = Krust;
+  bool destroyed = false;
+  kr::IntrusivePointer<TestRefObect> first { new TestRefObect(destroyed) };
+  TestRefObect* const raw = first.Get();
+  REQUIRE(raw->Count() == 1);
+
+  SECTION(" Move construction and assignment leave counts alone ")
+  {
+    kr::IntrusivePointer<TestRefObect> second { std::move(first) };
+    REQUIRE(!first);
+    REQUIRE(second.Get() == raw);
+    REQUIRE(raw->Count() == 1);
+
+    kr::IntrusivePointer<TestRefObect> third;
+    third = std::move(second);
+    REQUIRE(!second);
+    REQUIRE(third.Get() == raw);
+    REQUIRE(raw->Count() == 1);
+
+    // Through an alias so compilers don't warn about the self-move:
+    auto& alias = third;
+    third = std::move(alias);
+    REQUIRE(third.Get() == raw);
+    REQUIRE(raw->Count() == 1);
+
+    third = kr::IntrusivePointer<TestRefObect>();
+    REQUIRE(destroyed == true);
+  }
+
+  SECTION(" Move assignment releases the old pointee ")
+  {
+    bool otherDestroyed = false;
+    kr::IntrusivePointer<TestRefObect> other { new TestRefObect(otherDestroyed) };
+    other = std::move(first);
+    REQUIRE(otherDestroyed == true);
+    REQUIRE(destroyed == false);
+    REQUIRE(raw->Count() == 1);
+  }
+
+  SECTION(" Release and adopt ")
+  {
+    TestRefObect* const released = first.Release();
+    REQUIRE(!first);
+    REQUIRE(released == raw);
+    REQUIRE(raw->Count() == 1);
+    {
+      auto adopted = kr::IntrusivePointer<TestRefObect>::Adopt(released);
+      REQUIRE(raw->Count() == 1);
+    }
+    REQUIRE(destroyed == true);
+  }
+
+  SECTION(" Swap ")
+  {
+    bool otherDestroyed = false;
+    kr::IntrusivePointer<TestRefObect> other { new TestRefObect(otherDestroyed) };
+    TestRefObect* const otherRaw = other.Get();
+    using std::swap;
+    swap(first, other);
+    REQUIRE(first.Get() == otherRaw);
+    REQUIRE(other.Get() == raw);
+    REQUIRE(raw->Count() == 1);
+    REQUIRE(otherRaw->Count() == 1);
+    std::swap(first, other);
+    REQUIRE(first.Get() == raw);
+    REQUIRE(raw->Count() == 1);
+  }
+
+  SECTION(" Vector growth moves rather than copies ")
+  {
+    static_assert(std::is_nothrow_move_constructible<kr::IntrusivePointer<TestRefObect>>::value, "Vectors copy what can throw when moved.");
+    static_assert(std::is_nothrow_move_assignable<kr::IntrusivePointer<TestRefObect>>::value, "Vectors copy what can throw when moved.");
+
+    // The defaulted move is only noexcept if the pointer's is, so vector
+    // growth copying these, and so the pointers, shows up in the count:
+    struct Element
+    {
+      Element(kr::IntrusivePointer<TestRefObect>&& pointer, unsigned& copies) : pointer(std::move(pointer)), copies(&copies) {}
+      Element(Element&&) = default;
+      Element(const Element& other) : pointer(other.pointer), copies(other.copies) { ++*copies; }
+      kr::IntrusivePointer<TestRefObect> pointer;
+      unsigned* copies;
+    };
+    unsigned copies = 0;
+    std::vector<Element> pointers;
+    pointers.emplace_back(std::move(first), copies);
+    for (unsigned i = 0; i < 100; ++i)
+    {
+      pointers.emplace_back(kr::IntrusivePointer<TestRefObect>(), copies);
+      REQUIRE(raw->Count() == 1);
+    }
+    REQUIRE(pointers.capacity() > 1u);
+    REQUIRE(copies == 0u);
+  }
+}
+
+/* -----------------------------------------------------------------------------
+ * Test of the list that Vulkan objects are retired to for deferred destruction.
+ */
+#include "krust/internal/retire-list.h"
+namespace {
+  struct TestRetiree
+  {
+    TestRetiree(unsigned& destroyed, kr::Internal::RetireList<TestRetiree>* cascade = nullptr, TestRetiree* child = nullptr) :
+      mDestroyed(destroyed), mCascade(cascade), mChild(child) {}
+    ~TestRetiree()
+    {
+      ++mDestroyed;
+      // Model an object which held the last reference to another:
+      if(mChild)
+      {
+        mCascade->Push(*mChild);
+      }
+    }
+    unsigned& mDestroyed;
+    kr::Internal::RetireList<TestRetiree>* mCascade;
+    TestRetiree* mChild;
+    mutable const TestRetiree* mNextRetired = nullptr;
+    mutable uint64_t mRetireEpoch = 0;
+  };
+}
+
+TEST_CASE("RetireList", "[simple]")
+{
+  unsigned destroyed = 0;
+  kr::Internal::RetireList<TestRetiree> retired;
+
+  SECTION(" Objects wait for their epoch ")
+  {
+    retired.SetEpoch(1);
+    retired.Push(*new TestRetiree(destroyed));
+    retired.Push(*new TestRetiree(destroyed));
+    retired.SetEpoch(2);
+    retired.Push(*new TestRetiree(destroyed));
+    REQUIRE(retired.Pending() == 3);
+
+    REQUIRE(retired.Reap(0) == 0);
+    REQUIRE(destroyed == 0);
+    REQUIRE(retired.Reap(1) == 2);
+    REQUIRE(destroyed == 2);
+    REQUIRE(retired.Pending() == 1);
+    REQUIRE(retired.Reap(5) == 1);
+    REQUIRE(destroyed == 3);
+    REQUIRE(retired.Pending() == 0);
+  }
+
+  SECTION(" Objects retired during a reap are reaped with it ")
+  {
+    retired.SetEpoch(3);
+    TestRetiree* child = new TestRetiree(destroyed);
+    retired.Push(*new TestRetiree(destroyed, &retired, child));
+    REQUIRE(retired.Reap(3) == 2);
+    REQUIRE(destroyed == 2);
+  }
+
+  SECTION(" Concurrent retirement ")
+  {
+    constexpr unsigned numThreads = 8;
+    constexpr unsigned perThread = 1000;
+    retired.SetEpoch(7);
+    std::vector<std::future<void>> futures;
+    for(unsigned t = 0; t < numThreads; ++t)
+    {
+      futures.push_back(std::async(std::launch::async, [&retired, &destroyed](){
+        for(unsigned i = 0; i < perThread; ++i)
+        {
+          retired.Push(*new TestRetiree(destroyed));
+        }
+      }));
+    }
+    wait_all(futures);
+    REQUIRE(retired.Pending() == numThreads * perThread);
+    REQUIRE(retired.Reap(7) == numThreads * perThread);
+    REQUIRE(destroyed == numThreads * perThread);
+  }
+}
+
+/* -----------------------------------------------------------------------------
+ * Test of the barriers and culling a render graph derives, without a device.
+ */
+#include "krust/public-api/render-graph.h"
+#include "krust/public-api/thread-base.h"
+#include "krust/public-api/vulkan_struct_init.h"
+TEST_CASE("RenderGraph", "[simple]")
+{
+  namespace kr = Krust;
+  const VkImageSubresourceRange colour { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+  const kr::ResourceUsage acquired { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+  kr::RenderGraph graph;
+
+  SECTION(" Present, draw, overlay, present ")
+  {
+    auto image = graph.ImportImage("swapchain", VK_NULL_HANDLE, colour, acquired, kr::Usage::Present);
+    auto scratch = graph.ImportBuffer("scratch", VK_NULL_HANDLE, kr::Usage::Discard, kr::Usage::Discard);
+    auto scene = graph.AddPass("scene", nullptr);
+    graph.Write(scene, image, kr::Usage::ComputeWrite);
+    auto unused = graph.AddPass("unused", nullptr);
+    graph.Read(unused, image, kr::Usage::ComputeRead);
+    graph.Write(unused, scratch, kr::Usage::ComputeWrite);
+    auto text = graph.AddPass("text", nullptr);
+    graph.Read(text, image, kr::Usage::ComputeRead);
+    graph.Write(text, image, kr::Usage::ComputeWrite);
+    graph.Compile();
+    REQUIRE(graph.GetNumCulledPasses() == 1);
+    REQUIRE(graph.IsCulled(unused));
+    REQUIRE(!graph.IsCulled(scene));
+    REQUIRE(!graph.IsCulled(text));
+    // Into GENERAL, scene to text, and back to PRESENT_SRC:
+    REQUIRE(graph.GetNumBarriers() == 3);
+  }
+
+  SECTION(" Repeated reads and merged buffer barriers ")
+  {
+    const kr::ResourceUsage hostRead { VK_PIPELINE_STAGE_2_HOST_BIT_KHR, VK_ACCESS_2_HOST_READ_BIT_KHR };
+    auto a = graph.ImportBuffer("a", VK_NULL_HANDLE, kr::Usage::Discard, kr::Usage::Discard);
+    auto b = graph.ImportBuffer("b", VK_NULL_HANDLE, kr::Usage::Discard, hostRead);
+    auto produce = graph.AddPass("produce", nullptr);
+    graph.Write(produce, a, kr::Usage::ComputeWrite);
+    graph.Write(produce, b, kr::Usage::ComputeWrite);
+    auto consume1 = graph.AddPass("consume1", nullptr);
+    graph.Read(consume1, a, kr::Usage::ComputeRead);
+    graph.Read(consume1, b, kr::Usage::ComputeRead);
+    graph.SetSideEffects(consume1);
+    auto consume2 = graph.AddPass("consume2", nullptr);
+    graph.Read(consume2, a, kr::Usage::ComputeRead);
+    graph.SetSideEffects(consume2);
+    graph.Compile();
+    REQUIRE(graph.GetNumCulledPasses() == 0);
+    // One merged barrier before consume1, none before consume2, and one for
+    // the host to read b:
+    REQUIRE(graph.GetNumBarriers() == 2);
+
+    graph.Reset();
+    REQUIRE(graph.GetNumPasses() == 0);
+    auto c = graph.ImportBuffer("c", VK_NULL_HANDLE, kr::Usage::Discard, kr::Usage::Discard);
+    auto orphan = graph.AddPass("orphan", nullptr);
+    graph.Write(orphan, c, kr::Usage::ComputeWrite);
+    graph.Compile();
+    REQUIRE(graph.GetNumCulledPasses() == 1);
+    REQUIRE(graph.GetNumBarriers() == 0);
+  }
+
+  SECTION(" Transients need a device ")
+  {
+    struct CountingErrorPolicy : kr::ErrorPolicy
+    {
+      void VulkanError(const char*, VkResult, const char*, const char*, const char*, unsigned) override { ++errors; }
+      void VulkanUnexpected(const char*, const char*, const char*, const char*, unsigned) override { ++errors; }
+      void Error(kr::Errors, const char*, const char*, const char*, unsigned) override { ++errors; }
+      bool ErrorFlagged() const override { return errors > 0; }
+      unsigned errors = 0;
+    } policy;
+    kr::ThreadBase threadBase { &policy };
+    const auto image = graph.CreateImage("image", kr::ImageCreateInfo());
+    const auto buffer = graph.CreateBuffer("buffer", 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    REQUIRE(image == kr::RenderGraph::INVALID_RESOURCE);
+    REQUIRE(buffer == kr::RenderGraph::INVALID_RESOURCE);
+    REQUIRE(policy.errors == 2);
+    // Passes can't then use them:
+    auto pass = graph.AddPass("pass", nullptr);
+    graph.Write(pass, buffer, kr::Usage::ComputeWrite);
+    REQUIRE(policy.errors == 3);
+    graph.Compile();
+    REQUIRE(graph.GetNumCulledPasses() == 1);
+  }
+}
+
+#include "krust/internal/transient-placement.h"
+TEST_CASE("TransientPlacement", "[simple]")
+{
+  namespace kr = Krust;
+  using kr::Internal::TransientRange;
+
+  SECTION(" Disjoint lifetimes share memory ")
+  {
+    TransientRange ranges[] {
+      {256, 256, 0, 1},
+      {256, 256, 2, 3},
+      {128, 256, 4, 4},
+    };
+    REQUIRE(kr::Internal::PlaceTransients(ranges) == 256u);
+    REQUIRE(ranges[0].offset == 0u);
+    REQUIRE(ranges[1].offset == 0u);
+    REQUIRE(ranges[2].offset == 0u);
+  }
+
+  SECTION(" Overlapping lifetimes don't ")
+  {
+    TransientRange ranges[] {
+      {100, 64, 0, 2},
+      {300, 256, 1, 3},
+      {100, 64, 3, 4},
+      {0, 1, UINT32_MAX, 0},
+    };
+    // The biggest goes first at zero, then the first small one after it, then
+    // the last, which only overlaps the big one, fits in the same gap:
+    REQUIRE(kr::Internal::PlaceTransients(ranges) == 420u);
+    REQUIRE(ranges[1].offset == 0u);
+    REQUIRE(ranges[0].offset == 320u);
+    REQUIRE(ranges[2].offset == 320u);
+    for(unsigned i = 0; i < 4; ++i)
+    {
+      for(unsigned j = i + 1; j < 4; ++j)
+      {
+        REQUIRE(!(kr::Internal::LifetimesOverlap(ranges[i], ranges[j]) && kr::Internal::MemoryOverlaps(ranges[i], ranges[j])));
+      }
+    }
+  }
+}
+
+#include "krust/internal/kernel-set-cache.h"
+TEST_CASE("KernelSetCache", "[simple]")
+{
+  namespace kr = Krust;
+  using kr::Internal::KernelSetCache;
+
+  SECTION(" Keys come from the fields for the descriptor type ")
+  {
+    // Garbage where a resource's type has no field must not change its key:
+    kr::KernelResource a, b;
+    memset(&a, 0x55, sizeof(a));
+    memset(&b, 0xaa, sizeof(b));
+    a.buffer.buffer = b.buffer.buffer = (VkBuffer)(uintptr_t)(0x1000);
+    a.buffer.offset = b.buffer.offset = 64;
+    a.buffer.range = b.buffer.range = VK_WHOLE_SIZE;
+    KernelSetCache::Key keyA, keyB;
+    KernelSetCache::AppendKey(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, a, keyA);
+    KernelSetCache::AppendKey(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, b, keyB);
+    REQUIRE(keyA == keyB);
+
+    a.texelBuffer = b.texelBuffer = (VkBufferView)(uintptr_t)(0x2000);
+    keyA.clear();
+    keyB.clear();
+    KernelSetCache::AppendKey(VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, a, keyA);
+    KernelSetCache::AppendKey(VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, b, keyB);
+    REQUIRE(keyA == keyB);
+
+    const auto image = kr::KernelResource::Image((VkImageView)(uintptr_t)(0x3000));
+    auto otherLayout = kr::KernelResource::Image((VkImageView)(uintptr_t)(0x3000), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    keyA.clear();
+    keyB.clear();
+    KernelSetCache::AppendKey(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, image, keyA);
+    KernelSetCache::AppendKey(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, otherLayout, keyB);
+    REQUIRE(keyA != keyB);
+  }
+
+  SECTION(" Sets are found until their pool is evicted ")
+  {
+    constexpr uint32_t SETS_PER_POOL = 2;
+    constexpr uint32_t MAX_POOLS = 3;
+    KernelSetCache cache { SETS_PER_POOL, MAX_POOLS };
+    auto setFor = [](uint64_t i) { return (VkDescriptorSet)(uintptr_t)(i + 1); };
+
+    uint32_t pool = UINT32_MAX;
+    for(uint64_t i = 0; i < SETS_PER_POOL * MAX_POOLS; ++i)
+    {
+      const KernelSetCache::Slot slot = cache.Reserve();
+      REQUIRE(slot.pool == i / SETS_PER_POOL);
+      REQUIRE(!slot.evicted);
+      REQUIRE(cache.Insert({i}, setFor(i)) == slot.pool);
+    }
+    REQUIRE(cache.Size() == SETS_PER_POOL * MAX_POOLS);
+    REQUIRE(cache.Find({3}, pool) == setFor(3));
+    REQUIRE(pool == 1u);
+    REQUIRE(cache.Find({99}, pool) == VK_NULL_HANDLE);
+
+    // Once every pool is full the oldest makes way:
+    KernelSetCache::Slot slot = cache.Reserve();
+    REQUIRE(slot.pool == 0u);
+    REQUIRE(slot.evicted);
+    REQUIRE(cache.Size() == SETS_PER_POOL * (MAX_POOLS - 1));
+    REQUIRE(cache.Find({0}, pool) == VK_NULL_HANDLE);
+    REQUIRE(cache.Find({1}, pool) == VK_NULL_HANDLE);
+    REQUIRE(cache.Find({2}, pool) == setFor(2));
+    cache.Insert({100}, setFor(100));
+    // A failed allocation leaves the slot to be reserved again, already empty:
+    slot = cache.Reserve();
+    REQUIRE(slot.pool == 0u);
+    REQUIRE(!slot.evicted);
+    REQUIRE(cache.Size() <= SETS_PER_POOL * MAX_POOLS);
+
+    // Reset pools are reused rather than replaced:
+    cache.Clear();
+    REQUIRE(cache.Size() == 0u);
+    for(uint64_t i = 0; i < SETS_PER_POOL * MAX_POOLS; ++i)
+    {
+      slot = cache.Reserve();
+      REQUIRE(!slot.evicted);
+      cache.Insert({i}, setFor(i));
+    }
+  }
+}
+
+#include "krust/internal/pipeline-cache-format.h"
+#include <cstring>
+TEST_CASE("PipelineCacheFormat", "[simple]")
+{
+  namespace kr = Krust;
+
+  VkPhysicalDeviceProperties properties;
+  memset(&properties, 0, sizeof(properties));
+  properties.vendorID = 0x10de;
+  properties.deviceID = 0x2204;
+  properties.driverVersion = 0x1f000000;
+  for(unsigned i = 0; i < VK_UUID_SIZE; ++i)
+  {
+    properties.pipelineCacheUUID[i] = uint8_t(i * 7);
+  }
+
+  // What a driver would return from vkGetPipelineCacheData():
+  std::vector<uint8_t> data(sizeof(VkPipelineCacheHeaderVersionOne) + 100, 0xab);
+  VkPipelineCacheHeaderVersionOne vkHeader;
+  vkHeader.headerSize = sizeof(vkHeader);
+  vkHeader.headerVersion = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+  vkHeader.vendorID = properties.vendorID;
+  vkHeader.deviceID = properties.deviceID;
+  memcpy(vkHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+  memcpy(data.data(), &vkHeader, sizeof(vkHeader));
+
+  std::vector<uint8_t> file = kr::Internal::EncodePipelineCacheFile(properties, data);
+  const uint8_t* decoded = nullptr;
+  size_t decodedSize = 0;
+
+  SECTION(" Round trip ")
+  {
+    REQUIRE(kr::Internal::DecodePipelineCacheFile(properties, file.data(), file.size(), decoded, decodedSize) == nullptr);
+    REQUIRE(decodedSize == data.size());
+    REQUIRE(memcmp(decoded, data.data(), data.size()) == 0);
+  }
+
+  SECTION(" Truncation and corruption are rejected ")
+  {
+    REQUIRE(kr::Internal::DecodePipelineCacheFile(properties, file.data(), file.size() - 1, decoded, decodedSize) != nullptr);
+    REQUIRE(kr::Internal::DecodePipelineCacheFile(properties, file.data(), 10, decoded, decodedSize) != nullptr);
+    file.back() ^= 1u;
+    REQUIRE(kr::Internal::DecodePipelineCacheFile(properties, file.data(), file.size(), decoded, decodedSize) != nullptr);
+    REQUIRE(decoded == nullptr);
+  }
+
+  SECTION(" Other drivers and devices are rejected ")
+  {
+    auto updated = properties;
+    updated.driverVersion += 1;
+    REQUIRE(kr::Internal::DecodePipelineCacheFile(updated, file.data(), file.size(), decoded, decodedSize) != nullptr);
+    auto other = properties;
+    other.pipelineCacheUUID[3] ^= 1u;
+    REQUIRE(kr::Internal::DecodePipelineCacheFile(other, file.data(), file.size(), decoded, decodedSize) != nullptr);
+  }
+}
+
+#include "krust/public-api/mapped-spirv.h"
+#include <cstdio>
+#include <filesystem>
+TEST_CASE("MappedSpirV", "[simple]")
+{
+  namespace kr = Krust;
+
+  const auto path = std::filesystem::temp_directory_path() / "krust-test-mapped.spv";
+  const auto write = [&path](const void* bytes, size_t size)
+  {
+    FILE* const file = fopen(path.string().c_str(), "wb");
+    REQUIRE(file != nullptr);
+    REQUIRE(fwrite(bytes, 1, size, file) == size);
+    fclose(file);
+  };
+  // A header and a couple of instruction words:
+  const uint32_t words[] = { 0x07230203u, 0x00010000u, 0u, 8u, 0u, 0x00020011u, 1u };
+
+  SECTION(" Valid file ")
+  {
+    write(words, sizeof(words));
+    kr::MappedSpirV mapped { path.string().c_str() };
+    REQUIRE(mapped.IsValid());
+    REQUIRE(mapped.GetWords().size() == std::size(words));
+    REQUIRE(memcmp(mapped.GetWords().data(), words, sizeof(words)) == 0);
+
+    kr::MappedSpirV moved { std::move(mapped) };
+    REQUIRE(!mapped.IsValid());
+    REQUIRE(moved.GetWords().size() == std::size(words));
+    REQUIRE(moved.GetWords()[0] == words[0]);
+  }
+
+  SECTION(" Bad files are rejected ")
+  {
+    write(words, sizeof(words) - 1);
+    REQUIRE(!kr::MappedSpirV { path.string().c_str() }.IsValid());
+    const uint32_t notSpirV[] = { 0xdeadbeefu, 0u, 0u, 0u, 0u };
+    write(notSpirV, sizeof(notSpirV));
+    REQUIRE(!kr::MappedSpirV { path.string().c_str() }.IsValid());
+    std::filesystem::remove(path);
+    REQUIRE(!kr::MappedSpirV { path.string().c_str() }.IsValid());
+  }
+
+  std::filesystem::remove(path);
+}
+
+#include "krust/public-api/spirv-reflection.h"
+#include "krust/public-api/workgroup-tuner.h"
+#include <algorithm>
+#include <initializer_list>
+TEST_CASE("SpirVReflection", "[simple]")
+{
+  namespace kr = Krust;
+
+  // Assemble a small compute shader by hand:
+  std::vector<uint32_t> code { 0x07230203u, 0x00010000u, 0u, 20u, 0u };
+  const auto op = [&code](const uint32_t opcode, std::initializer_list<uint32_t> operands)
+  {
+    code.push_back(uint32_t(operands.size() + 1) << 16u | opcode);
+    code.insert(code.end(), operands);
+  };
+  op(15, { 5, 1, 0x6e69616du, 0 });  // OpEntryPoint GLCompute %1 "main"
+  op(16, { 1, 17, 8, 4, 1 });        // OpExecutionMode %1 LocalSize 8 4 1
+  op(71, { 8, 34, 0 });              // OpDecorate %8 DescriptorSet 0
+  op(71, { 8, 33, 1 });              // OpDecorate %8 Binding 1
+  op(71, { 13, 34, 2 });             // OpDecorate %13 DescriptorSet 2
+  op(71, { 13, 33, 0 });             // OpDecorate %13 Binding 0
+  op(71, { 19, 34, 0 });             // OpDecorate %19 DescriptorSet 0
+  op(71, { 19, 33, 0 });             // OpDecorate %19 Binding 0
+  op(71, { 6, 2 });                  // OpDecorate %6 Block
+  op(71, { 5, 6, 16 });              // OpDecorate %5 ArrayStride 16
+  op(72, { 14, 0, 35, 0 });          // OpMemberDecorate %14 0 Offset 0
+  op(72, { 14, 1, 35, 16 });         // OpMemberDecorate %14 1 Offset 16
+  op(21, { 2, 32, 0 });              // %2 = OpTypeInt 32 0
+  op(22, { 3, 32 });                 // %3 = OpTypeFloat 32
+  op(23, { 4, 3, 4 });               // %4 = OpTypeVector %3 4
+  op(29, { 5, 4 });                  // %5 = OpTypeRuntimeArray %4
+  op(30, { 6, 5 });                  // %6 = OpTypeStruct %5
+  op(32, { 7, 12, 6 });              // %7 = OpTypePointer StorageBuffer %6
+  op(59, { 7, 8, 12 });              // %8 = OpVariable %7 StorageBuffer
+  op(25, { 9, 3, 1, 0, 0, 0, 2, 4 }); // %9 = OpTypeImage %3 2D 0 0 0 2 Rgba8
+  op(43, { 2, 10, 3 });              // %10 = OpConstant %2 3
+  op(28, { 11, 9, 10 });             // %11 = OpTypeArray %9 %10
+  op(32, { 12, 0, 11 });             // %12 = OpTypePointer UniformConstant %11
+  op(59, { 12, 13, 0 });             // %13 = OpVariable %12 UniformConstant
+  op(30, { 14, 2, 4 });              // %14 = OpTypeStruct %2 %4
+  op(32, { 15, 9, 14 });             // %15 = OpTypePointer PushConstant %14
+  op(59, { 15, 16, 9 });             // %16 = OpVariable %15 PushConstant
+  op(5341, { 17 });                  // %17 = OpTypeAccelerationStructureKHR
+  op(32, { 18, 0, 17 });             // %18 = OpTypePointer UniformConstant %17
+  op(59, { 18, 19, 0 });             // %19 = OpVariable %18 UniformConstant
+
+  kr::SpirVReflection reflection;
+
+  SECTION(" Interface ")
+  {
+    REQUIRE(kr::ReflectSpirV(code, reflection));
+    REQUIRE(reflection.stage == VK_SHADER_STAGE_COMPUTE_BIT);
+    REQUIRE(reflection.localSize[0] == 8);
+    REQUIRE(reflection.localSize[1] == 4);
+    REQUIRE(reflection.localSize[2] == 1);
+    REQUIRE(reflection.pushConstantBytes == 32);
+
+    REQUIRE(reflection.bindings.size() == 3);
+    REQUIRE(reflection.NumSets() == 3);
+    const auto set0 = reflection.GetSetBindings(0);
+    REQUIRE(set0.size() == 2);
+    REQUIRE(set0[0].binding == 0);
+    REQUIRE(set0[0].descriptorType == VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR);
+    REQUIRE(set0[1].binding == 1);
+    REQUIRE(set0[1].descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    REQUIRE(set0[1].descriptorCount == 1);
+    REQUIRE(set0[1].stageFlags == VK_SHADER_STAGE_COMPUTE_BIT);
+    REQUIRE(reflection.GetSetBindings(1).empty());
+    const auto set2 = reflection.GetSetBindings(2);
+    REQUIRE(set2.size() == 1);
+    REQUIRE(set2[0].descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    REQUIRE(set2[0].descriptorCount == 3);
+  }
+
+  SECTION(" Workgroup size from specialization constants ")
+  {
+    code[3] = 25u;
+    op(71, { 20, 1, 0 });              // OpDecorate %20 SpecId 0
+    op(71, { 21, 1, 1 });              // OpDecorate %21 SpecId 1
+    op(71, { 23, 11, 25 });            // OpDecorate %23 BuiltIn WorkgroupSize
+    op(50, { 2, 20, 16 });             // %20 = OpSpecConstant %2 16
+    op(50, { 2, 21, 2 });              // %21 = OpSpecConstant %2 2
+    op(43, { 2, 22, 1 });              // %22 = OpConstant %2 1
+    op(23, { 24, 2, 3 });              // %24 = OpTypeVector %2 3
+    op(51, { 24, 23, 20, 21, 22 });    // %23 = OpSpecConstantComposite %24 %20 %21 %22
+
+    REQUIRE(kr::ReflectSpirV(code, reflection));
+    // The builtin overrides the execution mode:
+    REQUIRE(reflection.localSize[0] == 16);
+    REQUIRE(reflection.localSize[1] == 2);
+    REQUIRE(reflection.localSize[2] == 1);
+    REQUIRE(reflection.localSizeSpecIds[0] == kr::WORKGROUP_X_CONSTANT_ID);
+    REQUIRE(reflection.localSizeSpecIds[1] == kr::WORKGROUP_Y_CONSTANT_ID);
+    REQUIRE(reflection.localSizeSpecIds[2] == ~0u);
+
+    const kr::WorkgroupSpecialization specialization { kr::WorkgroupSize { 32, 4 } };
+    reflection.Specialize(*specialization.Get());
+    REQUIRE(reflection.localSize[0] == 32);
+    REQUIRE(reflection.localSize[1] == 4);
+    REQUIRE(reflection.localSize[2] == 1);
+  }
+
+  SECTION(" Bad code is rejected ")
+  {
+    code.push_back(4u << 16u | 59); // A word count running off the end.
+    REQUIRE(!kr::ReflectSpirV(code, reflection));
+    code[0] = 0;
+    REQUIRE(!kr::ReflectSpirV(code, reflection));
+  }
+}
+
+TEST_CASE("WorkgroupSizes", "[simple]")
+{
+  namespace kr = Krust;
+  namespace fs = std::filesystem;
+
+  const fs::path directory = fs::temp_directory_path() / "krust-test-workgroup-sizes";
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+  const uint8_t deviceUUID[VK_UUID_SIZE] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+  const uint8_t otherUUID[VK_UUID_SIZE] = { 16 };
+
+  kr::WorkgroupSize size;
+  REQUIRE(!kr::LoadWorkgroupSize(deviceUUID, directory.string(), "a.comp.spv", size));
+
+  REQUIRE(kr::SaveWorkgroupSize(deviceUUID, directory.string(), "a.comp.spv", { 16, 8 }));
+  REQUIRE(kr::SaveWorkgroupSize(deviceUUID, directory.string(), "b.comp.spv", { 64, 1 }));
+  // Saving again replaces the kernel's entry rather than adding another:
+  REQUIRE(kr::SaveWorkgroupSize(deviceUUID, directory.string(), "a.comp.spv", { 32, 4 }));
+  REQUIRE(!kr::SaveWorkgroupSize(deviceUUID, directory.string(), "has space", { 8, 8 }));
+
+  REQUIRE(kr::LoadWorkgroupSize(deviceUUID, directory.string(), "a.comp.spv", size));
+  REQUIRE((size == kr::WorkgroupSize { 32, 4 }));
+  REQUIRE(kr::LoadWorkgroupSize(deviceUUID, directory.string(), "b.comp.spv", size));
+  REQUIRE((size == kr::WorkgroupSize { 64, 1 }));
+  // Results are kept apart per GPU:
+  REQUIRE(!kr::LoadWorkgroupSize(otherUUID, directory.string(), "a.comp.spv", size));
+  REQUIRE(kr::WorkgroupSizesFilename(deviceUUID) != kr::WorkgroupSizesFilename(otherUUID));
+
+  REQUIRE(kr::NumWorkgroups(1920, 64) == 30);
+  REQUIRE(kr::NumWorkgroups(1080, 16) == 68);
+
+  // A device with only the minimum limits the spec requires:
+  VkPhysicalDeviceLimits limits {};
+  limits.maxComputeWorkGroupInvocations = 128;
+  limits.maxComputeWorkGroupSize[0] = 128;
+  limits.maxComputeWorkGroupSize[1] = 128;
+  limits.maxComputeWorkGroupSize[2] = 64;
+  REQUIRE(kr::WorkgroupSizeFits({ 16, 8 }, limits));
+  REQUIRE(!kr::WorkgroupSizeFits({ 16, 16 }, limits));
+  REQUIRE(!kr::WorkgroupSizeFits({ 256, 1 }, limits));
+  const std::vector<kr::WorkgroupSize> candidates = kr::WorkgroupSizeCandidates(limits);
+  REQUIRE(candidates.size() == std::size(kr::WORKGROUP_SIZE_CANDIDATES) - 1);
+  REQUIRE(std::find(candidates.begin(), candidates.end(), kr::WorkgroupSize { 16, 16 }) == candidates.end());
+  limits.maxComputeWorkGroupInvocations = 1024;
+  limits.maxComputeWorkGroupSize[1] = 8;
+  REQUIRE(kr::WorkgroupSizeFits({ 16, 8 }, limits));
+  REQUIRE(!kr::WorkgroupSizeFits({ 16, 16 }, limits));
+
+  fs::remove_all(directory);
+}
+
+#include "krust/public-api/trace.h"
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <thread>
+TEST_CASE("Trace", "[simple]")
+{
+  namespace kr = Krust;
+  namespace fs = std::filesystem;
+
+  const fs::path path = fs::temp_directory_path() / "krust-test-trace.json";
+  // Throw away the events of earlier tests with no file open to take them:
+  kr::FlushTrace();
+  const bool started = kr::StartTraceFile(path.string().c_str());
+#if defined(KRUST_BUILD_CONFIG_ENABLE_TRACING)
+  REQUIRE(started);
+  constexpr unsigned numEvents = 5000;
+  // One trace chunk's worth:
+  constexpr unsigned exactEvents = 4096;
+  {
+    KRUST_TRACE_SCOPE("outer");
+    // Enough events on another thread to fill more than one of its chunks:
+    std::thread other { []{
+      for(unsigned i = 0; i < numEvents; ++i)
+      {
+        KRUST_TRACE_SCOPE("\"quoted\"");
+      }
+    }};
+    other.join();
+    kr::FlushTrace();
+    // A thread that exits after a flush has freed its exactly-full chunk:
+    std::promise<void> flushed;
+    std::promise<void> filled;
+    std::thread exact { [&flushed, &filled]{
+      for(unsigned i = 0; i < exactEvents; ++i)
+      {
+        KRUST_TRACE_SCOPE("exact");
+      }
+      filled.set_value();
+      flushed.get_future().wait();
+    }};
+    filled.get_future().wait();
+    kr::FlushTrace();
+    flushed.set_value();
+    exact.join();
+    KRUST_TRACE_FUNCTION();
+  }
+  kr::StopTraceFile();
+
+  std::stringstream json;
+  json << std::ifstream { path }.rdbuf();
+  const std::string trace = json.str();
+  const auto count = [&trace](const std::string& needle)
+  {
+    size_t n = 0;
+    for(size_t at = trace.find(needle); at != std::string::npos; at = trace.find(needle, at + 1))
+    {
+      ++n;
+    }
+    return n;
+  };
+  REQUIRE(trace.front() == '[');
+  REQUIRE(trace.substr(trace.size() - 2) == "]\n");
+  REQUIRE(count("\"ph\":\"X\"") == numEvents + exactEvents + 2);
+  REQUIRE(count("{\"name\":\"exact\"") == exactEvents);
+  REQUIRE(count("{\"name\":\"\\\"quoted\\\"\"") == numEvents);
+  REQUIRE(count("{\"name\":\"outer\"") == 1);
+#else
+  // Compiled out:
+  REQUIRE(!started);
+  KRUST_TRACE_SCOPE("ignored");
+  kr::FlushTrace();
+  kr::StopTraceFile();
+#endif
+  fs::remove(path);
+}
+
+#include "krust/public-api/host-allocators.h"
+TEST_CASE("HostAllocators", "[simple]")
+{
+  namespace kr = Krust;
+
+  kr::TrackingAllocator tracking;
+  const VkAllocationCallbacks& tracked = *tracking.GetCallbacks();
+  void* const object = tracked.pfnAllocation(tracked.pUserData, 100, 64, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+  REQUIRE(object);
+  REQUIRE(uintptr_t(object) % 64 == 0);
+  memset(object, 7, 100);
+  void* const device = tracked.pfnAllocation(tracked.pUserData, 1000, 8, VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+  REQUIRE(device);
+  void* const grown = tracked.pfnReallocation(tracked.pUserData, object, 300, 64, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+  REQUIRE(grown);
+  REQUIRE(uintptr_t(grown) % 64 == 0);
+  REQUIRE(static_cast<uint8_t*>(grown)[99] == 7);
+  tracked.pfnInternalAllocation(tracked.pUserData, 4096, VK_INTERNAL_ALLOCATION_TYPE_EXECUTABLE, VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+
+  kr::HostAllocationStats stats = tracking.GetStats();
+  const kr::HostAllocationCounts& objectCounts = stats.scopes[VK_SYSTEM_ALLOCATION_SCOPE_OBJECT];
+  REQUIRE(objectCounts.allocations == 1u);
+  REQUIRE(objectCounts.reallocations == 1u);
+  REQUIRE(objectCounts.bytes == 300u);
+  REQUIRE(objectCounts.peakBytes == 400u);
+  REQUIRE(stats.scopes[VK_SYSTEM_ALLOCATION_SCOPE_DEVICE].bytes == 1000u);
+  REQUIRE(stats.total.bytes == 1300u);
+  REQUIRE(stats.total.peakBytes == 1400u);
+  REQUIRE(stats.internalBytes == 4096u);
+
+  tracked.pfnFree(tracked.pUserData, grown);
+  tracked.pfnFree(tracked.pUserData, device);
+  tracked.pfnFree(tracked.pUserData, nullptr);
+  tracked.pfnInternalFree(tracked.pUserData, 4096, VK_INTERNAL_ALLOCATION_TYPE_EXECUTABLE, VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+  stats = tracking.GetStats();
+  REQUIRE(stats.total.bytes == 0u);
+  REQUIRE(stats.total.frees == 2u);
+  REQUIRE(stats.total.peakBytes == 1400u);
+  REQUIRE(stats.internalBytes == 0u);
+  REQUIRE(stats.internalPeakBytes == 4096u);
+
+  // Command scoped blocks come from the arena and everything else goes on to
+  // the tracking allocator:
+  kr::ArenaAllocator arena(tracking.GetCallbacks(), 1024);
+  const VkAllocationCallbacks& arenaCallbacks = *arena.GetCallbacks();
+  void* const first = arenaCallbacks.pfnAllocation(arenaCallbacks.pUserData, 200, 16, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+  void* const second = arenaCallbacks.pfnAllocation(arenaCallbacks.pUserData, 200, 256, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+  REQUIRE(first);
+  REQUIRE(second);
+  REQUIRE(uintptr_t(second) % 256 == 0);
+  REQUIRE(static_cast<uint8_t*>(second) >= static_cast<uint8_t*>(first) + 200);
+  void* const other = arenaCallbacks.pfnAllocation(arenaCallbacks.pUserData, 50, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+  REQUIRE(other);
+  REQUIRE(tracking.GetStats().scopes[VK_SYSTEM_ALLOCATION_SCOPE_COMMAND].allocations == 0u);
+  REQUIRE(tracking.GetStats().scopes[VK_SYSTEM_ALLOCATION_SCOPE_OBJECT].allocations == 2u);
+
+  // Growing past the first chunk adds another:
+  memset(second, 9, 200);
+  void* const big = arenaCallbacks.pfnReallocation(arenaCallbacks.pUserData, second, 3000, 256, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+  REQUIRE(big);
+  REQUIRE(static_cast<uint8_t*>(big)[199] == 9);
+  const kr::ArenaAllocatorStats grownStats = arena.GetStats();
+  REQUIRE(grownStats.commandAllocations == 3u);
+  REQUIRE(grownStats.otherAllocations == 1u);
+  REQUIRE(grownStats.reservedBytes > 3000u);
+
+  // Once every command block is freed the arena starts again from one merged chunk:
+  arenaCallbacks.pfnFree(arenaCallbacks.pUserData, first);
+  arenaCallbacks.pfnFree(arenaCallbacks.pUserData, big);
+  void* const again = arenaCallbacks.pfnAllocation(arenaCallbacks.pUserData, 200, 16, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+  void* const againBig = arenaCallbacks.pfnAllocation(arenaCallbacks.pUserData, 3000, 16, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+  REQUIRE(again);
+  REQUIRE(againBig);
+  REQUIRE(arena.GetStats().reservedBytes == grownStats.reservedBytes);
+  arenaCallbacks.pfnFree(arenaCallbacks.pUserData, again);
+  arenaCallbacks.pfnFree(arenaCallbacks.pUserData, againBig);
+
+  // Each thread has its own arena:
+  void* fromThread = nullptr;
+  std::thread worker([&]()
+  {
+    fromThread = arenaCallbacks.pfnAllocation(arenaCallbacks.pUserData, 64, 8, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+  });
+  worker.join();
+  REQUIRE(fromThread);
+  REQUIRE(arena.GetStats().reservedBytes > grownStats.reservedBytes);
+  arenaCallbacks.pfnFree(arenaCallbacks.pUserData, fromThread);
+
+  arenaCallbacks.pfnFree(arenaCallbacks.pUserData, other);
+  REQUIRE(tracking.GetStats().total.bytes == 0u);
+}
+
+#include "krust/public-api/krust.h"
+#include "krust/public-api/submit-thread.h"
+#include "krust/public-api/thread-base.h"
+#include "krust/public-api/vulkan_struct_init.h"
+#include <future>
+TEST_CASE("SubmitThread", "[simple]")
+{
+  namespace kr = Krust;
+
+  // This one needs a Vulkan device so it passes with a warning on machines
+  // without a driver:
+  if(!kr::InitKrust())
+  {
+    WARN("No Vulkan loader so the SubmitThread was not tested.");
+    return;
+  }
+  kr::ThreadBase threadBase { kr::GetGlobalErrorPolicy() };
+  const auto appInfo = kr::ApplicationInfo("krust-test-simple", 1, "Krust", 0, VK_API_VERSION_1_2);
+  const auto instanceInfo = kr::InstanceCreateInfo(0, &appInfo, 0, nullptr, 0, nullptr);
+  kr::InstancePtr instance;
+  try
+  {
+    instance = kr::Instance::New(instanceInfo);
+  }
+  catch(kr::KrustException&) {}
+  if(!instance.Get() || *instance == VK_NULL_HANDLE)
+  {
+    WARN("No Vulkan instance so the SubmitThread was not tested.");
+    return;
+  }
+  volkLoadInstance(*instance);
+  uint32_t numGpus = 1;
+  VkPhysicalDevice gpu = VK_NULL_HANDLE;
+  vkEnumeratePhysicalDevices(*instance, &numGpus, &gpu);
+  if(gpu == VK_NULL_HANDLE)
+  {
+    WARN("No Vulkan device so the SubmitThread was not tested.");
+    return;
+  }
+
+  auto timelineFeatures = kr::PhysicalDeviceTimelineSemaphoreFeatures(VK_FALSE);
+  auto features = kr::PhysicalDeviceFeatures2();
+  features.pNext = &timelineFeatures;
+  vkGetPhysicalDeviceFeatures2(gpu, &features);
+  const float priority = 1.0f;
+  // Every queue family can take a submit with no command buffers in it:
+  const auto queueInfo = kr::DeviceQueueCreateInfo(0, 0, 1, &priority);
+  auto deviceInfo = kr::DeviceCreateInfo(0, 1, &queueInfo, 0, nullptr, 0, nullptr, nullptr);
+  deviceInfo.pNext = &timelineFeatures;
+  kr::DevicePtr device = kr::Device::New(*instance, gpu, deviceInfo);
+  volkLoadDevice(*device);
+
+  std::vector<kr::CompletionTracking> trackings { kr::CompletionTracking::Fences };
+  if(timelineFeatures.timelineSemaphore)
+  {
+    trackings.push_back(kr::CompletionTracking::TimelineSemaphore);
+  }
+  for(const kr::CompletionTracking tracking : trackings)
+  {
+    kr::QueueJanitorPtr janitor = kr::QueueJanitor::New(*device, 0, 0, tracking);
+    REQUIRE(janitor.Get());
+    kr::SubmitCounter last = 0;
+    {
+      kr::SubmitThreadPtr submitThread = kr::SubmitThread::New(*janitor);
+      constexpr unsigned NUM_PRODUCERS = 4;
+      constexpr unsigned SUBMITS_PER_PRODUCER = 16;
+      std::vector<std::future<kr::SubmitResult>> futures[NUM_PRODUCERS];
+      std::vector<std::thread> producers;
+      for(unsigned p = 0; p < NUM_PRODUCERS; ++p)
+      {
+        producers.emplace_back([&submitThread, &results = futures[p]]()
+        {
+          for(unsigned i = 0; i < SUBMITS_PER_PRODUCER; ++i)
+          {
+            results.push_back(submitThread->Submit(kr::OwnedQueueSubmit {}));
+          }
+        });
+      }
+      for(std::thread& producer : producers)
+      {
+        producer.join();
+      }
+      for(auto& results : futures)
+      {
+        for(std::future<kr::SubmitResult>& future : results)
+        {
+          const kr::SubmitResult result = future.get();
+          REQUIRE(result.result() == VK_SUCCESS);
+          last = std::max(last, result.counter());
+        }
+      }
+      REQUIRE(last > 0u);
+      // Destroying it here drains the queue.
+    }
+    REQUIRE(janitor->GetHighestCompletion() >= last);
+
+    if(tracking == kr::CompletionTracking::TimelineSemaphore)
+    {
+      // Timeline values for signals the submit doesn't have are rejected
+      // without using up a counter the timeline would never reach:
+      const uint64_t value = 1;
+      const auto callers = kr::TimelineSemaphoreSubmitInfo(0, nullptr, 1, &value);
+      kr::QueueSubmitInfo submit { {}, {}, {} };
+      submit.pNext = &callers;
+      const kr::SubmitCounter before = janitor->GetLastSubmit();
+      try
+      {
+        REQUIRE(janitor->Submit(submit).result() != VK_SUCCESS);
+      }
+      catch(kr::KrustException&) {}
+      REQUIRE(janitor->GetLastSubmit() == before);
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef KRUST_INTERNAL_FNV_HASH_H_INCLUDED_E26EF
+#define KRUST_INTERNAL_FNV_HASH_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * @file The FNV-1a hash used for cache keys and to check files for damage.
+ */
+
+// External includes:
+#include <cstddef>
+#include <cstdint>
+
+namespace Krust {
+namespace Internal {
+
+constexpr uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+constexpr uint64_t FNV1A_PRIME = 1099511628211ull;
+
+/// @return The hash of the bytes, continuing from a hash of earlier ones.
+inline uint64_t Fnv1aBytes(const void* const bytes, const size_t size, uint64_t hash = FNV1A_OFFSET_BASIS)
+{
+  const uint8_t* const data = static_cast<const uint8_t*>(bytes);
+  for(size_t i = 0; i < size; ++i)
+  {
+    hash = (hash ^ data[i]) * FNV1A_PRIME;
+  }
+  return hash;
+}
+
+/**
+ * @return The hash of the words, mixing in a whole word per step.
+ * This is cheaper than hashing their bytes and as good for in-memory keys, but
+ * gives different values so don't use it for anything stored.
+ */
+inline uint64_t Fnv1aWords(const uint64_t* const words, const size_t count, uint64_t hash = FNV1A_OFFSET_BASIS)
+{
+  for(size_t i = 0; i < count; ++i)
+  {
+    hash = (hash ^ words[i]) * FNV1A_PRIME;
+  }
+  return hash;
+}
+
+} /* namespace Internal */
+} /* namespace Krust */
+
+#endif /* KRUST_INTERNAL_FNV_HASH_H_INCLUDED_E26EF */
@@ -20,19 +20,184 @@
 
 #include "keep-alive-set.h"
 
+// External includes:
+#include <algorithm>
+
+namespace
+{
+  /// Multiply by 2^64 / golden ratio to spread the bits of aligned addresses
+  /// across the top of the word (Fibonacci hashing).
+  constexpr uint64_t FIBONACCI_MULTIPLIER = 11400714819323198485ull;
+
+  /// Slots in the table first allocated when the inline storage overflows.
+  /// The table is kept at most half full so probe sequences stay short.
+  constexpr size_t MIN_TABLE_CAPACITY = 64;
+
+  inline size_t Slot(const Krust::RefObject* obj, const unsigned shift)
+  {
+    return size_t((uint64_t(reinterpret_cast<uintptr_t>(obj)) * FIBONACCI_MULTIPLIER) >> shift);
+  }
+}
+
+Krust::KeepAliveSet::~KeepAliveSet()
+{
+  Clear();
+  delete[] mTable;
+}
+
+Krust::KeepAliveSet::KeepAliveSet(KeepAliveSet&& other) noexcept :
+  mTable(other.mTable),
+  mCapacity(other.mCapacity),
+  mShift(other.mShift),
+  mSize(other.mSize)
+{
+  if(!mTable)
+  {
+    std::copy(other.mInline, other.mInline + other.mSize, mInline);
+  }
+  other.mTable = nullptr;
+  other.mCapacity = 0;
+  other.mShift = 64;
+  other.mSize = 0;
+}
+
+Krust::KeepAliveSet& Krust::KeepAliveSet::operator=(KeepAliveSet&& other) noexcept
+{
+  if(this != &other)
+  {
+    Clear();
+    delete[] mTable;
+    mTable = other.mTable;
+    mCapacity = other.mCapacity;
+    mShift = other.mShift;
+    mSize = other.mSize;
+    if(!mTable)
+    {
+      std::copy(other.mInline, other.mInline + other.mSize, mInline);
+    }
+    other.mTable = nullptr;
+    other.mCapacity = 0;
+    other.mShift = 64;
+    other.mSize = 0;
+  }
+  return *this;
+}
+
 void Krust::KeepAliveSet::Add(const RefObject & obj)
 {
-  // Check the existing set for a duplicate and add obj only if there isn't one:
-  RefObject& obj_alias = const_cast<RefObject&>(obj);
-  const bool found = mKeepAlives.end() != std::find_if(mKeepAlives.begin(), mKeepAlives.end(),
-    [&obj_alias](RefObjectPtr& other) { return &obj_alias == other.Get(); });
-  if (!found)
+  if(!mTable)
   {
-    mKeepAlives.push_back(RefObjectPtr(obj_alias));
+    // Check the inline set for a duplicate and add obj only if there isn't one:
+    for(size_t i = 0; i < mSize; ++i)
+    {
+      if(mInline[i] == &obj)
+      {
+        return;
+      }
+    }
+    if(mSize < INLINE_CAPACITY)
+    {
+      obj.Inc();
+      mInline[mSize++] = &obj;
+      return;
+    }
+    Rehash(MIN_TABLE_CAPACITY);
+  }
+  else if((mSize + 1) * 2 > mCapacity)
+  {
+    Rehash(mCapacity * 2);
+  }
+  if(TableInsert(&obj))
+  {
+    obj.Inc();
+    ++mSize;
   }
 }
 
+void Krust::KeepAliveSet::Reserve(const size_t capacity)
+{
+  if(capacity <= INLINE_CAPACITY || capacity * 2 <= mCapacity)
+  {
+    return;
+  }
+  size_t slots = mCapacity ? mCapacity : MIN_TABLE_CAPACITY;
+  while(slots < capacity * 2)
+  {
+    slots *= 2;
+  }
+  Rehash(slots);
+}
+
 void Krust::KeepAliveSet::Clear()
 {
-  mKeepAlives.clear();
-}
\ No newline at end of file
+  if(mTable)
+  {
+    for(size_t i = 0; i < mCapacity; ++i)
+    {
+      if(const RefObject* obj = mTable[i])
+      {
+        mTable[i] = nullptr;
+        obj->Dec();
+      }
+    }
+  }
+  else
+  {
+    for(size_t i = 0; i < mSize; ++i)
+    {
+      mInline[i]->Dec();
+    }
+  }
+  mSize = 0;
+}
+
+bool Krust::KeepAliveSet::TableInsert(const RefObject* obj)
+{
+  const size_t mask = mCapacity - 1;
+  for(size_t slot = Slot(obj, mShift);; slot = (slot + 1) & mask)
+  {
+    const RefObject* occupant = mTable[slot];
+    if(occupant == nullptr)
+    {
+      mTable[slot] = obj;
+      return true;
+    }
+    if(occupant == obj)
+    {
+      return false;
+    }
+  }
+}
+
+void Krust::KeepAliveSet::Rehash(const size_t capacity)
+{
+  const RefObject** const oldTable = mTable;
+  const size_t oldCapacity = mCapacity;
+
+  mTable = new const RefObject*[capacity]();
+  mCapacity = capacity;
+  mShift = 64;
+  for(size_t slots = capacity; slots > 1; slots >>= 1)
+  {
+    --mShift;
+  }
+
+  if(oldTable)
+  {
+    for(size_t i = 0; i < oldCapacity; ++i)
+    {
+      if(oldTable[i])
+      {
+        TableInsert(oldTable[i]);
+      }
+    }
+    delete[] oldTable;
+  }
+  else
+  {
+    for(size_t i = 0; i < mSize; ++i)
+    {
+      TableInsert(mInline[i]);
+    }
+  }
+}
@@ -23,10 +23,11 @@
 
 // Internal includes:
 #include "krust/public-api/intrusive-pointer.h"
+#include "krust/public-api/object-pool.h"
+#include "krust-kernel/public-api/span.h"
 
 // External includes:
-#include <vector>
-#include <algorithm>
+#include <cstdint>
 
 namespace Krust {
 
@@ -35,29 +36,79 @@ using RefObjectPtr = IntrusivePointer<RefObject>;
 /**
  * @brief A set of reference counted objects that are kept alive as long as the
  * set is.
+ *
+ * The first few objects are held in storage inline in the set, which is
+ * searched linearly. Beyond that they move to an open-addressing hash table
+ * keyed on their addresses so adding stays constant time however many objects
+ * a command buffer or submit uses.
  */
-class KeepAliveSet
+class KeepAliveSet : public PooledObject
 {
 public:
   KeepAliveSet(){}
+  ~KeepAliveSet();
+  KeepAliveSet(KeepAliveSet&& other) noexcept;
+  KeepAliveSet& operator=(KeepAliveSet&& other) noexcept;
 
   /**
    * @return Number of objects being kept alive.
    */
-  size_t Size() const { return mKeepAlives.size(); } 
+  size_t Size() const { return mSize; }
 
   /**
    * @brief Hold a reference to the object passed in and thereby keep it alive.
    */
   void Add(const RefObject& obj);
 
+  /**
+   * @brief Add every non-null object in a span of raw or smart pointers.
+   */
+  template<class Pointer, size_t Extent>
+  void AddAll(span<Pointer, Extent> objects)
+  {
+    Reserve(mSize + objects.size());
+    for(const auto& object : objects)
+    {
+      if(!object)
+      {
+        continue;
+      }
+      Add(*object);
+    }
+  }
+
+  /**
+   * @brief Make room for the given number of objects in total.
+   */
+  void Reserve(size_t capacity);
+
   /**
    * @brief Allow anything being kept alive to die if no other reference is held to it.
+   * Any storage allocated is kept for reuse.
    */
   void Clear();
 
 private:
-  std::vector<RefObjectPtr> mKeepAlives;
+  // Ban copying:
+  KeepAliveSet(const KeepAliveSet&) = delete;
+  KeepAliveSet& operator=(const KeepAliveSet&) = delete;
+
+  /// Insert into the table, which must have room, without touching the count.
+  bool TableInsert(const RefObject* obj);
+  /// Move everything into a table with the given power of two number of slots.
+  void Rehash(size_t capacity);
+
+  static constexpr size_t INLINE_CAPACITY = 14;
+
+  /// The objects while there are few enough of them and no table, else unused.
+  const RefObject* mInline[INLINE_CAPACITY];
+  /// Open-addressed table of objects, with empty slots null.
+  const RefObject** mTable = nullptr;
+  /// Number of slots in mTable: a power of two.
+  size_t mCapacity = 0;
+  /// Shift which maps a 64 bit hash into the range of mTable slots.
+  unsigned mShift = 64;
+  size_t mSize = 0;
 };
 
 } /* namespace Krust */
@@ -0,0 +1,140 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compilation unit header:
+#include "krust/internal/kernel-set-cache.h"
+
+// Internal includes:
+#include "krust/internal/fnv-hash.h"
+#include "krust/public-api/krust-assertions.h"
+
+// External includes:
+#include <cstring>
+
+namespace Krust {
+namespace Internal {
+
+namespace
+{
+
+/// Non-dispatchable handles are pointers on 64 bit targets and integers on 32.
+template<class Handle>
+uint64_t HandleWord(const Handle handle)
+{
+  static_assert(sizeof(Handle) <= sizeof(uint64_t), "Handles fit in a word.");
+  uint64_t word = 0;
+  memcpy(&word, &handle, sizeof(handle));
+  return word;
+}
+
+}
+
+KernelSetCache::KernelSetCache(const uint32_t setsPerPool, const uint32_t maxPools) :
+  mSetsPerPool(setsPerPool),
+  mMaxPools(maxPools)
+{
+  KRUST_ASSERT1(setsPerPool > 0 && maxPools > 0, "Need room for at least one set.");
+}
+
+void KernelSetCache::AppendKey(const VkDescriptorType type, const KernelResource& resource, Key& key)
+{
+  switch(type)
+  {
+    case VK_DESCRIPTOR_TYPE_SAMPLER:
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+    case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+      key.push_back(HandleWord(resource.image.sampler));
+      key.push_back(HandleWord(resource.image.imageView));
+      key.push_back(uint64_t(resource.image.imageLayout));
+      break;
+    case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+    case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+      key.push_back(HandleWord(resource.texelBuffer));
+      break;
+    case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+      key.push_back(HandleWord(resource.accelerationStructure));
+      break;
+    default:
+      key.push_back(HandleWord(resource.buffer.buffer));
+      key.push_back(resource.buffer.offset);
+      key.push_back(resource.buffer.range);
+      break;
+  }
+}
+
+size_t KernelSetCache::KeyHash::operator()(const Key& key) const
+{
+  return size_t(Fnv1aWords(key.data(), key.size()));
+}
+
+VkDescriptorSet KernelSetCache::Find(const Key& key, uint32_t& pool) const
+{
+  const auto found = mSets.find(key);
+  if(found == mSets.end())
+  {
+    return VK_NULL_HANDLE;
+  }
+  pool = found->second.pool;
+  return found->second.set;
+}
+
+KernelSetCache::Slot KernelSetCache::Reserve()
+{
+  Slot slot { mPool, false };
+  if(mSetsInPool == mSetsPerPool)
+  {
+    mPool = (mPool + 1) % mMaxPools;
+    mSetsInPool = 0;
+    slot.pool = mPool;
+    for(auto it = mSets.begin(); it != mSets.end();)
+    {
+      if(it->second.pool == mPool)
+      {
+        it = mSets.erase(it);
+        slot.evicted = true;
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+  return slot;
+}
+
+uint32_t KernelSetCache::Insert(const Key& key, const VkDescriptorSet set)
+{
+  KRUST_ASSERT1(mSetsInPool < mSetsPerPool, "Reserve() before inserting.");
+  mSets[key] = Entry { set, mPool };
+  ++mSetsInPool;
+  return mPool;
+}
+
+void KernelSetCache::Clear()
+{
+  mSets.clear();
+  mPool = 0;
+  mSetsInPool = 0;
+}
+
+} /* namespace Internal */
+} /* namespace Krust */
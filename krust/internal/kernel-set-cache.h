@@ -0,0 +1,110 @@
+#ifndef KRUST_INTERNAL_KERNEL_SET_CACHE_H_INCLUDED_E26EF
+#define KRUST_INTERNAL_KERNEL_SET_CACHE_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Internal includes:
+#include "krust/public-api/compute-kernel.h"
+
+// External includes:
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Krust {
+namespace Internal {
+
+/**
+ * @brief The descriptor sets a ComputeKernel has written, keyed by the
+ * resources written into them, and which of a bounded ring of pools each came
+ * from.
+ *
+ * Pools are filled in order. Once all of them have been filled, making room
+ * for another set forgets every set of the oldest pool, which the kernel then
+ * replaces with a fresh pool rather than resetting it, as the GPU may still be
+ * using its sets.
+ */
+class KernelSetCache
+{
+public:
+  using Key = std::vector<uint64_t>;
+
+  /// Where the next set is to be allocated from.
+  struct Slot
+  {
+    uint32_t pool;
+    /// True if sets of the pool were forgotten to make room, so it must be
+    /// replaced before allocating from it.
+    bool evicted;
+  };
+
+  KernelSetCache(uint32_t setsPerPool, uint32_t maxPools);
+
+  /**
+   * Append the words which identify a resource bound as a descriptor of the
+   * given type, taken from its fields rather than its bytes so that unused
+   * members and padding don't matter.
+   */
+  static void AppendKey(VkDescriptorType type, const KernelResource& resource, Key& key);
+
+  /**
+   * @param[out] pool The pool the set came from, if found.
+   * @return The set cached for the key, or VK_NULL_HANDLE.
+   */
+  VkDescriptorSet Find(const Key& key, uint32_t& pool) const;
+  /**
+   * Make room for one more set, evicting the sets of the oldest pool if all
+   * are full. Call Insert() if allocating from the slot works.
+   */
+  Slot Reserve();
+  /**
+   * Cache a set allocated from the pool last returned by Reserve().
+   * @return That pool.
+   */
+  uint32_t Insert(const Key& key, VkDescriptorSet set);
+  /// Forget every set, e.g. after all pools have been reset.
+  void Clear();
+
+  size_t Size() const { return mSets.size(); }
+
+private:
+  struct KeyHash
+  {
+    size_t operator()(const Key& key) const;
+  };
+  struct Entry
+  {
+    VkDescriptorSet set;
+    uint32_t pool;
+  };
+
+  std::unordered_map<Key, Entry, KeyHash> mSets;
+  uint32_t mSetsPerPool;
+  uint32_t mMaxPools;
+  /// The pool sets are being allocated from.
+  uint32_t mPool = 0;
+  uint32_t mSetsInPool = 0;
+};
+
+} /* namespace Internal */
+} /* namespace Krust */
+
+#endif /* KRUST_INTERNAL_KERNEL_SET_CACHE_H_INCLUDED_E26EF */
@@ -0,0 +1,107 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Compilation unit header:
+#include "krust/internal/pipeline-cache-format.h"
+
+// Internal includes:
+#include "krust/internal/fnv-hash.h"
+
+// External includes:
+#include <cstring>
+
+namespace Krust {
+namespace Internal {
+
+static_assert(sizeof(PipelineCacheFileHeader) == 56u, "The file header has padding in it.");
+
+std::vector<uint8_t> EncodePipelineCacheFile(const VkPhysicalDeviceProperties& properties, const std::vector<uint8_t>& data)
+{
+  PipelineCacheFileHeader header;
+  header.magic = PipelineCacheFileHeader::MAGIC;
+  header.version = PipelineCacheFileHeader::VERSION;
+  header.vendorID = properties.vendorID;
+  header.deviceID = properties.deviceID;
+  header.driverVersion = properties.driverVersion;
+  memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+  header.reserved = 0;
+  header.dataSize = data.size();
+  header.dataHash = Fnv1aBytes(data.data(), data.size());
+
+  std::vector<uint8_t> file(sizeof(header) + data.size());
+  memcpy(file.data(), &header, sizeof(header));
+  if(!data.empty())
+  {
+    memcpy(file.data() + sizeof(header), data.data(), data.size());
+  }
+  return file;
+}
+
+const char* DecodePipelineCacheFile(const VkPhysicalDeviceProperties& properties, const uint8_t* const file, const size_t fileSize, const uint8_t*& data, size_t& dataSize)
+{
+  PipelineCacheFileHeader header;
+  if(fileSize < sizeof(header))
+  {
+    return "File too small for its header.";
+  }
+  memcpy(&header, file, sizeof(header));
+  if(header.magic != PipelineCacheFileHeader::MAGIC || header.version != PipelineCacheFileHeader::VERSION)
+  {
+    return "Not a pipeline cache file of the current version.";
+  }
+  if(header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+     header.driverVersion != properties.driverVersion ||
+     memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+  {
+    return "Written for a different device or driver.";
+  }
+  if(header.dataSize != fileSize - sizeof(header))
+  {
+    return "Truncated or has trailing bytes.";
+  }
+  const uint8_t* const cacheData = file + sizeof(header);
+  if(header.dataHash != Fnv1aBytes(cacheData, size_t(header.dataSize)))
+  {
+    return "Data is corrupt.";
+  }
+
+  // Check Vulkan's own header at the start of the data agrees:
+  VkPipelineCacheHeaderVersionOne vkHeader;
+  if(header.dataSize < sizeof(vkHeader))
+  {
+    return "Data too small for a Vulkan pipeline cache header.";
+  }
+  memcpy(&vkHeader, cacheData, sizeof(vkHeader));
+  if(vkHeader.headerSize < sizeof(vkHeader) || vkHeader.headerSize > header.dataSize ||
+     vkHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+     vkHeader.vendorID != properties.vendorID || vkHeader.deviceID != properties.deviceID ||
+     memcmp(vkHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+  {
+    return "Vulkan pipeline cache header doesn't match the device.";
+  }
+
+  data = cacheData;
+  dataSize = size_t(header.dataSize);
+  return nullptr;
+}
+
+} /* namespace Internal */
+} /* namespace Krust */
@@ -0,0 +1,76 @@
+#ifndef KRUST_INTERNAL_PIPELINE_CACHE_FORMAT_H_INCLUDED_E26EF
+#define KRUST_INTERNAL_PIPELINE_CACHE_FORMAT_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Internal includes:
+#include "krust/public-api/vulkan_types_and_macros.h"
+
+// External includes:
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Krust {
+namespace Internal {
+
+/**
+ * @brief The header Krust writes before the data of a pipeline cache in a file.
+ *
+ * Vulkan's own header in the data identifies the device but not the driver
+ * version, and nothing in it shows the data was cut short or damaged on disk,
+ * which some drivers don't cope well with being handed.
+ */
+struct PipelineCacheFileHeader
+{
+  static constexpr uint32_t MAGIC = 0x4350524bu; // "KRPC" little-endian.
+  static constexpr uint32_t VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+  /// Zero. Keeps the 64 bit fields aligned without hidden padding.
+  uint32_t reserved;
+  uint64_t dataSize;
+  /// FNV-1a hash of the dataSize bytes following the header.
+  uint64_t dataHash;
+};
+
+/// @return The file contents for the data of a cache for the device.
+std::vector<uint8_t> EncodePipelineCacheFile(const VkPhysicalDeviceProperties& properties, const std::vector<uint8_t>& data);
+
+/**
+ * Check the contents of a file written by EncodePipelineCacheFile() belong to
+ * the device and are intact.
+ * @param[out] data Set to the start of the cache data in the file on success.
+ * @param[out] dataSize Set to the size of the cache data on success.
+ * @return Null on success, else a description of the first check to fail.
+ */
+const char* DecodePipelineCacheFile(const VkPhysicalDeviceProperties& properties, const uint8_t* file, size_t fileSize, const uint8_t*& data, size_t& dataSize);
+
+} /* namespace Internal */
+} /* namespace Krust */
+
+#endif /* KRUST_INTERNAL_PIPELINE_CACHE_FORMAT_H_INCLUDED_E26EF */
@@ -0,0 +1,90 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Compilation unit header:
+#include "krust/internal/replace-file.h"
+
+// Internal includes:
+#include "krust/public-api/logging.h"
+
+// External includes:
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+
+namespace Krust {
+namespace Internal {
+
+namespace
+{
+
+/// @return A suffix for a temporary file which no other writer will pick.
+std::string UniqueSuffix()
+{
+  // Mix a random seed with the time and thread so it stays unique even where
+  // std::random_device is deterministic:
+  std::random_device random;
+  uint64_t bits = (uint64_t(random()) << 32u) ^ uint64_t(random());
+  bits ^= uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+  bits ^= uint64_t(std::hash<std::thread::id>{}(std::this_thread::get_id())) * 0x9E3779B97F4A7C15ull;
+  char suffix[24];
+  snprintf(suffix, sizeof(suffix), ".%016llx.tmp", static_cast<unsigned long long>(bits));
+  return suffix;
+}
+
+}
+
+bool ReplaceFile(const std::filesystem::path& path, const void* const data, const size_t size, const char* const description)
+{
+  auto tempPath = path;
+  tempPath += UniqueSuffix();
+  {
+    std::ofstream os{tempPath, std::ios::binary | std::ios::trunc};
+    os.write(static_cast<const char*>(data), std::streamsize(size));
+    os.close();
+    if(!os)
+    {
+      KRUST_LOG_WARN << "Failed to write " << description << " to \"" << tempPath.string() << "\"." << endlog;
+      std::error_code ignored;
+      std::filesystem::remove(tempPath, ignored);
+      return false;
+    }
+  }
+  // Replaces any existing file in one step:
+  std::error_code error;
+  std::filesystem::rename(tempPath, path, error);
+  if(error)
+  {
+    KRUST_LOG_WARN << "Failed to move " << description << " into place at \"" << path.string() << "\": " << error.message() << endlog;
+    std::filesystem::remove(tempPath, error);
+    return false;
+  }
+  return true;
+}
+
+} /* namespace Internal */
+} /* namespace Krust */
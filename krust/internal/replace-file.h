@@ -0,0 +1,52 @@
+#ifndef KRUST_INTERNAL_REPLACE_FILE_H_INCLUDED_E26EF
+#define KRUST_INTERNAL_REPLACE_FILE_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * @file Writing a file so that readers only ever see the old or the new one.
+ */
+
+// External includes:
+#include <cstddef>
+#include <filesystem>
+
+namespace Krust {
+namespace Internal {
+
+/**
+ * Replace the contents of a file in one step.
+ *
+ * The data is written to a temporary file next to the destination, named
+ * uniquely to this call so concurrent writers, in this process or others,
+ * never share one, and is then renamed over the destination. A crash or a
+ * concurrent write never leaves a partly-written file, though when two
+ * writers race the last rename wins.
+ * Failures are logged as warnings naming what was being written.
+ * @param description What the file holds, e.g. "pipeline cache".
+ * @return True if the file was replaced.
+ */
+bool ReplaceFile(const std::filesystem::path& path, const void* data, size_t size, const char* description);
+
+} /* namespace Internal */
+} /* namespace Krust */
+
+#endif /* KRUST_INTERNAL_REPLACE_FILE_H_INCLUDED_E26EF */
@@ -0,0 +1,160 @@
+#ifndef KRUST_INTERNAL_RETIRE_LIST_H_INCLUDED_E26EF
+#define KRUST_INTERNAL_RETIRE_LIST_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// External includes:
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Krust
+{
+
+class VulkanObject;
+
+namespace Internal
+{
+
+/**
+ * @brief A lock-free list of objects whose last reference has been dropped but
+ * which may still be in use by work submitted to the GPU.
+ *
+ * Each object is stamped with an epoch when it is pushed, being the counter of
+ * the latest submit which could have used it, and is destroyed in bulk by
+ * Reap() once that submit is known to have completed.
+ * The list is threaded through the objects themselves so that retiring one
+ * never allocates. T must provide members `mutable const T* mNextRetired` and
+ * `mutable uint64_t mRetireEpoch` and must be deletable through a `const T*`.
+ *
+ * Push() and Reap() can be called from any thread concurrently.
+ */
+template<class T>
+class RetireList
+{
+public:
+  RetireList() {}
+  ~RetireList() { Reap(UINT64_MAX); }
+
+  /**
+   * Set the epoch stamped on objects pushed from now on.
+   * Call before each submit to the GPU with that submit's counter.
+   */
+  void SetEpoch(const uint64_t epoch) { mEpoch.store(epoch, std::memory_order_release); }
+  uint64_t GetEpoch() const { return mEpoch.load(std::memory_order_acquire); }
+
+  /**
+   * Take ownership of an object which nothing else references any more.
+   */
+  void Push(const T& object)
+  {
+    object.mRetireEpoch = mEpoch.load(std::memory_order_acquire);
+    mPending.fetch_add(1, std::memory_order_relaxed);
+    PushChain(&object, &object);
+  }
+
+  /**
+   * Destroy every object whose epoch is at or below the completed one.
+   * Objects retired as a side effect of destroying others, such as a pool
+   * losing its last reference when its final buffer is destroyed, are reaped
+   * in the same call if their epoch allows it.
+   * @return The number of objects destroyed.
+   */
+  size_t Reap(const uint64_t completed)
+  {
+    size_t destroyed = 0;
+    for(;;)
+    {
+      const T* object = mHead.exchange(nullptr, std::memory_order_acquire);
+      if(object == nullptr)
+      {
+        break;
+      }
+      const T* keepHead = nullptr;
+      const T* keepTail = nullptr;
+      size_t pass = 0;
+      while(object)
+      {
+        const T* next = object->mNextRetired;
+        if(object->mRetireEpoch <= completed)
+        {
+          delete object;
+          ++pass;
+        }
+        else
+        {
+          object->mNextRetired = keepHead;
+          keepHead = object;
+          if(keepTail == nullptr)
+          {
+            keepTail = object;
+          }
+        }
+        object = next;
+      }
+      if(keepHead)
+      {
+        PushChain(keepHead, keepTail);
+      }
+      destroyed += pass;
+      if(pass == 0)
+      {
+        break;
+      }
+    }
+    mPending.fetch_sub(destroyed, std::memory_order_relaxed);
+    return destroyed;
+  }
+
+  /**
+   * @return The number of objects awaiting destruction.
+   */
+  size_t Pending() const { return mPending.load(std::memory_order_relaxed); }
+
+private:
+  // Ban copying:
+  RetireList(const RetireList&) = delete;
+  RetireList& operator=(const RetireList&) = delete;
+
+  void PushChain(const T* head, const T* tail)
+  {
+    tail->mNextRetired = mHead.load(std::memory_order_relaxed);
+    while(!mHead.compare_exchange_weak(tail->mNextRetired, head, std::memory_order_release, std::memory_order_relaxed))
+    {}
+  }
+
+  std::atomic<const T*> mHead { nullptr };
+  std::atomic<uint64_t> mEpoch { 0 };
+  std::atomic<size_t> mPending { 0 };
+};
+
+/**
+ * The list that VulkanObjects are retired to when their last reference is
+ * dropped, or null to destroy them immediately.
+ * Installed by QueueJanitor::EnableDeferredDestruction(). There is one per
+ * process since the objects pushed don't know which janitor's queue used them.
+ */
+extern std::atomic<RetireList<VulkanObject>*> sRetireList;
+
+} /* namespace Internal */
+} /* namespace Krust */
+
+#endif /* KRUST_INTERNAL_RETIRE_LIST_H_INCLUDED_E26EF */
@@ -0,0 +1,81 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compilation unit header:
+#include "krust/internal/transient-placement.h"
+
+// External includes:
+#include <algorithm>
+#include <vector>
+
+namespace Krust {
+namespace Internal {
+
+uint64_t PlaceTransients(span<TransientRange> ranges)
+{
+  std::vector<uint32_t> order(ranges.size());
+  for(uint32_t i = 0; i < order.size(); ++i)
+  {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&ranges](uint32_t a, uint32_t b) {
+    return ranges[a].size > ranges[b].size;
+  });
+
+  uint64_t total = 0;
+  std::vector<const TransientRange*> live;
+  for(size_t placed = 0; placed < order.size(); ++placed)
+  {
+    TransientRange& range = ranges[order[placed]];
+
+    // The blocks already placed which are in use at the same time as this one,
+    // in address order:
+    live.clear();
+    for(size_t i = 0; i < placed; ++i)
+    {
+      const TransientRange& other = ranges[order[i]];
+      if(LifetimesOverlap(range, other))
+      {
+        live.push_back(&other);
+      }
+    }
+    std::sort(live.begin(), live.end(), [](const TransientRange* a, const TransientRange* b) {
+      return a->offset < b->offset;
+    });
+
+    // First fit into the gaps between them:
+    const uint64_t mask = range.alignment - 1;
+    uint64_t offset = 0;
+    for(const TransientRange* other : live)
+    {
+      if(offset + range.size <= other->offset)
+      {
+        break;
+      }
+      offset = std::max(offset, (other->offset + other->size + mask) & ~mask);
+    }
+    range.offset = offset;
+    total = std::max(total, offset + range.size);
+  }
+  return total;
+}
+
+} /* namespace Internal */
+} /* namespace Krust */
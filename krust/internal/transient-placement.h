@@ -0,0 +1,73 @@
+#ifndef KRUST_INTERNAL_TRANSIENT_PLACEMENT_H_INCLUDED_E26EF
+#define KRUST_INTERNAL_TRANSIENT_PLACEMENT_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Internal includes:
+#include "krust-kernel/public-api/span.h"
+
+// External includes:
+#include <cstdint>
+
+namespace Krust {
+namespace Internal {
+
+/**
+ * @brief A block of memory a transient resource needs from the first to the
+ * last pass that uses it.
+ */
+struct TransientRange
+{
+  uint64_t size;
+  /// Must be a power of two.
+  uint64_t alignment;
+  uint32_t firstPass;
+  uint32_t lastPass;
+  /// Where PlaceTransients() put the block.
+  uint64_t offset = 0;
+};
+
+/**
+ * Give each range an offset in one shared block of memory such that ranges
+ * whose pass lifetimes overlap don't overlap in memory either.
+ * The largest ranges are placed first, each at the lowest aligned offset
+ * that doesn't collide with any range already placed which is live at the
+ * same time as it.
+ * @return The size of block needed to hold all the ranges.
+ */
+uint64_t PlaceTransients(span<TransientRange> ranges);
+
+/// @return True if the two ranges are live during any of the same passes.
+inline bool LifetimesOverlap(const TransientRange& a, const TransientRange& b)
+{
+  return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+}
+
+/// @return True if the two ranges share any bytes once placed.
+inline bool MemoryOverlaps(const TransientRange& a, const TransientRange& b)
+{
+  return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+} /* namespace Internal */
+} /* namespace Krust */
+
+#endif /* KRUST_INTERNAL_TRANSIENT_PLACEMENT_H_INCLUDED_E26EF */
@@ -0,0 +1,119 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compilation unit header:
+#include "krust/public-api/barriers.h"
+
+// Internal includes:
+#include "krust/public-api/vulkan_struct_init.h"
+#include "krust/public-api/vulkan.h"
+
+namespace Krust
+{
+
+BarrierBatch& BarrierBatch::Memory(
+  const VkPipelineStageFlags2KHR srcStages, const VkAccessFlags2KHR srcAccess,
+  const VkPipelineStageFlags2KHR dstStages, const VkAccessFlags2KHR dstAccess)
+{
+  mMemoryBarriers.push_back(MemoryBarrier2KHR(srcStages, srcAccess, dstStages, dstAccess));
+  return *this;
+}
+
+BarrierBatch& BarrierBatch::Buffer(const VkBuffer buffer,
+  const VkPipelineStageFlags2KHR srcStages, const VkAccessFlags2KHR srcAccess,
+  const VkPipelineStageFlags2KHR dstStages, const VkAccessFlags2KHR dstAccess,
+  const VkDeviceSize offset, const VkDeviceSize size)
+{
+  mBufferBarriers.push_back(BufferMemoryBarrier2KHR(
+    srcStages, srcAccess, dstStages, dstAccess,
+    VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+    buffer, offset, size));
+  return *this;
+}
+
+BarrierBatch& BarrierBatch::Image(const VkImage image,
+  const VkPipelineStageFlags2KHR srcStages, const VkAccessFlags2KHR srcAccess,
+  const VkPipelineStageFlags2KHR dstStages, const VkAccessFlags2KHR dstAccess,
+  const VkImageLayout oldLayout, const VkImageLayout newLayout,
+  const VkImageSubresourceRange& range)
+{
+  mImageBarriers.push_back(ImageMemoryBarrier2KHR(
+    srcStages, srcAccess, dstStages, dstAccess,
+    oldLayout, newLayout,
+    VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+    image, range));
+  return *this;
+}
+
+BarrierBatch& BarrierBatch::Add(const VkMemoryBarrier2KHR& barrier)
+{
+  mMemoryBarriers.push_back(barrier);
+  return *this;
+}
+
+BarrierBatch& BarrierBatch::Add(const VkBufferMemoryBarrier2KHR& barrier)
+{
+  mBufferBarriers.push_back(barrier);
+  return *this;
+}
+
+BarrierBatch& BarrierBatch::Add(const VkImageMemoryBarrier2KHR& barrier)
+{
+  mImageBarriers.push_back(barrier);
+  return *this;
+}
+
+bool BarrierBatch::Empty() const
+{
+  return mMemoryBarriers.empty() && mBufferBarriers.empty() && mImageBarriers.empty();
+}
+
+size_t BarrierBatch::Size() const
+{
+  return mMemoryBarriers.size() + mBufferBarriers.size() + mImageBarriers.size();
+}
+
+VkDependencyInfoKHR BarrierBatch::GetDependencyInfo(const VkDependencyFlags flags) const
+{
+  return DependencyInfoKHR(flags,
+    uint32_t(mMemoryBarriers.size()), mMemoryBarriers.data(),
+    uint32_t(mBufferBarriers.size()), mBufferBarriers.data(),
+    uint32_t(mImageBarriers.size()), mImageBarriers.data());
+}
+
+void BarrierBatch::Record(const VkCommandBuffer commandBuffer, const VkDependencyFlags flags)
+{
+  if(Empty())
+  {
+    return;
+  }
+  const VkDependencyInfoKHR dependencies = GetDependencyInfo(flags);
+  vkCmdPipelineBarrier2KHR(commandBuffer, &dependencies);
+  Clear();
+}
+
+void BarrierBatch::Clear()
+{
+  mMemoryBarriers.clear();
+  mBufferBarriers.clear();
+  mImageBarriers.clear();
+}
+
+} /* namespace Krust */
@@ -0,0 +1,106 @@
+#ifndef KRUST_PUBLIC_API_BARRIERS_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_BARRIERS_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * @file Batching of pipeline barriers for VK_KHR_synchronization2.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan_types_and_macros.h"
+
+// External includes:
+#include <vector>
+
+namespace Krust
+{
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Collects memory, buffer, and image barriers, each with its own source
+ * and destination stage masks, and records them all with a single
+ * vkCmdPipelineBarrier2KHR().
+ *
+ * Because every barrier carries its own stages, a batch can hold transitions
+ * of unrelated resources without widening any of them to the union of all
+ * their stages as a single legacy vkCmdPipelineBarrier() call would.
+ * The batch keeps its arrays between Record() calls so one can be kept around
+ * and reused every frame without allocating.
+ * Requires VK_KHR_synchronization2 to be enabled on the device.
+ */
+class BarrierBatch
+{
+public:
+  /// A global memory dependency.
+  BarrierBatch& Memory(
+    VkPipelineStageFlags2KHR srcStages, VkAccessFlags2KHR srcAccess,
+    VkPipelineStageFlags2KHR dstStages, VkAccessFlags2KHR dstAccess);
+
+  /// A dependency on a range of a buffer without a queue family transfer.
+  BarrierBatch& Buffer(VkBuffer buffer,
+    VkPipelineStageFlags2KHR srcStages, VkAccessFlags2KHR srcAccess,
+    VkPipelineStageFlags2KHR dstStages, VkAccessFlags2KHR dstAccess,
+    VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+  /// A dependency on an image, optionally transitioning its layout, without a
+  /// queue family transfer.
+  BarrierBatch& Image(VkImage image,
+    VkPipelineStageFlags2KHR srcStages, VkAccessFlags2KHR srcAccess,
+    VkPipelineStageFlags2KHR dstStages, VkAccessFlags2KHR dstAccess,
+    VkImageLayout oldLayout, VkImageLayout newLayout,
+    const VkImageSubresourceRange& range);
+
+  /// Add fully-specified barriers, e.g. for queue family ownership transfers.
+  ///@{
+  BarrierBatch& Add(const VkMemoryBarrier2KHR& barrier);
+  BarrierBatch& Add(const VkBufferMemoryBarrier2KHR& barrier);
+  BarrierBatch& Add(const VkImageMemoryBarrier2KHR& barrier);
+  ///@}
+
+  bool Empty() const;
+  /// @return The total number of barriers in the batch.
+  size_t Size() const;
+
+  /**
+   * @return A dependency info pointing into the batch's arrays, e.g. for
+   * vkCmdSetEvent2KHR(). It is invalidated by any change to the batch.
+   */
+  VkDependencyInfoKHR GetDependencyInfo(VkDependencyFlags flags = 0) const;
+
+  /**
+   * Record all the barriers of the batch into a command buffer with one
+   * vkCmdPipelineBarrier2KHR() and then clear the batch for reuse.
+   * Does nothing if the batch is empty.
+   */
+  void Record(VkCommandBuffer commandBuffer, VkDependencyFlags flags = 0);
+
+  /// Forget all barriers while keeping the storage for them.
+  void Clear();
+
+private:
+  std::vector<VkMemoryBarrier2KHR> mMemoryBarriers;
+  std::vector<VkBufferMemoryBarrier2KHR> mBufferBarriers;
+  std::vector<VkImageMemoryBarrier2KHR> mImageBarriers;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_BARRIERS_H_INCLUDED_E26EF */
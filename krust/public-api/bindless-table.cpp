@@ -0,0 +1,181 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "krust/public-api/bindless-table.h"
+
+// Internal includes:
+#include "krust/public-api/krust-errors.h"
+#include "krust/public-api/logging.h"
+#include "krust/public-api/thread-base.h"
+#include "krust/public-api/vulkan_struct_init.h"
+#include "krust/public-api/vulkan.h"
+
+// External includes:
+#include <algorithm>
+
+namespace Krust
+{
+
+BindlessTable::BindlessTable(Device& device, const uint32_t maxBuffers, const uint32_t maxImages, const VkShaderStageFlags stages) :
+  mDevice(&device)
+{
+  mBuffers.capacity = std::max(maxBuffers, 1u);
+  mImages.capacity = std::max(maxImages, 1u);
+
+  const VkDescriptorSetLayoutBinding bindings[2] {
+    DescriptorSetLayoutBinding(BUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, mBuffers.capacity, stages, nullptr),
+    DescriptorSetLayoutBinding(IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, mImages.capacity, stages, nullptr)
+  };
+  // Slots can be empty or hold stale descriptors as long as shaders don't use
+  // them, and can be written while the set is bound to pending work which
+  // doesn't use them:
+  constexpr VkDescriptorBindingFlags bindingFlags =
+    VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+    VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+    VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+  const VkDescriptorBindingFlags flags[2] { bindingFlags, bindingFlags };
+  const auto flagsInfo = DescriptorSetLayoutBindingFlagsCreateInfo(2, flags);
+  auto layoutInfo = DescriptorSetLayoutCreateInfo(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT, 2, bindings);
+  layoutInfo.pNext = &flagsInfo;
+  mLayout = DescriptorSetLayout::New(device, layoutInfo);
+
+  const VkDescriptorPoolSize poolSizes[2] {
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, mBuffers.capacity},
+    {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, mImages.capacity}
+  };
+  mPool = DescriptorPool::New(device, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT, 1, 2, poolSizes);
+  mSet = DescriptorSet::Allocate(*mPool, *mLayout);
+}
+
+BindlessTablePtr BindlessTable::New(Device& device, const uint32_t maxBuffers, const uint32_t maxImages, const VkShaderStageFlags stages)
+{
+  return new BindlessTable(device, maxBuffers, maxImages, stages);
+}
+
+uint32_t BindlessTable::AddBuffer(Buffer& buffer, const VkDeviceSize offset, const VkDeviceSize range)
+{
+  const uint32_t index = AddBuffer(VkBuffer(buffer), offset, range);
+  if(index != INVALID_INDEX)
+  {
+    if(mBufferRefs.size() <= index)
+    {
+      mBufferRefs.resize(index + 1);
+    }
+    mBufferRefs[index] = &buffer;
+  }
+  return index;
+}
+
+uint32_t BindlessTable::AddBuffer(const VkBuffer buffer, const VkDeviceSize offset, const VkDeviceSize range)
+{
+  const uint32_t index = Acquire(mBuffers);
+  if(index != INVALID_INDEX)
+  {
+    const auto bufferInfo = DescriptorBufferInfo(buffer, offset, range);
+    const auto write = WriteDescriptorSet(*mSet, BUFFER_BINDING, index, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &bufferInfo, nullptr);
+    vkUpdateDescriptorSets(*mDevice, 1, &write, 0, nullptr);
+  }
+  return index;
+}
+
+uint32_t BindlessTable::AddImage(ImageView& view, const VkImageLayout layout)
+{
+  const uint32_t index = AddImage(VkImageView(view), layout);
+  if(index != INVALID_INDEX)
+  {
+    if(mImageRefs.size() <= index)
+    {
+      mImageRefs.resize(index + 1);
+    }
+    mImageRefs[index] = &view;
+  }
+  return index;
+}
+
+uint32_t BindlessTable::AddImage(const VkImageView view, const VkImageLayout layout)
+{
+  const uint32_t index = Acquire(mImages);
+  if(index != INVALID_INDEX)
+  {
+    const auto imageInfo = DescriptorImageInfo(VK_NULL_HANDLE, view, layout);
+    const auto write = WriteDescriptorSet(*mSet, IMAGE_BINDING, index, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &imageInfo, nullptr, nullptr);
+    vkUpdateDescriptorSets(*mDevice, 1, &write, 0, nullptr);
+  }
+  return index;
+}
+
+void BindlessTable::RemoveBuffer(const uint32_t index)
+{
+  Release(mBuffers, index);
+  if(index < mBufferRefs.size())
+  {
+    mBufferRefs[index].Reset();
+  }
+}
+
+void BindlessTable::RemoveImage(const uint32_t index)
+{
+  Release(mImages, index);
+  if(index < mImageRefs.size())
+  {
+    mImageRefs[index].Reset();
+  }
+}
+
+void BindlessTable::Bind(const VkCommandBuffer commandBuffer, const VkPipelineBindPoint bindPoint,
+                         const VkPipelineLayout pipelineLayout, const uint32_t set) const
+{
+  vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, set, 1, mSet->GetHandleAddress(), 0, nullptr);
+}
+
+uint32_t BindlessTable::Acquire(Slots& slots)
+{
+  uint32_t index = INVALID_INDEX;
+  if(!slots.free.empty())
+  {
+    index = slots.free.back();
+    slots.free.pop_back();
+  }
+  else if(slots.end < slots.capacity)
+  {
+    index = slots.end++;
+  }
+  else
+  {
+    // Running out of room is for the caller to handle so it isn't an error:
+    KRUST_LOG_WARN << "Bindless table array of " << slots.capacity << " is full." << endlog;
+    return INVALID_INDEX;
+  }
+  ++slots.numUsed;
+  return index;
+}
+
+void BindlessTable::Release(Slots& slots, const uint32_t index)
+{
+  if(index >= slots.end || std::find(slots.free.begin(), slots.free.end(), index) != slots.free.end())
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "Index is not in use in the bindless table.", __FUNCTION__, __FILE__, __LINE__);
+    return;
+  }
+  slots.free.push_back(index);
+  --slots.numUsed;
+}
+
+} /* namespace Krust */
@@ -0,0 +1,158 @@
+#ifndef KRUST_PUBLIC_API_BINDLESS_TABLE_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_BINDLESS_TABLE_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file A global descriptor set of large arrays of resources which shaders
+ * index with handles passed to them in push constants or buffers.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan-objects.h"
+
+// External includes:
+#include <cstdint>
+#include <vector>
+
+namespace Krust
+{
+
+class BindlessTable;
+using BindlessTablePtr = IntrusivePointer<BindlessTable>;
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief One descriptor set holding arrays of storage buffers and storage
+ * images which resources are added to and removed from individually, each
+ * getting a stable index into its array.
+ *
+ * The set is bound once and stays bound as resources come and go. Shaders read
+ * the indices of the resources a dispatch should use from push constants, so
+ * materials and scenes can grow without changing any layout.
+ * The bindings are created with update-after-bind and partially-bound flags,
+ * which need the corresponding descriptor indexing features of Vulkan 1.2 or
+ * VK_EXT_descriptor_indexing enabled on the device:
+ * descriptorBindingStorageBufferUpdateAfterBind,
+ * descriptorBindingStorageImageUpdateAfterBind,
+ * descriptorBindingUpdateUnusedWhilePending,
+ * descriptorBindingPartiallyBound and runtimeDescriptorArray.
+ *
+ * In GLSL, with GL_EXT_nonuniform_qualifier, declare the arrays as, e.g.:
+ *
+ *     layout(set = 0, binding = 0) buffer block_t { vec4 data[]; } buffers[];
+ *     layout(rgba8, set = 0, binding = 1) uniform image2D images[];
+ *
+ * Not thread safe.
+ */
+class BindlessTable : public RefObject
+{
+  BindlessTable(Device& device, uint32_t maxBuffers, uint32_t maxImages, VkShaderStageFlags stages);
+  BindlessTable(const BindlessTable&) = delete;
+  BindlessTable& operator=(const BindlessTable&) = delete;
+
+public:
+  /// The binding of the array of storage buffers.
+  static constexpr uint32_t BUFFER_BINDING = 0;
+  /// The binding of the array of storage images.
+  static constexpr uint32_t IMAGE_BINDING = 1;
+  /// Returned when an array is full. That is not reported to the error policy.
+  static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+  /**
+   * @param maxBuffers The size of the storage buffer array.
+   * @param maxImages The size of the storage image array.
+   * @param stages The shader stages which can read the table.
+   */
+  static BindlessTablePtr New(Device& device, uint32_t maxBuffers, uint32_t maxImages,
+                              VkShaderStageFlags stages = VK_SHADER_STAGE_COMPUTE_BIT);
+
+  /**
+   * Add a range of a buffer to the table.
+   * The overload taking a raw handle leaves keeping it alive to the caller.
+   * @return Its index in the buffer array or INVALID_INDEX if that is full.
+   */
+  ///@{
+  uint32_t AddBuffer(Buffer& buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+  uint32_t AddBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+  ///@}
+
+  /**
+   * Add an image view to the table, in the layout it will be in whenever
+   * shaders access it.
+   * The overload taking a raw handle leaves keeping it alive to the caller.
+   * @return Its index in the image array or INVALID_INDEX if that is full.
+   */
+  ///@{
+  uint32_t AddImage(ImageView& view, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+  uint32_t AddImage(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+  ///@}
+
+  /**
+   * Free an index for reuse and drop the table's reference to its resource.
+   * No work still pending on the GPU may use the index, as the next resource
+   * added may take it. Enable deferred destruction on the QueueJanitor if the
+   * table held the last reference.
+   */
+  ///@{
+  void RemoveBuffer(uint32_t index);
+  void RemoveImage(uint32_t index);
+  ///@}
+
+  /// Bind the table to a command buffer as the given set of the layout.
+  void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint,
+            VkPipelineLayout pipelineLayout, uint32_t set = 0) const;
+
+  /// @return The layout to put in pipeline layouts at the set the table is bound to.
+  DescriptorSetLayout& GetLayout() const { return *mLayout; }
+  VkDescriptorSet GetSet() const { return *mSet; }
+  /// @return The number of buffers and images currently in the table.
+  uint32_t GetNumBuffers() const { return mBuffers.numUsed; }
+  uint32_t GetNumImages() const { return mImages.numUsed; }
+
+private:
+  /// The indices of one array.
+  struct Slots
+  {
+    uint32_t capacity;
+    /// One past the highest index handed out.
+    uint32_t end = 0;
+    uint32_t numUsed = 0;
+    /// Indices below end which are free, reused last-freed first.
+    std::vector<uint32_t> free;
+  };
+  uint32_t Acquire(Slots& slots);
+  void Release(Slots& slots, uint32_t index);
+
+  DevicePtr mDevice;
+  DescriptorSetLayoutPtr mLayout;
+  DescriptorPoolPtr mPool;
+  DescriptorSetPtr mSet;
+  Slots mBuffers;
+  Slots mImages;
+  /// References to the wrapped resources added, by index.
+  std::vector<BufferPtr> mBufferRefs;
+  std::vector<ImageViewPtr> mImageRefs;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_BINDLESS_TABLE_H_INCLUDED_E26EF */
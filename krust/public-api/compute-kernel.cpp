@@ -0,0 +1,296 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "krust/public-api/compute-kernel.h"
+
+// Internal includes:
+#include "krust/internal/kernel-set-cache.h"
+#include "krust/public-api/krust-assertions.h"
+#include "krust/public-api/krust-errors.h"
+#include "krust/public-api/thread-base.h"
+#include "krust/public-api/vulkan_struct_init.h"
+
+// External includes:
+#include <cstring>
+
+namespace Krust
+{
+
+namespace
+{
+
+/// Sets per descriptor pool. Most kernels only ever see a handful of
+/// combinations of resources.
+constexpr uint32_t SETS_PER_POOL = 16u;
+/// Pools kept before the oldest is released to bound the sets kept.
+constexpr uint32_t MAX_POOLS = 8u;
+/// The pool reported for kernels without descriptors.
+constexpr uint32_t NO_POOL = UINT32_MAX;
+
+}
+
+KernelResource KernelResource::Buffer(const VkBuffer buffer, const VkDeviceSize offset, const VkDeviceSize range)
+{
+  KernelResource resource;
+  memset(&resource, 0, sizeof(resource));
+  resource.buffer = DescriptorBufferInfo(buffer, offset, range);
+  return resource;
+}
+
+KernelResource KernelResource::Image(const VkImageView view, const VkImageLayout layout, const VkSampler sampler)
+{
+  KernelResource resource;
+  memset(&resource, 0, sizeof(resource));
+  resource.image = DescriptorImageInfo(sampler, view, layout);
+  return resource;
+}
+
+KernelResource KernelResource::TexelBuffer(const VkBufferView view)
+{
+  KernelResource resource;
+  memset(&resource, 0, sizeof(resource));
+  resource.texelBuffer = view;
+  return resource;
+}
+
+KernelResource KernelResource::AccelerationStructure(const VkAccelerationStructureKHR accelerationStructure)
+{
+  KernelResource resource;
+  memset(&resource, 0, sizeof(resource));
+  resource.accelerationStructure = accelerationStructure;
+  return resource;
+}
+
+ComputeKernel::ComputeKernel(Device& device, LayoutCache& layouts, const span<const uint32_t> spirv, const VkPipelineCache pipelineCache, const VkSpecializationInfo* const specializationInfo) :
+  mDevice(&device),
+  mSets(std::make_unique<Internal::KernelSetCache>(SETS_PER_POOL, MAX_POOLS))
+{
+  if(!ReflectSpirV(spirv, mReflection) || mReflection.stage != VK_SHADER_STAGE_COMPUTE_BIT)
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "SPIR-V is not a compute shader.", __FUNCTION__, __FILE__, __LINE__);
+    return;
+  }
+  // Dispatches are sized from the workgroup size the pipeline will really have:
+  if(specializationInfo)
+  {
+    mReflection.Specialize(*specializationInfo);
+  }
+  if(mReflection.NumSets() > 1)
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "Compute kernels can only use descriptor set 0.", __FUNCTION__, __FILE__, __LINE__);
+    return;
+  }
+
+  if(mReflection.NumSets() == 1)
+  {
+    mSetLayout = layouts.GetDescriptorSetLayout(mReflection, 0);
+
+    // Resources are passed as a packed array, one per descriptor:
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    for(const SpirVBinding& b : mReflection.bindings)
+    {
+      entries.push_back(DescriptorUpdateTemplateEntry(
+        b.binding.binding, 0, b.binding.descriptorCount, b.binding.descriptorType,
+        mResourceTypes.size() * sizeof(KernelResource), sizeof(KernelResource)));
+      mResourceTypes.insert(mResourceTypes.end(), b.binding.descriptorCount, b.binding.descriptorType);
+    }
+    mUpdateTemplate = DescriptorUpdateTemplate::New(device, *mSetLayout, uint32_t(entries.size()), entries.data());
+  }
+  mPipelineLayout = layouts.GetPipelineLayout(mReflection);
+
+  auto shaderModule = ShaderModule::New(device, 0, spirv);
+  const auto ssci = PipelineShaderStageCreateInfo(
+    0,
+    VK_SHADER_STAGE_COMPUTE_BIT,
+    *shaderModule,
+    "main",
+    specializationInfo
+  );
+  mPipeline = ComputePipeline::New(device, ComputePipelineCreateInfo(
+    0,    // no flags
+    ssci,
+    *mPipelineLayout,
+    VK_NULL_HANDLE, // no base pipeline
+    -1 // No index of a base pipeline.
+  ), pipelineCache);
+}
+
+ComputeKernelPtr ComputeKernel::New(
+  Device& device,
+  LayoutCache& layouts,
+  const span<const uint32_t> spirv,
+  const VkPipelineCache pipelineCache,
+  const VkSpecializationInfo* const specializationInfo)
+{
+  return new ComputeKernel { device, layouts, spirv, pipelineCache, specializationInfo };
+}
+
+ComputeKernel::~ComputeKernel()
+{
+}
+
+bool ComputeKernel::Dispatch(
+  const VkCommandBuffer commandBuffer,
+  const span<const KernelResource> resources,
+  const uint32_t x, const uint32_t y, const uint32_t z,
+  const void* const pushConstants)
+{
+  uint32_t pool = NO_POOL;
+  return Record(commandBuffer, resources, x, y, z, pushConstants, pool);
+}
+
+bool ComputeKernel::Dispatch(
+  CommandBuffer& commandBuffer,
+  const span<const KernelResource> resources,
+  const uint32_t x, const uint32_t y, const uint32_t z,
+  const void* const pushConstants)
+{
+  uint32_t pool = NO_POOL;
+  if(!Record(commandBuffer, resources, x, y, z, pushConstants, pool))
+  {
+    return false;
+  }
+  commandBuffer.KeepAlive(*mPipeline);
+  if(pool != NO_POOL)
+  {
+    commandBuffer.KeepAlive(*mPools[pool]);
+  }
+  return true;
+}
+
+bool ComputeKernel::Record(
+  const VkCommandBuffer commandBuffer,
+  const span<const KernelResource> resources,
+  const uint32_t x, const uint32_t y, const uint32_t z,
+  const void* const pushConstants,
+  uint32_t& pool)
+{
+  KRUST_ASSERT1(mPipeline.Get(), "Dispatching a kernel which failed to build.");
+  if(mSetLayout.Get())
+  {
+    const VkDescriptorSet set = GetDescriptorSet(resources, pool);
+    if(set == VK_NULL_HANDLE)
+    {
+      return false;
+    }
+    vkCmdBindDescriptorSets(
+      commandBuffer,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      *mPipelineLayout,
+      0,
+      1,
+      &set,
+      0, nullptr // No dynamic offsets.
+    );
+  }
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, *mPipeline);
+  if(pushConstants && mReflection.pushConstantBytes > 0)
+  {
+    vkCmdPushConstants(commandBuffer, *mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, mReflection.pushConstantBytes, pushConstants);
+  }
+  const uint32_t* const size = mReflection.localSize;
+  vkCmdDispatch(commandBuffer,
+    (x + size[0] - 1) / size[0],
+    (y + size[1] - 1) / size[1],
+    (z + size[2] - 1) / size[2]);
+  return true;
+}
+
+VkDescriptorSet ComputeKernel::GetDescriptorSet(const span<const KernelResource> resources)
+{
+  uint32_t pool = NO_POOL;
+  return GetDescriptorSet(resources, pool);
+}
+
+VkDescriptorSet ComputeKernel::GetDescriptorSet(const span<const KernelResource> resources, uint32_t& pool)
+{
+  KRUST_ASSERT1(resources.size() == mResourceTypes.size(), "Need exactly one resource per descriptor of the kernel.");
+  Internal::KernelSetCache::Key key;
+  key.reserve(resources.size() * 3);
+  for(size_t i = 0; i < resources.size(); ++i)
+  {
+    Internal::KernelSetCache::AppendKey(mResourceTypes[i], resources[i], key);
+  }
+
+  VkDescriptorSet set = mSets->Find(key, pool);
+  if(set == VK_NULL_HANDLE)
+  {
+    set = AllocateSet();
+    if(set == VK_NULL_HANDLE)
+    {
+      return VK_NULL_HANDLE;
+    }
+    mUpdateTemplate->Update(set, resources.data());
+    pool = mSets->Insert(key, set);
+  }
+  return set;
+}
+
+void ComputeKernel::ResetDescriptorSets()
+{
+  for(const DescriptorPoolPtr& pool : mPools)
+  {
+    vkResetDescriptorPool(*mDevice, *pool, 0);
+  }
+  mSets->Clear();
+}
+
+size_t ComputeKernel::GetNumDescriptorSets() const
+{
+  return mSets->Size();
+}
+
+DescriptorPoolPtr ComputeKernel::NewPool()
+{
+  std::vector<VkDescriptorPoolSize> sizes = mSetLayout->GetPoolSizes();
+  for(VkDescriptorPoolSize& size : sizes)
+  {
+    size.descriptorCount *= SETS_PER_POOL;
+  }
+  return DescriptorPool::New(*mDevice, 0, SETS_PER_POOL, uint32_t(sizes.size()), sizes.data());
+}
+
+VkDescriptorSet ComputeKernel::AllocateSet()
+{
+  const Internal::KernelSetCache::Slot slot = mSets->Reserve();
+  if(slot.pool == mPools.size())
+  {
+    mPools.push_back(NewPool());
+  }
+  else if(slot.evicted)
+  {
+    // Command buffers may still be using the old pool's sets, so rather than
+    // resetting it, let it go for whatever is keeping it alive to destroy:
+    mPools[slot.pool] = NewPool();
+  }
+
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  const auto info = DescriptorSetAllocateInfo(*mPools[slot.pool], 1, mSetLayout->GetDescriptorSetLayoutAddress());
+  const VkResult result = vkAllocateDescriptorSets(*mDevice, &info, &set);
+  if(result != VK_SUCCESS)
+  {
+    ThreadBase::Get().GetErrorPolicy().VulkanError("vkAllocateDescriptorSets", result, nullptr, __FUNCTION__, __FILE__, __LINE__);
+    return VK_NULL_HANDLE;
+  }
+  return set;
+}
+
+} /* namespace Krust */
@@ -0,0 +1,183 @@
+#ifndef KRUST_PUBLIC_API_COMPUTE_KERNEL_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_COMPUTE_KERNEL_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file A compute shader packaged up with everything needed to run it again
+ * and again.
+ */
+
+// Internal includes:
+#include "krust/public-api/layout-cache.h"
+#include "krust/public-api/spirv-reflection.h"
+#include "krust/public-api/vulkan-objects.h"
+
+// External includes:
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Krust
+{
+
+namespace Internal { class KernelSetCache; }
+
+class ComputeKernel;
+using ComputeKernelPtr = IntrusivePointer<ComputeKernel>;
+
+/**
+ * @brief One descriptor's worth of resource to bind to a ComputeKernel.
+ *
+ * Make them with the static functions. Only the members for the type of
+ * descriptor bound to are read.
+ */
+struct KernelResource
+{
+  static KernelResource Buffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+  static KernelResource Image(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL, VkSampler sampler = VK_NULL_HANDLE);
+  static KernelResource TexelBuffer(VkBufferView view);
+  static KernelResource AccelerationStructure(VkAccelerationStructureKHR accelerationStructure);
+
+  union
+  {
+    VkDescriptorBufferInfo buffer;
+    VkDescriptorImageInfo image;
+    VkBufferView texelBuffer;
+    VkAccelerationStructureKHR accelerationStructure;
+  };
+};
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief A compute pipeline with its layouts taken from its SPIR-V, which
+ * records dispatches of itself into command buffers.
+ *
+ * Each distinct combination of resources a kernel is dispatched with gets a
+ * descriptor set of its own the first time it is seen. The set is kept, so
+ * running the kernel again over the same resources only records a bind and a
+ * dispatch, and sets are never rewritten while a command buffer might be using
+ * them. The number of sets kept is bounded: when it is reached, the sets of
+ * the oldest descriptor pool are forgotten and the pool is released, so record
+ * with the CommandBuffer overload of Dispatch() or have deferred destruction
+ * enabled on a QueueJanitor to keep it alive until the GPU is done with it.
+ *
+ * Kernels may only use descriptor set 0.
+ * Not thread safe: record dispatches of a kernel from one thread at a time.
+ */
+class ComputeKernel : public RefObject
+{
+  /** Hidden constructor to prevent users doing naked `new`s.*/
+  ComputeKernel(Device& device, LayoutCache& layouts, span<const uint32_t> spirv, VkPipelineCache pipelineCache, const VkSpecializationInfo* specializationInfo);
+
+  // Ban copying objects:
+  ComputeKernel(const ComputeKernel&) = delete;
+  ComputeKernel& operator=(const ComputeKernel&) = delete;
+
+public:
+  ~ComputeKernel();
+
+  /**
+   * Reflect a compute shader and create its layouts and pipeline.
+   * @param layouts The layouts are shared through this.
+   */
+  static ComputeKernelPtr New(
+    Device& device,
+    LayoutCache& layouts,
+    span<const uint32_t> spirv,
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    const VkSpecializationInfo* specializationInfo = nullptr);
+
+  /**
+   * Record the commands to run the kernel over a grid of invocations.
+   * @param resources One for each descriptor of the kernel, in binding order
+   * with the elements of arrays following each other.
+   * @param x, y, z The number of invocations, which are rounded up to a whole
+   * number of workgroups. The shader must ignore any beyond the end.
+   * @param pushConstants The kernel's push constants, if it has any.
+   * @return False if no descriptor set could be had for the resources, in
+   * which case nothing was recorded.
+   */
+  bool Dispatch(
+    VkCommandBuffer commandBuffer,
+    span<const KernelResource> resources,
+    uint32_t x, uint32_t y = 1, uint32_t z = 1,
+    const void* pushConstants = nullptr);
+
+  /**
+   * As above, also having the command buffer keep the pipeline and the pool
+   * of the descriptor set bound alive.
+   */
+  bool Dispatch(
+    CommandBuffer& commandBuffer,
+    span<const KernelResource> resources,
+    uint32_t x, uint32_t y = 1, uint32_t z = 1,
+    const void* pushConstants = nullptr);
+
+  /**
+   * @return The descriptor set for a combination of resources, written the
+   * first time the combination is seen, or VK_NULL_HANDLE if one couldn't be
+   * allocated.
+   */
+  VkDescriptorSet GetDescriptorSet(span<const KernelResource> resources);
+
+  /**
+   * Forget all descriptor sets so their pools can be reused, e.g. when the
+   * resources they point at are being destroyed. The GPU must be done with
+   * every command buffer the kernel has been recorded into.
+   */
+  void ResetDescriptorSets();
+
+  const SpirVReflection& GetReflection() const { return mReflection; }
+  PipelineLayout& GetPipelineLayout() const { return *mPipelineLayout; }
+  ComputePipeline& GetPipeline() const { return *mPipeline; }
+  size_t GetNumDescriptorSets() const;
+
+private:
+  /// @param[out] pool The index of the pool the set came from.
+  VkDescriptorSet GetDescriptorSet(span<const KernelResource> resources, uint32_t& pool);
+  /// @param[out] pool The index of the pool of the set bound, if any.
+  bool Record(
+    VkCommandBuffer commandBuffer,
+    span<const KernelResource> resources,
+    uint32_t x, uint32_t y, uint32_t z,
+    const void* pushConstants,
+    uint32_t& pool);
+  /// Allocate a set from the pool the cache has room in.
+  VkDescriptorSet AllocateSet();
+  DescriptorPoolPtr NewPool();
+
+  DevicePtr mDevice;
+  SpirVReflection mReflection;
+  /// Null for kernels with no descriptors.
+  DescriptorSetLayoutPtr mSetLayout;
+  PipelineLayoutPtr mPipelineLayout;
+  ComputePipelinePtr mPipeline;
+  DescriptorUpdateTemplatePtr mUpdateTemplate;
+  /// The type of descriptor each KernelResource of a dispatch is bound as.
+  std::vector<VkDescriptorType> mResourceTypes;
+  std::vector<DescriptorPoolPtr> mPools;
+  std::unique_ptr<Internal::KernelSetCache> mSets;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_COMPUTE_KERNEL_H_INCLUDED_E26EF */
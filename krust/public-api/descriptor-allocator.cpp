@@ -0,0 +1,186 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "krust/public-api/descriptor-allocator.h"
+
+// Internal includes:
+#include "krust/public-api/krust-errors.h"
+#include "krust/public-api/logging.h"
+#include "krust/public-api/thread-base.h"
+#include "krust/public-api/vulkan_struct_init.h"
+#include "krust/public-api/vulkan.h"
+
+// External includes:
+#include <algorithm>
+
+namespace Krust
+{
+
+namespace
+{
+
+/// Pools stop growing at this many sets.
+constexpr uint32_t MAX_SETS_PER_POOL = 1024;
+
+bool SameSizes(const std::vector<VkDescriptorPoolSize>& a, const std::vector<VkDescriptorPoolSize>& b)
+{
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+    [](const VkDescriptorPoolSize& x, const VkDescriptorPoolSize& y) { return x.type == y.type && x.descriptorCount == y.descriptorCount; });
+}
+
+}
+
+DescriptorAllocator::DescriptorAllocator(Device& device, const uint32_t numFrames, const uint32_t setsPerPool) :
+  mDevice(&device),
+  mFrames(std::max(numFrames, 1u)),
+  mSetsPerPool(std::max(setsPerPool, 1u))
+{
+}
+
+DescriptorAllocatorPtr DescriptorAllocator::New(Device& device, const uint32_t numFrames, const uint32_t setsPerPool)
+{
+  return new DescriptorAllocator(device, numFrames, setsPerPool);
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+  KRUST_LOG_DEBUG << "DescriptorAllocator: " << mStats.allocations << " sets from " << mStats.poolsCreated << " pools reset " << mStats.poolResets << " times." << endlog;
+}
+
+void DescriptorAllocator::BeginFrame(const uint32_t frame)
+{
+  if(frame >= mFrames.size())
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "Frame index out of range.", __FUNCTION__, __FILE__, __LINE__);
+    return;
+  }
+  mFrame = frame;
+  ResetFrame(mFrames[frame]);
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(const DescriptorSetLayout& layout)
+{
+  const uint32_t chain = FindChain(layout);
+  Frame& frame = mFrames[mFrame];
+  if(frame.current.size() < mChains.size())
+  {
+    frame.current.resize(mChains.size());
+  }
+
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  // A fresh pool always has room for one set so the second try can only fail
+  // if the pool couldn't be created:
+  for(unsigned attempt = 0; attempt < 2; ++attempt)
+  {
+    DescriptorPoolPtr& pool = frame.current[chain];
+    if(!pool.Get())
+    {
+      pool = NextPool(chain);
+      if(!pool.Get() || *pool == VK_NULL_HANDLE)
+      {
+        pool.Reset();
+        return VK_NULL_HANDLE;
+      }
+      frame.used.push_back({chain, pool});
+    }
+    const auto info = DescriptorSetAllocateInfo(*pool, 1, layout.GetDescriptorSetLayoutAddress());
+    const VkResult result = vkAllocateDescriptorSets(*mDevice, &info, &set);
+    if(result == VK_SUCCESS)
+    {
+      ++mStats.allocations;
+      return set;
+    }
+    if(result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)
+    {
+      ThreadBase::Get().GetErrorPolicy().VulkanError("vkAllocateDescriptorSets", result, nullptr, __FUNCTION__, __FILE__, __LINE__);
+      return VK_NULL_HANDLE;
+    }
+    // This pool is full so move on to the next, leaving this one in the used
+    // list to be reset with the frame:
+    ++mStats.poolsExhausted;
+    pool.Reset();
+  }
+  return VK_NULL_HANDLE;
+}
+
+void DescriptorAllocator::ResetAll()
+{
+  for(Frame& frame : mFrames)
+  {
+    ResetFrame(frame);
+  }
+}
+
+uint32_t DescriptorAllocator::FindChain(const DescriptorSetLayout& layout)
+{
+  const std::vector<VkDescriptorPoolSize>& sizes = layout.GetPoolSizes();
+  for(uint32_t i = 0; i < mChains.size(); ++i)
+  {
+    if(mChains[i].layoutFlags == layout.GetFlags() && SameSizes(mChains[i].setSizes, sizes))
+    {
+      return i;
+    }
+  }
+  mChains.push_back({layout.GetFlags(), sizes, {}, mSetsPerPool});
+  return uint32_t(mChains.size() - 1);
+}
+
+DescriptorPoolPtr DescriptorAllocator::NextPool(const uint32_t chainIndex)
+{
+  Chain& chain = mChains[chainIndex];
+  if(!chain.free.empty())
+  {
+    DescriptorPoolPtr pool = std::move(chain.free.back());
+    chain.free.pop_back();
+    return pool;
+  }
+
+  const uint32_t maxSets = chain.nextPoolSets;
+  chain.nextPoolSets = std::min(maxSets * 2, MAX_SETS_PER_POOL);
+  std::vector<VkDescriptorPoolSize> poolSizes = chain.setSizes;
+  for(VkDescriptorPoolSize& size : poolSizes)
+  {
+    size.descriptorCount *= maxSets;
+  }
+  VkDescriptorPoolCreateFlags flags = 0;
+  if(chain.layoutFlags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT)
+  {
+    flags |= VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  }
+  ++mStats.poolsCreated;
+  return DescriptorPool::New(*mDevice, flags, maxSets, uint32_t(poolSizes.size()), poolSizes.data());
+}
+
+void DescriptorAllocator::ResetFrame(Frame& frame)
+{
+  for(UsedPool& used : frame.used)
+  {
+    vkResetDescriptorPool(*mDevice, *used.pool, 0);
+    ++mStats.poolResets;
+    mChains[used.chain].free.push_back(std::move(used.pool));
+  }
+  frame.used.clear();
+  for(DescriptorPoolPtr& pool : frame.current)
+  {
+    pool.Reset();
+  }
+}
+
+} /* namespace Krust */
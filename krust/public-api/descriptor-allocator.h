@@ -0,0 +1,151 @@
+#ifndef KRUST_PUBLIC_API_DESCRIPTOR_ALLOCATOR_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_DESCRIPTOR_ALLOCATOR_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Growable, recycled pools of short-lived descriptor sets.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan-objects.h"
+
+// External includes:
+#include <cstdint>
+#include <vector>
+
+namespace Krust
+{
+
+class DescriptorAllocator;
+using DescriptorAllocatorPtr = IntrusivePointer<DescriptorAllocator>;
+
+/**
+ * @brief Counters for the lifetime of a DescriptorAllocator.
+ */
+struct DescriptorAllocatorStats
+{
+  /// Number of sets handed out.
+  uint64_t allocations = 0;
+  /// Number of times a pool ran out of room and the next one was started.
+  uint64_t poolsExhausted = 0;
+  /// Number of descriptor pools created.
+  uint64_t poolsCreated = 0;
+  /// Number of times a pool was reset for reuse.
+  uint64_t poolResets = 0;
+};
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Hands out descriptor sets which live for one frame from chains of
+ * pools that grow on demand and are reset whole rather than freeing sets one
+ * at a time.
+ *
+ * Layouts needing the same numbers of each type of descriptor share a chain of
+ * pools sized for a whole number of their sets. Each of the frames in flight
+ * has its own pools. BeginFrame() resets all the pools a frame used last time
+ * around and makes them available again, so once enough pools exist to cover
+ * the busiest frame no more are created and allocating a set is a single
+ * vkAllocateDescriptorSets() call.
+ *
+ * Sets are returned as raw handles: they are only valid until their frame is
+ * next begun and must not be freed individually.
+ * Not thread safe: use one allocator per recording thread.
+ */
+class DescriptorAllocator : public RefObject
+{
+  DescriptorAllocator(Device& device, uint32_t numFrames, uint32_t setsPerPool);
+  DescriptorAllocator(const DescriptorAllocator&) = delete;
+  DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+public:
+  /**
+   * @param numFrames The number of frames in flight, e.g. the number of
+   *        swapchain images, each of which gets its own pools.
+   * @param setsPerPool The number of sets the first pool of each layout
+   *        signature holds. Later pools double in size up to a limit.
+   */
+  static DescriptorAllocatorPtr New(Device& device, uint32_t numFrames, uint32_t setsPerPool = 16);
+  ~DescriptorAllocator();
+
+  /**
+   * Start allocating for a frame, recycling the pools it used last time.
+   * The GPU must have finished with all the sets allocated for the frame
+   * before, e.g. by the caller having waited on its fence or for its
+   * QueueJanitor submit counter.
+   */
+  void BeginFrame(uint32_t frame);
+
+  /**
+   * Allocate a set with the given layout for the current frame.
+   * @return The set or VK_NULL_HANDLE if a new pool could not be created.
+   */
+  VkDescriptorSet Allocate(const DescriptorSetLayout& layout);
+
+  /// Reset all the pools of every frame. The GPU must be done with all sets.
+  void ResetAll();
+
+  uint32_t GetCurrentFrame() const { return mFrame; }
+  const DescriptorAllocatorStats& GetStats() const { return mStats; }
+  Device& GetDevice() const { return *mDevice; }
+
+private:
+  /// The pools of all frames for one layout signature.
+  struct Chain
+  {
+    VkDescriptorSetLayoutCreateFlags layoutFlags;
+    /// Descriptors of each type one set needs.
+    std::vector<VkDescriptorPoolSize> setSizes;
+    /// Reset pools ready to be handed to a frame.
+    std::vector<DescriptorPoolPtr> free;
+    /// The number of sets the next pool created will hold.
+    uint32_t nextPoolSets;
+  };
+  /// A pool a frame has allocated from.
+  struct UsedPool
+  {
+    uint32_t chain;
+    DescriptorPoolPtr pool;
+  };
+  struct Frame
+  {
+    /// The pool being allocated from for each chain, or null.
+    std::vector<DescriptorPoolPtr> current;
+    /// Pools allocated from, including the current ones.
+    std::vector<UsedPool> used;
+  };
+
+  uint32_t FindChain(const DescriptorSetLayout& layout);
+  /// Take a pool from the free list of the chain or create a new one.
+  DescriptorPoolPtr NextPool(uint32_t chain);
+  void ResetFrame(Frame& frame);
+
+  DevicePtr mDevice;
+  std::vector<Chain> mChains;
+  std::vector<Frame> mFrames;
+  uint32_t mFrame = 0;
+  uint32_t mSetsPerPool;
+  DescriptorAllocatorStats mStats;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_DESCRIPTOR_ALLOCATOR_H_INCLUDED_E26EF */
@@ -34,14 +34,26 @@
 #include "krust/public-api/krust-errors.h"
 #include "krust/public-api/vulkan.h"
 
+// External includes:
+#include <cstdint>
+
 namespace Krust
 {
 DeviceMemoryMapper::DeviceMemoryMapper(DeviceMemory& deviceMemory, size_t offset, size_t size, uint32_t flags)
 : mMemory(&deviceMemory), mOffset(offset), mSize(size)
 {
     Device& device = deviceMemory.GetDevice();
-    // Chapter 11: memory must not be currently host mapped
-    const auto result = vkMapMemory(device, deviceMemory, offset, size, flags, &mHostAccess);
+    VkResult result = VK_SUCCESS;
+    if(void* const persistent = deviceMemory.GetMappedAddress())
+    {
+      mHostAccess = static_cast<uint8_t*>(persistent) + offset;
+      mOwnsMapping = false;
+    }
+    else
+    {
+      // Chapter 11: memory must not be currently host mapped
+      result = vkMapMemory(device, deviceMemory, offset, size, flags, &mHostAccess);
+    }
     const auto memRange = MappedMemoryRange(*mMemory, mOffset, mSize);
     const auto resultInval = vkInvalidateMappedMemoryRanges(device, 1, &memRange);
     if(resultInval != VK_SUCCESS){
@@ -72,7 +84,10 @@ void DeviceMemoryMapper::unMap()
         if(result != VK_SUCCESS){
             KRUST_LOG_ERROR << "Failed to flush mapped memory with result: " << result << endlog;
         }
-        vkUnmapMemory(device, *mMemory);
+        if(mOwnsMapping)
+        {
+          vkUnmapMemory(device, *mMemory);
+        }
         mHostAccess = nullptr;
     }
 }
@@ -44,6 +44,10 @@ namespace Krust
  * @brief
  * Owner/Janitor for mapping host-visible GPU device memory to be accessed
  * directly from CPU code and then remembering to always flush and unmap it.
+ *
+ * If the memory is already persistently mapped (DeviceMemory::GetPersistentMapping())
+ * that mapping is reused and left in place, but ranges are still invalidated and
+ * flushed.
  */
 class DeviceMemoryMapper
 {
@@ -62,6 +66,8 @@ private:
   size_t mOffset = 0;
   size_t mSize = 0;
   void* mHostAccess = nullptr;
+  /// False if we borrowed the memory's persistent mapping so must not unmap it.
+  bool mOwnsMapping = true;
 };
 
 }
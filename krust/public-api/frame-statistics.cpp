@@ -0,0 +1,155 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "krust/public-api/frame-statistics.h"
+
+// Internal includes:
+#include "krust/public-api/barriers.h"
+#include "krust/public-api/krust-assertions.h"
+#include "krust/public-api/krust-errors.h"
+#include "krust/public-api/logging.h"
+#include "krust/public-api/thread-base.h"
+#include "krust/public-api/vulkan-utils.h"
+#include "krust/public-api/vulkan_struct_init.h"
+
+// External includes:
+#include <algorithm>
+#include <cstring>
+
+namespace Krust
+{
+
+FrameStatistics::FrameStatistics(
+  Device& device,
+  const VkPhysicalDeviceMemoryProperties& memoryProperties,
+  const VkDeviceSize minStorageBufferOffsetAlignment,
+  const uint32_t numFrames,
+  const uint32_t numCounters,
+  const bool pipelineStatistics) :
+  mDevice(&device),
+  mNumCounters(numCounters),
+  mRecorded(numFrames, false)
+{
+  KRUST_ASSERT1(numCounters > 0, "A buffer of no counters can't be bound.");
+  const VkDeviceSize alignment = std::max<VkDeviceSize>(minStorageBufferOffsetAlignment, 1);
+  mStride = (GetRange() + alignment - 1) / alignment * alignment;
+  mLastFrame.counters.resize(numCounters, 0);
+
+  if(pipelineStatistics)
+  {
+    mQueries = QueryPool::New(device, VK_QUERY_TYPE_PIPELINE_STATISTICS, numFrames, VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT);
+  }
+
+  mBuffer = Buffer::New(device, 0, mStride * numFrames, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, 0);
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(device, *mBuffer, &requirements);
+  // The host reads the counters back so cached memory is best, but any which
+  // is coherent will do:
+  constexpr VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  ConditionalValue<uint32_t> memoryType = FindFirstMemoryTypeWithProperties(memoryProperties, requirements.memoryTypeBits, coherent | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+  if(!memoryType)
+  {
+    memoryType = FindFirstMemoryTypeWithProperties(memoryProperties, requirements.memoryTypeBits, coherent);
+  }
+  if(!memoryType)
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalState, "No host-coherent memory type suits the statistics counters.", __FUNCTION__, __FILE__, __LINE__);
+    return;
+  }
+  DeviceMemoryPtr memory = DeviceMemory::New(device, MemoryAllocateInfo(requirements.size, memoryType.GetValue()));
+  mBuffer->BindMemory(*memory, 0);
+  mCounters = static_cast<uint64_t*>(memory->GetPersistentMapping());
+  if(!mCounters)
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalState, "Failed to map the statistics counters.", __FUNCTION__, __FILE__, __LINE__);
+    return;
+  }
+  memset(mCounters, 0, mStride * numFrames);
+}
+
+FrameStatisticsPtr FrameStatistics::New(
+  Device& device,
+  const VkPhysicalDeviceMemoryProperties& memoryProperties,
+  const VkDeviceSize minStorageBufferOffsetAlignment,
+  const uint32_t numFrames,
+  const uint32_t numCounters,
+  const bool pipelineStatistics)
+{
+  return new FrameStatistics { device, memoryProperties, minStorageBufferOffsetAlignment, numFrames, numCounters, pipelineStatistics };
+}
+
+void FrameStatistics::BeginFrame(const VkCommandBuffer commandBuffer, const uint32_t frame)
+{
+  KRUST_ASSERT1(frame < mRecorded.size(), "More frames in flight than the statistics were made for.");
+  Collect(frame);
+  mCurrentFrame = frame;
+  mRecorded[frame] = true;
+  if(mQueries.Get())
+  {
+    vkCmdResetQueryPool(commandBuffer, *mQueries, frame, 1);
+    vkCmdBeginQuery(commandBuffer, *mQueries, frame, 0);
+  }
+}
+
+void FrameStatistics::EndFrame(const VkCommandBuffer commandBuffer)
+{
+  if(mQueries.Get())
+  {
+    vkCmdEndQuery(commandBuffer, *mQueries, mCurrentFrame);
+  }
+  BarrierBatch().Buffer(*mBuffer,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+    VK_PIPELINE_STAGE_2_HOST_BIT_KHR, VK_ACCESS_2_HOST_READ_BIT_KHR,
+    GetDynamicOffset(mCurrentFrame), GetRange()).Record(commandBuffer);
+}
+
+void FrameStatistics::Collect(const uint32_t frame)
+{
+  if(!mRecorded[frame] || !mCounters)
+  {
+    return;
+  }
+  mRecorded[frame] = false;
+
+  // The GPU is done with the slot so its counters can be read and zeroed for
+  // the next frame to add to. Writes from the host before a submit are seen by
+  // the commands it submits:
+  uint64_t* const counters = mCounters + GetDynamicOffset(frame) / sizeof(uint64_t);
+  std::copy(counters, counters + mNumCounters, mLastFrame.counters.begin());
+  std::fill(counters, counters + mNumCounters, uint64_t(0));
+
+  if(mQueries.Get())
+  {
+    uint64_t invocations = 0;
+    // No wait flag: the frame is known to be done so this never stalls.
+    const VkResult result = vkGetQueryPoolResults(*mDevice, *mQueries, frame, 1,
+      sizeof(invocations), &invocations, sizeof(invocations), VK_QUERY_RESULT_64_BIT);
+    if(result != VK_SUCCESS)
+    {
+      KRUST_LOG_WARN << "Pipeline statistics of frame slot " << frame << " not available: " << result << endlog;
+      invocations = 0;
+    }
+    mLastFrame.computeInvocations = invocations;
+  }
+  ++mLastFrame.frame;
+}
+
+} /* namespace Krust */
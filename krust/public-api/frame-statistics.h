@@ -0,0 +1,148 @@
+#ifndef KRUST_PUBLIC_API_FRAME_STATISTICS_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_FRAME_STATISTICS_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Counting the work done on the GPU in each frame, so that frame and pass
+ * times can be normalized by it, e.g. into nanoseconds per ray.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan-objects.h"
+
+// External includes:
+#include <cstdint>
+#include <vector>
+
+namespace Krust
+{
+
+class FrameStatistics;
+using FrameStatisticsPtr = IntrusivePointer<FrameStatistics>;
+
+/**
+ * @brief The work counted for one frame.
+ */
+struct FrameCounts
+{
+  /// Compute shader invocations from a pipeline statistics query, or zero if
+  /// those were not asked for.
+  uint64_t computeInvocations = 0;
+  /// The totals of the counters the shaders added to, in the order they were
+  /// declared in the shaders (see KRUST_SHADER_STATS in header.inc.glsl).
+  std::vector<uint64_t> counters;
+  /// The number of frames counted so far, so zero until the first is in.
+  uint64_t frame = 0;
+};
+
+/**
+ * @return The nanoseconds each item took on average if a number of items took
+ * the given milliseconds, or zero if there were no items.
+ */
+inline double NanosecondsPerItem(const double milliseconds, const uint64_t items)
+{
+  return items > 0 ? milliseconds * 1e6 / double(items) : 0.0;
+}
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Collects a pipeline statistics query and a set of 64 bit counters
+ * which shaders add to per frame.
+ *
+ * The counters live in host-visible memory with a region per frame in flight.
+ * Shaders see the region of the frame being recorded through a storage buffer
+ * descriptor created with GetBuffer() and GetRange(), bound with the dynamic
+ * offset GetDynamicOffset() returns. The shaders in krust-examples do this
+ * through the KRUST_SHADER_STATS macros of header.inc.glsl.
+ *
+ * As for the GpuProfiler, BeginFrame() reads back the counts of the last frame
+ * recorded in the slot before reusing it, so must only be called once the GPU
+ * is done with that frame. Reading then never stalls.
+ */
+class FrameStatistics : public RefObject
+{
+  /** Hidden constructor to prevent users doing naked `new`s.*/
+  FrameStatistics(Device& device, const VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize minStorageBufferOffsetAlignment, uint32_t numFrames, uint32_t numCounters, bool pipelineStatistics);
+
+  // Ban copying objects:
+  FrameStatistics(const FrameStatistics&) = delete;
+  FrameStatistics& operator=(const FrameStatistics&) = delete;
+
+public:
+  /**
+   * @param memoryProperties Those of the device, to find host-visible memory for
+   * the counters in.
+   * @param minStorageBufferOffsetAlignment From VkPhysicalDeviceLimits.
+   * @param numFrames The number of frames which can be in flight at once.
+   * @param numCounters The number of 64 bit counters the shaders add to.
+   * @param pipelineStatistics Whether to count compute shader invocations with
+   * a query. Needs the pipelineStatisticsQuery device feature to be enabled.
+   */
+  static FrameStatisticsPtr New(
+    Device& device,
+    const VkPhysicalDeviceMemoryProperties& memoryProperties,
+    VkDeviceSize minStorageBufferOffsetAlignment,
+    uint32_t numFrames,
+    uint32_t numCounters,
+    bool pipelineStatistics);
+
+  /**
+   * Collect the counts last recorded for the frame slot, zero its counters and
+   * start counting into it.
+   * Record this outside any render pass, before the work to be counted.
+   */
+  void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+  /**
+   * Stop counting and make the shaders' writes to the counters available to
+   * the host once the frame completes.
+   */
+  void EndFrame(VkCommandBuffer commandBuffer);
+
+  /** @return The counts of the most recent frame collected. */
+  const FrameCounts& GetLastFrame() const { return mLastFrame; }
+
+  /** @return The buffer holding the counters of all frame slots. */
+  VkBuffer GetBuffer() const { return *mBuffer; }
+  /** @return The bytes of the buffer used by one frame slot. */
+  VkDeviceSize GetRange() const { return mNumCounters * sizeof(uint64_t); }
+  /** @return The offset of a frame slot's counters from the start of the buffer. */
+  uint32_t GetDynamicOffset(uint32_t frame) const { return uint32_t(frame * mStride); }
+
+private:
+  void Collect(uint32_t frame);
+
+  DevicePtr mDevice;
+  BufferPtr mBuffer;
+  /// Null unless compute shader invocations are being counted.
+  QueryPoolPtr mQueries;
+  uint64_t* mCounters = nullptr;
+  VkDeviceSize mStride;
+  uint32_t mNumCounters;
+  /// Whether each frame slot has counts recorded into it waiting to be read.
+  std::vector<bool> mRecorded;
+  uint32_t mCurrentFrame = 0;
+  FrameCounts mLastFrame;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_FRAME_STATISTICS_H_INCLUDED_E26EF */
@@ -0,0 +1,193 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "krust/public-api/gpu-profiler.h"
+
+// Internal includes:
+#include "krust/public-api/krust-assertions.h"
+#include "krust/public-api/line-printer.h"
+#include "krust/public-api/logging.h"
+
+// External includes:
+#include <algorithm>
+#include <cstdio>
+
+namespace Krust
+{
+
+GpuProfiler::GpuProfiler(
+  Device& device,
+  const uint32_t numFrames,
+  const float timestampPeriod,
+  const uint32_t timestampValidBits,
+  const uint32_t maxScopesPerFrame,
+  const uint32_t historyLength) :
+  mDevice(&device),
+  mQueries(QueryPool::New(device, VK_QUERY_TYPE_TIMESTAMP, numFrames * maxScopesPerFrame * 2)),
+  mMillisecondsPerTick(timestampPeriod * 1e-6),
+  mTimestampMask(timestampValidBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << timestampValidBits) - 1),
+  mMaxScopesPerFrame(maxScopesPerFrame),
+  mHistoryLength(std::max(historyLength, 1u)),
+  mFrames(numFrames)
+{
+  KRUST_ASSERT1(timestampValidBits > 0, "The queue doesn't support timestamps.");
+}
+
+GpuProfilerPtr GpuProfiler::New(
+  Device& device,
+  const uint32_t numFrames,
+  const float timestampPeriod,
+  const uint32_t timestampValidBits,
+  const uint32_t maxScopesPerFrame,
+  const uint32_t historyLength)
+{
+  return new GpuProfiler { device, numFrames, timestampPeriod, timestampValidBits, maxScopesPerFrame, historyLength };
+}
+
+void GpuProfiler::BeginFrame(const VkCommandBuffer commandBuffer, const uint32_t frame)
+{
+  KRUST_ASSERT1(frame < mFrames.size(), "More frames in flight than the profiler was made for.");
+  KRUST_ASSERT1(mOpenScopes.empty(), "Scopes left open at the end of the last frame.");
+  mOpenScopes.clear();
+  Collect(frame);
+  mCurrentFrame = frame;
+  vkCmdResetQueryPool(commandBuffer, *mQueries, frame * mMaxScopesPerFrame * 2, mMaxScopesPerFrame * 2);
+}
+
+void GpuProfiler::BeginScope(const VkCommandBuffer commandBuffer, const char* const name)
+{
+  Frame& frame = mFrames[mCurrentFrame];
+  if(frame.recorded.size() >= mMaxScopesPerFrame)
+  {
+    mOpenScopes.push_back(NO_QUERY);
+    return;
+  }
+  const uint32_t firstQuery = uint32_t(mCurrentFrame * mMaxScopesPerFrame + frame.recorded.size()) * 2;
+  frame.recorded.push_back({ FindScope(name), firstQuery });
+  mOpenScopes.push_back(firstQuery);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, *mQueries, firstQuery);
+}
+
+void GpuProfiler::EndScope(const VkCommandBuffer commandBuffer)
+{
+  KRUST_ASSERT1(!mOpenScopes.empty(), "Ending a scope which was never begun.");
+  const uint32_t firstQuery = mOpenScopes.back();
+  mOpenScopes.pop_back();
+  if(firstQuery != NO_QUERY)
+  {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, *mQueries, firstQuery + 1);
+  }
+}
+
+std::vector<GpuScopeTimings> GpuProfiler::GetTimings() const
+{
+  std::vector<GpuScopeTimings> timings;
+  timings.reserve(mScopes.size());
+  for(const ScopeHistory& scope : mScopes)
+  {
+    GpuScopeTimings scopeTimings { scope.name, scope.depth, 0, 0, 0, 0, uint32_t(scope.milliseconds.size()) };
+    if(!scope.milliseconds.empty())
+    {
+      const auto minMax = std::minmax_element(scope.milliseconds.begin(), scope.milliseconds.end());
+      double sum = 0;
+      for(const double ms : scope.milliseconds)
+      {
+        sum += ms;
+      }
+      scopeTimings.minMilliseconds = *minMax.first;
+      scopeTimings.maxMilliseconds = *minMax.second;
+      scopeTimings.avgMilliseconds = sum / scope.milliseconds.size();
+      scopeTimings.lastMilliseconds = scope.milliseconds[(scope.next + mHistoryLength - 1) % mHistoryLength];
+    }
+    timings.push_back(scopeTimings);
+  }
+  return timings;
+}
+
+unsigned GpuProfiler::PrintTimings(LinePrinter& printer, const VkCommandBuffer commandBuffer, const uint8_t x, const uint8_t y) const
+{
+  unsigned lines = 0;
+  for(const GpuScopeTimings& timings : GetTimings())
+  {
+    char line[126];
+    snprintf(line, sizeof(line), "%*s%-*s avg %6.3f  min %6.3f  max %6.3f ms",
+      int(timings.depth * 2), "", int(16 - std::min(timings.depth * 2, 8u)), timings.name.c_str(),
+      timings.avgMilliseconds, timings.minMilliseconds, timings.maxMilliseconds);
+    printer.PrintLine(commandBuffer, x, uint8_t(y + lines), 7, 0, true, true, line);
+    ++lines;
+  }
+  return lines;
+}
+
+void GpuProfiler::Collect(const uint32_t frame)
+{
+  std::vector<Recorded>& recorded = mFrames[frame].recorded;
+  if(recorded.empty())
+  {
+    return;
+  }
+  const uint32_t firstQuery = frame * mMaxScopesPerFrame * 2;
+  std::vector<uint64_t> ticks(recorded.size() * 2);
+  // No wait flag: the frame is known to be done so this never stalls.
+  const VkResult result = vkGetQueryPoolResults(*mDevice, *mQueries, firstQuery, uint32_t(ticks.size()),
+    ticks.size() * sizeof(uint64_t), ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if(result == VK_SUCCESS)
+  {
+    for(const Recorded& scope : recorded)
+    {
+      const uint32_t query = scope.firstQuery - firstQuery;
+      const uint64_t elapsed = ((ticks[query + 1] & mTimestampMask) - (ticks[query] & mTimestampMask)) & mTimestampMask;
+      ScopeHistory& history = mScopes[scope.scope];
+      const double milliseconds = elapsed * mMillisecondsPerTick;
+      if(history.milliseconds.size() < mHistoryLength)
+      {
+        history.milliseconds.push_back(milliseconds);
+      }
+      else
+      {
+        history.milliseconds[history.next] = milliseconds;
+      }
+      history.next = (history.next + 1) % mHistoryLength;
+    }
+  }
+  else
+  {
+    ++mNumDroppedFrames;
+    KRUST_LOG_WARN << "GPU timings of frame slot " << frame << " not available: " << result << endlog;
+  }
+  recorded.clear();
+}
+
+uint32_t GpuProfiler::FindScope(const char* const name)
+{
+  for(uint32_t scope = 0; scope < mScopes.size(); ++scope)
+  {
+    if(mScopes[scope].name == name)
+    {
+      return scope;
+    }
+  }
+  mScopes.push_back({ name, uint32_t(mOpenScopes.size()), {}, 0 });
+  mScopes.back().milliseconds.reserve(mHistoryLength);
+  return uint32_t(mScopes.size() - 1);
+}
+
+} /* namespace Krust */
@@ -0,0 +1,200 @@
+#ifndef KRUST_PUBLIC_API_GPU_PROFILER_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_GPU_PROFILER_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Timing named scopes of the work in command buffers on the GPU itself
+ * with timestamp queries.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan-objects.h"
+
+// External includes:
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Krust
+{
+
+class LinePrinter;
+class GpuProfiler;
+using GpuProfilerPtr = IntrusivePointer<GpuProfiler>;
+
+/**
+ * @brief The recent GPU times of one named scope.
+ */
+struct GpuScopeTimings
+{
+  std::string name;
+  /// How many scopes this one was nested inside when first seen.
+  uint32_t depth;
+  double minMilliseconds;
+  double avgMilliseconds;
+  double maxMilliseconds;
+  /// The time of the most recent frame collected.
+  double lastMilliseconds;
+  /// The number of frames the figures cover, up to the history length.
+  uint32_t numSamples;
+};
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Times named scopes of GPU work, e.g. the passes of a frame, and keeps
+ * rolling statistics for each.
+ *
+ * Each frame in flight has its own range of timestamp queries. BeginFrame()
+ * reads back the results of the last frame recorded in the slot before reusing
+ * its queries, so must only be called once the GPU is done with that frame,
+ * e.g. after waiting on its fence or seeing its SubmitCounter complete on a
+ * QueueJanitor. The results are then ready and reading them never stalls.
+ *
+ * Both timestamps of a scope are written once all earlier commands have
+ * finished, so the time of a scope is that from the end of the work before it
+ * to the end of its own work. Scopes one after the other then add up to the
+ * time of the frame rather than overlapping.
+ */
+class GpuProfiler : public RefObject
+{
+  /** Hidden constructor to prevent users doing naked `new`s.*/
+  GpuProfiler(Device& device, uint32_t numFrames, float timestampPeriod, uint32_t timestampValidBits, uint32_t maxScopesPerFrame, uint32_t historyLength);
+
+  // Ban copying objects:
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+public:
+  /**
+   * @param numFrames The number of frames which can be in flight at once.
+   * @param timestampPeriod From VkPhysicalDeviceLimits: nanoseconds per tick.
+   * @param timestampValidBits From the VkQueueFamilyProperties of the queue the
+   * command buffers are submitted to. Must not be zero.
+   * @param maxScopesPerFrame Scopes beyond this in a frame are not timed.
+   * @param historyLength The number of frames the statistics cover.
+   */
+  static GpuProfilerPtr New(
+    Device&  device,
+    uint32_t numFrames,
+    float    timestampPeriod,
+    uint32_t timestampValidBits,
+    uint32_t maxScopesPerFrame = 32,
+    uint32_t historyLength = 120);
+
+  /**
+   * Collect the timings last recorded for the frame slot and start recording
+   * new ones into the command buffer.
+   */
+  void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+
+  /**
+   * Start timing a scope. Scopes can nest.
+   * @param name Scopes are matched up between frames by name.
+   */
+  void BeginScope(VkCommandBuffer commandBuffer, const char* name);
+  /** Stop timing the innermost scope. */
+  void EndScope(VkCommandBuffer commandBuffer);
+
+  /**
+   * @brief Times the commands recorded during its lifetime.
+   */
+  class Scope
+  {
+  public:
+    Scope(GpuProfiler* profiler, VkCommandBuffer commandBuffer, const char* name) :
+      mProfiler(profiler), mCommandBuffer(commandBuffer)
+    {
+      if(mProfiler)
+      {
+        mProfiler->BeginScope(commandBuffer, name);
+      }
+    }
+    ~Scope()
+    {
+      if(mProfiler)
+      {
+        mProfiler->EndScope(mCommandBuffer);
+      }
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  private:
+    GpuProfiler* mProfiler;
+    VkCommandBuffer mCommandBuffer;
+  };
+
+  /** @return Statistics of every scope seen so far, in the order first seen. */
+  std::vector<GpuScopeTimings> GetTimings() const;
+
+  /**
+   * Print a line per scope with its average, minimum and maximum times, one
+   * character row apart and indented by nesting.
+   * The printer must have been bound to the command buffer.
+   * @return The number of lines printed.
+   */
+  unsigned PrintTimings(LinePrinter& printer, VkCommandBuffer commandBuffer, uint8_t x, uint8_t y) const;
+
+  /** @return The number of frames whose timings were not ready when collected. */
+  uint64_t GetNumDroppedFrames() const { return mNumDroppedFrames; }
+
+private:
+  static constexpr uint32_t NO_QUERY = ~0u;
+
+  /// A scope recorded into a frame, timed by two consecutive queries.
+  struct Recorded
+  {
+    uint32_t scope;
+    uint32_t firstQuery;
+  };
+  struct Frame
+  {
+    std::vector<Recorded> recorded;
+  };
+  struct ScopeHistory
+  {
+    std::string name;
+    uint32_t depth;
+    /// Ring of the most recent times.
+    std::vector<double> milliseconds;
+    uint32_t next = 0;
+  };
+
+  void Collect(uint32_t frame);
+  uint32_t FindScope(const char* name);
+
+  DevicePtr mDevice;
+  QueryPoolPtr mQueries;
+  double mMillisecondsPerTick;
+  uint64_t mTimestampMask;
+  uint32_t mMaxScopesPerFrame;
+  uint32_t mHistoryLength;
+  std::vector<Frame> mFrames;
+  std::vector<ScopeHistory> mScopes;
+  /// The first query of the open scopes, or NO_QUERY for those not timed.
+  std::vector<uint32_t> mOpenScopes;
+  uint32_t mCurrentFrame = 0;
+  uint64_t mNumDroppedFrames = 0;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_GPU_PROFILER_H_INCLUDED_E26EF */
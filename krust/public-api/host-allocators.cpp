@@ -0,0 +1,513 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "krust/public-api/host-allocators.h"
+
+// Internal includes:
+#include "krust/public-api/logging.h"
+
+// External includes:
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace Krust
+{
+
+namespace
+{
+
+/// Sits just before each block handed to Vulkan so frees and reallocations,
+/// which aren't told the size or scope, can find them.
+struct BlockHeader
+{
+  /// The start of the memory the block was carved from, or null for a block
+  /// in an arena.
+  void* base;
+  /// The arena the block is in, or null.
+  void* arena;
+  uint64_t size;
+  uint64_t scope;
+};
+
+const char* const SCOPE_NAMES[NUM_SYSTEM_ALLOCATION_SCOPES] = { "command", "object", "cache", "device", "instance" };
+
+inline BlockHeader* HeaderOf(void* const block)
+{
+  return reinterpret_cast<BlockHeader*>(block) - 1;
+}
+
+inline size_t BlockAlignment(const size_t alignment)
+{
+  return std::max(alignment, alignof(BlockHeader));
+}
+
+inline uintptr_t AlignUp(const uintptr_t address, const size_t alignment)
+{
+  return (address + alignment - 1u) & ~uintptr_t(alignment - 1u);
+}
+
+/// @return The bytes to ask for so a block of size bytes plus its header fits
+/// at the alignment wherever the allocation lands.
+inline size_t PaddedSize(const size_t size, const size_t alignment)
+{
+  return size + sizeof(BlockHeader) + alignment - 1u;
+}
+
+/// Place a block and its header within memory of PaddedSize() bytes.
+void* PlaceBlock(void* const base, void* const arena, const size_t size, const size_t alignment, const VkSystemAllocationScope scope)
+{
+  void* const block = reinterpret_cast<void*>(AlignUp(uintptr_t(base) + sizeof(BlockHeader), alignment));
+  BlockHeader* const header = HeaderOf(block);
+  header->base = base;
+  header->arena = arena;
+  header->size = size;
+  header->scope = uint64_t(scope);
+  return block;
+}
+
+void* HeapAllocate(const size_t size, const size_t alignment, const VkSystemAllocationScope scope)
+{
+  const size_t blockAlignment = BlockAlignment(alignment);
+  void* const base = std::malloc(PaddedSize(size, blockAlignment));
+  if(!base)
+  {
+    return nullptr;
+  }
+  return PlaceBlock(base, nullptr, size, blockAlignment, scope);
+}
+
+inline unsigned ScopeIndex(const uint64_t scope)
+{
+  return scope < NUM_SYSTEM_ALLOCATION_SCOPES ? unsigned(scope) : NUM_SYSTEM_ALLOCATION_SCOPES - 1u;
+}
+
+/// Raise a peak to a new value if it is higher.
+inline void RaisePeak(std::atomic<uint64_t>& peak, const uint64_t value)
+{
+  uint64_t current = peak.load(std::memory_order_relaxed);
+  while(value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+  {
+  }
+}
+
+/// Identifies allocators in threads' caches of their arena so an arena cached
+/// for one that was destroyed is never mistaken for one of another at the same
+/// address.
+std::atomic<uint64_t> sNextArenaAllocatorId { 1 };
+
+}
+
+TrackingAllocator::TrackingAllocator()
+{
+  mCallbacks.pUserData = this;
+  mCallbacks.pfnAllocation = Allocate;
+  mCallbacks.pfnReallocation = Reallocate;
+  mCallbacks.pfnFree = Free;
+  mCallbacks.pfnInternalAllocation = InternalAllocation;
+  mCallbacks.pfnInternalFree = InternalFree;
+}
+
+HostAllocationStats TrackingAllocator::GetStats() const
+{
+  const auto snapshot = [](const Counters& counters)
+  {
+    HostAllocationCounts counts;
+    counts.allocations = counters.allocations.load(std::memory_order_relaxed);
+    counts.reallocations = counters.reallocations.load(std::memory_order_relaxed);
+    counts.frees = counters.frees.load(std::memory_order_relaxed);
+    counts.bytes = counters.bytes.load(std::memory_order_relaxed);
+    counts.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+    return counts;
+  };
+
+  HostAllocationStats stats;
+  for(unsigned scope = 0; scope < NUM_SYSTEM_ALLOCATION_SCOPES; ++scope)
+  {
+    stats.scopes[scope] = snapshot(mScopes[scope]);
+  }
+  stats.total = snapshot(mTotal);
+  stats.internalBytes = mInternalBytes.load(std::memory_order_relaxed);
+  stats.internalPeakBytes = mInternalPeakBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void TrackingAllocator::LogStats() const
+{
+  const HostAllocationStats stats = GetStats();
+  KRUST_LOG_INFO << "Host allocations by scope (allocations, reallocations, frees, bytes live, peak bytes):" << endlog;
+  for(unsigned scope = 0; scope < NUM_SYSTEM_ALLOCATION_SCOPES; ++scope)
+  {
+    const HostAllocationCounts& counts = stats.scopes[scope];
+    KRUST_LOG_INFO << "  " << SCOPE_NAMES[scope] << ": " << counts.allocations << ", " << counts.reallocations << ", " << counts.frees << ", " << counts.bytes << ", " << counts.peakBytes << endlog;
+  }
+  const HostAllocationCounts& total = stats.total;
+  KRUST_LOG_INFO << "  total: " << total.allocations << ", " << total.reallocations << ", " << total.frees << ", " << total.bytes << ", " << total.peakBytes << endlog;
+  KRUST_LOG_INFO << "  internal: " << stats.internalBytes << " bytes live, " << stats.internalPeakBytes << " peak." << endlog;
+}
+
+void TrackingAllocator::AddBytes(const unsigned scope, const int64_t bytes)
+{
+  const uint64_t scopeBytes = mScopes[scope].bytes.fetch_add(uint64_t(bytes), std::memory_order_relaxed) + uint64_t(bytes);
+  const uint64_t totalBytes = mTotal.bytes.fetch_add(uint64_t(bytes), std::memory_order_relaxed) + uint64_t(bytes);
+  if(bytes > 0)
+  {
+    RaisePeak(mScopes[scope].peakBytes, scopeBytes);
+    RaisePeak(mTotal.peakBytes, totalBytes);
+  }
+}
+
+void* TrackingAllocator::Allocate(void* const userData, const size_t size, const size_t alignment, const VkSystemAllocationScope scope)
+{
+  TrackingAllocator& self = *static_cast<TrackingAllocator*>(userData);
+  void* const block = HeapAllocate(size, alignment, scope);
+  if(block)
+  {
+    const unsigned index = ScopeIndex(scope);
+    self.mScopes[index].allocations.fetch_add(1u, std::memory_order_relaxed);
+    self.mTotal.allocations.fetch_add(1u, std::memory_order_relaxed);
+    self.AddBytes(index, int64_t(size));
+  }
+  return block;
+}
+
+void* TrackingAllocator::Reallocate(void* const userData, void* const original, const size_t size, const size_t alignment, const VkSystemAllocationScope scope)
+{
+  if(!original)
+  {
+    return Allocate(userData, size, alignment, scope);
+  }
+  if(size == 0)
+  {
+    Free(userData, original);
+    return nullptr;
+  }
+
+  TrackingAllocator& self = *static_cast<TrackingAllocator*>(userData);
+  void* const block = HeapAllocate(size, alignment, scope);
+  if(!block)
+  {
+    // The original is left alone as the spec requires:
+    return nullptr;
+  }
+  const BlockHeader& oldHeader = *HeaderOf(original);
+  const unsigned oldIndex = ScopeIndex(oldHeader.scope);
+  const unsigned index = ScopeIndex(scope);
+  std::memcpy(block, original, std::min(size_t(oldHeader.size), size));
+  // Both blocks are live for a moment so the peaks include them both:
+  self.AddBytes(index, int64_t(size));
+  self.AddBytes(oldIndex, -int64_t(oldHeader.size));
+  self.mScopes[index].reallocations.fetch_add(1u, std::memory_order_relaxed);
+  self.mTotal.reallocations.fetch_add(1u, std::memory_order_relaxed);
+  std::free(oldHeader.base);
+  return block;
+}
+
+void TrackingAllocator::Free(void* const userData, void* const memory)
+{
+  if(!memory)
+  {
+    return;
+  }
+  TrackingAllocator& self = *static_cast<TrackingAllocator*>(userData);
+  const BlockHeader& header = *HeaderOf(memory);
+  const unsigned index = ScopeIndex(header.scope);
+  self.AddBytes(index, -int64_t(header.size));
+  self.mScopes[index].frees.fetch_add(1u, std::memory_order_relaxed);
+  self.mTotal.frees.fetch_add(1u, std::memory_order_relaxed);
+  std::free(header.base);
+}
+
+void TrackingAllocator::InternalAllocation(void* const userData, const size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+  TrackingAllocator& self = *static_cast<TrackingAllocator*>(userData);
+  const uint64_t bytes = self.mInternalBytes.fetch_add(size, std::memory_order_relaxed) + size;
+  RaisePeak(self.mInternalPeakBytes, bytes);
+}
+
+void TrackingAllocator::InternalFree(void* const userData, const size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+  TrackingAllocator& self = *static_cast<TrackingAllocator*>(userData);
+  self.mInternalBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+/**
+ * The chunks a thread bumps its command scoped blocks through. Only the owning
+ * thread allocates from it, but a block could be freed on any thread so the
+ * count of live blocks is atomic.
+ */
+struct ArenaAllocator::ThreadArena
+{
+  struct Chunk
+  {
+    uint8_t* memory;
+    size_t size;
+  };
+
+  explicit ThreadArena(std::thread::id thread) : thread(thread) {}
+  ~ThreadArena()
+  {
+    for(const Chunk& chunk : chunks)
+    {
+      std::free(chunk.memory);
+    }
+  }
+
+  std::thread::id thread;
+  /// The last chunk is the one being bumped through.
+  std::vector<Chunk> chunks;
+  /// Offset of the next free byte in the last chunk.
+  size_t offset = 0;
+  std::atomic<uint32_t> live { 0 };
+};
+
+namespace
+{
+
+/// The arena the thread last used and the allocator it belongs to.
+struct ThreadArenaCache
+{
+  uint64_t allocatorId = 0;
+  void* arena = nullptr;
+};
+thread_local ThreadArenaCache tArenaCache;
+
+}
+
+ArenaAllocator::ArenaAllocator(const VkAllocationCallbacks* const next, const size_t chunkBytes) :
+  mNext(next),
+  mChunkBytes(std::max(chunkBytes, size_t(256))),
+  mId(sNextArenaAllocatorId.fetch_add(1u, std::memory_order_relaxed))
+{
+  mCallbacks.pUserData = this;
+  mCallbacks.pfnAllocation = Allocate;
+  mCallbacks.pfnReallocation = Reallocate;
+  mCallbacks.pfnFree = Free;
+  mCallbacks.pfnInternalAllocation = InternalAllocation;
+  mCallbacks.pfnInternalFree = InternalFree;
+}
+
+ArenaAllocator::~ArenaAllocator()
+{
+  for(const auto& arena : mArenas)
+  {
+    if(arena->live.load(std::memory_order_relaxed) != 0)
+    {
+      KRUST_LOG_WARN << arena->live.load(std::memory_order_relaxed) << " command scoped host allocations were never freed." << endlog;
+    }
+  }
+}
+
+ArenaAllocatorStats ArenaAllocator::GetStats() const
+{
+  ArenaAllocatorStats stats;
+  stats.commandAllocations = mCommandAllocations.load(std::memory_order_relaxed);
+  stats.commandBytes = mCommandBytes.load(std::memory_order_relaxed);
+  stats.otherAllocations = mOtherAllocations.load(std::memory_order_relaxed);
+  stats.reservedBytes = mReservedBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+ArenaAllocator::ThreadArena& ArenaAllocator::GetThreadArena()
+{
+  if(tArenaCache.allocatorId == mId)
+  {
+    return *static_cast<ThreadArena*>(tArenaCache.arena);
+  }
+
+  // The thread last used another allocator, or none, so look for an arena it
+  // made earlier before making one:
+  const std::thread::id thread = std::this_thread::get_id();
+  ThreadArena* arena = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mArenasMutex);
+    for(const auto& candidate : mArenas)
+    {
+      if(candidate->thread == thread)
+      {
+        arena = candidate.get();
+        break;
+      }
+    }
+    if(!arena)
+    {
+      mArenas.push_back(std::make_unique<ThreadArena>(thread));
+      arena = mArenas.back().get();
+    }
+  }
+  tArenaCache.allocatorId = mId;
+  tArenaCache.arena = arena;
+  return *arena;
+}
+
+void* ArenaAllocator::AllocateFromArena(ThreadArena& arena, const size_t size, const size_t alignment)
+{
+  // Every block handed out has been freed so start again from the beginning,
+  // merging the chunks if the arena had to grow since the last time:
+  if(arena.offset != 0 && arena.live.load(std::memory_order_acquire) == 0)
+  {
+    if(arena.chunks.size() > 1u)
+    {
+      size_t total = 0;
+      for(const ThreadArena::Chunk& chunk : arena.chunks)
+      {
+        total += chunk.size;
+        std::free(chunk.memory);
+      }
+      arena.chunks.clear();
+      uint8_t* const memory = static_cast<uint8_t*>(std::malloc(total));
+      if(memory)
+      {
+        arena.chunks.push_back({ memory, total });
+      }
+      else
+      {
+        mReservedBytes.fetch_sub(total, std::memory_order_relaxed);
+      }
+    }
+    arena.offset = 0;
+  }
+
+  const size_t blockAlignment = BlockAlignment(alignment);
+  if(!arena.chunks.empty())
+  {
+    const ThreadArena::Chunk& chunk = arena.chunks.back();
+    const uintptr_t start = uintptr_t(chunk.memory) + arena.offset;
+    const uintptr_t block = AlignUp(start + sizeof(BlockHeader), blockAlignment);
+    if(block + size <= uintptr_t(chunk.memory) + chunk.size)
+    {
+      arena.offset = block + size - uintptr_t(chunk.memory);
+      arena.live.fetch_add(1u, std::memory_order_relaxed);
+      return PlaceBlock(reinterpret_cast<void*>(start), &arena, size, blockAlignment, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+    }
+  }
+
+  // Grow by a chunk at least as big as the last one, doubling to keep the
+  // number of chunks down until the next merge:
+  const size_t lastSize = arena.chunks.empty() ? mChunkBytes / 2u : arena.chunks.back().size;
+  const size_t chunkSize = std::max(lastSize * 2u, PaddedSize(size, blockAlignment));
+  uint8_t* const memory = static_cast<uint8_t*>(std::malloc(chunkSize));
+  if(!memory)
+  {
+    return nullptr;
+  }
+  mReservedBytes.fetch_add(chunkSize, std::memory_order_relaxed);
+  arena.chunks.push_back({ memory, chunkSize });
+  void* const block = PlaceBlock(memory, &arena, size, blockAlignment, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+  arena.offset = uintptr_t(block) + size - uintptr_t(memory);
+  arena.live.fetch_add(1u, std::memory_order_relaxed);
+  return block;
+}
+
+void* ArenaAllocator::Allocate(void* const userData, const size_t size, const size_t alignment, const VkSystemAllocationScope scope)
+{
+  ArenaAllocator& self = *static_cast<ArenaAllocator*>(userData);
+  if(scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND)
+  {
+    void* const block = self.AllocateFromArena(self.GetThreadArena(), size, alignment);
+    if(block)
+    {
+      self.mCommandAllocations.fetch_add(1u, std::memory_order_relaxed);
+      self.mCommandBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return block;
+  }
+
+  self.mOtherAllocations.fetch_add(1u, std::memory_order_relaxed);
+  if(!self.mNext)
+  {
+    return HeapAllocate(size, alignment, scope);
+  }
+  // Our header goes in front of the next allocator's block so frees can tell
+  // these apart from arena blocks:
+  const size_t blockAlignment = BlockAlignment(alignment);
+  const size_t prefix = AlignUp(sizeof(BlockHeader), blockAlignment);
+  void* const base = self.mNext->pfnAllocation(self.mNext->pUserData, size + prefix, blockAlignment, scope);
+  if(!base)
+  {
+    return nullptr;
+  }
+  return PlaceBlock(base, nullptr, size, blockAlignment, scope);
+}
+
+void* ArenaAllocator::Reallocate(void* const userData, void* const original, const size_t size, const size_t alignment, const VkSystemAllocationScope scope)
+{
+  if(!original)
+  {
+    return Allocate(userData, size, alignment, scope);
+  }
+  if(size == 0)
+  {
+    Free(userData, original);
+    return nullptr;
+  }
+  void* const block = Allocate(userData, size, alignment, scope);
+  if(block)
+  {
+    std::memcpy(block, original, std::min(size_t(HeaderOf(original)->size), size));
+    Free(userData, original);
+  }
+  return block;
+}
+
+void ArenaAllocator::Free(void* const userData, void* const memory)
+{
+  if(!memory)
+  {
+    return;
+  }
+  ArenaAllocator& self = *static_cast<ArenaAllocator*>(userData);
+  const BlockHeader& header = *HeaderOf(memory);
+  if(header.arena)
+  {
+    // The arena rewinds on its own thread's next allocation once this is zero:
+    static_cast<ThreadArena*>(header.arena)->live.fetch_sub(1u, std::memory_order_release);
+  }
+  else if(self.mNext)
+  {
+    self.mNext->pfnFree(self.mNext->pUserData, header.base);
+  }
+  else
+  {
+    std::free(header.base);
+  }
+}
+
+void ArenaAllocator::InternalAllocation(void* const userData, const size_t size, const VkInternalAllocationType type, const VkSystemAllocationScope scope)
+{
+  const ArenaAllocator& self = *static_cast<ArenaAllocator*>(userData);
+  if(self.mNext && self.mNext->pfnInternalAllocation)
+  {
+    self.mNext->pfnInternalAllocation(self.mNext->pUserData, size, type, scope);
+  }
+}
+
+void ArenaAllocator::InternalFree(void* const userData, const size_t size, const VkInternalAllocationType type, const VkSystemAllocationScope scope)
+{
+  const ArenaAllocator& self = *static_cast<ArenaAllocator*>(userData);
+  if(self.mNext && self.mNext->pfnInternalFree)
+  {
+    self.mNext->pfnInternalFree(self.mNext->pUserData, size, type, scope);
+  }
+}
+
+} /* namespace Krust */
@@ -0,0 +1,208 @@
+#ifndef KRUST_PUBLIC_API_HOST_ALLOCATORS_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_HOST_ALLOCATORS_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Ready-made VkAllocationCallbacks to pass to InitKrust(), so that the
+ * memory the Vulkan implementation allocates on the host for Krust's objects
+ * and commands can be measured and made cheaper.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan_types_and_macros.h"
+
+// External includes:
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Krust
+{
+
+/// The number of VkSystemAllocationScope values, from COMMAND (0) to INSTANCE (4).
+constexpr unsigned NUM_SYSTEM_ALLOCATION_SCOPES = 5u;
+
+/**
+ * @brief Counts of host allocations, either in one VkSystemAllocationScope or
+ * in all of them.
+ */
+struct HostAllocationCounts
+{
+  /// Calls to allocate, not counting reallocations.
+  uint64_t allocations = 0;
+  uint64_t reallocations = 0;
+  uint64_t frees = 0;
+  /// Bytes currently allocated.
+  uint64_t bytes = 0;
+  /// The most bytes allocated at once.
+  uint64_t peakBytes = 0;
+};
+
+/**
+ * @brief A snapshot of the counts of a TrackingAllocator.
+ */
+struct HostAllocationStats
+{
+  /// Indexed by VkSystemAllocationScope.
+  HostAllocationCounts scopes[NUM_SYSTEM_ALLOCATION_SCOPES];
+  HostAllocationCounts total;
+  /// Memory the implementation allocated itself and told us about.
+  uint64_t internalBytes = 0;
+  uint64_t internalPeakBytes = 0;
+};
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Allocation callbacks which count the calls and bytes of each
+ * VkSystemAllocationScope, keeping the peak bytes of each, before passing the
+ * allocations on to the C heap.
+ *
+ * The callbacks don't say which type of object an allocation is for so the
+ * scope is as fine as the counts go.
+ * The object must outlive everything allocated through its callbacks, i.e. the
+ * instance and devices and all objects created from them.
+ * The counts are atomic so the callbacks can be called from any thread.
+ */
+class TrackingAllocator
+{
+public:
+  TrackingAllocator();
+  TrackingAllocator(const TrackingAllocator&) = delete;
+  TrackingAllocator& operator=(const TrackingAllocator&) = delete;
+
+  /** @return Callbacks to pass to InitKrust() or to chain from another allocator. */
+  VkAllocationCallbacks* GetCallbacks() { return &mCallbacks; }
+
+  /// A snapshot of the counts. Not atomic with respect to concurrent allocations.
+  HostAllocationStats GetStats() const;
+
+  /** Log the counts of each scope and the totals. */
+  void LogStats() const;
+
+private:
+  struct Counters
+  {
+    std::atomic<uint64_t> allocations { 0 };
+    std::atomic<uint64_t> reallocations { 0 };
+    std::atomic<uint64_t> frees { 0 };
+    std::atomic<uint64_t> bytes { 0 };
+    std::atomic<uint64_t> peakBytes { 0 };
+  };
+
+  static VKAPI_ATTR void* VKAPI_CALL Allocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+  static VKAPI_ATTR void* VKAPI_CALL Reallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+  static VKAPI_ATTR void VKAPI_CALL Free(void* userData, void* memory);
+  static VKAPI_ATTR void VKAPI_CALL InternalAllocation(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+  static VKAPI_ATTR void VKAPI_CALL InternalFree(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+  /// Add to or take from the bytes of a scope and the total, raising the peaks.
+  void AddBytes(unsigned scope, int64_t bytes);
+
+  Counters mScopes[NUM_SYSTEM_ALLOCATION_SCOPES];
+  Counters mTotal;
+  std::atomic<uint64_t> mInternalBytes { 0 };
+  std::atomic<uint64_t> mInternalPeakBytes { 0 };
+  VkAllocationCallbacks mCallbacks;
+};
+
+/**
+ * @brief Counts of the work of an ArenaAllocator.
+ */
+struct ArenaAllocatorStats
+{
+  /// Allocations in the COMMAND scope served from the arenas.
+  uint64_t commandAllocations = 0;
+  uint64_t commandBytes = 0;
+  /// Allocations in other scopes passed on to the next allocator.
+  uint64_t otherAllocations = 0;
+  /// Bytes held by the arenas of all threads.
+  uint64_t reservedBytes = 0;
+};
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Allocation callbacks which serve allocations in the
+ * VK_SYSTEM_ALLOCATION_SCOPE_COMMAND scope by bumping a pointer through an
+ * arena of the calling thread, and pass all others on to the next allocator.
+ *
+ * Command scoped allocations only live as long as the Vulkan command which
+ * made them, so each thread's arena goes back to its start as soon as all of
+ * its blocks have been freed, which happens at least once per command and so
+ * many times a frame. Doing that on the arena's own thread, rather than
+ * resetting all arenas at a frame boundary, means it can never race with a
+ * command being recorded on another thread. If an arena had to grow during
+ * a frame, its chunks are merged into one big enough for the next.
+ *
+ * The object must outlive everything allocated through its callbacks. The
+ * arenas of threads which exit are kept until it is destroyed.
+ */
+class ArenaAllocator
+{
+public:
+  /**
+   * @param next Callbacks for the scopes other than COMMAND, e.g. those of a
+   * TrackingAllocator, or null to use the C heap. They are also told about
+   * the implementation's internal allocations.
+   * @param chunkBytes The size of the first chunk of each thread's arena.
+   */
+  explicit ArenaAllocator(const VkAllocationCallbacks* next = nullptr, size_t chunkBytes = 64 * 1024);
+  ~ArenaAllocator();
+  ArenaAllocator(const ArenaAllocator&) = delete;
+  ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+  /** @return Callbacks to pass to InitKrust(). */
+  VkAllocationCallbacks* GetCallbacks() { return &mCallbacks; }
+
+  /// A snapshot of the counts. Not atomic with respect to concurrent allocations.
+  ArenaAllocatorStats GetStats() const;
+
+private:
+  struct ThreadArena;
+
+  static VKAPI_ATTR void* VKAPI_CALL Allocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+  static VKAPI_ATTR void* VKAPI_CALL Reallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+  static VKAPI_ATTR void VKAPI_CALL Free(void* userData, void* memory);
+  static VKAPI_ATTR void VKAPI_CALL InternalAllocation(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+  static VKAPI_ATTR void VKAPI_CALL InternalFree(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+  /// @return The arena of the calling thread, made on its first allocation.
+  ThreadArena& GetThreadArena();
+  void* AllocateFromArena(ThreadArena& arena, size_t size, size_t alignment);
+
+  const VkAllocationCallbacks* mNext;
+  size_t mChunkBytes;
+  /// Tells this allocator apart from others in the threads' caches of their arena.
+  uint64_t mId;
+  std::mutex mArenasMutex;
+  std::vector<std::unique_ptr<ThreadArena>> mArenas;
+  std::atomic<uint64_t> mCommandAllocations { 0 };
+  std::atomic<uint64_t> mCommandBytes { 0 };
+  std::atomic<uint64_t> mOtherAllocations { 0 };
+  std::atomic<uint64_t> mReservedBytes { 0 };
+  VkAllocationCallbacks mCallbacks;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_HOST_ALLOCATORS_H_INCLUDED_E26EF */
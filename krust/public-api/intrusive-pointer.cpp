@@ -60,5 +60,23 @@ void IntrusivePointerBase::Reset(RefObject* other)
   mRefObject = other;
 }
 
+void IntrusivePointerBase::MoveFrom(IntrusivePointerBase& other) noexcept
+{
+  if(this != &other)
+  {
+    Adopt(other.Release());
+  }
+}
+
+void IntrusivePointerBase::Adopt(RefObject* other)
+{
+  RefObject* const old = mRefObject;
+  mRefObject = other;
+  if(old)
+  {
+    old->Dec();
+  }
+}
+
 
 } /* namespace Krust */
@@ -25,6 +25,9 @@
 #include "krust/public-api/ref-object.h"
 #include "krust-kernel/public-api/debug.h"
 
+// External includes:
+#include <utility>
+
 namespace Krust {
 
 /**
@@ -38,11 +41,25 @@ public:
   bool operator==(const IntrusivePointerBase& rhs) const { return mRefObject == rhs.mRefObject; }
 
 protected:
+  /** Tag to select constructors which take over an existing reference. */
+  struct AdoptTag {};
+
   IntrusivePointerBase() : mRefObject(nullptr) {}
   IntrusivePointerBase(RefObject& refObject);
   IntrusivePointerBase(RefObject* refObject);
+  /** Take over a reference already counted in the object without incrementing. */
+  IntrusivePointerBase(RefObject* refObject, AdoptTag) noexcept : mRefObject(refObject) {}
+  /** Steal the reference of the other pointer, leaving it null. No refcount traffic. */
+  IntrusivePointerBase(IntrusivePointerBase&& other) noexcept : mRefObject(other.mRefObject) { other.mRefObject = nullptr; }
   ~IntrusivePointerBase();
   void Reset(RefObject* other);
+  /** Drop our reference and steal the other pointer's one, leaving it null. */
+  void MoveFrom(IntrusivePointerBase& other) noexcept;
+  /** Drop our reference and take over one already counted in the object passed in. */
+  void Adopt(RefObject* other);
+  /** Give up our reference without decrementing the count. */
+  RefObject* Release() noexcept { RefObject* const released = mRefObject; mRefObject = nullptr; return released; }
+  void Swap(IntrusivePointerBase& other) noexcept { RefObject* const temp = mRefObject; mRefObject = other.mRefObject; other.mRefObject = temp; }
 
   RefObject* mRefObject;
 };
@@ -57,6 +74,7 @@ class IntrusivePointer : public IntrusivePointerBase
 public:
   IntrusivePointer() {}
   IntrusivePointer(const IntrusivePointer<T>& counted) : IntrusivePointerBase(counted.Get()) { KRUST_DEBUG_CODE( mPointee = Get() ); }
+  IntrusivePointer(IntrusivePointer<T>&& counted) noexcept : IntrusivePointerBase(std::move(counted)) { KRUST_DEBUG_CODE( mPointee = Get(); counted.mPointee = nullptr ); }
   IntrusivePointer(T* counted) : IntrusivePointerBase(counted) { KRUST_DEBUG_CODE( mPointee = Get() ); }
   IntrusivePointer(T& counted) : IntrusivePointerBase(counted) { KRUST_DEBUG_CODE( mPointee = Get() );}
   IntrusivePointer<T>& operator=(const IntrusivePointer<T>& other)
@@ -65,17 +83,53 @@ public:
     KRUST_DEBUG_CODE( mPointee = Get() );
     return *this;
   }
+  IntrusivePointer<T>& operator=(IntrusivePointer<T>&& other) noexcept
+  {
+    MoveFrom(other);
+    KRUST_DEBUG_CODE( mPointee = Get(); other.mPointee = nullptr );
+    return *this;
+  }
+
+  /**
+   * Wrap an object whose count already includes a reference for this pointer,
+   * such as one previously given up by Release(), without incrementing it.
+   */
+  static IntrusivePointer<T> Adopt(T* counted) { return IntrusivePointer<T>(counted, AdoptTag{}); }
 
   T* Get() const { return reinterpret_cast<T*>(mRefObject); }
   T* operator->() const { return Get(); }
   T& operator*() const { return *Get(); }
 
   void Reset(T* other = nullptr){ IntrusivePointerBase::Reset(other); KRUST_DEBUG_CODE( mPointee = Get() ); }
+
+  /**
+   * Give up ownership of the pointee without decrementing its count, leaving
+   * this pointer null. The caller becomes responsible for the reference, e.g.
+   * by passing it to Adopt() later or calling Dec() on the object.
+   */
+  T* Release() noexcept { KRUST_DEBUG_CODE( mPointee = nullptr ); return reinterpret_cast<T*>(IntrusivePointerBase::Release()); }
+
+  /** Exchange pointees with another pointer without touching either count. */
+  void Swap(IntrusivePointer<T>& other) noexcept
+  {
+    IntrusivePointerBase::Swap(other);
+    KRUST_DEBUG_CODE( mPointee = Get(); other.mPointee = other.Get() );
+  }
+
 private:
+  IntrusivePointer(T* counted, AdoptTag tag) noexcept : IntrusivePointerBase(counted, tag) { KRUST_DEBUG_CODE( mPointee = Get() ); }
+
   // Typed alias of the thing pointed at that we can look through in a debugger.
   KRUST_DEBUG_CODE(T* mPointee = nullptr);
 };
 
+/** Found by argument-dependent lookup so `using std::swap; swap(a, b);` avoids refcount traffic. */
+template<class T>
+inline void swap(IntrusivePointer<T>& lhs, IntrusivePointer<T>& rhs) noexcept
+{
+  lhs.Swap(rhs);
+}
+
 } /* namespace Krust */
 
 #endif /* KRUST_PUBLIC_API_INTRUSIVE_POINTER_H_ */
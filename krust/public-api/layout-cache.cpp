@@ -0,0 +1,146 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "krust/public-api/layout-cache.h"
+
+// Internal includes:
+#include "krust/internal/fnv-hash.h"
+#include "krust/public-api/krust-assertions.h"
+#include "krust/public-api/vulkan_struct_init.h"
+
+// External includes:
+#include <algorithm>
+
+namespace Krust
+{
+
+size_t LayoutCache::KeyHash::operator()(const Key& key) const
+{
+  return size_t(Internal::Fnv1aWords(key.data(), key.size()));
+}
+
+LayoutCache::LayoutCache(Device& device) :
+  mDevice(&device)
+{
+}
+
+LayoutCachePtr LayoutCache::New(Device& device)
+{
+  return new LayoutCache { device };
+}
+
+DescriptorSetLayoutPtr LayoutCache::GetDescriptorSetLayout(const span<const VkDescriptorSetLayoutBinding> bindings, const VkDescriptorSetLayoutCreateFlags flags)
+{
+  std::vector<VkDescriptorSetLayoutBinding> sorted { bindings.begin(), bindings.end() };
+  std::sort(sorted.begin(), sorted.end(),
+    [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b){ return a.binding < b.binding; });
+
+  Key key { flags };
+  for(const auto& b : sorted)
+  {
+    key.push_back(b.binding);
+    key.push_back(uint64_t(b.descriptorType));
+    key.push_back(b.descriptorCount);
+    key.push_back(b.stageFlags);
+    // Immutable samplers are baked into the layout so they distinguish it:
+    key.push_back(b.pImmutableSamplers != nullptr);
+    if(b.pImmutableSamplers)
+    {
+      for(uint32_t i = 0; i < b.descriptorCount; ++i)
+      {
+        key.push_back(uint64_t(b.pImmutableSamplers[i]));
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  DescriptorSetLayoutPtr& layout = mDescriptorSetLayouts[key];
+  if(!layout)
+  {
+    layout = DescriptorSetLayout::New(*mDevice, flags, uint32_t(sorted.size()), sorted.data());
+  }
+  return layout;
+}
+
+DescriptorSetLayoutPtr LayoutCache::GetDescriptorSetLayout(const SpirVReflection& reflection, const uint32_t set)
+{
+  const std::vector<VkDescriptorSetLayoutBinding> bindings = reflection.GetSetBindings(set);
+  KRUST_ASSERT1(std::none_of(bindings.begin(), bindings.end(), [](const VkDescriptorSetLayoutBinding& b){ return b.descriptorCount == 0; }),
+    "Runtime-sized descriptor arrays need their layout built by hand.");
+  return GetDescriptorSetLayout(bindings);
+}
+
+PipelineLayoutPtr LayoutCache::GetPipelineLayout(const span<const VkDescriptorSetLayout> setLayouts, const span<const VkPushConstantRange> pushConstantRanges)
+{
+  // Set layouts from this cache are unique per shape so their handles are
+  // enough to tell pipeline layouts apart:
+  Key key { setLayouts.size() };
+  for(const VkDescriptorSetLayout setLayout : setLayouts)
+  {
+    key.push_back(uint64_t(setLayout));
+  }
+  for(const auto& range : pushConstantRanges)
+  {
+    key.push_back(range.stageFlags);
+    key.push_back(range.offset);
+    key.push_back(range.size);
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  PipelineLayoutPtr& layout = mPipelineLayouts[key];
+  if(!layout)
+  {
+    layout = PipelineLayout::New(*mDevice, 0,
+      uint32_t(setLayouts.size()), setLayouts.data(),
+      uint32_t(pushConstantRanges.size()), pushConstantRanges.data());
+  }
+  return layout;
+}
+
+PipelineLayoutPtr LayoutCache::GetPipelineLayout(const SpirVReflection& reflection)
+{
+  // Sets the shader skips over still need a layout, so they get empty ones:
+  std::vector<VkDescriptorSetLayout> setLayouts;
+  for(uint32_t set = 0; set < reflection.NumSets(); ++set)
+  {
+    setLayouts.push_back(*GetDescriptorSetLayout(reflection, set));
+  }
+  std::vector<VkPushConstantRange> ranges;
+  if(reflection.pushConstantBytes > 0)
+  {
+    ranges.push_back(PushConstantRange(reflection.stage, 0, reflection.pushConstantBytes));
+  }
+  return GetPipelineLayout(setLayouts, ranges);
+}
+
+size_t LayoutCache::GetNumDescriptorSetLayouts() const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mDescriptorSetLayouts.size();
+}
+
+size_t LayoutCache::GetNumPipelineLayouts() const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mPipelineLayouts.size();
+}
+
+} /* namespace Krust */
@@ -0,0 +1,101 @@
+#ifndef KRUST_PUBLIC_API_LAYOUT_CACHE_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_LAYOUT_CACHE_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Sharing descriptor set and pipeline layouts between everything which
+ * asks for identical ones.
+ */
+
+// Internal includes:
+#include "krust/public-api/spirv-reflection.h"
+#include "krust/public-api/vulkan-objects.h"
+
+// External includes:
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Krust
+{
+
+class LayoutCache;
+using LayoutCachePtr = IntrusivePointer<LayoutCache>;
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Hands out one DescriptorSetLayout per distinct set of bindings and
+ * one PipelineLayout per distinct combination of set layouts and push
+ * constant ranges.
+ *
+ * Two descriptor set layouts with the same bindings are compatible anyway, so
+ * sharing them costs nothing and means fewer layout objects for the driver to
+ * track, fewer distinct pool shapes for descriptor allocators and pipeline
+ * layouts that can be shared in turn because their set layout handles match.
+ * Bindings are compared regardless of the order they are passed in.
+ *
+ * Layouts stay in the cache until it is destroyed. It may be used from any
+ * thread.
+ */
+class LayoutCache : public RefObject
+{
+  /** Hidden constructor to prevent users doing naked `new`s.*/
+  LayoutCache(Device& device);
+
+  // Ban copying objects:
+  LayoutCache(const LayoutCache&) = delete;
+  LayoutCache& operator=(const LayoutCache&) = delete;
+
+public:
+  static LayoutCachePtr New(Device& device);
+
+  DescriptorSetLayoutPtr GetDescriptorSetLayout(span<const VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags = 0);
+  /// The layout of one set of a reflected shader. Runtime arrays in it must
+  /// be given a size by building the bindings by hand instead.
+  DescriptorSetLayoutPtr GetDescriptorSetLayout(const SpirVReflection& reflection, uint32_t set);
+
+  PipelineLayoutPtr GetPipelineLayout(span<const VkDescriptorSetLayout> setLayouts, span<const VkPushConstantRange> pushConstantRanges = {});
+  /// A layout with every set of a reflected shader and its push constants.
+  PipelineLayoutPtr GetPipelineLayout(const SpirVReflection& reflection);
+
+  size_t GetNumDescriptorSetLayouts() const;
+  size_t GetNumPipelineLayouts() const;
+  Device& GetDevice() const { return *mDevice; }
+
+private:
+  /// Everything that distinguishes one layout from another, flattened.
+  using Key = std::vector<uint64_t>;
+  struct KeyHash
+  {
+    size_t operator()(const Key& key) const;
+  };
+
+  DevicePtr mDevice;
+  mutable std::mutex mMutex;
+  std::unordered_map<Key, DescriptorSetLayoutPtr, KeyHash> mDescriptorSetLayouts;
+  std::unordered_map<Key, PipelineLayoutPtr, KeyHash> mPipelineLayouts;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_LAYOUT_CACHE_H_INCLUDED_E26EF */
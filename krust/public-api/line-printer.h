@@ -27,12 +27,23 @@
  */
 
 // Internal includes:
+#include "krust/public-api/descriptor-allocator.h"
+#include "krust/public-api/krust-assertions.h"
+#include "krust/public-api/krust-errors.h"
+#include "krust/public-api/layout-cache.h"
+#include "krust/public-api/logging.h"
+#include "krust/public-api/mapped-spirv.h"
+#include "krust/public-api/pipeline-compiler.h"
+#include "krust/public-api/thread-base.h"
 #include "krust/public-api/vulkan-objects.h"
 #include "krust/public-api/vulkan-utils.h"
+#include "krust/public-api/vulkan_struct_init.h"
 #include "krust-kernel/public-api/span.h"
 
 // External includes:
 #include "krust/public-api/vulkan.h"
+#include <algorithm>
+#include <string_view>
 #include <vector>
 
 namespace Krust
@@ -58,17 +69,18 @@ struct LinePrinterFrameParams
 class LinePrinter
 {
 public:
-    /// @param image_views The images that can be printed into (e.g. all the images in a swapchain).
-    LinePrinter(Krust::Device& device, span<VkImageView> image_views) : mDevice(&device)
+    /// @param descriptors Where the per-frame descriptor sets naming the image
+    /// to print into come from. Usually shared with the rest of the frame.
+    /// @param layouts Where the layouts reflected from the shader come from.
+    /// @param pipelineCache Where to look for the compiled text shader.
+    LinePrinter(Krust::Device& device, DescriptorAllocator& descriptors, LayoutCache& layouts, VkPipelineCache pipelineCache = VK_NULL_HANDLE) : mDevice(&device), mDescriptors(&descriptors)
     {
-        // Build all resources required to run the compute shader:
-
-        // Load the spir-v shader code into a module:
-        ShaderBuffer spirv { loadSpirV(mShaderName) };
-        if(spirv.empty()){
+        const MappedSpirV mapped { mShaderName };
+        if(!mapped.IsValid()){
             ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalState, "Failed to load SPIR-V shader.", __FUNCTION__, __FILE__, __LINE__);
         }
-        auto shaderModule = ShaderModule::New(device, 0, spirv);
+        InitLayouts(device, layouts, mapped.GetWords());
+        auto shaderModule = ShaderModule::New(device, 0, mapped.GetWords());
 
         const auto ssci = PipelineShaderStageCreateInfo(
             0,
@@ -78,23 +90,6 @@ public:
             nullptr // VkSpecializationInfo
         );
 
-        // Define the descriptor and pipeline layouts:
-
-        const auto fbBinding = DescriptorSetLayoutBinding(
-            0, // Binding to the first location
-            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-            1,
-            VK_SHADER_STAGE_COMPUTE_BIT,
-            nullptr // No immutable samplers.
-        );
-
-        mDescriptorSetLayout = DescriptorSetLayout::New(device, 0, 1, &fbBinding);
-        mPipelineLayout = PipelineLayout::New(device,
-            0,
-            *mDescriptorSetLayout,
-            PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(LinePrinterFrameParams))
-        );
-
         // Construct our compute pipeline:
         mComputePipeline = ComputePipeline::New(device, ComputePipelineCreateInfo(
             0,    // no flags
@@ -102,41 +97,58 @@ public:
             *mPipelineLayout,
             VK_NULL_HANDLE, // no base pipeline
             -1 // No index of a base pipeline.
-        ));
-
-        // Create a descriptor pool and allocate a matching descriptorSet for each image
-        // we are asked to render into:
-        VkDescriptorPoolSize poolSizes[1] = {{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1u}};
-        mDescriptorPool = DescriptorPool::New(device, 0, image_views.size(), uint32_t(1), poolSizes);
-        unsigned slot = 0;
-        for(auto& view : image_views){
-            mDescriptorSets.push_back( DescriptorSet::Allocate(*mDescriptorPool, *mDescriptorSetLayout));
-            SetFramebuffer(view, slot++);
+        ), pipelineCache);
+    }
+
+    /// @param compiler Creates the pipeline in the background. The first
+    /// BindCommandBuffer() waits for it.
+    /// @param spirv The text shader if it is embedded in the binary. It is
+    /// loaded from a file if this is empty.
+    LinePrinter(Krust::Device& device, DescriptorAllocator& descriptors, LayoutCache& layouts, PipelineCompiler& compiler, span<const uint32_t> spirv = {}) : mDevice(&device), mDescriptors(&descriptors)
+    {
+        if(!spirv.empty()){
+            InitLayouts(device, layouts, spirv);
+            mPendingPipeline = compiler.CompileCompute(spirv, *mPipelineLayout);
+            return;
         }
+        // The file is only mapped for as long as it takes to make a module:
+        const MappedSpirV mapped { mShaderName };
+        if(!mapped.IsValid()){
+            ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalState, "Failed to load SPIR-V shader.", __FUNCTION__, __FILE__, __LINE__);
+        }
+        InitLayouts(device, layouts, mapped.GetWords());
+        mPendingPipeline = compiler.CompileCompute(*ShaderModule::New(device, 0, mapped.GetWords()), *mPipelineLayout);
     }
 
-    /// Once per frame call this to make sure we write text into the correct image.
-    void SetFramebuffer(VkImageView imageView, unsigned slot)
+    /// Once per frame, after the DescriptorAllocator has begun the frame, call
+    /// this to make sure we write text into the correct image.
+    void SetFramebuffer(VkImageView imageView)
     {
-        auto imageInfo  = DescriptorImageInfo(VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_GENERAL);
-        auto write = WriteDescriptorSet(*mDescriptorSets[slot % mDescriptorSets.size()], 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &imageInfo, nullptr, nullptr);
-        vkUpdateDescriptorSets(*mDevice, 1, &write, 0, nullptr);
+        mDescriptorSet = mDescriptors->Allocate(*mDescriptorSetLayout);
+        const auto imageInfo = DescriptorImageInfo(VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_GENERAL);
+        mUpdateTemplate->Update(mDescriptorSet, &imageInfo);
     }
 
     /// Bind the descriptor set to the command buffer and other ops done before a
     /// sequence of prints.
-    void BindCommandBuffer(VkCommandBuffer commandBuffer, unsigned slot)
+    /// @return False if the text pipeline failed to compile, in which case
+    /// nothing is bound and PrintLine() does nothing.
+    bool BindCommandBuffer(VkCommandBuffer commandBuffer)
     {
+        if(!ResolvePipeline()){
+            return false;
+        }
         vkCmdBindDescriptorSets(
             commandBuffer,
             VK_PIPELINE_BIND_POINT_COMPUTE,
             *mPipelineLayout,
             0,
             1,
-            mDescriptorSets[slot % mDescriptorSets.size()]->GetHandleAddress(),
+            &mDescriptorSet,
             0, nullptr // No dynamic offsets.
         );
         vkCmdBindPipeline(commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, *mComputePipeline);
+        return true;
     }
 
     /// Print a line of 125 8*16 pixel chars at a top-left relative location
@@ -151,6 +163,9 @@ public:
         // Between 0 and 125 characters to print.
         const std::string_view& msg)
     {
+        if(!mComputePipeline){
+            return;
+        }
         const size_t msg_len = std::min(msg.size(), size_t(125));
         params.fb_char_x = x;
         params.fb_char_y = y;
@@ -161,15 +176,50 @@ public:
         vkCmdDispatch(commandBuffer, msg_len, 1, 1);
     }
 private:
+    /// Wait for the pipeline if it is still being compiled.
+    /// @return True if there is a pipeline to print with.
+    bool ResolvePipeline()
+    {
+        if(mPendingPipeline.valid()){
+            // A throwing error policy's exception comes out of get() here:
+            mComputePipeline = mPendingPipeline.get();
+            mPendingPipeline = ComputePipelineFuture();
+            if(!mComputePipeline){
+                KRUST_LOG_ERROR << "The text pipeline failed to compile so no text will be printed." << endlog;
+            }
+        }
+        if(mComputePipeline.Get() && *mComputePipeline == VK_NULL_HANDLE){
+            KRUST_LOG_ERROR << "The text pipeline failed to compile so no text will be printed." << endlog;
+            mComputePipeline.Reset();
+        }
+        return mComputePipeline.Get() != nullptr;
+    }
+
+    void InitLayouts(Krust::Device& device, LayoutCache& layouts, span<const uint32_t> spirv)
+    {
+        SpirVReflection reflection;
+        ReflectSpirV(spirv, reflection);
+        KRUST_ASSERT1(reflection.pushConstantBytes == sizeof(LinePrinterFrameParams), "Text shader's push constants don't match LinePrinterFrameParams.");
+        mDescriptorSetLayout = layouts.GetDescriptorSetLayout(reflection, 0);
+        mPipelineLayout = layouts.GetPipelineLayout(reflection);
+
+        // The only descriptor is the image to print into, written straight from
+        // a VkDescriptorImageInfo:
+        const auto fbEntry = DescriptorUpdateTemplateEntry(0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, sizeof(VkDescriptorImageInfo));
+        mUpdateTemplate = DescriptorUpdateTemplate::New(device, *mDescriptorSetLayout, 1, &fbEntry);
+    }
+
     const char* mShaderName {"text_print.comp.spv"};
     Krust::DevicePtr mDevice;
     DescriptorSetLayoutPtr mDescriptorSetLayout;
+    DescriptorUpdateTemplatePtr mUpdateTemplate;
     PipelineLayoutPtr mPipelineLayout;
     ComputePipelinePtr mComputePipeline;
-    DescriptorPoolPtr mDescriptorPool;
-    /// We need one of these per image in the app's present queue unless we wait for
-    /// the GPU every frame.
-    std::vector<DescriptorSetPtr> mDescriptorSets;
+    /// Set when the pipeline is being created by a PipelineCompiler.
+    ComputePipelineFuture mPendingPipeline;
+    DescriptorAllocatorPtr mDescriptors;
+    /// The set for the current frame's framebuffer. Recycled with the frame.
+    VkDescriptorSet mDescriptorSet = VK_NULL_HANDLE;
     LinePrinterFrameParams params;
 };
 
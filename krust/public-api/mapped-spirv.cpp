@@ -0,0 +1,165 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "krust/public-api/mapped-spirv.h"
+
+// Internal includes:
+#include "krust/public-api/logging.h"
+#include "krust/public-api/trace.h"
+
+// External includes:
+#include <utility>
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Krust
+{
+
+namespace
+{
+
+constexpr uint32_t SPIRV_MAGIC = 0x07230203u;
+/// The magic number, version, generator, bound and schema words.
+constexpr size_t SPIRV_HEADER_WORDS = 5u;
+
+bool CheckSpirV(const char* const filename, const void* const code, const size_t bytes)
+{
+  if(bytes % sizeof(uint32_t) != 0 || bytes / sizeof(uint32_t) < SPIRV_HEADER_WORDS)
+  {
+    KRUST_LOG_ERROR << "Shader file \"" << filename << "\" is " << bytes << " bytes which is not a whole number of SPIR-V words with a header." << endlog;
+    return false;
+  }
+  if(*static_cast<const uint32_t*>(code) != SPIRV_MAGIC)
+  {
+    KRUST_LOG_ERROR << "Shader file \"" << filename << "\" does not start with the SPIR-V magic number." << endlog;
+    return false;
+  }
+  return true;
+}
+
+}
+
+MappedSpirV::MappedSpirV(const char* const filename)
+{
+  KRUST_TRACE_SCOPE("MappedSpirV");
+#if !defined(_WIN32)
+  const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if(fd < 0)
+  {
+    KRUST_LOG_ERROR << "Failed to open shader file \"" << filename << "\"." << endlog;
+    return;
+  }
+  struct stat status;
+  if(fstat(fd, &status) != 0 || status.st_size <= 0)
+  {
+    KRUST_LOG_ERROR << "Failed to get the size of shader file \"" << filename << "\"." << endlog;
+    close(fd);
+    return;
+  }
+  const size_t bytes = size_t(status.st_size);
+  void* const mapping = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file alive on its own:
+  close(fd);
+  if(mapping == MAP_FAILED)
+  {
+    KRUST_LOG_ERROR << "Failed to map shader file \"" << filename << "\"." << endlog;
+    return;
+  }
+  mMapping = mapping;
+  mMappedBytes = bytes;
+  if(!CheckSpirV(filename, mapping, bytes))
+  {
+    Release();
+    return;
+  }
+  mWords = static_cast<const uint32_t*>(mapping);
+  mNumWords = bytes / sizeof(uint32_t);
+#else
+  std::ifstream is { filename, std::ios::binary | std::ios::ate };
+  if(!is)
+  {
+    KRUST_LOG_ERROR << "Failed to open shader file \"" << filename << "\"." << endlog;
+    return;
+  }
+  const size_t bytes = size_t(is.tellg());
+  mFallback.resize((bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+  is.seekg(0);
+  is.read(reinterpret_cast<char*>(mFallback.data()), bytes);
+  if(!is || !CheckSpirV(filename, mFallback.data(), bytes))
+  {
+    Release();
+    return;
+  }
+  mWords = mFallback.data();
+  mNumWords = mFallback.size();
+#endif
+}
+
+MappedSpirV::MappedSpirV(MappedSpirV&& other) noexcept :
+  mWords(std::exchange(other.mWords, nullptr)),
+  mNumWords(std::exchange(other.mNumWords, 0)),
+  mMapping(std::exchange(other.mMapping, nullptr)),
+  mMappedBytes(std::exchange(other.mMappedBytes, 0)),
+  mFallback(std::move(other.mFallback))
+{
+}
+
+MappedSpirV& MappedSpirV::operator=(MappedSpirV&& other) noexcept
+{
+  if(this != &other)
+  {
+    Release();
+    mWords = std::exchange(other.mWords, nullptr);
+    mNumWords = std::exchange(other.mNumWords, 0);
+    mMapping = std::exchange(other.mMapping, nullptr);
+    mMappedBytes = std::exchange(other.mMappedBytes, 0);
+    mFallback = std::move(other.mFallback);
+  }
+  return *this;
+}
+
+MappedSpirV::~MappedSpirV()
+{
+  Release();
+}
+
+void MappedSpirV::Release()
+{
+#if !defined(_WIN32)
+  if(mMapping)
+  {
+    munmap(mMapping, mMappedBytes);
+  }
+#endif
+  mWords = nullptr;
+  mNumWords = 0;
+  mMapping = nullptr;
+  mMappedBytes = 0;
+  mFallback.clear();
+}
+
+} /* namespace Krust */
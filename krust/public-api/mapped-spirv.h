@@ -0,0 +1,86 @@
+#ifndef KRUST_PUBLIC_API_MAPPED_SPIRV_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_MAPPED_SPIRV_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Loading SPIR-V from files by mapping them into memory rather than
+ * reading them into a buffer.
+ *
+ * Shaders built with Krust's examples are embedded in their executables (see
+ * tools/scripts/spv2inc.py), so this is for packs of shaders shipped beside a
+ * binary or named at runtime.
+ */
+
+// Internal includes:
+#include "krust-kernel/public-api/span.h"
+
+// External includes:
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Krust
+{
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief A read-only view of a SPIR-V file mapped into the address space of
+ * the process.
+ *
+ * The words can be passed straight to ShaderModule::New() without being
+ * copied. The file is checked for being a whole number of words starting with
+ * the SPIR-V magic number, and an empty view is left if it is missing or
+ * fails either check.
+ * Where the platform has no mmap the file is read into a heap buffer instead.
+ */
+class MappedSpirV
+{
+public:
+  MappedSpirV() = default;
+  explicit MappedSpirV(const char* filename);
+  MappedSpirV(MappedSpirV&& other) noexcept;
+  MappedSpirV& operator=(MappedSpirV&& other) noexcept;
+  ~MappedSpirV();
+
+  // Ban copying objects:
+  MappedSpirV(const MappedSpirV&) = delete;
+  MappedSpirV& operator=(const MappedSpirV&) = delete;
+
+  /// The words of the shader, valid until this is destroyed or moved from.
+  span<const uint32_t> GetWords() const { return { mWords, mNumWords }; }
+  bool IsValid() const { return mNumWords > 0; }
+
+private:
+  void Release();
+
+  const uint32_t* mWords = nullptr;
+  size_t mNumWords = 0;
+  /// Start and length of the mapping, which are kept to unmap it.
+  void* mMapping = nullptr;
+  size_t mMappedBytes = 0;
+  /// Holds the words where there is no mmap.
+  std::vector<uint32_t> mFallback;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_MAPPED_SPIRV_H_INCLUDED_E26EF */
@@ -0,0 +1,422 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compilation unit header:
+#include "object-pool.h"
+
+// Internal includes:
+#include "krust/public-api/krust-assertions.h"
+
+// External includes:
+#include <atomic>
+#include <mutex>
+#include <new>
+
+namespace Krust
+{
+
+#if defined(KRUST_BUILD_CONFIG_DISABLE_OBJECT_POOLS)
+
+ObjectPoolStats GetObjectPoolStats()
+{
+  return ObjectPoolStats{};
+}
+
+namespace Internal
+{
+
+void* PoolAllocate(const std::size_t bytes)
+{
+  return ::operator new(bytes);
+}
+
+void PoolFree(void* const block, const std::size_t) noexcept
+{
+  ::operator delete(block);
+}
+
+} // namespace Internal
+
+#else
+
+namespace
+{
+
+/// Block sizes are multiples of this, which also keeps them suitably aligned.
+constexpr std::size_t GRANULE = 16;
+constexpr std::size_t NUM_SIZE_CLASSES = 32;
+/// Anything bigger than this goes to the general heap.
+constexpr std::size_t MAX_POOLED_BYTES = GRANULE * NUM_SIZE_CLASSES;
+/// Size of the chunks taken from the heap to be carved up into blocks.
+constexpr std::size_t SLAB_BYTES = 16 * 1024;
+/// Number of blocks moved between a thread's list and the shared one at a time.
+constexpr unsigned BATCH_SIZE = 32;
+/// A thread hands a batch back to the shared list when it holds more than this.
+constexpr unsigned MAX_THREAD_FREE = BATCH_SIZE * 2;
+
+KRUST_COMPILE_ASSERT(GRANULE % alignof(std::max_align_t) == 0, "Blocks would not be aligned for all types.");
+KRUST_COMPILE_ASSERT(SLAB_BYTES >= MAX_POOLED_BYTES * BATCH_SIZE, "Slabs should hold at least a batch of the largest blocks.");
+
+inline std::size_t SizeClass(const std::size_t bytes)
+{
+  return bytes == 0 ? 0 : (bytes - 1) / GRANULE;
+}
+
+inline std::size_t BlockBytes(const std::size_t sizeClass)
+{
+  return (sizeClass + 1) * GRANULE;
+}
+
+struct FreeBlock
+{
+  FreeBlock* next;
+};
+
+struct SharedFreeList
+{
+  std::mutex mutex;
+  FreeBlock* head = nullptr;
+};
+
+SharedFreeList sSharedLists[NUM_SIZE_CLASSES];
+
+/**
+ * A counter only ever written by one thread but which may be read by others.
+ * Avoids an atomic read-modify-write on the allocation path.
+ */
+struct OwnedCounter
+{
+  void Add(const uint64_t n) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+  uint64_t Get() const { return value.load(std::memory_order_relaxed); }
+  std::atomic<uint64_t> value {0};
+};
+
+struct ThreadStats
+{
+  OwnedCounter allocations;
+  OwnedCounter frees;
+  OwnedCounter threadHits;
+  OwnedCounter sharedRefills;
+  OwnedCounter slabAllocations;
+  OwnedCounter oversized;
+  OwnedCounter bytesReserved;
+};
+
+void Accumulate(const ThreadStats& stats, ObjectPoolStats& total)
+{
+  total.allocations     += stats.allocations.Get();
+  total.frees           += stats.frees.Get();
+  total.threadHits      += stats.threadHits.Get();
+  total.sharedRefills   += stats.sharedRefills.Get();
+  total.slabAllocations += stats.slabAllocations.Get();
+  total.oversized       += stats.oversized.Get();
+  total.bytesReserved   += stats.bytesReserved.Get();
+}
+
+/**
+ * Blocks for each size class that the owning thread can use without locking.
+ * Every live cache is on a list so its counters can be summed.
+ */
+struct ThreadCache
+{
+  ThreadCache();
+  ~ThreadCache();
+  FreeBlock* lists[NUM_SIZE_CLASSES] = {};
+  unsigned counts[NUM_SIZE_CLASSES] = {};
+  ThreadStats stats;
+  ThreadCache* prev = nullptr;
+  ThreadCache* next = nullptr;
+};
+
+/// Guards the list of thread caches and the retired stats.
+std::mutex sRegistryMutex;
+ThreadCache* sRegistry = nullptr;
+/// Counters of threads that have exited and of operations made after a
+/// thread's cache was torn down.
+ObjectPoolStats sRetiredStats;
+
+/// Set once the thread's cache has been destroyed so late frees during thread
+/// exit go to the shared lists. Trivially destructible so it outlives the cache.
+thread_local bool tCacheDestroyed = false;
+thread_local ThreadCache tCache;
+
+/// Push a chain of blocks onto the front of the shared list.
+void PushToShared(const std::size_t sizeClass, FreeBlock* const first, FreeBlock* const last)
+{
+  SharedFreeList& shared = sSharedLists[sizeClass];
+  std::lock_guard<std::mutex> lock(shared.mutex);
+  last->next = shared.head;
+  shared.head = first;
+}
+
+/// Take a slab from the heap and chain its blocks into a list.
+/// All but the first batch of blocks go onto the shared list.
+/// @return The first block of the list.
+FreeBlock* CarveSlab(const std::size_t sizeClass, unsigned& outNumBlocks)
+{
+  const std::size_t blockBytes = BlockBytes(sizeClass);
+  const unsigned numBlocks = unsigned(SLAB_BYTES / blockBytes);
+  const unsigned numKept = numBlocks < BATCH_SIZE ? numBlocks : BATCH_SIZE;
+  // Slabs are never returned to the heap: objects may be freed on any thread
+  // at any time up to process exit so there is no safe point to do so.
+  char* const slab = static_cast<char*>(::operator new(SLAB_BYTES));
+  const auto blockAt = [slab, blockBytes](const unsigned i) { return reinterpret_cast<FreeBlock*>(slab + i * blockBytes); };
+  for(unsigned i = 0; i + 1 < numBlocks; ++i)
+  {
+    blockAt(i)->next = blockAt(i + 1);
+  }
+  blockAt(numKept - 1)->next = nullptr;
+  blockAt(numBlocks - 1)->next = nullptr;
+  if(numKept < numBlocks)
+  {
+    PushToShared(sizeClass, blockAt(numKept), blockAt(numBlocks - 1));
+  }
+  outNumBlocks = numKept;
+  return blockAt(0);
+}
+
+/// Move up to a batch of blocks from the shared list to the thread's list.
+void RefillFromShared(ThreadCache& cache, const std::size_t sizeClass)
+{
+  SharedFreeList& shared = sSharedLists[sizeClass];
+  std::lock_guard<std::mutex> lock(shared.mutex);
+  unsigned moved = 0;
+  while(shared.head && moved < BATCH_SIZE)
+  {
+    FreeBlock* const block = shared.head;
+    shared.head = block->next;
+    block->next = cache.lists[sizeClass];
+    cache.lists[sizeClass] = block;
+    ++moved;
+  }
+  cache.counts[sizeClass] += moved;
+}
+
+/// Hand a batch of blocks from the thread's list back to the shared list.
+/// The blocks at the back of the list, which were freed longest ago and are
+/// least likely to be in the cache, are the ones given away.
+void ReturnBatchToShared(ThreadCache& cache, const std::size_t sizeClass, const unsigned numBlocks)
+{
+  KRUST_ASSERT2(numBlocks > 0 && numBlocks <= cache.counts[sizeClass], "Can't return more blocks than held.");
+  const unsigned numKept = cache.counts[sizeClass] - numBlocks;
+  FreeBlock* first = cache.lists[sizeClass];
+  if(numKept == 0)
+  {
+    cache.lists[sizeClass] = nullptr;
+  }
+  else
+  {
+    FreeBlock* lastKept = first;
+    for(unsigned i = 1; i < numKept; ++i)
+    {
+      lastKept = lastKept->next;
+    }
+    first = lastKept->next;
+    lastKept->next = nullptr;
+  }
+  FreeBlock* last = first;
+  while(last->next)
+  {
+    last = last->next;
+  }
+  cache.counts[sizeClass] = numKept;
+  PushToShared(sizeClass, first, last);
+}
+
+ThreadCache::ThreadCache()
+{
+  std::lock_guard<std::mutex> lock(sRegistryMutex);
+  next = sRegistry;
+  if(next)
+  {
+    next->prev = this;
+  }
+  sRegistry = this;
+}
+
+ThreadCache::~ThreadCache()
+{
+  for(std::size_t sizeClass = 0; sizeClass < NUM_SIZE_CLASSES; ++sizeClass)
+  {
+    if(counts[sizeClass] > 0)
+    {
+      ReturnBatchToShared(*this, sizeClass, counts[sizeClass]);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(sRegistryMutex);
+    Accumulate(stats, sRetiredStats);
+    if(prev)
+    {
+      prev->next = next;
+    }
+    else
+    {
+      sRegistry = next;
+    }
+    if(next)
+    {
+      next->prev = prev;
+    }
+  }
+  tCacheDestroyed = true;
+}
+
+/// Slow path for allocations and frees made while the thread is exiting.
+void* AllocateWithoutCache(const std::size_t sizeClass)
+{
+  SharedFreeList& shared = sSharedLists[sizeClass];
+  {
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if(shared.head)
+    {
+      FreeBlock* const block = shared.head;
+      shared.head = block->next;
+      std::lock_guard<std::mutex> statsLock(sRegistryMutex);
+      ++sRetiredStats.allocations;
+      return block;
+    }
+  }
+  unsigned numBlocks = 0;
+  FreeBlock* const block = CarveSlab(sizeClass, numBlocks);
+  if(block->next)
+  {
+    FreeBlock* last = block->next;
+    while(last->next)
+    {
+      last = last->next;
+    }
+    PushToShared(sizeClass, block->next, last);
+  }
+  std::lock_guard<std::mutex> statsLock(sRegistryMutex);
+  ++sRetiredStats.allocations;
+  ++sRetiredStats.slabAllocations;
+  sRetiredStats.bytesReserved += SLAB_BYTES;
+  return block;
+}
+
+void FreeWithoutCache(void* const memory, const std::size_t sizeClass)
+{
+  FreeBlock* const block = static_cast<FreeBlock*>(memory);
+  {
+    SharedFreeList& shared = sSharedLists[sizeClass];
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    block->next = shared.head;
+    shared.head = block;
+  }
+  std::lock_guard<std::mutex> statsLock(sRegistryMutex);
+  ++sRetiredStats.frees;
+}
+
+} // namespace
+
+ObjectPoolStats GetObjectPoolStats()
+{
+  std::lock_guard<std::mutex> lock(sRegistryMutex);
+  ObjectPoolStats total = sRetiredStats;
+  for(const ThreadCache* cache = sRegistry; cache; cache = cache->next)
+  {
+    Accumulate(cache->stats, total);
+  }
+  return total;
+}
+
+namespace Internal
+{
+
+void* PoolAllocate(const std::size_t bytes)
+{
+  if(bytes > MAX_POOLED_BYTES)
+  {
+    if(!tCacheDestroyed)
+    {
+      tCache.stats.oversized.Add(1);
+    }
+    return ::operator new(bytes);
+  }
+  const std::size_t sizeClass = SizeClass(bytes);
+  if(tCacheDestroyed)
+  {
+    return AllocateWithoutCache(sizeClass);
+  }
+
+  ThreadCache& cache = tCache;
+  cache.stats.allocations.Add(1);
+  if(cache.lists[sizeClass])
+  {
+    cache.stats.threadHits.Add(1);
+  }
+  else
+  {
+    RefillFromShared(cache, sizeClass);
+    if(cache.lists[sizeClass])
+    {
+      cache.stats.sharedRefills.Add(1);
+    }
+    else
+    {
+      unsigned numBlocks = 0;
+      cache.lists[sizeClass] = CarveSlab(sizeClass, numBlocks);
+      cache.counts[sizeClass] = numBlocks;
+      cache.stats.slabAllocations.Add(1);
+      cache.stats.bytesReserved.Add(SLAB_BYTES);
+    }
+  }
+
+  FreeBlock* const block = cache.lists[sizeClass];
+  cache.lists[sizeClass] = block->next;
+  --cache.counts[sizeClass];
+  return block;
+}
+
+void PoolFree(void* const memory, const std::size_t bytes) noexcept
+{
+  if(!memory)
+  {
+    return;
+  }
+  if(bytes > MAX_POOLED_BYTES)
+  {
+    ::operator delete(memory);
+    return;
+  }
+  const std::size_t sizeClass = SizeClass(bytes);
+  if(tCacheDestroyed)
+  {
+    FreeWithoutCache(memory, sizeClass);
+    return;
+  }
+
+  ThreadCache& cache = tCache;
+  cache.stats.frees.Add(1);
+  FreeBlock* const block = static_cast<FreeBlock*>(memory);
+  block->next = cache.lists[sizeClass];
+  cache.lists[sizeClass] = block;
+  if(++cache.counts[sizeClass] > MAX_THREAD_FREE)
+  {
+    ReturnBatchToShared(cache, sizeClass, BATCH_SIZE);
+  }
+}
+
+} // namespace Internal
+
+#endif // KRUST_BUILD_CONFIG_DISABLE_OBJECT_POOLS
+
+} // namespace Krust
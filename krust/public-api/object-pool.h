@@ -0,0 +1,109 @@
+#ifndef KRUST_PUBLIC_API_OBJECT_POOL_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_OBJECT_POOL_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * @file Size-class pools for the small, frequently created and destroyed
+ * objects of Krust such as the Vulkan API object wrappers.
+ *
+ * Each thread keeps a free list per size class so that allocating and freeing
+ * objects does not touch the general heap or any lock in the common case.
+ * Threads exchange batches of free blocks through a shared, mutex-protected
+ * free list per size class when their own lists run dry or grow too long, so
+ * an object created on one thread and destroyed on another is handled without
+ * leaking memory into that thread's list forever.
+ *
+ * Define KRUST_BUILD_CONFIG_DISABLE_OBJECT_POOLS to send everything straight to
+ * the global `operator new` and `operator delete`, e.g. when running under an
+ * address sanitizer.
+ */
+
+// External includes:
+#include <cstddef>
+#include <cstdint>
+
+namespace Krust
+{
+
+/**
+ * @brief Counters summed across all threads which have used the pools.
+ */
+struct ObjectPoolStats
+{
+  /// Number of objects allocated through the pools.
+  uint64_t allocations = 0;
+  /// Number of objects returned to the pools.
+  uint64_t frees = 0;
+  /// Allocations served from the calling thread's own free list.
+  uint64_t threadHits = 0;
+  /// Allocations which refilled the thread's free list from the shared one.
+  uint64_t sharedRefills = 0;
+  /// Allocations which had to carve a new slab of blocks from the heap.
+  uint64_t slabAllocations = 0;
+  /// Allocations too big for any size class which went to the general heap.
+  uint64_t oversized = 0;
+  /// Bytes of slab memory the pools have taken from the heap.
+  uint64_t bytesReserved = 0;
+};
+
+/**
+ * @return A snapshot of the pool counters.
+ * The snapshot is not atomic with respect to threads allocating concurrently.
+ */
+ObjectPoolStats GetObjectPoolStats();
+
+/**
+ * @brief Derive from this to have objects of the derived type allocated from
+ * the size-class pools.
+ *
+ * Objects destroyed with `delete`, including by RefObject::Dec() through a
+ * virtual destructor, are returned to the pool matching the size of their most
+ * derived type.
+ */
+class PooledObject
+{
+public:
+  static void* operator new(std::size_t bytes);
+  static void operator delete(void* object, std::size_t bytes) noexcept;
+};
+
+namespace Internal
+{
+  /** Allocate a block of at least the given number of bytes from the pools. */
+  void* PoolAllocate(std::size_t bytes);
+  /** Return a block to the pools. The size must match that passed to PoolAllocate(). */
+  void PoolFree(void* block, std::size_t bytes) noexcept;
+}
+
+inline void* PooledObject::operator new(const std::size_t bytes)
+{
+  return Internal::PoolAllocate(bytes);
+}
+
+inline void PooledObject::operator delete(void* const object, const std::size_t bytes) noexcept
+{
+  Internal::PoolFree(object, bytes);
+}
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_OBJECT_POOL_H_INCLUDED_E26EF */
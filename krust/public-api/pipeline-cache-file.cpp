@@ -0,0 +1,104 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "krust/public-api/pipeline-cache-file.h"
+
+// Internal includes:
+#include "krust/internal/pipeline-cache-format.h"
+#include "krust/internal/replace-file.h"
+#include "krust/public-api/logging.h"
+
+// External includes:
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace Krust
+{
+
+namespace
+{
+
+std::filesystem::path CachePath(const VkPhysicalDeviceProperties& properties, const std::string& directory)
+{
+  return std::filesystem::path(directory.empty() ? "." : directory) / PipelineCacheFilename(properties);
+}
+
+}
+
+std::string PipelineCacheFilename(const VkPhysicalDeviceProperties& properties)
+{
+  char uuid[VK_UUID_SIZE * 2 + 1];
+  for(unsigned i = 0; i < VK_UUID_SIZE; ++i)
+  {
+    snprintf(uuid + i * 2, 3, "%02x", properties.pipelineCacheUUID[i]);
+  }
+  char name[128];
+  snprintf(name, sizeof(name), "krust-pipelines-%04x-%04x-%s-%08x.bin",
+           properties.vendorID, properties.deviceID, uuid, properties.driverVersion);
+  return name;
+}
+
+PipelineCachePtr LoadPipelineCache(Device& device, const VkPhysicalDeviceProperties& properties, const std::string& directory)
+{
+  const auto path = CachePath(properties, directory);
+  std::vector<uint8_t> file;
+  if(std::ifstream is{path, std::ios::binary})
+  {
+    file.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+  }
+  else
+  {
+    KRUST_LOG_INFO << "No pipeline cache at \"" << path.string() << "\". Starting with an empty one." << endlog;
+    return PipelineCache::New(device);
+  }
+
+  const uint8_t* data = nullptr;
+  size_t dataSize = 0;
+  const char* const failure = Internal::DecodePipelineCacheFile(properties, file.data(), file.size(), data, dataSize);
+  if(failure)
+  {
+    KRUST_LOG_WARN << "Ignoring pipeline cache \"" << path.string() << "\": " << failure << endlog;
+    return PipelineCache::New(device);
+  }
+  KRUST_LOG_INFO << "Loaded " << dataSize << " bytes of pipeline cache from \"" << path.string() << "\"." << endlog;
+  return PipelineCache::New(device, dataSize, data);
+}
+
+bool SavePipelineCache(const PipelineCache& cache, const VkPhysicalDeviceProperties& properties, const std::string& directory)
+{
+  const std::vector<uint8_t> data = cache.GetData();
+  if(data.empty())
+  {
+    return false;
+  }
+  const std::vector<uint8_t> file = Internal::EncodePipelineCacheFile(properties, data);
+
+  const auto path = CachePath(properties, directory);
+  if(!Internal::ReplaceFile(path, file.data(), file.size(), "pipeline cache"))
+  {
+    return false;
+  }
+  KRUST_LOG_INFO << "Saved " << data.size() << " bytes of pipeline cache to \"" << path.string() << "\"." << endlog;
+  return true;
+}
+
+} /* namespace Krust */
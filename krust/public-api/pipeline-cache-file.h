@@ -0,0 +1,74 @@
+#ifndef KRUST_PUBLIC_API_PIPELINE_CACHE_FILE_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_PIPELINE_CACHE_FILE_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Persisting the contents of a PipelineCache between runs so pipelines
+ * compiled by one run of an application are loaded rather than compiled again
+ * by the next.
+ * A cache only helps pipelines it is passed to when they are created, e.g. by
+ * ComputePipeline::New() or PipelineCompiler, which default to none.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan-objects.h"
+
+// External includes:
+#include <string>
+
+namespace Krust
+{
+
+/**
+ * @return The name of the file the pipeline cache for a device is kept in.
+ * It includes the device's pipelineCacheUUID and driver version so different
+ * GPUs, and drivers updated between runs, get separate files.
+ */
+std::string PipelineCacheFilename(const VkPhysicalDeviceProperties& properties);
+
+/**
+ * Create a pipeline cache seeded with the data saved for the device in a
+ * directory by an earlier call to SavePipelineCache().
+ *
+ * The file is checked for truncation, corruption, and having been written for
+ * a different device or driver before its data is handed to Vulkan. If it is
+ * missing or fails any check, an empty cache is returned instead.
+ * @param directory The directory to look in, or empty for the current one.
+ */
+PipelineCachePtr LoadPipelineCache(Device& device, const VkPhysicalDeviceProperties& properties, const std::string& directory);
+
+/**
+ * Write the contents of a pipeline cache to a file in a directory for
+ * LoadPipelineCache() to pick up on the next run.
+ *
+ * The data is written to a temporary file with a name unique to the call,
+ * which is then renamed over the old one, so a crash or a concurrent run never
+ * leaves a partly-written file for the next load. When two runs save at once
+ * the last to finish wins.
+ * @return True if the file was written.
+ */
+bool SavePipelineCache(const PipelineCache& cache, const VkPhysicalDeviceProperties& properties, const std::string& directory);
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_PIPELINE_CACHE_FILE_H_INCLUDED_E26EF */
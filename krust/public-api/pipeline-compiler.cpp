@@ -0,0 +1,215 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Compilation unit header:
+#include "krust/public-api/pipeline-compiler.h"
+
+// Internal includes:
+#include "krust/public-api/logging.h"
+#include "krust/public-api/mapped-spirv.h"
+#include "krust/public-api/thread-base.h"
+#include "krust/public-api/trace.h"
+#include "krust/public-api/vulkan_struct_init.h"
+
+// External includes:
+#include <algorithm>
+#include <functional>
+
+namespace Krust
+{
+
+// -----------------------------------------------------------------------------
+PipelineCompiler::PipelineCompiler(Device& device, const VkPipelineCache pipelineCache, unsigned numThreads) :
+  mDevice(&device),
+  mPipelineCache(pipelineCache)
+{
+  if(numThreads == 0)
+  {
+    numThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1u;
+  }
+  ErrorPolicy& errorPolicy = ThreadBase::Get().GetErrorPolicy();
+  for(unsigned i = 0; i < numThreads; ++i)
+  {
+    mThreads.emplace_back(&PipelineCompiler::Run, this, std::ref(errorPolicy));
+  }
+}
+
+PipelineCompilerPtr PipelineCompiler::New(Device& device, const VkPipelineCache pipelineCache, const unsigned numThreads)
+{
+  return new PipelineCompiler(device, pipelineCache, numThreads);
+}
+
+PipelineCompiler::~PipelineCompiler()
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mWork.notify_all();
+  for(auto& thread : mThreads)
+  {
+    thread.join();
+  }
+}
+
+ComputePipelineFuture PipelineCompiler::CompileCompute(
+  std::string spirvFilename,
+  PipelineLayout& layout,
+  const VkSpecializationInfo* const specializationInfo,
+  const char* const entryPoint)
+{
+  ComputeJob job;
+  job.spirvFilename = std::move(spirvFilename);
+  job.layout = &layout;
+  job.entryPoint = entryPoint;
+  return Enqueue(std::move(job), specializationInfo);
+}
+
+ComputePipelineFuture PipelineCompiler::CompileCompute(
+  const span<const uint32_t> spirv,
+  PipelineLayout& layout,
+  const VkSpecializationInfo* const specializationInfo,
+  const char* const entryPoint)
+{
+  ComputeJob job;
+  job.spirv = spirv;
+  job.layout = &layout;
+  job.entryPoint = entryPoint;
+  return Enqueue(std::move(job), specializationInfo);
+}
+
+ComputePipelineFuture PipelineCompiler::CompileCompute(
+  ShaderModule& shaderModule,
+  PipelineLayout& layout,
+  const VkSpecializationInfo* const specializationInfo,
+  const char* const entryPoint)
+{
+  ComputeJob job;
+  job.shaderModule = &shaderModule;
+  job.layout = &layout;
+  job.entryPoint = entryPoint;
+  return Enqueue(std::move(job), specializationInfo);
+}
+
+void PipelineCompiler::WaitIdle()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  mIdle.wait(lock, [this]{ return mOutstanding == 0; });
+}
+
+ComputePipelineFuture PipelineCompiler::Enqueue(ComputeJob&& job, const VkSpecializationInfo* const specializationInfo)
+{
+  // Take copies of everything the caller's specialization info points at:
+  if(specializationInfo)
+  {
+    job.specialized = true;
+    job.specializationInfo = *specializationInfo;
+    job.mapEntries.assign(specializationInfo->pMapEntries, specializationInfo->pMapEntries + specializationInfo->mapEntryCount);
+    const uint8_t* const data = static_cast<const uint8_t*>(specializationInfo->pData);
+    job.specializationData.assign(data, data + specializationInfo->dataSize);
+  }
+
+  std::packaged_task<ComputePipelinePtr()> task([this, job = std::move(job)]() mutable { return Compile(job); });
+  ComputePipelineFuture future = task.get_future().share();
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQueue.push_back(std::move(task));
+    ++mOutstanding;
+  }
+  mWork.notify_one();
+  return future;
+}
+
+ComputePipelinePtr PipelineCompiler::Compile(ComputeJob& job)
+{
+  KRUST_TRACE_SCOPE("PipelineCompiler::Compile");
+  if(!job.shaderModule)
+  {
+    // The mapping only needs to last until the driver has taken its copy:
+    MappedSpirV mapped;
+    if(job.spirv.empty())
+    {
+      mapped = MappedSpirV { job.spirvFilename.c_str() };
+      if(!mapped.IsValid())
+      {
+        ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "Failed to load SPIR-V shader.", __FUNCTION__, __FILE__, __LINE__);
+        return nullptr;
+      }
+      job.spirv = mapped.GetWords();
+    }
+    job.shaderModule = ShaderModule::New(*mDevice, 0, job.spirv);
+  }
+
+  if(job.specialized)
+  {
+    job.specializationInfo.pMapEntries = job.mapEntries.data();
+    job.specializationInfo.pData = job.specializationData.data();
+  }
+  const auto ssci = PipelineShaderStageCreateInfo(
+    0,
+    VK_SHADER_STAGE_COMPUTE_BIT,
+    *job.shaderModule,
+    job.entryPoint.c_str(),
+    job.specialized ? &job.specializationInfo : nullptr
+  );
+  return ComputePipeline::New(*mDevice, ComputePipelineCreateInfo(
+    0,    // no flags
+    ssci,
+    *job.layout,
+    VK_NULL_HANDLE, // no base pipeline
+    -1 // No index of a base pipeline.
+  ), mPipelineCache);
+}
+
+void PipelineCompiler::Run(ErrorPolicy& errorPolicy)
+{
+  ThreadBase threadBase { &errorPolicy };
+  for(;;)
+  {
+    std::packaged_task<ComputePipelinePtr()> task;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mWork.wait(lock, [this]{ return mStop || !mQueue.empty(); });
+      // Drain the queue before honouring a stop so no future is left broken:
+      if(mQueue.empty())
+      {
+        break;
+      }
+      task = std::move(mQueue.front());
+      mQueue.pop_front();
+    }
+
+    // Any exception thrown by an error policy is stored in the future:
+    task();
+
+    bool idle;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      idle = --mOutstanding == 0;
+    }
+    if(idle)
+    {
+      mIdle.notify_all();
+    }
+  }
+}
+
+} /* namespace Krust */
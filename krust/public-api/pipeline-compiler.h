@@ -0,0 +1,165 @@
+#ifndef KRUST_PUBLIC_API_PIPELINE_COMPILER_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_PIPELINE_COMPILER_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file A pool of threads which create pipelines in the background so
+ * startup time is not the sum of every pipeline's compile.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan-objects.h"
+#include "krust/public-api/krust-errors.h"
+
+// External includes:
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Krust
+{
+
+class PipelineCompiler;
+using PipelineCompilerPtr = IntrusivePointer<PipelineCompiler>;
+
+/// A pipeline being created on a PipelineCompiler thread. Copy it freely and
+/// call get() where the pipeline is first needed.
+using ComputePipelineFuture = std::shared_future<ComputePipelinePtr>;
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Creates pipelines on worker threads, all going through one
+ * pipeline cache.
+ *
+ * Enqueue every pipeline an application will need as soon as the device
+ * exists, then build swapchains, buffers and so on while they compile,
+ * blocking on each future only when the pipeline is first bound.
+ * VkPipelineCache is internally synchronized so the workers share it
+ * directly and the pipelines they compile all end up in it to be saved.
+ *
+ * Errors on the worker threads are reported to the error policy of the
+ * thread that created the compiler. If that throws, the exception comes out
+ * of the future's get().
+ */
+class PipelineCompiler : public RefObject
+{
+  /** Hidden constructor to prevent users doing naked `new`s.*/
+  PipelineCompiler(Device& device, VkPipelineCache pipelineCache, unsigned numThreads);
+
+  // Ban copying objects:
+  PipelineCompiler(const PipelineCompiler&) = delete;
+  PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+public:
+  /**
+   * @brief Start the worker threads.
+   * @param pipelineCache The cache every pipeline is created through. It must
+   * outlive the compiler.
+   * @param numThreads The number of workers, with zero meaning one fewer than
+   * the number of hardware threads, leaving one for the caller.
+   */
+  static PipelineCompilerPtr New(Device& device, VkPipelineCache pipelineCache = VK_NULL_HANDLE, unsigned numThreads = 0);
+  /**
+   * Finishes every creation already enqueued and joins the threads.
+   */
+  ~PipelineCompiler();
+
+  /**
+   * Map a SPIR-V file and create a compute pipeline from it on a worker.
+   * The layout is kept alive until the pipeline has been created.
+   * @param specializationInfo Copied, along with its map entries and data,
+   * before this returns.
+   */
+  ComputePipelineFuture CompileCompute(
+    std::string spirvFilename,
+    PipelineLayout& layout,
+    const VkSpecializationInfo* specializationInfo = nullptr,
+    const char* entryPoint = "main");
+
+  /**
+   * Create a compute pipeline from SPIR-V in memory, such as a shader embedded
+   * in the binary, on a worker.
+   * @param spirv Not copied so it must stay valid until the future is ready.
+   */
+  ComputePipelineFuture CompileCompute(
+    span<const uint32_t> spirv,
+    PipelineLayout& layout,
+    const VkSpecializationInfo* specializationInfo = nullptr,
+    const char* entryPoint = "main");
+
+  /**
+   * Create a compute pipeline from an existing module on a worker.
+   * The module and layout are kept alive until the pipeline has been created.
+   */
+  ComputePipelineFuture CompileCompute(
+    ShaderModule& shaderModule,
+    PipelineLayout& layout,
+    const VkSpecializationInfo* specializationInfo = nullptr,
+    const char* entryPoint = "main");
+
+  /// Block until every creation enqueued so far has finished.
+  void WaitIdle();
+
+  unsigned GetNumThreads() const { return unsigned(mThreads.size()); }
+  Device& GetDevice() const { return *mDevice; }
+  VkPipelineCache GetPipelineCache() const { return mPipelineCache; }
+
+private:
+  /// Everything a worker needs to create one compute pipeline.
+  struct ComputeJob
+  {
+    std::string spirvFilename;
+    span<const uint32_t> spirv;
+    ShaderModulePtr shaderModule;
+    PipelineLayoutPtr layout;
+    std::string entryPoint;
+    bool specialized = false;
+    VkSpecializationInfo specializationInfo;
+    std::vector<VkSpecializationMapEntry> mapEntries;
+    std::vector<uint8_t> specializationData;
+  };
+
+  ComputePipelineFuture Enqueue(ComputeJob&& job, const VkSpecializationInfo* specializationInfo);
+  ComputePipelinePtr Compile(ComputeJob& job);
+  void Run(ErrorPolicy& errorPolicy);
+
+  DevicePtr mDevice;
+  VkPipelineCache mPipelineCache;
+  std::mutex mMutex;
+  /// Signalled when a job is queued or the compiler is stopping.
+  std::condition_variable mWork;
+  /// Signalled when the last outstanding job finishes.
+  std::condition_variable mIdle;
+  std::deque<std::packaged_task<ComputePipelinePtr()>> mQueue;
+  /// Jobs queued or running.
+  size_t mOutstanding = 0;
+  bool mStop = false;
+  std::vector<std::thread> mThreads;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_PIPELINE_COMPILER_H_INCLUDED_E26EF */
@@ -25,17 +25,24 @@
 // Internal includes:
 #include "krust/public-api/queue_janitor.h"
 #include "krust/public-api/vulkan-utils.h"
+#include "krust/public-api/vulkan_struct_init.h"
 #include "krust/public-api/krust-errors.h"
 #include "krust/public-api/thread-base.h"
+#include "krust/public-api/trace.h"
 #include "krust/internal/keep-alive-set.h"
-#include "krust/internal/scoped-temp-array.h"
+#include "krust/internal/retire-list.h"
 #include "krust/public-api/vulkan.h"
 
 // External includes:
+#include <algorithm>
 
 namespace Krust
 {
 
+/// Number of slots the ring of live batches starts with when tracking
+/// completions with a timeline semaphore. Must be a power of two.
+constexpr size_t TIMELINE_RING_INITIAL_SIZE = 8;
+
 /// A bundle of handles to the CPU-side representations of objects used on the GPU
 /// during a submit's execution.
 struct QueueJanitor::SubmitLiveBatch {
@@ -44,16 +51,21 @@ struct QueueJanitor::SubmitLiveBatch {
   }
   void Inactivate() {
     submitCounter = 0;
-    VK_CALL(vkResetFences, completionSignal->device(), 1, completionSignal->GetVkFenceAddress());
+    // Batches tracked by the queue's timeline semaphore have no fence:
+    if(completionSignal.Get()){
+      VK_CALL(vkResetFences, completionSignal->device(), 1, completionSignal->GetVkFenceAddress());
+    }
     liveCommandbuffers.clear();
     liveOthers.Clear();
   }
   void KeepAlive(const span<const QueueSubmitInfo, dynamic_extent> submits);
+  void KeepAlive(const span<const QueueSubmitInfo2, dynamic_extent> submits);
   /// Command buffers that we will inform when a batch of submits completes on the GPU.
   std::vector<CommandBufferPtr> liveCommandbuffers;
   /// All semaphores and possible future resources used by a submit are added in here.
   KeepAliveSet liveOthers;
   /// Points to Fence which is passed into the Vulkan submit function.
+  /// Null when completions are tracked with a timeline semaphore.
   FencePtr completionSignal;
   /// Which submit in monotonically increasing order for the associated queue this
   /// batch represents.
@@ -61,6 +73,32 @@ struct QueueJanitor::SubmitLiveBatch {
   SubmitCounter submitCounter = 0;
 };
 
+/// Arrays for translating submits into Vulkan's structs, kept between submits
+/// so that they grow to the size of the largest frame once rather than being
+/// allocated for every submit.
+struct QueueJanitor::SubmitScratch {
+  std::vector<VkSubmitInfo> submits;
+  std::vector<VkSemaphore> semaphores;
+  std::vector<VkPipelineStageFlags> waitFlags;
+  std::vector<VkCommandBuffer> buffers;
+  std::vector<uint64_t> signalValues;
+  /// The equivalents for vkQueueSubmit2KHR():
+  std::vector<VkSubmitInfo2KHR> submits2;
+  std::vector<VkSemaphoreSubmitInfoKHR> semaphoreInfos;
+  std::vector<VkCommandBufferSubmitInfoKHR> bufferInfos;
+  /// Views of the enqueued submits being flushed.
+  std::vector<QueueSubmitInfo> pending;
+};
+
+// -----------------------------------------------------------------------------
+OwnedQueueSubmit::OwnedQueueSubmit(const QueueSubmitInfo& info) :
+  pNext(info.pNext),
+  waits(info.waits.begin(), info.waits.end()),
+  commandBuffers(info.commandBuffers.begin(), info.commandBuffers.end()),
+  completionSignals(info.completionSignals.begin(), info.completionSignals.end())
+{
+}
+
 void QueueJanitor::SubmitLiveBatch::KeepAlive(const span<const QueueSubmitInfo, dynamic_extent> submits)
 {
   for(const auto& submit : submits)
@@ -69,14 +107,26 @@ void QueueJanitor::SubmitLiveBatch::KeepAlive(const span<const QueueSubmitInfo,
     for(const auto& wait : submit.waits){
       liveOthers.Add(*wait.first);
     }
-    for(const auto& semi : submit.completionSignals){
-      liveOthers.Add(*semi);
+    liveOthers.AddAll(submit.completionSignals);
+  }
+}
+
+void QueueJanitor::SubmitLiveBatch::KeepAlive(const span<const QueueSubmitInfo2, dynamic_extent> submits)
+{
+  for(const auto& submit : submits)
+  {
+    liveCommandbuffers.insert(liveCommandbuffers.end(), submit.commandBuffers.begin(), submit.commandBuffers.end());
+    for(const auto& wait : submit.waits){
+      liveOthers.Add(*wait.first);
+    }
+    for(const auto& signal : submit.completionSignals){
+      liveOthers.Add(*signal.first);
     }
   }
 }
 
 // -----------------------------------------------------------------------------
-QueueJanitor::QueueJanitor(Device& device, const uint32_t queueFamilyIndex, const uint32_t queueIndex)
+QueueJanitor::QueueJanitor(Device& device, const uint32_t queueFamilyIndex, const uint32_t queueIndex, const CompletionTracking tracking)
     : mQueue(Queue::New(device, queueFamilyIndex, queueIndex))
 {
   // If we are doing error reporting with exceptions, the following check is redundant / never reached.
@@ -85,11 +135,22 @@ QueueJanitor::QueueJanitor(Device& device, const uint32_t queueFamilyIndex, cons
     ThreadBase::Get().GetErrorPolicy().Error(Krust::Errors::IllegalState, "Returned a null Queue pointer.", __FUNCTION__, __FILE__, __LINE__);
   }
   mLiveBatches = new SubmitLiveBatches();
+  mScratch = new SubmitScratch();
+  if(tracking == CompletionTracking::TimelineSemaphore)
+  {
+    mTimeline = Semaphore::NewTimeline(device, 0);
+    if(*mTimeline == VK_NULL_HANDLE)
+    {
+      // Don't leave a janitor which will never see a completion:
+      mQueue.Reset();
+    }
+    mLiveBatches->resize(TIMELINE_RING_INITIAL_SIZE);
+  }
 }
 
-QueueJanitorPtr QueueJanitor::New(Device& device, const uint32_t queueFamilyIndex, const uint32_t queueIndex)
+QueueJanitorPtr QueueJanitor::New(Device& device, const uint32_t queueFamilyIndex, const uint32_t queueIndex, const CompletionTracking tracking)
 {
-  QueueJanitorPtr janitor = new QueueJanitor(device, queueFamilyIndex, queueIndex);
+  QueueJanitorPtr janitor = new QueueJanitor(device, queueFamilyIndex, queueIndex, tracking);
   // In case we have been compiled without exceptions and/or have a non-exceptions
   // error policy enabled, return a null pointer to indicate error if the
   // constructor failed. Even then we assume allocation can't fail or we'd have to
@@ -104,13 +165,68 @@ QueueJanitorPtr QueueJanitor::New(Device& device, const uint32_t queueFamilyInde
 
 QueueJanitor::~QueueJanitor()
 {
+  // Objects dropped from here on are destroyed immediately:
+  if(mRetired)
+  {
+    Internal::RetireList<VulkanObject>* expected = mRetired;
+    Internal::sRetireList.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+  }
   // Deleting the queue waits for it to go idle:
   mQueue.Reset();
+  // Nothing queued can be in use on the GPU now:
+  delete mRetired;
+  mRetired = nullptr;
   delete mLiveBatches;
   mLiveBatches = nullptr;
+  delete mScratch;
+  mScratch = nullptr;
+}
+
+bool QueueJanitor::EnableDeferredDestruction()
+{
+  if(mRetired)
+  {
+    return true;
+  }
+  auto retired = new Internal::RetireList<VulkanObject>();
+  retired->SetEpoch(mNextSubmit - 1);
+  Internal::RetireList<VulkanObject>* expected = nullptr;
+  if(!Internal::sRetireList.compare_exchange_strong(expected, retired, std::memory_order_acq_rel))
+  {
+    delete retired;
+    KRUST_LOG_WARN << "Deferred destruction is already enabled on another QueueJanitor." << endlog;
+    return false;
+  }
+  mRetired = retired;
+  return true;
+}
+
+size_t QueueJanitor::ReapRetired()
+{
+  if(!mRetired)
+  {
+    return 0;
+  }
+  CheckCompletions();
+  return mRetired->Reap(mHighestCompletion);
+}
+
+size_t QueueJanitor::NumRetired() const
+{
+  return mRetired ? mRetired->Pending() : 0;
 }
 
 void QueueJanitor::CheckCompletions()
+{
+  KRUST_TRACE_SCOPE("QueueJanitor::CheckCompletions");
+  if(mTimeline.Get()){
+    CheckTimelineCompletions();
+  } else {
+    CheckFenceCompletions();
+  }
+}
+
+void QueueJanitor::CheckFenceCompletions()
 {
   for(SubmitLiveBatch& b : *mLiveBatches){
     if(b.InFlight()){
@@ -120,17 +236,68 @@ void QueueJanitor::CheckCompletions()
         mHighestCompletion = std::max(mHighestCompletion, b.submitCounter);
         this->RecycleLiveBatch(b);
       } else if(wait_res == VK_ERROR_DEVICE_LOST){
-        KRUST_LOG_ERROR << "VK_ERROR_DEVICE_LOST calling vkWaitForFences() from " << __FUNCTION__ << " in File " __FILE__ " at line " << __LINE__  << endlog;
-        mLiveBatches->clear();
-        mHighestCompletion = mNextSubmit - 1;
+        OnDeviceLost("vkWaitForFences");
         break;
       }
     }
   }
 }
 
+void QueueJanitor::CheckTimelineCompletions()
+{
+  // One query tells us about every submit made so far:
+  uint64_t completed = 0;
+  const VkResult result = vkGetSemaphoreCounterValue(mQueue->GetDevice(), *mTimeline, &completed);
+  if(result == VK_SUCCESS){
+    RetireTimelineBatches(completed);
+  } else if(result == VK_ERROR_DEVICE_LOST){
+    OnDeviceLost("vkGetSemaphoreCounterValue");
+  }
+}
+
+void QueueJanitor::RetireTimelineBatches(const SubmitCounter completed)
+{
+  const size_t mask = mLiveBatches->size() - 1;
+  // Only the batches which completed since we last looked are touched:
+  for(SubmitCounter submit = mHighestCompletion + 1; submit <= completed && submit < mNextSubmit; ++submit){
+    SubmitLiveBatch& b = (*mLiveBatches)[submit & mask];
+    if(b.submitCounter == submit){
+      RecycleLiveBatch(b);
+    }
+  }
+  mHighestCompletion = std::max(mHighestCompletion, completed);
+}
+
+void QueueJanitor::OnDeviceLost(const char* const function)
+{
+  KRUST_LOG_ERROR << "VK_ERROR_DEVICE_LOST calling " << function << "() from " << __FUNCTION__ << " in File " __FILE__ " at line " << __LINE__  << endlog;
+  if(mTimeline.Get()){
+    // The ring has to keep its size:
+    for(SubmitLiveBatch& b : *mLiveBatches){
+      b.submitCounter = 0;
+      b.liveCommandbuffers.clear();
+      b.liveOthers.Clear();
+    }
+  } else {
+    mLiveBatches->clear();
+  }
+  mHighestCompletion = mNextSubmit - 1;
+}
+
 VkResult QueueJanitor::WaitComplete(const SubmitCounter submit, const uint64_t timeout)
 {
+  if(mTimeline.Get()){
+    if(submit <= mHighestCompletion){
+      return VK_SUCCESS;
+    }
+    auto info = SemaphoreWaitInfo(0, 1, mTimeline->GetVkSemaphoreAddress(), &submit);
+    const VkResult wait_res = vkWaitSemaphores(mQueue->GetDevice(), &info, timeout);
+    if(wait_res == VK_SUCCESS){
+      RetireTimelineBatches(submit);
+    }
+    return wait_res;
+  }
+
   for(SubmitLiveBatch& b : *mLiveBatches){
     if(b.InFlight() && (b.submitCounter == submit)){
       Fence* fence = b.completionSignal.Get();
@@ -148,12 +315,41 @@ VkResult QueueJanitor::WaitComplete(const SubmitCounter submit, const uint64_t t
 
 bool QueueJanitor::IsComplete(const SubmitCounter submit)
 {
+  if(submit <= mHighestCompletion){
+    return true;
+  }
   CheckCompletions();
   return submit <= mHighestCompletion;
 }
 
+QueueJanitor::SubmitLiveBatch& QueueJanitor::BeginLiveBatch(const SubmitCounter submitCounter)
+{
+  // See if any previous submits have finished, and release their resources:
+  CheckCompletions();
+  // Get a record to keep resources alive on the host while they are in use on the
+  // device:
+  SubmitLiveBatch& live_batch = GetLiveBatch(submitCounter);
+  // Anything retired from now on may have been used by this submit:
+  if(mRetired)
+  {
+    mRetired->SetEpoch(submitCounter);
+  }
+  return live_batch;
+}
+
 QueueJanitor::SubmitLiveBatch& QueueJanitor::GetLiveBatch(const SubmitCounter submitCounter)
 {
+  if(mTimeline.Get()){
+    // The ring has to span every submit from the oldest in flight to this one:
+    while(submitCounter - mHighestCompletion > mLiveBatches->size()){
+      GrowTimelineRing();
+    }
+    SubmitLiveBatch& batch = (*mLiveBatches)[submitCounter & (mLiveBatches->size() - 1)];
+    KRUST_ASSERT1(!batch.InFlight(), "Timeline ring slot still in use.");
+    batch.submitCounter = submitCounter;
+    return batch;
+  }
+
   SubmitLiveBatch* batch = nullptr;
   for(SubmitLiveBatch& b : *mLiveBatches){
     if(!b.InFlight()){
@@ -170,6 +366,21 @@ QueueJanitor::SubmitLiveBatch& QueueJanitor::GetLiveBatch(const SubmitCounter su
   return *batch;
 }
 
+void QueueJanitor::GrowTimelineRing()
+{
+  const size_t oldMask = mLiveBatches->size() - 1;
+  auto grown = new SubmitLiveBatches(mLiveBatches->size() * 2);
+  const size_t newMask = grown->size() - 1;
+  for(SubmitCounter submit = mHighestCompletion + 1; submit < mNextSubmit; ++submit){
+    SubmitLiveBatch& b = (*mLiveBatches)[submit & oldMask];
+    if(b.submitCounter == submit){
+      (*grown)[submit & newMask] = std::move(b);
+    }
+  }
+  delete mLiveBatches;
+  mLiveBatches = grown;
+}
+
 void QueueJanitor::RecycleLiveBatch(QueueJanitor::SubmitLiveBatch& batch)
 {
   batch.Inactivate();
@@ -191,28 +402,119 @@ std::array<size_t, 3> CountSubmits(const span<const QueueSubmitInfo, dynamic_ext
 }
 
 SubmitResult QueueJanitor::Submit(span<const QueueSubmitInfo, dynamic_extent> submits)
+{
+  KRUST_TRACE_SCOPE("QueueJanitor::Submit");
+  // Anything enqueued was meant to reach the queue first:
+  if(mNumPending > 0)
+  {
+    Flush();
+  }
+  return SubmitNow(submits);
+}
+
+SubmitCounter QueueJanitor::Enqueue(const QueueSubmitInfo& submit)
+{
+  if(mNumPending == mPending.size())
+  {
+    mPending.emplace_back();
+  }
+  OwnedQueueSubmit& owned = mPending[mNumPending++];
+  owned.pNext = submit.pNext;
+  for(const auto& wait : submit.waits)
+  {
+    owned.waits.emplace_back(wait.first, wait.second);
+  }
+  owned.commandBuffers.insert(owned.commandBuffers.end(), submit.commandBuffers.begin(), submit.commandBuffers.end());
+  owned.completionSignals.insert(owned.completionSignals.end(), submit.completionSignals.begin(), submit.completionSignals.end());
+  return mNextSubmit;
+}
+
+SubmitResult QueueJanitor::Flush()
+{
+  KRUST_TRACE_SCOPE("QueueJanitor::Flush");
+  if(mNumPending == 0)
+  {
+    return {VK_SUCCESS, GetLastSubmit()};
+  }
+  std::vector<QueueSubmitInfo>& infos = mScratch->pending;
+  infos.clear();
+  for(size_t i = 0; i < mNumPending; ++i)
+  {
+    OwnedQueueSubmit& owned = mPending[i];
+    infos.emplace_back(owned.waits, owned.commandBuffers, owned.completionSignals);
+    infos.back().pNext = owned.pNext;
+  }
+  const SubmitResult result = SubmitNow(infos);
+
+  // The live batch holds its own references now so let go of ours but keep
+  // the arrays for the next frame:
+  for(size_t i = 0; i < mNumPending; ++i)
+  {
+    OwnedQueueSubmit& owned = mPending[i];
+    owned.pNext = nullptr;
+    owned.waits.clear();
+    owned.commandBuffers.clear();
+    owned.completionSignals.clear();
+  }
+  infos.clear();
+  mNumPending = 0;
+  return result;
+}
+
+SubmitResult QueueJanitor::SubmitNow(span<const QueueSubmitInfo, dynamic_extent> submits)
 {
   VkResult result = VK_ERROR_UNKNOWN;
+
+  // With a timeline semaphore there is always a submit to signal it, even if
+  // the caller has nothing to submit:
+  const bool timeline = mTimeline.Get() != nullptr;
+  const size_t num_vk_submits = timeline ? std::max<size_t>(submits.size(), 1u) : submits.size();
+
+  // The caller may have chained their own timeline values to the last submit
+  // to wait on or signal timeline semaphores. A second struct of that type
+  // would be invalid so we take over theirs, which we can only unlink if it
+  // is first in the chain. Check it before taking a counter so a rejected
+  // submit doesn't leave one the timeline will never reach:
+  const size_t last_signals = submits.empty() ? 0 : submits.back().completionSignals.size();
+  const VkTimelineSemaphoreSubmitInfo* callers = nullptr;
+  if(timeline && !submits.empty())
+  {
+    for(auto ext = static_cast<const VkBaseInStructure*>(submits.back().pNext); ext != nullptr; ext = ext->pNext)
+    {
+      if(ext->sType == VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO)
+      {
+        callers = reinterpret_cast<const VkTimelineSemaphoreSubmitInfo*>(ext);
+        break;
+      }
+    }
+    if(callers && callers != submits.back().pNext)
+    {
+      ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "A VkTimelineSemaphoreSubmitInfo chained to the last submit must be first in its pNext chain.", __FUNCTION__, __FILE__, __LINE__);
+      return {VK_ERROR_UNKNOWN, GetLastSubmit()};
+    }
+    if(callers && callers->signalSemaphoreValueCount != last_signals)
+    {
+      ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "A VkTimelineSemaphoreSubmitInfo chained to the last submit must have a signal value for each of its completion signals.", __FUNCTION__, __FILE__, __LINE__);
+      return {VK_ERROR_UNKNOWN, GetLastSubmit()};
+    }
+  }
   auto submitCounter = mNextSubmit++;
 
   // Translate the submit infos into the native Vulkan struct type:
   auto [buffers, semaphores, wait_flags] = CountSubmits(submits);
-  ScopedTempArray<VkSubmitInfo, sizeof(VkSubmitInfo) * 10>
-    vk_submits(submits.size());
-  ScopedTempArray<VkSemaphore, sizeof(VkSemaphore) * 20>
-    vk_semaphores(semaphores);
-  ScopedTempArray<VkPipelineStageFlags, sizeof(VkPipelineStageFlags) * 10>
-    vk_wait_flags(wait_flags);
-  ScopedTempArray<VkCommandBuffer, sizeof(VkCommandBuffer) * 10> 
-    vk_buffers(buffers);
-  VkSemaphore*          next_semi = vk_semaphores.Get();
-  VkCommandBuffer*      next_buffer = vk_buffers.Get();
-  VkPipelineStageFlags* next_wait_flags = vk_wait_flags.Get();
+  SubmitScratch& scratch = *mScratch;
+  scratch.submits.resize(num_vk_submits);
+  scratch.semaphores.resize(semaphores + (timeline ? 1 : 0));
+  scratch.waitFlags.resize(wait_flags);
+  scratch.buffers.resize(buffers);
+  VkSemaphore*          next_semi = scratch.semaphores.data();
+  VkCommandBuffer*      next_buffer = scratch.buffers.data();
+  VkPipelineStageFlags* next_wait_flags = scratch.waitFlags.data();
 
   for(size_t submit_i = 0; submit_i < submits.size(); ++submit_i)
   {
     const QueueSubmitInfo& submit = submits[submit_i];
-    VkSubmitInfo&   vk_submit = vk_submits.Get()[submit_i];
+    VkSubmitInfo&   vk_submit = scratch.submits[submit_i];
     vk_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     vk_submit.pNext = submit.pNext;
 
@@ -237,23 +539,144 @@ SubmitResult QueueJanitor::Submit(span<const QueueSubmitInfo, dynamic_extent> su
       *next_buffer++ = *submit.commandBuffers[i];
     }
   }
-  // See if any previous submits have finished, and release their resources:
-  CheckCompletions();
-  // Get a record to keep resources alive on the host while they are in use on the
-  // device:
-  SubmitLiveBatch& live_batch = GetLiveBatch(submitCounter);
+
+  // Have the last submit signal the timeline semaphore with our counter:
+  VkTimelineSemaphoreSubmitInfo timeline_info;
+  if(timeline)
+  {
+    scratch.signalValues.resize(last_signals + 1);
+    VkSubmitInfo& last = scratch.submits[num_vk_submits - 1];
+    if(submits.empty())
+    {
+      last = SubmitInfo(0, nullptr, nullptr, 0, nullptr, 0, next_semi);
+    }
+
+    // The last submit's signals are at the end of the array so ours follows them:
+    *next_semi++ = *mTimeline;
+    if(callers)
+    {
+      std::copy_n(callers->pSignalSemaphoreValues, last_signals, scratch.signalValues.data());
+    }
+    else
+    {
+      // Binary semaphores ignore their values:
+      std::fill_n(scratch.signalValues.data(), last_signals, uint64_t(0));
+    }
+    scratch.signalValues[last_signals] = submitCounter;
+    last.signalSemaphoreCount = last_signals + 1;
+    timeline_info = TimelineSemaphoreSubmitInfo(0, nullptr, last_signals + 1, scratch.signalValues.data());
+    if(callers)
+    {
+      timeline_info.waitSemaphoreValueCount = callers->waitSemaphoreValueCount;
+      timeline_info.pWaitSemaphoreValues = callers->pWaitSemaphoreValues;
+      timeline_info.pNext = callers->pNext;
+    }
+    else
+    {
+      timeline_info.pNext = last.pNext;
+    }
+    last.pNext = &timeline_info;
+  }
+
+  SubmitLiveBatch& live_batch = BeginLiveBatch(submitCounter);
   live_batch.KeepAlive(submits);
   result = vkQueueSubmit(
     *mQueue,
-    submits.size(),
-    vk_submits.Get(),
-    *live_batch.completionSignal
+    num_vk_submits,
+    scratch.submits.data(),
+    timeline ? VK_NULL_HANDLE : VkFence(*live_batch.completionSignal)
+  );
+  return {result, submitCounter};
+}
+
+SubmitResult QueueJanitor::Submit2(span<const QueueSubmitInfo2, dynamic_extent> submits)
+{
+  KRUST_TRACE_SCOPE("QueueJanitor::Submit2");
+  if(mNumPending > 0)
+  {
+    Flush();
+  }
+  for(const auto& submit : submits)
+  {
+    if((!submit.waitValues.empty() && submit.waitValues.size() != submit.waits.size()) ||
+       (!submit.signalValues.empty() && submit.signalValues.size() != submit.completionSignals.size()))
+    {
+      ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "Timeline values must be given for all of a submit's waits or signals, or none.", __FUNCTION__, __FILE__, __LINE__);
+      return {VK_ERROR_UNKNOWN, GetLastSubmit()};
+    }
+  }
+  auto submitCounter = mNextSubmit++;
+
+  const bool timeline = mTimeline.Get() != nullptr;
+  const size_t num_vk_submits = timeline ? std::max<size_t>(submits.size(), 1u) : submits.size();
+
+  size_t semaphores = timeline ? 1 : 0;
+  size_t buffers = 0;
+  for(auto& submit : submits)
+  {
+    semaphores += submit.waits.size() + submit.completionSignals.size();
+    buffers += submit.commandBuffers.size();
+  }
+  SubmitScratch& scratch = *mScratch;
+  scratch.submits2.resize(num_vk_submits);
+  scratch.semaphoreInfos.resize(semaphores);
+  scratch.bufferInfos.resize(buffers);
+  VkSemaphoreSubmitInfoKHR*     next_semi = scratch.semaphoreInfos.data();
+  VkCommandBufferSubmitInfoKHR* next_buffer = scratch.bufferInfos.data();
+
+  for(size_t submit_i = 0; submit_i < submits.size(); ++submit_i)
+  {
+    const QueueSubmitInfo2& submit = submits[submit_i];
+    VkSubmitInfo2KHR& vk_submit = scratch.submits2[submit_i];
+    vk_submit = SubmitInfo2KHR(0,
+      submit.waits.size(), next_semi,
+      submit.commandBuffers.size(), next_buffer,
+      submit.completionSignals.size(), next_semi + submit.waits.size());
+    vk_submit.pNext = submit.pNext;
+    // Binary semaphores ignore their values:
+    for(size_t i = 0; i < submit.waits.size(); ++i)
+    {
+      const uint64_t value = submit.waitValues.empty() ? 0 : submit.waitValues[i];
+      *next_semi++ = SemaphoreSubmitInfoKHR(*submit.waits[i].first, value, submit.waits[i].second, 0);
+    }
+    for(size_t i = 0; i < submit.completionSignals.size(); ++i)
+    {
+      const uint64_t value = submit.signalValues.empty() ? 0 : submit.signalValues[i];
+      *next_semi++ = SemaphoreSubmitInfoKHR(*submit.completionSignals[i].first, value, submit.completionSignals[i].second, 0);
+    }
+    for(const auto& buffer : submit.commandBuffers)
+    {
+      *next_buffer++ = CommandBufferSubmitInfoKHR(*buffer, 0);
+    }
+  }
+
+  // The timeline signal is just one more semaphore info on the last submit,
+  // waiting on all stages so it marks the completion of everything:
+  if(timeline)
+  {
+    VkSubmitInfo2KHR& last = scratch.submits2[num_vk_submits - 1];
+    if(submits.empty())
+    {
+      last = SubmitInfo2KHR(0, 0, nullptr, 0, nullptr, 0, next_semi);
+    }
+    *next_semi++ = SemaphoreSubmitInfoKHR(*mTimeline, submitCounter, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, 0);
+    last.signalSemaphoreInfoCount += 1;
+  }
+
+  SubmitLiveBatch& live_batch = BeginLiveBatch(submitCounter);
+  live_batch.KeepAlive(submits);
+  const VkResult result = vkQueueSubmit2KHR(
+    *mQueue,
+    num_vk_submits,
+    scratch.submits2.data(),
+    timeline ? VK_NULL_HANDLE : VkFence(*live_batch.completionSignal)
   );
   return {result, submitCounter};
 }
 
 SubmitResult QueueJanitor::Submit(Semaphore& wait, const VkPipelineStageFlags waitFlags, CommandBuffer& commandbuffer)
 {
+  // Traced by the Submit() this forwards to.
   std::pair<SemaphorePtr, const VkPipelineStageFlags> waits[1] {
     {SemaphorePtr(&wait), waitFlags}
   };
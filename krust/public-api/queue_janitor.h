@@ -31,11 +31,14 @@
 #include "krust-kernel/public-api/span.h"
 
 // External includes:
+#include <utility>
 #include <vector>
 
 namespace Krust
 {
 
+namespace Internal { template<class T> class RetireList; }
+
 class QueueJanitor;
 using QueueJanitorPtr = IntrusivePointer<QueueJanitor>;
 using SubmitCounter = uint64_t;
@@ -52,6 +55,17 @@ private:
     const VkResult vkResult;
 };
 
+/// How a QueueJanitor finds out which of its submits have completed on the GPU.
+enum class CompletionTracking {
+  /// A fence per batch of submits, each polled individually.
+  Fences,
+  /// One timeline semaphore for the queue, signalled by each submit with that
+  /// submit's counter so completion is a single query of its value.
+  /// Requires the timelineSemaphore feature of Vulkan 1.2 or
+  /// VK_KHR_timeline_semaphore to be enabled on the device.
+  TimelineSemaphore
+};
+
 /// Describes the data required for a queue submission.
 struct QueueSubmitInfo {
   QueueSubmitInfo(
@@ -61,12 +75,66 @@ struct QueueSubmitInfo {
   ) : waits(waits), commandBuffers(commandBuffers), completionSignals(completionSignals)
   {}
   /// Use to extend the submit as you would for pNext of VkSubmitInfo.
+  /// With timeline completion tracking a VkTimelineSemaphoreSubmitInfo on the
+  /// last submit must come first in the chain so it can be merged with ours,
+  /// and have a signal value for each of that submit's completionSignals.
   const void* pNext = nullptr;
   span<std::pair<SemaphorePtr, const VkPipelineStageFlags>, dynamic_extent> waits;
   span<CommandBufferPtr, dynamic_extent>                                    commandBuffers;
   span<SemaphorePtr, dynamic_extent>                                        completionSignals;
 };
 
+/// A semaphore to wait on or signal along with the pipeline stages the
+/// dependency applies to, for submits made with vkQueueSubmit2KHR().
+using SemaphoreStages = std::pair<SemaphorePtr, const VkPipelineStageFlags2KHR>;
+
+/**
+ * @brief Describes the data required for a queue submission made with
+ * vkQueueSubmit2KHR().
+ * Unlike QueueSubmitInfo, signals carry stage masks too, so a semaphore
+ * guarding only, say, a transfer at the start of the command buffers can be
+ * signalled as soon as that transfer is done rather than when all the work of
+ * the submit has completed.
+ */
+struct QueueSubmitInfo2 {
+  QueueSubmitInfo2(
+    span<SemaphoreStages, dynamic_extent>  waits,
+    span<CommandBufferPtr, dynamic_extent> commandBuffers,
+    span<SemaphoreStages, dynamic_extent>  completionSignals
+  ) : waits(waits), commandBuffers(commandBuffers), completionSignals(completionSignals)
+  {}
+  /// Use to extend the submit as you would for pNext of VkSubmitInfo2KHR.
+  const void* pNext = nullptr;
+  span<SemaphoreStages, dynamic_extent>  waits;
+  span<CommandBufferPtr, dynamic_extent> commandBuffers;
+  span<SemaphoreStages, dynamic_extent>  completionSignals;
+  /// Values for the timeline semaphores among waits, one per wait with
+  /// binary ones ignoring theirs, or empty if all are binary.
+  span<const uint64_t, dynamic_extent>   waitValues;
+  /// Values for the timeline semaphores among completionSignals, as for
+  /// waitValues.
+  span<const uint64_t, dynamic_extent>   signalValues;
+};
+
+/**
+ * @brief A queue submission which owns references to everything it uses, so it
+ * can be held past the call which provided it, e.g. by QueueJanitor::Enqueue()
+ * or when handing it from a recording thread to a SubmitThread.
+ */
+struct OwnedQueueSubmit
+{
+  OwnedQueueSubmit() {}
+  /// Copy the handles out of a submit description.
+  explicit OwnedQueueSubmit(const QueueSubmitInfo& info);
+
+  /// Use to extend the submit as you would for pNext of VkSubmitInfo.
+  /// Must stay valid until the submit has been made.
+  const void* pNext = nullptr;
+  std::vector<std::pair<SemaphorePtr, const VkPipelineStageFlags>> waits;
+  std::vector<CommandBufferPtr> commandBuffers;
+  std::vector<SemaphorePtr> completionSignals;
+};
+
 /* ----------------------------------------------------------------------- *//**
  * @brief A wrapper for Vulkan's Queue API object which keeps related API
  * objects alive on the CPU while in use on the GPU.
@@ -74,7 +142,7 @@ struct QueueSubmitInfo {
 class QueueJanitor : public RefObject
 {
   /** Hidden constructor to prevent users doing naked `new`s.*/
-  QueueJanitor(Device& device, const uint32_t queueFamilyIndex, const uint32_t queueIndex);
+  QueueJanitor(Device& device, const uint32_t queueFamilyIndex, const uint32_t queueIndex, CompletionTracking tracking);
 
   // Ban copying objects:
   QueueJanitor(const QueueJanitor&) = delete;
@@ -82,13 +150,15 @@ class QueueJanitor : public RefObject
 
   struct SubmitLiveBatch;
   using SubmitLiveBatches = std::vector<SubmitLiveBatch>;
+  struct SubmitScratch;
 
 public:
   /**
    * @brief Creator for new handles to Queue Janitor objects.
    * @return Smart pointer wrapper to keep the Queue Janitor alive.
    */
-  static QueueJanitorPtr New(Device& device, const uint32_t queueFamilyIndex, const uint32_t queueIndex);
+  static QueueJanitorPtr New(Device& device, const uint32_t queueFamilyIndex, const uint32_t queueIndex,
+                             CompletionTracking tracking = CompletionTracking::Fences);
   /**
    * Destruction requires waiting for the queue to go idle so the smart pointer
    * to the device can be released.
@@ -108,6 +178,38 @@ public:
   /// Single-command buffer, single wait semaphore wrapper submit helper.
   SubmitResult Submit(Semaphore& wait, const VkPipelineStageFlags waitFlags, CommandBuffer& commandbuffer);
 
+  /**
+   * As Submit() but through vkQueueSubmit2KHR() so each wait and signal
+   * semaphore can be given exactly the stages it applies to.
+   * Requires VK_KHR_synchronization2 to be enabled on the device.
+   * Anything enqueued is flushed first.
+   */
+  SubmitResult Submit2(span<const QueueSubmitInfo2, dynamic_extent> submits);
+  /// Helper submit for when there is only one submit per call.
+  SubmitResult Submit2(const QueueSubmitInfo2& submit) {
+    return Submit2({&submit, 1});
+  }
+
+  /**
+   * Defer a submission to the next Flush() so that all the submissions of a
+   * frame reach the GPU in one vkQueueSubmit with one fence, rather than paying
+   * the driver's per-submit overhead for each.
+   * The handles in the submit are copied so the spans it points to needn't
+   * outlive the call. Submit() flushes anything enqueued first so the order
+   * submissions reach the queue is preserved.
+   * @return The counter the submission will share with the rest of its batch
+   * once flushed.
+   */
+  SubmitCounter Enqueue(const QueueSubmitInfo& submit);
+  /**
+   * Submit everything enqueued since the last flush in a single vkQueueSubmit.
+   * @return The result of the submit, or VK_SUCCESS and the counter of the
+   * last submit if there was nothing to flush.
+   */
+  SubmitResult Flush();
+  /// @return The number of submissions waiting for the next Flush().
+  size_t NumEnqueued() const { return mNumPending; }
+
   /**
    * Call this to free any Command Buffers and Semaphores previously kept alive
    * while in use on the GPU.
@@ -115,25 +217,89 @@ public:
   void CheckCompletions();
 
   bool IsComplete(SubmitCounter submit);
-  /// Returns what vkWaitForFences() returns.
+  /// The counter of the most recent submit, or zero if there has been none.
+  SubmitCounter GetLastSubmit() const { return mNextSubmit - 1; }
+  /// The highest submit known to have completed as of the last check.
+  SubmitCounter GetHighestCompletion() const { return mHighestCompletion; }
+  /// Returns what vkWaitForFences() or vkWaitSemaphores() returns.
   VkResult WaitComplete(SubmitCounter submit, uint64_t timeout);
 
+  CompletionTracking GetCompletionTracking() const {
+    return mTimeline.Get() ? CompletionTracking::TimelineSemaphore : CompletionTracking::Fences;
+  }
+  /// The timeline semaphore signalled with each submit's counter, or null if
+  /// completion is tracked with fences. Other queues can wait on it.
+  Semaphore* GetTimelineSemaphore() const { return mTimeline.Get(); }
+
+  /**
+   * Route the destruction of all VulkanObjects whose last reference is dropped
+   * from now on through this janitor. Rather than being destroyed in place on
+   * whatever thread dropped the reference, each is stamped with the latest
+   * submit made here and queued, lock-free, to be destroyed in bulk by
+   * ReapRetired() once the GPU has completed that submit.
+   * Only one janitor at a time can have deferred destruction enabled, as a
+   * wrapper doesn't know which queues used it and so the epoch of a single
+   * queue's submits is the only one its destruction can safely wait on. Enable
+   * it on the janitor of the queue which all frame work goes through and have
+   * work on other queues keep what it uses alive itself.
+   * Work submitted straight to the VkQueue rather than through the janitor
+   * doesn't move the epoch on, so objects it uses could be destroyed while it
+   * is still running: submit everything which could drop objects mid-flight
+   * through the janitor.
+   * It stays enabled until the janitor is destroyed, which destroys anything
+   * still queued after waiting for the queue to go idle.
+   * @return False if another janitor already has it enabled.
+   */
+  bool EnableDeferredDestruction();
+  /**
+   * Destroy every retired object whose submit has completed on the GPU.
+   * Call at the end of each frame or at another point where the cost of the
+   * destructors is acceptable.
+   * @return The number of objects destroyed.
+   */
+  size_t ReapRetired();
+  /// @return The number of retired objects awaiting destruction.
+  size_t NumRetired() const;
+
   operator VkQueue() const { return *mQueue; }
   Queue& GetQueue() const { return *mQueue; }
   Device& GetDevice() const { return mQueue->GetDevice(); }
 
 private:
+  SubmitResult SubmitNow(span<const QueueSubmitInfo, dynamic_extent> submits);
+  /// Find completed submits then get a batch to keep the resources of a new
+  /// one alive.
+  SubmitLiveBatch& BeginLiveBatch(SubmitCounter submitCounter);
   SubmitLiveBatch& GetLiveBatch(SubmitCounter submitCounter);
   void RecycleLiveBatch(SubmitLiveBatch& batch);
+  void CheckFenceCompletions();
+  void CheckTimelineCompletions();
+  /// Recycle the batches of the timeline ring up to and including the given submit.
+  void RetireTimelineBatches(SubmitCounter completed);
+  void GrowTimelineRing();
+  void OnDeviceLost(const char* function);
 
   /// A monotonic counter of submissions.
   SubmitCounter mNextSubmit = 1;
   /// Record of the highest submission yet to complete:
   SubmitCounter mHighestCompletion = 0;
   QueuePtr mQueue = nullptr;
+  /// Signalled with the counter of each submit if tracking completions with a
+  /// timeline semaphore rather than fences.
+  SemaphorePtr mTimeline;
   /// The submitted batches of command buffers "live" in-flight on the GPU.
+  /// With a timeline semaphore this is a ring with a power of two size indexed
+  /// by submit counter.
   SubmitLiveBatches* mLiveBatches = nullptr;
   size_t mNumLiveBatches = 0;
+  /// Arrays reused to translate submits into Vulkan's structs.
+  SubmitScratch* mScratch = nullptr;
+  /// Submits enqueued for the next flush. Entries past mNumPending are kept
+  /// empty for reuse so their arrays don't have to be reallocated each frame.
+  std::vector<OwnedQueueSubmit> mPending;
+  size_t mNumPending = 0;
+  /// Objects awaiting destruction if deferred destruction is enabled.
+  Internal::RetireList<VulkanObject>* mRetired = nullptr;
 };
 
 } /* namespace Krust */
@@ -23,27 +23,49 @@
 namespace Krust {
 
 RefObject::RefObject() :
-    mCount(0) {
+    mCount(0), mPolicy(RefCountPolicy::Shared) {
+}
+
+RefObject::RefObject(const RefCountPolicy policy) :
+    mCount(0), mPolicy(policy) {
 }
 
 void RefObject::Inc() const {
-  ++mCount;
-  KRUST_ASSERT5(mCount > 0, "Count should be at least one.");
+  if (mPolicy == RefCountPolicy::ThreadConfined) {
+    mCount.store(mCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  } else {
+    mCount.fetch_add(1, std::memory_order_relaxed);
+  }
+  KRUST_ASSERT5(mCount.load(std::memory_order_relaxed) > 0, "Count should be at least one.");
   // If assertions fire, think about managing your ReObjects with a smart pointer
   // like IntrusivePointer.
 }
 
 void RefObject::Dec() const {
-  KRUST_ASSERT5(mCount > 0, "Count is too low.");
-  const Counter oldCount = mCount.fetch_sub(1);
+  KRUST_ASSERT5(mCount.load(std::memory_order_relaxed) > 0, "Count is too low.");
+  Counter oldCount;
+  if (mPolicy == RefCountPolicy::ThreadConfined) {
+    oldCount = mCount.load(std::memory_order_relaxed);
+    mCount.store(oldCount - 1, std::memory_order_relaxed);
+  } else {
+    oldCount = mCount.fetch_sub(1, std::memory_order_release);
+    if (oldCount == 1) {
+      // Make every other thread's use of the object visible before we tear it down:
+      std::atomic_thread_fence(std::memory_order_acquire);
+    }
+  }
   if (oldCount == 1) {
-    delete this;
+    Retire();
   }
 }
 
-size_t RefObject::Count() const
-{
-  return mCount.load();
+void RefObject::Retire() const {
+  delete this;
+}
+
+size_t RefObject::Count() const
+{
+  return mCount.load();
 }
 
 RefObject::~RefObject() {
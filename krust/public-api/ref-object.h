@@ -31,11 +31,29 @@
 
 namespace Krust {
 
+/**
+ * @brief How the reference count of a RefObject is maintained.
+ */
+enum class RefCountPolicy : unsigned char
+{
+  /// Atomic read-modify-write operations so references can be taken and
+  /// dropped on any thread concurrently. The default.
+  Shared,
+  /// Plain loads and stores with no read-modify-write. Only for objects whose
+  /// references are only ever taken and dropped on a single thread at a time,
+  /// such as per-frame transients built and retired on one recording thread.
+  ThreadConfined
+};
+
 /**
  * @brief Base class for reference counted objects.
  *
  * Allows reasonably efficient lockless cross-thread sharing using atomics to
  * maintain the reference count internally.
+ * Increments are relaxed since taking a new reference needs an existing one
+ * and so orders nothing. Decrements are release operations, with an acquire
+ * fence only on the final one, so all writes to the object through other
+ * references happen before it is deleted.
  * @note Use virtual inheritance to derive from it if used in a multiple
  * inheritance.
  */
@@ -43,6 +61,7 @@ class RefObject
 {
 public:
   RefObject();
+  explicit RefObject(RefCountPolicy policy);
 
   /**
    * Increment the counter of references to this object.
@@ -59,9 +78,20 @@ public:
    */
   size_t Count() const;
 
+  /**
+   * @return How the reference count is maintained.
+   */
+  RefCountPolicy GetRefCountPolicy() const { return mPolicy; }
+
 protected:
   virtual ~RefObject();
 
+  /**
+   * Called by Dec() when the last reference is dropped.
+   * Deletes the object. Override to defer or redirect the destruction.
+   */
+  virtual void Retire() const;
+
 private:
 
   /**
@@ -69,6 +99,7 @@ private:
    **/
   using Counter = size_t;
   mutable std::atomic<Counter> mCount;
+  const RefCountPolicy mPolicy;
 };
 
 } /* namespace Krust */
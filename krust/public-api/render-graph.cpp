@@ -0,0 +1,638 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compilation unit header:
+#include "krust/public-api/render-graph.h"
+
+// Internal includes:
+#include "krust/public-api/gpu-profiler.h"
+#include "krust/public-api/krust-assertions.h"
+#include "krust/public-api/krust-errors.h"
+#include "krust/public-api/logging.h"
+#include "krust/public-api/thread-base.h"
+#include "krust/public-api/vulkan-utils.h"
+#include "krust/public-api/vulkan_struct_init.h"
+#include "krust/public-api/vulkan.h"
+#include "krust/internal/transient-placement.h"
+
+// External includes:
+#include <algorithm>
+
+namespace Krust
+{
+
+namespace
+{
+
+bool IsDiscard(const ResourceUsage& usage)
+{
+  return usage.stages == VK_PIPELINE_STAGE_2_NONE_KHR &&
+         usage.access == VK_ACCESS_2_NONE_KHR &&
+         usage.layout == VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+bool HasMemoryBarrier(const VkMemoryBarrier2KHR& barrier)
+{
+  return (barrier.srcStageMask | barrier.dstStageMask | barrier.srcAccessMask | barrier.dstAccessMask) != 0;
+}
+
+bool SameImage(const VkImageCreateInfo& a, const VkImageCreateInfo& b)
+{
+  return a.flags == b.flags && a.imageType == b.imageType && a.format == b.format &&
+         a.extent.width == b.extent.width && a.extent.height == b.extent.height && a.extent.depth == b.extent.depth &&
+         a.mipLevels == b.mipLevels && a.arrayLayers == b.arrayLayers && a.samples == b.samples &&
+         a.tiling == b.tiling && a.usage == b.usage;
+}
+
+}
+
+RenderGraph::RenderGraph()
+{
+}
+
+RenderGraph::RenderGraph(Device& device) :
+  mDevice(&device)
+{
+  vkGetPhysicalDeviceMemoryProperties(device.GetPhysicalDevice(), &mMemoryProperties);
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device.GetPhysicalDevice(), &properties);
+  // Buffers and optimally tiled images can't share a page, so keep every
+  // transient aligned to one:
+  mBufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1u);
+}
+
+RenderGraph::~RenderGraph()
+{
+}
+
+RenderGraph::ResourceHandle RenderGraph::ImportImage(const char* const name, const VkImage image, const VkImageSubresourceRange& range,
+                                                     const ResourceUsage& before, const ResourceUsage& after)
+{
+  mResources.push_back({name, true, image, VK_NULL_HANDLE, range, before, after, NOT_TRANSIENT});
+  mCompiled = false;
+  return ResourceHandle(mResources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::ImportBuffer(const char* const name, const VkBuffer buffer,
+                                                      const ResourceUsage& before, const ResourceUsage& after)
+{
+  mResources.push_back({name, false, VK_NULL_HANDLE, buffer, {0, 0, 0, 0, 0}, before, after, NOT_TRANSIENT});
+  mCompiled = false;
+  return ResourceHandle(mResources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::CreateImage(const char* const name, const VkImageCreateInfo& info, const VkImageAspectFlags aspects)
+{
+  if(!mDevice.Get())
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalState, "Transient resources need a RenderGraph constructed with a device.", __FUNCTION__, __FILE__, __LINE__);
+    return INVALID_RESOURCE;
+  }
+  KRUST_ASSERT1(info.tiling == VK_IMAGE_TILING_OPTIMAL && info.initialLayout == VK_IMAGE_LAYOUT_UNDEFINED, "Unsupported transient image.");
+  const VkImageSubresourceRange range { aspects, 0, info.mipLevels, 0, info.arrayLayers };
+  mResources.push_back({name, true, VK_NULL_HANDLE, VK_NULL_HANDLE, range, Usage::Discard, Usage::Discard, uint32_t(mTransients.size())});
+  mTransients.push_back({ResourceHandle(mResources.size() - 1), true, info, 0, 0, NOT_TRANSIENT, false});
+  // Extension chains can't be kept or compared between frames:
+  mTransients.back().imageInfo.pNext = nullptr;
+  mCompiled = false;
+  return ResourceHandle(mResources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::CreateBuffer(const char* const name, const VkDeviceSize size, const VkBufferUsageFlags usage)
+{
+  if(!mDevice.Get())
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalState, "Transient resources need a RenderGraph constructed with a device.", __FUNCTION__, __FILE__, __LINE__);
+    return INVALID_RESOURCE;
+  }
+  mResources.push_back({name, false, VK_NULL_HANDLE, VK_NULL_HANDLE, {0, 0, 0, 0, 0}, Usage::Discard, Usage::Discard, uint32_t(mTransients.size())});
+  mTransients.push_back({ResourceHandle(mResources.size() - 1), false, ImageCreateInfo(), size, usage, NOT_TRANSIENT, false});
+  mCompiled = false;
+  return ResourceHandle(mResources.size() - 1);
+}
+
+VkImage RenderGraph::GetImage(const ResourceHandle resource) const
+{
+  KRUST_ASSERT1(resource < mResources.size(), "Invalid resource handle.");
+  return mResources[resource].image;
+}
+
+VkBuffer RenderGraph::GetBuffer(const ResourceHandle resource) const
+{
+  KRUST_ASSERT1(resource < mResources.size(), "Invalid resource handle.");
+  return mResources[resource].buffer;
+}
+
+Image* RenderGraph::GetTransientImage(const ResourceHandle resource) const
+{
+  KRUST_ASSERT1(resource < mResources.size(), "Invalid resource handle.");
+  const uint32_t transient = mResources[resource].transient;
+  if(transient == NOT_TRANSIENT || mTransients[transient].object == NOT_TRANSIENT)
+  {
+    return nullptr;
+  }
+  return mTransientObjects[mTransients[transient].object].image.Get();
+}
+
+RenderGraph::PassHandle RenderGraph::AddPass(const char* const name, RecordFunction record)
+{
+  mPasses.emplace_back();
+  mPasses.back().name = name;
+  mPasses.back().record = std::move(record);
+  mCompiled = false;
+  return PassHandle(mPasses.size() - 1);
+}
+
+void RenderGraph::Read(const PassHandle pass, const ResourceHandle resource, const ResourceUsage& usage)
+{
+  AddAccess(pass, resource, usage, false);
+}
+
+void RenderGraph::Write(const PassHandle pass, const ResourceHandle resource, const ResourceUsage& usage)
+{
+  AddAccess(pass, resource, usage, true);
+}
+
+void RenderGraph::SetSideEffects(const PassHandle pass)
+{
+  KRUST_ASSERT1(pass < mPasses.size(), "Invalid pass handle.");
+  mPasses[pass].sideEffects = true;
+}
+
+void RenderGraph::AddAccess(const PassHandle pass, const ResourceHandle resource, const ResourceUsage& usage, const bool write)
+{
+  KRUST_ASSERT1(pass < mPasses.size(), "Invalid pass handle.");
+  if(resource >= mResources.size())
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "Invalid resource handle.", __FUNCTION__, __FILE__, __LINE__);
+    return;
+  }
+  mCompiled = false;
+
+  // Accesses are usually declared right after their pass so look for an
+  // earlier one to the same resource at the end:
+  for(auto access = mAccesses.rbegin(); access != mAccesses.rend() && access->pass == pass; ++access)
+  {
+    if(access->resource == resource)
+    {
+      if(mResources[resource].isImage && access->usage.layout != usage.layout)
+      {
+        ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalArgument, "A pass can't use an image in two layouts.", __FUNCTION__, __FILE__, __LINE__);
+        return;
+      }
+      access->usage.stages |= usage.stages;
+      access->usage.access |= usage.access;
+      access->write = access->write || write;
+      return;
+    }
+  }
+  mAccesses.push_back({pass, resource, usage, write});
+}
+
+void RenderGraph::Cull()
+{
+  // Walk backwards from the resources needed after the graph to the passes
+  // which contribute to them. A write is assumed not to cover the whole
+  // resource, so an earlier writer of anything a live pass touches is live too:
+  mNeeded.assign(mResources.size(), false);
+  for(size_t i = 0; i < mResources.size(); ++i)
+  {
+    mNeeded[i] = !IsDiscard(mResources[i].after);
+  }
+  mNumCulled = 0;
+  for(size_t p = mPasses.size(); p-- > 0; )
+  {
+    Pass& pass = mPasses[p];
+    const Access* const begin = mAccesses.data() + pass.accessBegin;
+    const Access* const end = begin + pass.accessCount;
+    bool live = pass.sideEffects;
+    for(const Access* access = begin; !live && access != end; ++access)
+    {
+      live = access->write && mNeeded[access->resource];
+    }
+    pass.culled = !live;
+    if(live)
+    {
+      for(const Access* access = begin; access != end; ++access)
+      {
+        mNeeded[access->resource] = true;
+      }
+    }
+    else
+    {
+      ++mNumCulled;
+    }
+  }
+}
+
+void RenderGraph::Compile()
+{
+  mCompiled = false;
+  mImageBarriers.clear();
+  mNumMemoryBarriers = 0;
+  // A graph compiled again without a Reset() works its transients out afresh:
+  for(Transient& transient : mTransients)
+  {
+    transient.object = NOT_TRANSIENT;
+    transient.primed = false;
+  }
+
+  // Group the accesses by pass, keeping their order within each:
+  std::stable_sort(mAccesses.begin(), mAccesses.end(),
+    [](const Access& a, const Access& b) { return a.pass < b.pass; });
+  for(Pass& pass : mPasses)
+  {
+    pass.accessCount = 0;
+  }
+  for(size_t i = mAccesses.size(); i-- > 0; )
+  {
+    Pass& pass = mPasses[mAccesses[i].pass];
+    pass.accessBegin = uint32_t(i);
+    ++pass.accessCount;
+  }
+
+  Cull();
+  if(!AllocateTransients())
+  {
+    return;
+  }
+
+  // Whatever used a resource before the graph is treated as a write we must
+  // wait on:
+  mStates.resize(mResources.size());
+  for(size_t i = 0; i < mResources.size(); ++i)
+  {
+    const ResourceUsage& before = mResources[i].before;
+    mStates[i] = {before.layout, before.stages, before.access, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR};
+  }
+
+  for(Pass& pass : mPasses)
+  {
+    if(pass.culled)
+    {
+      continue;
+    }
+    pass.barriers.imageBegin = uint32_t(mImageBarriers.size());
+    pass.barriers.memory = MemoryBarrier2KHR(0, 0, 0, 0);
+    for(uint32_t i = pass.accessBegin; i < pass.accessBegin + pass.accessCount; ++i)
+    {
+      const Access& access = mAccesses[i];
+      const uint32_t transient = mResources[access.resource].transient;
+      if(transient != NOT_TRANSIENT && !mTransients[transient].primed)
+      {
+        PrimeTransient(mTransients[transient]);
+      }
+      Transition(access.resource, access.usage, access.write, pass.barriers);
+    }
+    pass.barriers.imageCount = uint32_t(mImageBarriers.size()) - pass.barriers.imageBegin;
+    mNumMemoryBarriers += HasMemoryBarrier(pass.barriers.memory) ? 1 : 0;
+  }
+
+  // Hand the resources on in the state the world outside expects:
+  mFinalBarriers.imageBegin = uint32_t(mImageBarriers.size());
+  mFinalBarriers.memory = MemoryBarrier2KHR(0, 0, 0, 0);
+  for(size_t i = 0; i < mResources.size(); ++i)
+  {
+    if(!IsDiscard(mResources[i].after))
+    {
+      Transition(ResourceHandle(i), mResources[i].after, false, mFinalBarriers);
+    }
+  }
+  mFinalBarriers.imageCount = uint32_t(mImageBarriers.size()) - mFinalBarriers.imageBegin;
+  mNumMemoryBarriers += HasMemoryBarrier(mFinalBarriers.memory) ? 1 : 0;
+  mCompiled = true;
+}
+
+bool RenderGraph::AllocateTransients()
+{
+  const VkDeviceSize reserved = mTransientStats.reservedBytes;
+  mTransientStats = TransientMemoryStats();
+  mTransientStats.reservedBytes = reserved;
+  if(mTransients.empty() || !mDevice.Get())
+  {
+    return true;
+  }
+
+  // Let go of objects no transient wanted last time:
+  mTransientObjects.erase(std::remove_if(mTransientObjects.begin(), mTransientObjects.end(),
+    [](const TransientObject& object) { return !object.used; }), mTransientObjects.end());
+  for(TransientObject& object : mTransientObjects)
+  {
+    object.used = false;
+  }
+
+  // Find the span of passes each transient is live for. Unused ones are left
+  // empty and overlap nothing:
+  mTransientRanges.resize(mTransients.size());
+  for(Internal::TransientRange& range : mTransientRanges)
+  {
+    range = {0, 1, UINT32_MAX, 0, 0};
+  }
+  for(uint32_t p = 0; p < mPasses.size(); ++p)
+  {
+    const Pass& pass = mPasses[p];
+    if(pass.culled)
+    {
+      continue;
+    }
+    for(uint32_t i = pass.accessBegin; i < pass.accessBegin + pass.accessCount; ++i)
+    {
+      const uint32_t transient = mResources[mAccesses[i].resource].transient;
+      if(transient != NOT_TRANSIENT)
+      {
+        Internal::TransientRange& range = mTransientRanges[transient];
+        range.firstPass = std::min(range.firstPass, p);
+        range.lastPass = std::max(range.lastPass, p);
+      }
+    }
+  }
+
+  uint32_t memoryTypes = UINT32_MAX;
+  for(size_t i = 0; i < mTransients.size(); ++i)
+  {
+    Transient& transient = mTransients[i];
+    Internal::TransientRange& range = mTransientRanges[i];
+    mResources[transient.resource].image = VK_NULL_HANDLE;
+    mResources[transient.resource].buffer = VK_NULL_HANDLE;
+    if(range.firstPass == UINT32_MAX)
+    {
+      continue;
+    }
+    const TransientObject& object = FindTransientObject(transient);
+    range.alignment = std::max(object.requirements.alignment, mBufferImageGranularity);
+    range.size = (object.requirements.size + range.alignment - 1) & ~(range.alignment - 1);
+    memoryTypes &= object.requirements.memoryTypeBits;
+    mTransientStats.numResources += 1;
+    mTransientStats.unaliasedBytes += range.size;
+  }
+
+  const uint64_t total = Internal::PlaceTransients(mTransientRanges);
+  mTransientStats.aliasedBytes = total;
+  if(total == 0)
+  {
+    return true;
+  }
+
+  ConditionalValue<uint32_t> memoryType = FindFirstMemoryTypeWithProperties(mMemoryProperties, memoryTypes, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  if(!memoryType)
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalState, "No device-local memory type suits all the transient resources.", __FUNCTION__, __FILE__, __LINE__);
+    return false;
+  }
+  if(!mTransientMemory.Get() || mTransientStats.reservedBytes < total || mTransientMemoryType != memoryType.GetValue())
+  {
+    // Objects bound to the old block keep it alive until they are replaced:
+    mTransientMemory = DeviceMemory::New(*mDevice, MemoryAllocateInfo(total, memoryType.GetValue()));
+    mTransientMemoryType = memoryType.GetValue();
+    mTransientStats.reservedBytes = total;
+    ++mTransientGeneration;
+    KRUST_LOG_INFO << "RenderGraph transients: " << mTransientStats.numResources << " resources needing "
+                   << (mTransientStats.unaliasedBytes >> 10) << " kB share " << (total >> 10) << " kB of memory, saving "
+                   << ((mTransientStats.unaliasedBytes - total) >> 10) << " kB." << endlog;
+  }
+
+  for(size_t i = 0; i < mTransients.size(); ++i)
+  {
+    const Transient& transient = mTransients[i];
+    const Internal::TransientRange& range = mTransientRanges[i];
+    if(transient.object == NOT_TRANSIENT)
+    {
+      continue;
+    }
+    TransientObject& object = mTransientObjects[transient.object];
+    if(object.generation != mTransientGeneration || object.offset != range.offset)
+    {
+      // A binding can't be changed so an object placed differently from
+      // last time has to be replaced:
+      if(object.generation != 0)
+      {
+        if(object.isImage)
+        {
+          object.image = Image::New(*mDevice, object.imageInfo);
+        }
+        else
+        {
+          object.buffer = Buffer::New(*mDevice, 0, object.bufferSize, object.bufferUsage, VK_SHARING_MODE_EXCLUSIVE, 0);
+        }
+      }
+      const VkResult result = object.isImage ?
+        object.image->BindMemory(*mTransientMemory, range.offset) :
+        object.buffer->BindMemory(*mTransientMemory, range.offset);
+      if(result != VK_SUCCESS)
+      {
+        // Images report their own failures:
+        if(!object.isImage)
+        {
+          ThreadBase::Get().GetErrorPolicy().VulkanError("vkBindBufferMemory", result, "Failed to bind a transient buffer.", __FUNCTION__, __FILE__, __LINE__);
+        }
+        return false;
+      }
+      object.generation = mTransientGeneration;
+      object.offset = range.offset;
+    }
+    if(object.isImage)
+    {
+      mResources[transient.resource].image = *object.image;
+    }
+    else
+    {
+      mResources[transient.resource].buffer = *object.buffer;
+    }
+  }
+  return true;
+}
+
+RenderGraph::TransientObject& RenderGraph::FindTransientObject(Transient& transient)
+{
+  // Objects are matched in the order the graph creates transients so one
+  // built the same way each frame gets the same objects back:
+  for(uint32_t i = 0; i < mTransientObjects.size(); ++i)
+  {
+    TransientObject& object = mTransientObjects[i];
+    if(!object.used && object.isImage == transient.isImage &&
+       (transient.isImage ? SameImage(object.imageInfo, transient.imageInfo) :
+         (object.bufferSize == transient.bufferSize && object.bufferUsage == transient.bufferUsage)))
+    {
+      object.used = true;
+      transient.object = i;
+      return object;
+    }
+  }
+
+  mTransientObjects.emplace_back();
+  TransientObject& object = mTransientObjects.back();
+  object.isImage = transient.isImage;
+  object.imageInfo = transient.imageInfo;
+  object.bufferSize = transient.bufferSize;
+  object.bufferUsage = transient.bufferUsage;
+  if(transient.isImage)
+  {
+    object.image = Image::New(*mDevice, transient.imageInfo);
+    vkGetImageMemoryRequirements(*mDevice, *object.image, &object.requirements);
+  }
+  else
+  {
+    object.buffer = Buffer::New(*mDevice, 0, transient.bufferSize, transient.bufferUsage, VK_SHARING_MODE_EXCLUSIVE, 0);
+    vkGetBufferMemoryRequirements(*mDevice, *object.buffer, &object.requirements);
+  }
+  object.used = true;
+  transient.object = uint32_t(mTransientObjects.size() - 1);
+  return object;
+}
+
+void RenderGraph::PrimeTransient(Transient& transient)
+{
+  // The first access waits for the last accesses of everything which used
+  // the same memory earlier in the graph:
+  const uint32_t index = mResources[transient.resource].transient;
+  const Internal::TransientRange& mine = mTransientRanges[index];
+  ResourceState& state = mStates[transient.resource];
+  state = {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR};
+  for(uint32_t i = 0; i < mTransients.size(); ++i)
+  {
+    const Internal::TransientRange& other = mTransientRanges[i];
+    if(i != index && other.size > 0 && other.lastPass < mine.firstPass && Internal::MemoryOverlaps(mine, other))
+    {
+      const ResourceState& previous = mStates[mTransients[i].resource];
+      state.writeStages |= previous.writeStages | previous.readStages;
+      state.writeAccess |= previous.writeAccess;
+    }
+  }
+  transient.primed = true;
+}
+
+void RenderGraph::Transition(const ResourceHandle resource, const ResourceUsage& usage, const bool write, BarrierPoint& point)
+{
+  const Resource& r = mResources[resource];
+  ResourceState& state = mStates[resource];
+  const VkImageLayout oldLayout = state.layout;
+  const bool layoutChange = r.isImage && usage.layout != oldLayout;
+
+  VkPipelineStageFlags2KHR srcStages = VK_PIPELINE_STAGE_2_NONE_KHR;
+  VkAccessFlags2KHR srcAccess = VK_ACCESS_2_NONE_KHR;
+  bool barrier = false;
+
+  if(write || layoutChange)
+  {
+    // Writes, including layout transitions, wait for both the last write and
+    // every read since it:
+    srcStages = state.writeStages | state.readStages;
+    srcAccess = state.writeAccess;
+    barrier = layoutChange || srcStages != VK_PIPELINE_STAGE_2_NONE_KHR;
+    if(r.isImage)
+    {
+      state.layout = usage.layout;
+    }
+    // A transition for a read has no memory of ours to make available but
+    // later accesses in other stages still have to wait for it:
+    state.writeStages = usage.stages;
+    state.writeAccess = write ? usage.access : VK_ACCESS_2_NONE_KHR;
+    state.readStages = write ? VK_PIPELINE_STAGE_2_NONE_KHR : usage.stages;
+    state.readAccess = write ? VK_ACCESS_2_NONE_KHR : usage.access;
+  }
+  else if(state.writeStages == VK_PIPELINE_STAGE_2_NONE_KHR && state.writeAccess == VK_ACCESS_2_NONE_KHR)
+  {
+    // Nothing to wait for, but a later write must wait for this read:
+    state.readStages |= usage.stages;
+    state.readAccess |= usage.access;
+  }
+  else if((usage.stages & ~state.readStages) != 0 || (usage.access & ~state.readAccess) != 0)
+  {
+    // The first read since the last write in these stages:
+    srcStages = state.writeStages;
+    srcAccess = state.writeAccess;
+    barrier = true;
+    state.readStages |= usage.stages;
+    state.readAccess |= usage.access;
+  }
+
+  if(!barrier)
+  {
+    return;
+  }
+  if(r.isImage)
+  {
+    mImageBarriers.push_back(ImageMemoryBarrier2KHR(
+      srcStages, srcAccess, usage.stages, usage.access,
+      oldLayout, usage.layout,
+      VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+      r.image, r.range));
+  }
+  else
+  {
+    // Buffer barriers are no more precise than a global one on common
+    // hardware, so fold them all into one:
+    point.memory.srcStageMask  |= srcStages;
+    point.memory.srcAccessMask |= srcAccess;
+    point.memory.dstStageMask  |= usage.stages;
+    point.memory.dstAccessMask |= usage.access;
+  }
+}
+
+void RenderGraph::RecordBarriers(const VkCommandBuffer commandBuffer, const BarrierPoint& point)
+{
+  const bool memory = HasMemoryBarrier(point.memory);
+  if(point.imageCount == 0 && !memory)
+  {
+    return;
+  }
+  const VkDependencyInfoKHR dependencies = DependencyInfoKHR(0,
+    memory ? 1 : 0, &point.memory,
+    0, nullptr,
+    point.imageCount, mImageBarriers.data() + point.imageBegin);
+  vkCmdPipelineBarrier2KHR(commandBuffer, &dependencies);
+}
+
+void RenderGraph::Execute(const VkCommandBuffer commandBuffer, GpuProfiler* const profiler)
+{
+  if(!mCompiled)
+  {
+    ThreadBase::Get().GetErrorPolicy().Error(Errors::IllegalState, "RenderGraph executed without being compiled since its last change.", __FUNCTION__, __FILE__, __LINE__);
+    return;
+  }
+  for(const Pass& pass : mPasses)
+  {
+    if(pass.culled)
+    {
+      continue;
+    }
+    RecordBarriers(commandBuffer, pass.barriers);
+    if(pass.record)
+    {
+      const GpuProfiler::Scope scope { profiler, commandBuffer, pass.name };
+      pass.record(commandBuffer);
+    }
+  }
+  RecordBarriers(commandBuffer, mFinalBarriers);
+}
+
+void RenderGraph::Reset()
+{
+  mResources.clear();
+  mPasses.clear();
+  mAccesses.clear();
+  mTransients.clear();
+  mImageBarriers.clear();
+  mNumMemoryBarriers = 0;
+  mNumCulled = 0;
+  mCompiled = false;
+}
+
+} /* namespace Krust */
@@ -0,0 +1,329 @@
+#ifndef KRUST_PUBLIC_API_RENDER_GRAPH_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_RENDER_GRAPH_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * @file A frame graph which derives the pipeline barriers between passes from
+ * the resources each pass declares it reads and writes.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan-objects.h"
+
+// External includes:
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace Krust
+{
+
+namespace Internal { struct TransientRange; }
+class GpuProfiler;
+
+/**
+ * @brief The pipeline stages, access types, and, for images, the layout with
+ * which a pass or the world outside a RenderGraph uses a resource.
+ */
+struct ResourceUsage
+{
+  VkPipelineStageFlags2KHR stages = VK_PIPELINE_STAGE_2_NONE_KHR;
+  VkAccessFlags2KHR access = VK_ACCESS_2_NONE_KHR;
+  /// Ignored for buffers.
+  VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+/// Usages which cover the common cases.
+namespace Usage
+{
+  constexpr ResourceUsage ComputeRead      { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL };
+  constexpr ResourceUsage ComputeWrite     { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL };
+  constexpr ResourceUsage ComputeReadWrite { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL };
+  constexpr ResourceUsage ComputeSampled   { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+  constexpr ResourceUsage TransferRead     { VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+  constexpr ResourceUsage TransferWrite    { VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+  /// Handed to the presentation engine, which needs no access of ours to be
+  /// made available, only the layout.
+  constexpr ResourceUsage Present          { VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+  /// The contents are of no interest, either before the graph runs, so an
+  /// image's first transition can discard them, or after, so passes whose only
+  /// effect is to write them can be culled.
+  constexpr ResourceUsage Discard          { VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_UNDEFINED };
+}
+
+/**
+ * @brief How much memory a RenderGraph's transient resources need with and
+ * without aliasing.
+ */
+struct TransientMemoryStats
+{
+  /// Number of transients used by passes which survived culling.
+  uint32_t numResources = 0;
+  /// Bytes the transients would need with dedicated memory each.
+  uint64_t unaliasedBytes = 0;
+  /// Bytes they need when sharing memory.
+  uint64_t aliasedBytes = 0;
+  /// Size of the block of device memory currently held for them.
+  uint64_t reservedBytes = 0;
+};
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Records a frame's passes with the minimal set of barriers between them,
+ * derived from the reads and writes each declares on the images and buffers it
+ * uses.
+ *
+ * Each frame: import the resources, add the passes in submission order with
+ * their accesses, Compile() and Execute(). Compile() culls passes which
+ * contribute nothing to a resource needed after the graph, then walks the rest
+ * tracking the last writes and synchronised reads of each resource to find
+ * which accesses actually hazard. All the barriers in front of a pass are
+ * recorded with one vkCmdPipelineBarrier2KHR(), with the buffer barriers folded
+ * into a single global memory barrier.
+ * Reset() clears the graph for the next frame but keeps its storage.
+ *
+ * Resources created by the graph rather than imported are transient: their
+ * contents live only from the first to the last pass that uses them. Compile()
+ * places transients whose lifetimes don't overlap at the same offsets in one
+ * block of device memory and adds the barriers to hand memory from one to the
+ * next. The Vulkan objects and memory are kept between frames and reused as
+ * long as the graph places them the same way. Since every execution of the
+ * graph uses the same memory, the previous execution must have completed on
+ * the GPU before the next starts, or use one graph per frame in flight.
+ * Objects replaced when placements change are released, so enable deferred
+ * destruction on the QueueJanitor if they may still be in use.
+ *
+ * Requires VK_KHR_synchronization2 to be enabled on the device.
+ * Passes are recorded in the order they were added; the graph does not reorder
+ * them.
+ */
+class RenderGraph
+{
+public:
+  using ResourceHandle = uint32_t;
+  using PassHandle = uint32_t;
+  /// Returned in place of a resource the graph couldn't add.
+  static constexpr ResourceHandle INVALID_RESOURCE = UINT32_MAX;
+  /// Called to record a pass's commands.
+  using RecordFunction = std::function<void(VkCommandBuffer commandBuffer)>;
+
+  /// A graph which can only use imported resources.
+  RenderGraph();
+  /// A graph which can also create transient resources on the device.
+  explicit RenderGraph(Device& device);
+  ~RenderGraph();
+
+  /**
+   * Add an image owned outside the graph.
+   * @param[in] name For diagnostics. Must outlive the graph, e.g. a literal.
+   * @param[in] before How the image was last used before the graph runs. The
+   *            first pass to touch it waits on these stages.
+   * @param[in] after How the image will be used after the graph. It is left in
+   *            this layout. Passing Usage::Discard allows passes which only
+   *            write the image to be culled.
+   */
+  ResourceHandle ImportImage(const char* name, VkImage image, const VkImageSubresourceRange& range,
+                             const ResourceUsage& before, const ResourceUsage& after);
+  /// Add a buffer owned outside the graph. As ImportImage() but layouts are ignored.
+  ResourceHandle ImportBuffer(const char* name, VkBuffer buffer,
+                              const ResourceUsage& before, const ResourceUsage& after);
+
+  /**
+   * Add an image whose contents are only needed between the passes of the
+   * graph that use it. Its memory may be shared with other transients.
+   * The graph must have been constructed with a device, else INVALID_RESOURCE
+   * is returned.
+   * @param[in] info The tiling must be optimal, the sharing exclusive, and
+   *            the initial layout undefined.
+   */
+  ResourceHandle CreateImage(const char* name, const VkImageCreateInfo& info,
+                             VkImageAspectFlags aspects = VK_IMAGE_ASPECT_COLOR_BIT);
+  /// Add a buffer whose contents are only needed between the passes of the
+  /// graph that use it. As CreateImage() the graph needs a device.
+  ResourceHandle CreateBuffer(const char* name, VkDeviceSize size, VkBufferUsageFlags usage);
+
+  /// @return The image of an imported or transient resource. Transients only
+  /// have one once Compile() has run and a pass which survived culling uses them.
+  VkImage GetImage(ResourceHandle resource) const;
+  VkBuffer GetBuffer(ResourceHandle resource) const;
+  /// @return The wrapper of a transient image, e.g. to make views of it, or
+  /// null as for GetImage().
+  Image* GetTransientImage(ResourceHandle resource) const;
+
+  /**
+   * Add a pass to run after all those added before it.
+   * @param[in] name For diagnostics. Must outlive the graph, e.g. a literal.
+   */
+  PassHandle AddPass(const char* name, RecordFunction record);
+  /// Declare that the pass reads the resource. Declaring several accesses to
+  /// one resource in a pass merges them, but image layouts must agree.
+  void Read(PassHandle pass, ResourceHandle resource, const ResourceUsage& usage);
+  /// Declare that the pass writes the resource.
+  void Write(PassHandle pass, ResourceHandle resource, const ResourceUsage& usage);
+  /// Stop a pass being culled, e.g. because it writes to host-visible memory
+  /// or does other work not expressed in the graph.
+  void SetSideEffects(PassHandle pass);
+
+  /// Cull passes and work out the barriers before each. Call after adding all
+  /// passes and before Execute(). If the transients can't be given memory the
+  /// graph is left uncompiled.
+  void Compile();
+  /// Record the barriers and passes which survived culling into the command
+  /// buffer, followed by the transitions of imported resources to their
+  /// after-graph usages.
+  /// @param profiler If given, each pass is timed as a scope named after it.
+  void Execute(VkCommandBuffer commandBuffer, GpuProfiler* profiler = nullptr);
+  /// Forget all resources and passes while keeping the storage for them.
+  void Reset();
+
+  size_t GetNumPasses() const { return mPasses.size(); }
+  /// @return The number of passes Compile() found had no effect.
+  size_t GetNumCulledPasses() const { return mNumCulled; }
+  /// @return The number of image and memory barriers Compile() generated.
+  size_t GetNumBarriers() const { return mImageBarriers.size() + mNumMemoryBarriers; }
+  bool IsCulled(PassHandle pass) const { return mPasses[pass].culled; }
+  /// @return The memory used by transients as of the last Compile().
+  const TransientMemoryStats& GetTransientMemoryStats() const { return mTransientStats; }
+
+private:
+  struct Resource
+  {
+    const char* name;
+    bool isImage;
+    VkImage image;
+    VkBuffer buffer;
+    VkImageSubresourceRange range;
+    ResourceUsage before;
+    ResourceUsage after;
+    /// Index into mTransients, or NOT_TRANSIENT for imported resources.
+    uint32_t transient;
+  };
+  static constexpr uint32_t NOT_TRANSIENT = UINT32_MAX;
+  /// A transient's Vulkan object, kept between frames.
+  struct TransientObject
+  {
+    bool isImage;
+    VkImageCreateInfo imageInfo;
+    VkDeviceSize bufferSize;
+    VkBufferUsageFlags bufferUsage;
+    ImagePtr image;
+    BufferPtr buffer;
+    VkMemoryRequirements requirements;
+    /// The memory block generation and offset it is bound at, if bound.
+    uint32_t generation = 0;
+    VkDeviceSize offset = 0;
+    bool used = false;
+  };
+  /// A transient resource of the current graph.
+  struct Transient
+  {
+    ResourceHandle resource;
+    bool isImage;
+    VkImageCreateInfo imageInfo;
+    VkDeviceSize bufferSize;
+    VkBufferUsageFlags bufferUsage;
+    /// Index into mTransientObjects once Compile() has found one.
+    uint32_t object;
+    /// Set once the aliasing barrier before its first use has been worked out.
+    bool primed;
+  };
+  struct Access
+  {
+    PassHandle pass;
+    ResourceHandle resource;
+    ResourceUsage usage;
+    bool write;
+  };
+  /// The barriers to record before a pass or at the end of the graph.
+  struct BarrierPoint
+  {
+    uint32_t imageBegin = 0;
+    uint32_t imageCount = 0;
+    /// All buffer hazards at this point, merged. Unused if stages are both none.
+    VkMemoryBarrier2KHR memory;
+  };
+  struct Pass
+  {
+    const char* name;
+    RecordFunction record;
+    /// The pass's accesses once Compile() has sorted them.
+    uint32_t accessBegin = 0;
+    uint32_t accessCount = 0;
+    bool sideEffects = false;
+    bool culled = false;
+    BarrierPoint barriers;
+  };
+  /// What Compile() knows of a resource as it walks the passes.
+  struct ResourceState
+  {
+    VkImageLayout layout;
+    VkPipelineStageFlags2KHR writeStages;
+    VkAccessFlags2KHR writeAccess;
+    /// Reads which already wait on the last write, and which a later write must
+    /// wait for in turn.
+    VkPipelineStageFlags2KHR readStages;
+    VkAccessFlags2KHR readAccess;
+  };
+
+  void AddAccess(PassHandle pass, ResourceHandle resource, const ResourceUsage& usage, bool write);
+  void Cull();
+  /// Find the lifetimes of the transients, place them in memory, and bind
+  /// objects to them.
+  /// @return False if they couldn't be given memory.
+  bool AllocateTransients();
+  TransientObject& FindTransientObject(Transient& transient);
+  /// Start the state of a transient from the last accesses of the transients
+  /// which used its memory before it.
+  void PrimeTransient(Transient& transient);
+  /// Add any barrier needed for the usage to the barrier point and update
+  /// the state of the resource to follow it.
+  void Transition(ResourceHandle resource, const ResourceUsage& usage, bool write, BarrierPoint& point);
+  void RecordBarriers(VkCommandBuffer commandBuffer, const BarrierPoint& point);
+
+  /// The device transients are created on. May be null.
+  DevicePtr mDevice;
+  VkPhysicalDeviceMemoryProperties mMemoryProperties;
+  VkDeviceSize mBufferImageGranularity = 1;
+
+  std::vector<Resource> mResources;
+  std::vector<Pass> mPasses;
+  std::vector<Access> mAccesses;
+  std::vector<ResourceState> mStates;
+  /// Resources whose contents are needed, used while culling.
+  std::vector<bool> mNeeded;
+  std::vector<VkImageMemoryBarrier2KHR> mImageBarriers;
+  BarrierPoint mFinalBarriers;
+  std::vector<Transient> mTransients;
+  std::vector<Internal::TransientRange> mTransientRanges;
+  std::vector<TransientObject> mTransientObjects;
+  DeviceMemoryPtr mTransientMemory;
+  uint32_t mTransientMemoryType = 0;
+  /// Bumped each time the transient memory is reallocated.
+  uint32_t mTransientGeneration = 0;
+  TransientMemoryStats mTransientStats;
+  size_t mNumMemoryBarriers = 0;
+  size_t mNumCulled = 0;
+  bool mCompiled = false;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_RENDER_GRAPH_H_INCLUDED_E26EF */
@@ -0,0 +1,500 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "krust/public-api/spirv-reflection.h"
+
+// Internal includes:
+#include "krust/public-api/logging.h"
+#include "krust/public-api/vulkan_struct_init.h"
+
+// External includes:
+#include <algorithm>
+#include <cstring>
+
+namespace Krust
+{
+
+namespace
+{
+
+// Numbers from the SPIR-V specification:
+constexpr uint32_t SPIRV_MAGIC = 0x07230203u;
+/// The magic number, version, generator, bound and schema words.
+constexpr size_t SPIRV_HEADER_WORDS = 5u;
+
+constexpr uint32_t OpEntryPoint = 15;
+constexpr uint32_t OpExecutionMode = 16;
+constexpr uint32_t OpTypeBool = 20;
+constexpr uint32_t OpTypeInt = 21;
+constexpr uint32_t OpTypeFloat = 22;
+constexpr uint32_t OpTypeVector = 23;
+constexpr uint32_t OpTypeMatrix = 24;
+constexpr uint32_t OpTypeImage = 25;
+constexpr uint32_t OpTypeSampler = 26;
+constexpr uint32_t OpTypeSampledImage = 27;
+constexpr uint32_t OpTypeArray = 28;
+constexpr uint32_t OpTypeRuntimeArray = 29;
+constexpr uint32_t OpTypeStruct = 30;
+constexpr uint32_t OpTypePointer = 32;
+constexpr uint32_t OpConstant = 43;
+constexpr uint32_t OpConstantComposite = 44;
+constexpr uint32_t OpSpecConstant = 50;
+constexpr uint32_t OpSpecConstantComposite = 51;
+constexpr uint32_t OpVariable = 59;
+constexpr uint32_t OpDecorate = 71;
+constexpr uint32_t OpMemberDecorate = 72;
+constexpr uint32_t OpExecutionModeId = 331;
+constexpr uint32_t OpTypeAccelerationStructureKHR = 5341;
+
+constexpr uint32_t DecorationSpecId = 1;
+constexpr uint32_t DecorationBlock = 2;
+constexpr uint32_t DecorationBufferBlock = 3;
+constexpr uint32_t DecorationArrayStride = 6;
+constexpr uint32_t DecorationMatrixStride = 7;
+constexpr uint32_t DecorationBuiltIn = 11;
+constexpr uint32_t DecorationBinding = 33;
+constexpr uint32_t DecorationDescriptorSet = 34;
+constexpr uint32_t DecorationOffset = 35;
+
+constexpr uint32_t StorageClassUniformConstant = 0;
+constexpr uint32_t StorageClassUniform = 2;
+constexpr uint32_t StorageClassPushConstant = 9;
+constexpr uint32_t StorageClassStorageBuffer = 12;
+
+constexpr uint32_t ExecutionModeLocalSize = 17;
+constexpr uint32_t ExecutionModeLocalSizeId = 38;
+
+constexpr uint32_t BuiltInWorkgroupSize = 25;
+
+constexpr uint32_t DimBuffer = 5;
+constexpr uint32_t DimSubpassData = 6;
+
+constexpr uint32_t NONE = ~0u;
+
+/// What the module says about one of its ids.
+struct IdInfo
+{
+  /// The instruction which defines the id.
+  uint32_t opcode = 0;
+  /// The operands of that instruction, following its first word.
+  span<const uint32_t> operands;
+
+  uint32_t set = NONE;
+  uint32_t binding = NONE;
+  uint32_t specId = NONE;
+  uint32_t arrayStride = 0;
+  bool block = false;
+  bool bufferBlock = false;
+  /// For structs, the Offset and MatrixStride decorations of each member.
+  std::vector<uint32_t> memberOffsets;
+  std::vector<uint32_t> memberMatrixStrides;
+};
+
+class Module
+{
+public:
+  explicit Module(const uint32_t bound) : mIds(bound) {}
+
+  IdInfo* Find(const uint32_t id)
+  {
+    return id < mIds.size() ? &mIds[id] : nullptr;
+  }
+
+  uint32_t ConstantValue(const uint32_t id)
+  {
+    const IdInfo* info = Find(id);
+    if(info && (info->opcode == OpConstant || info->opcode == OpSpecConstant) && info->operands.size() > 2)
+    {
+      return info->operands[2];
+    }
+    return 0;
+  }
+
+  /// The number of bytes a type occupies in a block, or zero if unsized.
+  uint32_t TypeSize(const uint32_t typeId, const uint32_t matrixStride = 0)
+  {
+    const IdInfo* type = Find(typeId);
+    if(!type)
+    {
+      return 0;
+    }
+    const auto& ops = type->operands;
+    switch(type->opcode)
+    {
+      case OpTypeBool:
+        return 4;
+      case OpTypeInt:
+      case OpTypeFloat:
+        return ops.size() > 1 ? ops[1] / 8u : 0;
+      case OpTypeVector:
+        return ops.size() > 2 ? ops[2] * TypeSize(ops[1]) : 0;
+      case OpTypeMatrix:
+        return ops.size() > 2 ? ops[2] * (matrixStride ? matrixStride : TypeSize(ops[1])) : 0;
+      case OpTypeArray:
+        return ops.size() > 2 ? ConstantValue(ops[2]) * (type->arrayStride ? type->arrayStride : TypeSize(ops[1])) : 0;
+      case OpTypeStruct:
+      {
+        // Members needn't be in offset order so find the one which ends last:
+        uint32_t size = 0;
+        for(size_t member = 1; member < ops.size(); ++member)
+        {
+          const size_t index = member - 1;
+          const uint32_t offset = index < type->memberOffsets.size() ? type->memberOffsets[index] : 0;
+          const uint32_t stride = index < type->memberMatrixStrides.size() ? type->memberMatrixStrides[index] : 0;
+          size = std::max(size, offset + TypeSize(ops[member], stride));
+        }
+        return size;
+      }
+      default:
+        return 0;
+    }
+  }
+
+private:
+  std::vector<IdInfo> mIds;
+};
+
+VkShaderStageFlags StageOfExecutionModel(const uint32_t model)
+{
+  switch(model)
+  {
+    case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+    case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+    case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+    case 5313: return VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    case 5314: return VK_SHADER_STAGE_INTERSECTION_BIT_KHR;
+    case 5315: return VK_SHADER_STAGE_ANY_HIT_BIT_KHR;
+    case 5316: return VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    case 5317: return VK_SHADER_STAGE_MISS_BIT_KHR;
+    case 5318: return VK_SHADER_STAGE_CALLABLE_BIT_KHR;
+    default: return 0;
+  }
+}
+
+/// @return The descriptor type for an opaque resource or NONE.
+uint32_t DescriptorTypeOfUniformConstant(const IdInfo& type)
+{
+  switch(type.opcode)
+  {
+    case OpTypeSampler: return VK_DESCRIPTOR_TYPE_SAMPLER;
+    case OpTypeSampledImage: return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    case OpTypeAccelerationStructureKHR: return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+    case OpTypeImage:
+    {
+      // Operands: result, sampled type, dim, depth, arrayed, MS, sampled, format.
+      if(type.operands.size() < 7)
+      {
+        return NONE;
+      }
+      const uint32_t dim = type.operands[2];
+      const bool storage = type.operands[6] == 2;
+      if(dim == DimBuffer)
+      {
+        return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+      }
+      if(dim == DimSubpassData)
+      {
+        return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      }
+      return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    }
+    default:
+      return NONE;
+  }
+}
+
+}
+
+uint32_t SpirVReflection::NumSets() const
+{
+  return bindings.empty() ? 0 : bindings.back().set + 1;
+}
+
+std::vector<VkDescriptorSetLayoutBinding> SpirVReflection::GetSetBindings(const uint32_t set) const
+{
+  std::vector<VkDescriptorSetLayoutBinding> setBindings;
+  for(const auto& b : bindings)
+  {
+    if(b.set == set)
+    {
+      setBindings.push_back(b.binding);
+    }
+  }
+  return setBindings;
+}
+
+void SpirVReflection::Specialize(const VkSpecializationInfo& info)
+{
+  for(unsigned i = 0; i < 3; ++i)
+  {
+    for(uint32_t entry = 0; entry < info.mapEntryCount; ++entry)
+    {
+      const VkSpecializationMapEntry& mapEntry = info.pMapEntries[entry];
+      if(mapEntry.constantID == localSizeSpecIds[i] && mapEntry.size == sizeof(uint32_t) &&
+         mapEntry.offset + sizeof(uint32_t) <= info.dataSize)
+      {
+        memcpy(&localSize[i], static_cast<const uint8_t*>(info.pData) + mapEntry.offset, sizeof(uint32_t));
+      }
+    }
+  }
+}
+
+bool ReflectSpirV(const span<const uint32_t> code, SpirVReflection& reflection)
+{
+  reflection = SpirVReflection {};
+  if(code.size() < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC)
+  {
+    KRUST_LOG_ERROR << "Can't reflect code which is not SPIR-V." << endlog;
+    return false;
+  }
+
+  Module module { code[3] };
+  std::vector<uint32_t> variables;
+  uint32_t entryPoint = NONE;
+  uint32_t localSizeIds[3] = { NONE, NONE, NONE };
+  uint32_t workgroupSizeId = NONE;
+
+  // Gather everything needed about types, constants, variables and their
+  // decorations in one pass:
+  for(size_t word = SPIRV_HEADER_WORDS; word < code.size();)
+  {
+    const uint32_t opcode = code[word] & 0xffffu;
+    const uint32_t wordCount = code[word] >> 16u;
+    if(wordCount == 0 || word + wordCount > code.size())
+    {
+      KRUST_LOG_ERROR << "Truncated SPIR-V instruction at word " << word << "." << endlog;
+      return false;
+    }
+    const span<const uint32_t> ops = code.subspan(word + 1, wordCount - 1);
+    word += wordCount;
+
+    switch(opcode)
+    {
+      case OpEntryPoint:
+        // Only the first entry point of a module with several is reflected:
+        if(entryPoint == NONE && ops.size() > 1)
+        {
+          reflection.stage = StageOfExecutionModel(ops[0]);
+          entryPoint = ops[1];
+        }
+        break;
+
+      case OpExecutionMode:
+        if(ops.size() > 4 && ops[0] == entryPoint && ops[1] == ExecutionModeLocalSize)
+        {
+          std::copy(ops.data() + 2, ops.data() + 5, reflection.localSize);
+        }
+        break;
+
+      case OpExecutionModeId:
+        if(ops.size() > 4 && ops[0] == entryPoint && ops[1] == ExecutionModeLocalSizeId)
+        {
+          std::copy(ops.data() + 2, ops.data() + 5, localSizeIds);
+        }
+        break;
+
+      case OpDecorate:
+        if(IdInfo* info = ops.size() > 1 ? module.Find(ops[0]) : nullptr)
+        {
+          const uint32_t literal = ops.size() > 2 ? ops[2] : 0;
+          switch(ops[1])
+          {
+            case DecorationBlock: info->block = true; break;
+            case DecorationBufferBlock: info->bufferBlock = true; break;
+            case DecorationArrayStride: info->arrayStride = literal; break;
+            case DecorationBinding: info->binding = literal; break;
+            case DecorationDescriptorSet: info->set = literal; break;
+            case DecorationSpecId: info->specId = literal; break;
+            case DecorationBuiltIn:
+              if(literal == BuiltInWorkgroupSize)
+              {
+                workgroupSizeId = ops[0];
+              }
+              break;
+            default: break;
+          }
+        }
+        break;
+
+      case OpMemberDecorate:
+        if(IdInfo* info = ops.size() > 3 ? module.Find(ops[0]) : nullptr)
+        {
+          const uint32_t member = ops[1];
+          std::vector<uint32_t>* values =
+            ops[2] == DecorationOffset ? &info->memberOffsets :
+            ops[2] == DecorationMatrixStride ? &info->memberMatrixStrides : nullptr;
+          if(values)
+          {
+            if(values->size() <= member)
+            {
+              values->resize(member + 1, 0);
+            }
+            (*values)[member] = ops[3];
+          }
+        }
+        break;
+
+      case OpTypeBool:
+      case OpTypeInt:
+      case OpTypeFloat:
+      case OpTypeVector:
+      case OpTypeMatrix:
+      case OpTypeImage:
+      case OpTypeSampler:
+      case OpTypeSampledImage:
+      case OpTypeArray:
+      case OpTypeRuntimeArray:
+      case OpTypeStruct:
+      case OpTypePointer:
+      case OpTypeAccelerationStructureKHR:
+        // Types have their result id first:
+        if(IdInfo* info = ops.size() > 0 ? module.Find(ops[0]) : nullptr)
+        {
+          info->opcode = opcode;
+          info->operands = ops;
+        }
+        break;
+
+      case OpConstant:
+      case OpConstantComposite:
+      case OpSpecConstant:
+      case OpSpecConstantComposite:
+      case OpVariable:
+        // These have a result type before their result id:
+        if(IdInfo* info = ops.size() > 1 ? module.Find(ops[1]) : nullptr)
+        {
+          info->opcode = opcode;
+          info->operands = ops;
+          if(opcode == OpVariable)
+          {
+            variables.push_back(ops[1]);
+          }
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  for(unsigned i = 0; i < 3; ++i)
+  {
+    if(localSizeIds[i] != NONE)
+    {
+      reflection.localSize[i] = module.ConstantValue(localSizeIds[i]);
+      reflection.localSizeSpecIds[i] = module.Find(localSizeIds[i]) ? module.Find(localSizeIds[i])->specId : NONE;
+    }
+  }
+  // A constant decorated as the WorkgroupSize builtin overrides the execution
+  // mode. This is how GLSL's local_size_x_id and friends come through:
+  const IdInfo* workgroupSize = module.Find(workgroupSizeId);
+  if(workgroupSize && workgroupSize->operands.size() > 4 &&
+    (workgroupSize->opcode == OpConstantComposite || workgroupSize->opcode == OpSpecConstantComposite))
+  {
+    for(unsigned i = 0; i < 3; ++i)
+    {
+      const uint32_t component = workgroupSize->operands[2 + i];
+      reflection.localSize[i] = module.ConstantValue(component);
+      reflection.localSizeSpecIds[i] = module.Find(component) ? module.Find(component)->specId : NONE;
+    }
+  }
+
+  for(const uint32_t id : variables)
+  {
+    const IdInfo& variable = *module.Find(id);
+    const uint32_t storageClass = variable.operands.size() > 2 ? variable.operands[2] : NONE;
+    const IdInfo* pointer = module.Find(variable.operands[0]);
+    if(!pointer || pointer->opcode != OpTypePointer || pointer->operands.size() < 3)
+    {
+      continue;
+    }
+    const uint32_t pointeeId = pointer->operands[2];
+
+    if(storageClass == StorageClassPushConstant)
+    {
+      reflection.pushConstantBytes = std::max(reflection.pushConstantBytes, module.TypeSize(pointeeId));
+      continue;
+    }
+    if(variable.binding == NONE)
+    {
+      continue;
+    }
+
+    // Arrays of descriptors multiply the count, with runtime arrays
+    // leaving it to whoever creates the layout:
+    uint32_t count = 1;
+    const IdInfo* type = module.Find(pointeeId);
+    while(type && (type->opcode == OpTypeArray || type->opcode == OpTypeRuntimeArray))
+    {
+      count = type->opcode == OpTypeArray ? count * module.ConstantValue(type->operands[2]) : 0;
+      type = module.Find(type->operands[1]);
+    }
+    if(!type)
+    {
+      continue;
+    }
+
+    uint32_t descriptorType = NONE;
+    switch(storageClass)
+    {
+      case StorageClassUniform:
+        descriptorType = type->bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        break;
+      case StorageClassStorageBuffer:
+        descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        break;
+      case StorageClassUniformConstant:
+        descriptorType = DescriptorTypeOfUniformConstant(*type);
+        break;
+      default:
+        break;
+    }
+    if(descriptorType == NONE)
+    {
+      KRUST_LOG_ERROR << "SPIR-V variable " << id << " at binding " << variable.binding << " has no matching Vulkan descriptor type." << endlog;
+      return false;
+    }
+
+    const uint32_t set = variable.set == NONE ? 0 : variable.set;
+    const auto duplicate = std::find_if(reflection.bindings.begin(), reflection.bindings.end(),
+      [set, &variable](const SpirVBinding& b){ return b.set == set && b.binding.binding == variable.binding; });
+    // Variables aliasing the same binding share its descriptor:
+    if(duplicate == reflection.bindings.end())
+    {
+      reflection.bindings.push_back({ set, DescriptorSetLayoutBinding(
+        variable.binding,
+        VkDescriptorType(descriptorType),
+        count,
+        reflection.stage,
+        nullptr // No immutable samplers.
+      )});
+    }
+  }
+
+  std::sort(reflection.bindings.begin(), reflection.bindings.end(),
+    [](const SpirVBinding& a, const SpirVBinding& b){ return a.set != b.set ? a.set < b.set : a.binding.binding < b.binding.binding; });
+  return true;
+}
+
+} /* namespace Krust */
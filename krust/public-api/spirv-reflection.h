@@ -0,0 +1,92 @@
+#ifndef KRUST_PUBLIC_API_SPIRV_REFLECTION_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_SPIRV_REFLECTION_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Pulling the resource interface of a shader out of its SPIR-V so
+ * descriptor set and pipeline layouts can be built to match it rather than
+ * being written out by hand alongside it.
+ *
+ * This only understands what Krust needs to make layouts: descriptor
+ * bindings, the size of the push constant block and the workgroup size of
+ * compute shaders. It is not a general purpose SPIR-V parser.
+ */
+
+// Internal includes:
+#include "krust-kernel/public-api/span.h"
+
+// External includes:
+#include "krust/public-api/vulkan.h"
+#include <cstdint>
+#include <vector>
+
+namespace Krust
+{
+
+/**
+ * @brief A descriptor the shader declares, with the set it is in.
+ */
+struct SpirVBinding
+{
+  uint32_t set;
+  /// The stage flags are those of the shader. The descriptor count is zero
+  /// for runtime-sized arrays, which the layout's creator must size.
+  VkDescriptorSetLayoutBinding binding;
+};
+
+/**
+ * @brief The parts of a shader's interface with the outside world that affect
+ * its pipeline layout.
+ */
+struct SpirVReflection
+{
+  /// The stage of the shader's (first) entry point.
+  VkShaderStageFlags stage = 0;
+  /// The workgroup size of a compute shader.
+  uint32_t localSize[3] = { 1, 1, 1 };
+  /// The specialization constant each dimension of localSize can be set
+  /// through, or ~0u for those fixed in the shader.
+  uint32_t localSizeSpecIds[3] = { ~0u, ~0u, ~0u };
+  /// The size of the push constant block, or zero if there is none.
+  uint32_t pushConstantBytes = 0;
+  /// Ordered by set and then binding.
+  std::vector<SpirVBinding> bindings;
+
+  /// @return One more than the highest set a descriptor is in.
+  uint32_t NumSets() const;
+  /// @return The bindings in one set, ready to create its layout from.
+  std::vector<VkDescriptorSetLayoutBinding> GetSetBindings(uint32_t set) const;
+  /// Update localSize with any of its dimensions the specialization sets.
+  void Specialize(const VkSpecializationInfo& info);
+};
+
+/**
+ * Reflect the interface of a shader.
+ * @return False, having logged why, if the code is not SPIR-V or uses a
+ * descriptor type there is no Vulkan equivalent for.
+ */
+bool ReflectSpirV(span<const uint32_t> code, SpirVReflection& reflection);
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_SPIRV_REFLECTION_H_INCLUDED_E26EF */
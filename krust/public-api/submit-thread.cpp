@@ -0,0 +1,264 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compilation unit header:
+#include "krust/public-api/submit-thread.h"
+
+// Internal includes:
+#include "krust/public-api/logging.h"
+#include "krust/public-api/object-pool.h"
+#include "krust/public-api/thread-base.h"
+#include "krust/public-api/vulkan_struct_init.h"
+
+// External includes:
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+
+namespace Krust
+{
+
+namespace
+{
+
+/// How long the submit thread sleeps between polls for completions while
+/// there is work in flight on a janitor which tracks completions with fences
+/// and there is nothing new to submit.
+constexpr std::chrono::microseconds COMPLETION_POLL_INTERVAL { 1000 };
+
+/// Puts the shared state of the promises in the size-class pools.
+template<class T>
+struct PoolAllocator
+{
+  using value_type = T;
+  PoolAllocator() {}
+  template<class U> PoolAllocator(const PoolAllocator<U>&) {}
+  T* allocate(const std::size_t n) { return static_cast<T*>(Internal::PoolAllocate(n * sizeof(T))); }
+  void deallocate(T* const block, const std::size_t n) { Internal::PoolFree(block, n * sizeof(T)); }
+  template<class U> bool operator==(const PoolAllocator<U>&) const { return true; }
+  template<class U> bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+}
+
+/// A submission waiting in the list for the submit thread.
+struct SubmitThread::Pending : public PooledObject
+{
+  explicit Pending(OwnedQueueSubmit&& submit) : submit(std::move(submit)) {}
+  OwnedQueueSubmit submit;
+  std::promise<SubmitResult> promise { std::allocator_arg, PoolAllocator<char>() };
+  Pending* next = nullptr;
+};
+
+// -----------------------------------------------------------------------------
+SubmitThread::SubmitThread(QueueJanitor& janitor) :
+  mJanitor(&janitor),
+  mHighestCompletion(janitor.GetHighestCompletion())
+{
+  if(janitor.GetTimelineSemaphore())
+  {
+    mWakeTimeline = Semaphore::NewTimeline(janitor.GetDevice(), 0);
+  }
+  mThread = std::thread(&SubmitThread::Run, this, std::ref(ThreadBase::Get().GetErrorPolicy()));
+}
+
+SubmitThreadPtr SubmitThread::New(QueueJanitor& janitor)
+{
+  return new SubmitThread(janitor);
+}
+
+SubmitThread::~SubmitThread()
+{
+  mStop.store(true);
+  {
+    std::lock_guard<std::mutex> lock(mWakeMutex);
+    WakeLocked();
+  }
+  mThread.join();
+}
+
+std::future<SubmitResult> SubmitThread::Submit(OwnedQueueSubmit&& submit)
+{
+  Pending* pending = new Pending(std::move(submit));
+  std::future<SubmitResult> result = pending->promise.get_future();
+  pending->next = mHead.load(std::memory_order_relaxed);
+  while(!mHead.compare_exchange_weak(pending->next, pending))
+  {}
+  Wake();
+  return result;
+}
+
+void SubmitThread::Wake()
+{
+  // Only pay for the lock if the submit thread may be blocked:
+  if(mSleeping.load())
+  {
+    std::lock_guard<std::mutex> lock(mWakeMutex);
+    WakeLocked();
+  }
+}
+
+void SubmitThread::WakeLocked()
+{
+  mWake.notify_one();
+  if(mWakeTimeline.Get())
+  {
+    // The lock keeps the values signalled increasing as the spec requires:
+    const auto info = SemaphoreSignalInfo(*mWakeTimeline, ++mWakeValue);
+    const VkResult result = vkSignalSemaphore(mJanitor->GetDevice(), &info);
+    if(result != VK_SUCCESS)
+    {
+      KRUST_LOG_ERROR << "Failed to signal the submit thread's wake semaphore: " << result << endlog;
+    }
+  }
+}
+
+SubmitThread::Pending* SubmitThread::TakeAll()
+{
+  Pending* newestFirst = mHead.exchange(nullptr);
+  // Reverse the stack to submit in the order the producers pushed:
+  Pending* oldestFirst = nullptr;
+  while(newestFirst)
+  {
+    Pending* next = newestFirst->next;
+    newestFirst->next = oldestFirst;
+    oldestFirst = newestFirst;
+    newestFirst = next;
+  }
+  return oldestFirst;
+}
+
+void SubmitThread::SubmitAll(Pending* const pending)
+{
+  if(mError)
+  {
+    // Something failed since the last submit so tell the producers rather
+    // than submit more work to a queue which may be lost:
+    for(Pending* p = pending; p; p = p->next)
+    {
+      p->promise.set_exception(mError);
+    }
+    mError = nullptr;
+  }
+  else
+  {
+    // Coalesce everything pending into a single vkQueueSubmit:
+    std::vector<QueueSubmitInfo> infos;
+    for(Pending* p = pending; p; p = p->next)
+    {
+      OwnedQueueSubmit& owned = p->submit;
+      infos.emplace_back(owned.waits, owned.commandBuffers, owned.completionSignals);
+      infos.back().pNext = owned.pNext;
+    }
+    try
+    {
+      const SubmitResult result = mJanitor->Submit(span<const QueueSubmitInfo, dynamic_extent>(infos));
+      for(Pending* p = pending; p; p = p->next)
+      {
+        p->promise.set_value(result);
+      }
+    }
+    catch(...)
+    {
+      // An exception-throwing error policy is in use. Hand the error to the producers:
+      for(Pending* p = pending; p; p = p->next)
+      {
+        p->promise.set_exception(std::current_exception());
+      }
+    }
+  }
+  for(Pending* p = pending; p;)
+  {
+    Pending* next = p->next;
+    delete p;
+    p = next;
+  }
+}
+
+void SubmitThread::Sleep(const bool inFlight)
+{
+  std::unique_lock<std::mutex> lock(mWakeMutex);
+  mSleeping.store(true);
+  // A producer which pushed before seeing mSleeping set is caught here:
+  if(mHead.load() == nullptr && (inFlight || !mStop.load()))
+  {
+    if(inFlight && mWakeTimeline.Get())
+    {
+      // Wait for whichever comes first of the GPU completing the next submit
+      // and a producer signalling past the wake value read under the lock:
+      const VkSemaphore semaphores[2] = { *mJanitor->GetTimelineSemaphore(), *mWakeTimeline };
+      const uint64_t values[2] = { mJanitor->GetHighestCompletion() + 1u, mWakeValue + 1u };
+      lock.unlock();
+      const auto info = SemaphoreWaitInfo(VK_SEMAPHORE_WAIT_ANY_BIT, 2, semaphores, values);
+      const VkResult result = vkWaitSemaphores(mJanitor->GetDevice(), &info, UINT64_MAX);
+      lock.lock();
+      if(result != VK_SUCCESS)
+      {
+        // Don't spin if the device is lost:
+        mWake.wait_for(lock, COMPLETION_POLL_INTERVAL);
+      }
+    }
+    else if(inFlight)
+    {
+      mWake.wait_for(lock, COMPLETION_POLL_INTERVAL);
+    }
+    else
+    {
+      mWake.wait(lock);
+    }
+  }
+  mSleeping.store(false);
+}
+
+void SubmitThread::Run(ErrorPolicy& errorPolicy)
+{
+  ThreadBase threadBase { &errorPolicy };
+  for(;;)
+  {
+    bool inFlight = false;
+    try
+    {
+      if(Pending* pending = TakeAll())
+      {
+        SubmitAll(pending);
+      }
+      mJanitor->CheckCompletions();
+      mJanitor->ReapRetired();
+      mHighestCompletion.store(mJanitor->GetHighestCompletion(), std::memory_order_release);
+      inFlight = mJanitor->GetLastSubmit() > mJanitor->GetHighestCompletion();
+    }
+    catch(...)
+    {
+      // An exception-throwing error policy is in use. Keep it from escaping
+      // the thread and give it to the producers of the next submission:
+      mError = std::current_exception();
+    }
+
+    // Work in flight can't be waited for once the janitor has failed:
+    if(mStop.load() && (!inFlight || mError) && mHead.load() == nullptr)
+    {
+      break;
+    }
+    Sleep(inFlight && !mError);
+  }
+}
+
+} /* namespace Krust */
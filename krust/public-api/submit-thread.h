@@ -0,0 +1,147 @@
+#ifndef KRUST_PUBLIC_API_SUBMIT_THREAD_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_SUBMIT_THREAD_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * @file A thread which owns a QueueJanitor and makes all submissions to it on
+ * behalf of any number of recording threads.
+ */
+
+// Internal includes:
+#include "krust/public-api/queue_janitor.h"
+#include "krust/public-api/krust-errors.h"
+
+// External includes:
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Krust
+{
+
+class SubmitThread;
+using SubmitThreadPtr = IntrusivePointer<SubmitThread>;
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Funnels submissions from many recording threads into one queue.
+ *
+ * Any thread can call Submit(), which pushes the submission onto a lock-free
+ * multi-producer, single-consumer list and returns straight away.
+ * A dedicated thread drains the list, coalescing everything pending into one
+ * vkQueueSubmit through the QueueJanitor, fulfils the futures handed back by
+ * Submit(), checks for completions and publishes the highest completed submit
+ * counter for any thread to read.
+ * With a janitor tracking completions on a timeline semaphore the thread
+ * sleeps in vkWaitSemaphores() until either the GPU completes its next submit
+ * or a producer signals a second timeline semaphore to wake it. With fences
+ * it polls while work is in flight.
+ *
+ * Errors raised on the submit thread by an exception-throwing error policy
+ * are handed to the producers through the futures of the next submission.
+ *
+ * The QueueJanitor must not be used directly by any other thread while the
+ * SubmitThread exists.
+ * If the janitor has deferred destruction enabled, the submit thread is also
+ * the reaper of retired objects.
+ */
+class SubmitThread : public RefObject
+{
+  /** Hidden constructor to prevent users doing naked `new`s.*/
+  SubmitThread(QueueJanitor& janitor);
+
+  // Ban copying objects:
+  SubmitThread(const SubmitThread&) = delete;
+  SubmitThread& operator=(const SubmitThread&) = delete;
+
+  struct Pending;
+
+public:
+  /**
+   * @brief Start a thread to make submissions to the queue of the janitor.
+   * Errors on the submit thread are reported to the error policy of the thread
+   * calling this.
+   */
+  static SubmitThreadPtr New(QueueJanitor& janitor);
+  /**
+   * Makes any pending submits, waits for the GPU to complete them all and
+   * joins the thread.
+   */
+  ~SubmitThread();
+
+  /**
+   * Queue a submission to be made on the submit thread.
+   * Can be called from any thread.
+   * @return A future which yields the result of the vkQueueSubmit which
+   * included this submission and the counter assigned to it.
+   */
+  std::future<SubmitResult> Submit(OwnedQueueSubmit&& submit);
+  std::future<SubmitResult> Submit(const QueueSubmitInfo& submit) {
+    return Submit(OwnedQueueSubmit(submit));
+  }
+
+  /**
+   * @return The highest submit counter known to have completed on the GPU.
+   * Can be called from any thread.
+   */
+  SubmitCounter GetHighestCompletion() const { return mHighestCompletion.load(std::memory_order_acquire); }
+  bool IsComplete(const SubmitCounter submit) const { return submit <= GetHighestCompletion(); }
+
+  QueueJanitor& GetJanitor() const { return *mJanitor; }
+
+private:
+  void Run(ErrorPolicy& errorPolicy);
+  /// Take everything pushed so far, oldest first.
+  Pending* TakeAll();
+  void SubmitAll(Pending* pending);
+  /// Block until there is work to submit or, if inFlight, the GPU completes some.
+  void Sleep(bool inFlight);
+  void Wake();
+  /// Call with mWakeMutex held.
+  void WakeLocked();
+
+  QueueJanitorPtr mJanitor;
+  /// Head of the lock-free stack of submissions pushed by producers.
+  std::atomic<Pending*> mHead { nullptr };
+  std::atomic<SubmitCounter> mHighestCompletion { 0 };
+  std::atomic<bool> mStop { false };
+  /// Set while the submit thread is, or is about to be, blocked on mWake.
+  std::atomic<bool> mSleeping { false };
+  std::mutex mWakeMutex;
+  std::condition_variable mWake;
+  /// Signalled by producers to end a wait on the janitor's timeline semaphore.
+  /// Null if the janitor tracks completions with fences.
+  SemaphorePtr mWakeTimeline;
+  /// The last value mWakeTimeline was signalled with. Guarded by mWakeMutex.
+  uint64_t mWakeValue = 0;
+  /// An error caught on the submit thread, awaiting the next submission.
+  std::exception_ptr mError;
+  std::thread mThread;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_SUBMIT_THREAD_H_INCLUDED_E26EF */
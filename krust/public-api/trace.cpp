@@ -0,0 +1,232 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "krust/public-api/trace.h"
+
+#if defined(KRUST_BUILD_CONFIG_ENABLE_TRACING)
+
+// External includes:
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Krust
+{
+
+namespace
+{
+
+constexpr uint32_t EVENTS_PER_CHUNK = 4096;
+
+struct TraceEvent
+{
+  const char* name;
+  uint64_t begin;
+  uint64_t end;
+};
+
+/// A block of events recorded by one thread.
+struct TraceChunk
+{
+  explicit TraceChunk(const uint32_t thread) : thread(thread) {}
+
+  TraceEvent events[EVENTS_PER_CHUNK];
+  /// The number of events the owning thread has published.
+  std::atomic<uint32_t> count { 0 };
+  /// The number of events already flushed. Guarded by the registry's mutex.
+  uint32_t flushed = 0;
+  uint32_t thread;
+  /// Set when the owning thread exits, after which no more events can be
+  /// added. Guarded by the registry's mutex.
+  bool retired = false;
+};
+
+struct TraceRegistry
+{
+  const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+  std::mutex mutex;
+  /// Every chunk with events still to be flushed, and the chunk each thread
+  /// is recording into.
+  std::vector<std::unique_ptr<TraceChunk>> chunks;
+  FILE* file = nullptr;
+  bool firstEvent = true;
+  uint32_t nextThread = 1;
+};
+
+TraceRegistry& GetRegistry()
+{
+  static TraceRegistry registry;
+  return registry;
+}
+
+/// The chunk the thread is recording into and the number of events in it.
+/// Starting out full makes the first event register a chunk.
+thread_local TraceChunk* tChunk = nullptr;
+thread_local uint32_t tCount = EVENTS_PER_CHUNK;
+thread_local uint32_t tThread = 0;
+
+/// Lets the flush free the partly filled chunk of a thread which has exited,
+/// which would otherwise wait forever to fill.
+struct ChunkRetirer
+{
+  ~ChunkRetirer()
+  {
+    // A full chunk is the flush's already and may have been freed:
+    if(tChunk && tCount < EVENTS_PER_CHUNK)
+    {
+      TraceRegistry& registry = GetRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      tChunk->retired = true;
+    }
+    // Anything recorded by later thread_local destructors starts a new chunk:
+    tChunk = nullptr;
+    tCount = EVENTS_PER_CHUNK;
+  }
+};
+/// Only touched when a chunk is made, keeping its construction check off the
+/// recording path.
+thread_local ChunkRetirer tRetirer;
+
+TraceChunk* NewChunk()
+{
+  static_cast<void>(&tRetirer);
+  TraceRegistry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  if(tThread == 0)
+  {
+    tThread = registry.nextThread++;
+  }
+  registry.chunks.push_back(std::make_unique<TraceChunk>(tThread));
+  return registry.chunks.back().get();
+}
+
+/// Write a string as a JSON string literal.
+void WriteJsonString(FILE* const file, const char* string)
+{
+  fputc('"', file);
+  for(; *string; ++string)
+  {
+    if(*string == '"' || *string == '\\')
+    {
+      fputc('\\', file);
+    }
+    fputc(*string, file);
+  }
+  fputc('"', file);
+}
+
+} // namespace <anonymous>
+
+namespace Internal
+{
+
+uint64_t TraceNow()
+{
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - GetRegistry().epoch).count());
+}
+
+void RecordTraceEvent(const char* const name, const uint64_t begin, const uint64_t end)
+{
+  // Once a chunk is full it is left to the flush to free, so is never touched
+  // again here:
+  if(tCount == EVENTS_PER_CHUNK)
+  {
+    tChunk = NewChunk();
+    tCount = 0;
+  }
+  tChunk->events[tCount] = { name, begin, end };
+  tChunk->count.store(++tCount, std::memory_order_release);
+}
+
+} // namespace Internal
+
+bool StartTraceFile(const char* const filename)
+{
+  TraceRegistry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  if(registry.file)
+  {
+    fclose(registry.file);
+  }
+  registry.file = fopen(filename, "w");
+  registry.firstEvent = true;
+  if(!registry.file)
+  {
+    return false;
+  }
+  // The JSON array format of the Chrome trace event format:
+  fputs("[\n", registry.file);
+  return true;
+}
+
+void FlushTrace()
+{
+  TraceRegistry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for(const auto& chunk : registry.chunks)
+  {
+    const uint32_t count = chunk->count.load(std::memory_order_acquire);
+    if(registry.file)
+    {
+      for(uint32_t i = chunk->flushed; i < count; ++i)
+      {
+        const TraceEvent& event = chunk->events[i];
+        fputs(registry.firstEvent ? "{\"name\":" : ",\n{\"name\":", registry.file);
+        WriteJsonString(registry.file, event.name);
+        // Complete events with times in microseconds:
+        fprintf(registry.file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+          event.begin * 1e-3, (event.end - event.begin) * 1e-3, chunk->thread);
+        registry.firstEvent = false;
+      }
+    }
+    chunk->flushed = count;
+  }
+  registry.chunks.erase(std::remove_if(registry.chunks.begin(), registry.chunks.end(),
+    [](const std::unique_ptr<TraceChunk>& chunk) {
+      return chunk->flushed == EVENTS_PER_CHUNK || (chunk->retired && chunk->flushed == chunk->count.load(std::memory_order_relaxed));
+    }),
+    registry.chunks.end());
+  if(registry.file)
+  {
+    fflush(registry.file);
+  }
+}
+
+void StopTraceFile()
+{
+  FlushTrace();
+  TraceRegistry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  if(registry.file)
+  {
+    fputs("\n]\n", registry.file);
+    fclose(registry.file);
+    registry.file = nullptr;
+  }
+}
+
+} /* namespace Krust */
+
+#endif // KRUST_BUILD_CONFIG_ENABLE_TRACING
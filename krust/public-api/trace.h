@@ -0,0 +1,130 @@
+#ifndef KRUST_PUBLIC_API_TRACE_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_TRACE_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Lightweight CPU tracing of scopes of code, written out as a Chrome
+ * trace JSON file which chrome://tracing and the Perfetto UI can both open.
+ *
+ * Define KRUST_BUILD_CONFIG_ENABLE_TRACING (the CMake option of the same name)
+ * to compile the trace macros in. Otherwise they compile out to nothing, as the
+ * logging macros do with KRUST_BUILD_CONFIG_DISABLE_LOGGING, and the functions
+ * here are empty inlines.
+ *
+ * Usage:
+ * @code{.cpp}
+ *   void Renderer::Draw()
+ *   {
+ *     KRUST_TRACE_SCOPE("Draw");
+ *     ...
+ *   }
+ * @endcode
+ *
+ * Each thread records the scopes it closes into its own chunks of events,
+ * publishing each one with a single release store so recording never takes a
+ * lock except to register a new chunk every few thousand events.
+ * FlushTrace() copies the events published so far out to the file opened by
+ * StartTraceFile(), freeing full chunks and those of threads which have exited.
+ */
+
+#if defined(KRUST_BUILD_CONFIG_ENABLE_TRACING)
+// External includes:
+#include <cstdint>
+#endif
+
+/**
+ * @name TracingDefines Wrappers for the tracing functions
+ * The name of a scope must be a string which lives as long as the program, e.g.
+ * a literal or `__func__`, as only the pointer to it is kept.
+ */
+///@{
+#if defined(KRUST_BUILD_CONFIG_ENABLE_TRACING)
+#define KRUST_TRACE_CONCAT_INNER(A, B) A##B
+#define KRUST_TRACE_CONCAT(A, B) KRUST_TRACE_CONCAT_INNER(A, B)
+/// Trace from here to the end of the enclosing block.
+#define KRUST_TRACE_SCOPE(NAME) const Krust::TraceScope KRUST_TRACE_CONCAT(krustTraceScope, __LINE__) { NAME }
+/// Trace from here to the end of the enclosing function, named after it.
+#define KRUST_TRACE_FUNCTION() KRUST_TRACE_SCOPE(__func__)
+#else
+#define KRUST_TRACE_SCOPE(NAME) static_cast<void>(0)
+#define KRUST_TRACE_FUNCTION() static_cast<void>(0)
+#endif
+///@}
+
+namespace Krust
+{
+
+#if defined(KRUST_BUILD_CONFIG_ENABLE_TRACING)
+
+/**
+ * Open a file for the trace and start the JSON array of events in it.
+ * Events recorded before this are written out on the first flush.
+ * @return False if the file could not be opened.
+ */
+bool StartTraceFile(const char* filename);
+
+/**
+ * Write the events published by all threads since the last flush to the trace
+ * file, or discard them if no file is open.
+ * Call it regularly, e.g. once a frame, to bound the memory the events use.
+ */
+void FlushTrace();
+
+/** Flush the trace and close the file. */
+void StopTraceFile();
+
+namespace Internal
+{
+  /** @return The time now in nanoseconds since the trace epoch. */
+  uint64_t TraceNow();
+  /** Record a completed scope into the calling thread's buffer. */
+  void RecordTraceEvent(const char* name, uint64_t begin, uint64_t end);
+}
+
+/**
+ * @brief Records a trace event covering its own lifetime.
+ * Use through KRUST_TRACE_SCOPE().
+ */
+class TraceScope
+{
+public:
+  explicit TraceScope(const char* const name) : mName(name), mBegin(Internal::TraceNow()) {}
+  ~TraceScope() { Internal::RecordTraceEvent(mName, mBegin, Internal::TraceNow()); }
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+private:
+  const char* mName;
+  uint64_t mBegin;
+};
+
+#else
+
+inline bool StartTraceFile(const char*) { return false; }
+inline void FlushTrace() {}
+inline void StopTraceFile() {}
+
+#endif
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_TRACE_H_INCLUDED_E26EF */
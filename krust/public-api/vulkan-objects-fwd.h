@@ -94,6 +94,10 @@ using DescriptorSetLayoutPtr = IntrusivePointer<DescriptorSetLayout>;
 class DescriptorSet;
 using DescriptorSetPtr = IntrusivePointer<DescriptorSet>;
 
+// -----------------------------------------------------------------------------
+class DescriptorUpdateTemplate;
+using DescriptorUpdateTemplatePtr = IntrusivePointer<DescriptorUpdateTemplate>;
+
 // -----------------------------------------------------------------------------
 class DeviceMemory;
 using DeviceMemoryPtr = IntrusivePointer<DeviceMemory>;
@@ -110,10 +114,18 @@ using ImagePtr = IntrusivePointer<Image>;
 class ImageView;
 using ImageViewPtr = IntrusivePointer<ImageView>;
 
+// -----------------------------------------------------------------------------
+class PipelineCache;
+using PipelineCachePtr = IntrusivePointer<PipelineCache>;
+
 // -----------------------------------------------------------------------------
 class PipelineLayout;
 using PipelineLayoutPtr = IntrusivePointer<PipelineLayout>;
 
+// -----------------------------------------------------------------------------
+class QueryPool;
+using QueryPoolPtr = IntrusivePointer<QueryPool>;
+
 // -----------------------------------------------------------------------------
 class Semaphore;
 using SemaphorePtr = IntrusivePointer<Semaphore>;
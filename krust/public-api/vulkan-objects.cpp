@@ -25,13 +25,18 @@
 #include "krust/public-api/logging.h"
 #include "krust/public-api/krust-assertions.h"
 #include "krust/public-api/krust-errors.h"
+#include "krust/public-api/trace.h"
 #include "krust/internal/keep-alive-set.h"
 #include "krust/internal/krust-internal.h"
+#include "krust/internal/retire-list.h"
 #include "krust/internal/scoped-temp-array.h"
 #include "krust/public-api/vulkan.h"
 
 #include "krust-kernel/public-api/debug.h"
 
+// External includes:
+#include <algorithm>
+
 #define KRUST_CALL_CREATOR(NAME) \
 const VkResult result = vkCreate##NAME(device, &info, Internal::sAllocator, &m##NAME);\
   if (result != VK_SUCCESS)\
@@ -89,9 +94,29 @@ namespace Krust
 /// Max size for a temporary buffer on the stack (over this and we do a temp heap alloc).
 constexpr unsigned MAX_STACK_BUFFER_BYTES = DEFAULT_MAX_LOCAL_BUFFER_BYTES;
 
+namespace Internal
+{
+  std::atomic<RetireList<VulkanObject>*> sRetireList { nullptr };
+}
 
 // -----------------------------------------------------------------------------
-CommandBuffer::CommandBuffer(CommandPool& pool, const VkCommandBufferLevel level) :
+void VulkanObject::Retire() const
+{
+  Internal::RetireList<VulkanObject>* const retired = Internal::sRetireList.load(std::memory_order_acquire);
+  if(retired)
+  {
+    retired->Push(*this);
+  }
+  else
+  {
+    delete this;
+  }
+}
+
+
+// -----------------------------------------------------------------------------
+CommandBuffer::CommandBuffer(CommandPool& pool, const VkCommandBufferLevel level, const RefCountPolicy policy) :
+  VulkanObject(policy),
   mPool(&pool)
 {
   auto info = CommandBufferAllocateInfo(pool, level, 1u);
@@ -106,9 +131,9 @@ CommandBuffer::CommandBuffer(CommandPool& pool, const VkCommandBufferLevel level
 
 CommandBuffer::CommandBuffer(CommandPool& pool, VkCommandBuffer vkBuf) : mPool(&pool), mCommandBuffer(vkBuf) {}
 
-CommandBufferPtr CommandBuffer::New(CommandPool & pool, VkCommandBufferLevel level)
+CommandBufferPtr CommandBuffer::New(CommandPool & pool, VkCommandBufferLevel level, const RefCountPolicy policy)
 {
-  return CommandBufferPtr{ new CommandBuffer{pool, level} };
+  return CommandBufferPtr{ new CommandBuffer{pool, level, policy} };
 }
 
 void CommandBuffer::Allocate(CommandPool & pool, VkCommandBufferLevel level, unsigned number, std::vector<CommandBufferPtr>& outCommandBuffers)
@@ -161,7 +186,7 @@ void CommandBuffer::Reset(const VkCommandBufferResetFlags flags, bool deleteKeep
       delete reinterpret_cast<KeepAliveSet*>(mKeepAlives);
       mKeepAlives = nullptr;
     } else {
-      /// @todo reinterpret_cast<KeepAliveSet*>(mKeepAlives)->Clear();
+      reinterpret_cast<KeepAliveSet*>(mKeepAlives)->Clear();
     }
   }
   /// @todo Unfinished function. Never actually resets the underlying Vulkan object. [FixMe]
@@ -224,10 +249,11 @@ CommandPool::~CommandPool()
 
 
 // -----------------------------------------------------------------------------
-ComputePipeline::ComputePipeline(Device& device, const VkComputePipelineCreateInfo& createInfo) :
+ComputePipeline::ComputePipeline(Device& device, const VkComputePipelineCreateInfo& createInfo, const VkPipelineCache pipelineCache) :
   mDevice(device)
 {
-  const VkResult result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &createInfo, Internal::sAllocator, &mPipeline);
+  KRUST_TRACE_SCOPE("vkCreateComputePipelines");
+  const VkResult result = vkCreateComputePipelines(device, pipelineCache, 1, &createInfo, Internal::sAllocator, &mPipeline);
   if (result != VK_SUCCESS)
   {
     mPipeline = VK_NULL_HANDLE;
@@ -235,9 +261,9 @@ ComputePipeline::ComputePipeline(Device& device, const VkComputePipelineCreateIn
   }
 }
 
-ComputePipelinePtr ComputePipeline::New(Device& device, const VkComputePipelineCreateInfo& createInfo)
+ComputePipelinePtr ComputePipeline::New(Device& device, const VkComputePipelineCreateInfo& createInfo, const VkPipelineCache pipelineCache)
 {
-  return new ComputePipeline { device, createInfo };
+  return new ComputePipeline { device, createInfo, pipelineCache };
 }
 
 ComputePipeline::~ComputePipeline()
@@ -311,7 +337,74 @@ DescriptorSet::~DescriptorSet()
 
 
 // -----------------------------------------------------------------------------
-KRUST_VKOBJ_LIFETIME(DescriptorSetLayout)
+DescriptorUpdateTemplate::DescriptorUpdateTemplate(Device& device, const VkDescriptorUpdateTemplateCreateInfo& info, PipelineLayout* const pipelineLayout) :
+  mDevice(&device),
+  mPipelineLayout(pipelineLayout),
+  mSet(info.set)
+{
+  KRUST_CALL_CREATOR(DescriptorUpdateTemplate);
+}
+
+DescriptorUpdateTemplatePtr DescriptorUpdateTemplate::New(
+  Device& device,
+  const DescriptorSetLayout& setLayout,
+  const uint32_t entryCount,
+  const VkDescriptorUpdateTemplateEntry* const pEntries)
+{
+  return new DescriptorUpdateTemplate(device, DescriptorUpdateTemplateCreateInfo(0, entryCount, pEntries,
+    VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET, setLayout, VK_PIPELINE_BIND_POINT_COMPUTE, VK_NULL_HANDLE, 0), nullptr);
+}
+
+DescriptorUpdateTemplatePtr DescriptorUpdateTemplate::NewPush(
+  Device& device,
+  const VkPipelineBindPoint bindPoint,
+  PipelineLayout& pipelineLayout,
+  const uint32_t set,
+  const uint32_t entryCount,
+  const VkDescriptorUpdateTemplateEntry* const pEntries)
+{
+  return new DescriptorUpdateTemplate(device, DescriptorUpdateTemplateCreateInfo(0, entryCount, pEntries,
+    VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR, VK_NULL_HANDLE, bindPoint, pipelineLayout, set), &pipelineLayout);
+}
+
+KRUST_VKOBJ_DESTRUCTOR(DescriptorUpdateTemplate)
+
+void DescriptorUpdateTemplate::Update(const VkDescriptorSet set, const void* const data) const
+{
+  KRUST_ASSERT1(!mPipelineLayout.Get(), "Push templates can't update descriptor sets.");
+  vkUpdateDescriptorSetWithTemplate(*mDevice, set, mDescriptorUpdateTemplate, data);
+}
+
+void DescriptorUpdateTemplate::Push(const VkCommandBuffer commandBuffer, const void* const data) const
+{
+  KRUST_ASSERT1(mPipelineLayout.Get(), "Only templates made by NewPush() can push.");
+  vkCmdPushDescriptorSetWithTemplateKHR(commandBuffer, mDescriptorUpdateTemplate, *mPipelineLayout, mSet, data);
+}
+
+
+
+// -----------------------------------------------------------------------------
+DescriptorSetLayout::DescriptorSetLayout(Device& device, const VkDescriptorSetLayoutCreateInfo& info) :
+  mDevice(&device),
+  mFlags(info.flags)
+{
+  KRUST_CALL_CREATOR(DescriptorSetLayout);
+
+  // Sum the descriptors of each type so pools can be sized to fit sets:
+  for(uint32_t i = 0; i < info.bindingCount; ++i)
+  {
+    const VkDescriptorSetLayoutBinding& binding = info.pBindings[i];
+    auto size = std::lower_bound(mPoolSizes.begin(), mPoolSizes.end(), binding.descriptorType,
+      [](const VkDescriptorPoolSize& poolSize, VkDescriptorType type) { return poolSize.type < type; });
+    if(size == mPoolSizes.end() || size->type != binding.descriptorType)
+    {
+      size = mPoolSizes.insert(size, VkDescriptorPoolSize{binding.descriptorType, 0});
+    }
+    size->descriptorCount += binding.descriptorCount;
+  }
+}
+
+KRUST_VKOBJ_DESTRUCTOR(DescriptorSetLayout)
 
 DescriptorSetLayoutPtr DescriptorSetLayout::New(
   Device& device,
@@ -322,6 +415,11 @@ DescriptorSetLayoutPtr DescriptorSetLayout::New(
     return new DescriptorSetLayout {device, DescriptorSetLayoutCreateInfo(flags, bindingCount, pBindings)};
 }
 
+DescriptorSetLayoutPtr DescriptorSetLayout::New(Device& device, const VkDescriptorSetLayoutCreateInfo& createInfo)
+{
+    return new DescriptorSetLayout {device, createInfo};
+}
+
 
 
 // -----------------------------------------------------------------------------
@@ -373,9 +471,28 @@ DeviceMemoryPtr DeviceMemory::New(Device & device, const VkMemoryAllocateInfo &
 
 DeviceMemory::~DeviceMemory()
 {
+  if(mMappedAddress)
+  {
+    vkUnmapMemory(*mDevice, mDeviceMemory);
+  }
   vkFreeMemory(*mDevice, mDeviceMemory, Internal::sAllocator);
 }
 
+void* DeviceMemory::GetPersistentMapping()
+{
+  if(!mMappedAddress)
+  {
+    const VkResult result = vkMapMemory(*mDevice, mDeviceMemory, 0, VK_WHOLE_SIZE, 0, &mMappedAddress);
+    if(result != VK_SUCCESS)
+    {
+      // Callers can fall back to staging so this isn't an error:
+      mMappedAddress = nullptr;
+      KRUST_LOG_WARN << "Failed to persistently map device memory: " << result << endlog;
+    }
+  }
+  return mMappedAddress;
+}
+
 
 
 // -----------------------------------------------------------------------------
@@ -416,14 +533,16 @@ ImagePtr Image::New(Device & device, const VkImageCreateInfo & createInfo)
   return new Image{ device, createInfo };
 }
 
-void Image::BindMemory(DeviceMemory& memory, const VkDeviceSize offset)
+VkResult Image::BindMemory(DeviceMemory& memory, const VkDeviceSize offset)
 {
   const VkResult result = vkBindImageMemory(*mDevice, mImage, memory, offset);
   if (result != VK_SUCCESS)
   {
     ThreadBase::Get().GetErrorPolicy().VulkanError("vkBindImageMemory", result, nullptr, __FUNCTION__, __FILE__, __LINE__);
+    return result;
   }
   mMemory = DeviceMemoryPtr(&memory);
+  return result;
 }
 
 
@@ -480,6 +599,41 @@ Instance::~Instance()
 
 
 
+// -----------------------------------------------------------------------------
+KRUST_VKOBJ_LIFETIME(PipelineCache);
+
+PipelineCachePtr PipelineCache::New(
+  Device&                          device,
+  const size_t                     initialDataSize,
+  const void* const                pInitialData,
+  const VkPipelineCacheCreateFlags flags)
+{
+  return new PipelineCache(device, PipelineCacheCreateInfo(flags, initialDataSize, pInitialData));
+}
+
+std::vector<uint8_t> PipelineCache::GetData() const
+{
+  std::vector<uint8_t> data;
+  size_t size = 0;
+  VkResult result = vkGetPipelineCacheData(*mDevice, mPipelineCache, &size, nullptr);
+  if(result == VK_SUCCESS)
+  {
+    data.resize(size);
+    // The cache can grow between the two calls if other threads are compiling
+    // pipelines with it, leaving us the data which fitted and VK_INCOMPLETE:
+    result = vkGetPipelineCacheData(*mDevice, mPipelineCache, &size, data.data());
+    data.resize(size);
+  }
+  if(result != VK_SUCCESS && result != VK_INCOMPLETE)
+  {
+    data.clear();
+    ThreadBase::Get().GetErrorPolicy().VulkanError("vkGetPipelineCacheData", result, nullptr, __FUNCTION__, __FILE__, __LINE__);
+  }
+  return data;
+}
+
+
+
 // -----------------------------------------------------------------------------
 KRUST_VKOBJ_LIFETIME(PipelineLayout);
 
@@ -541,6 +695,20 @@ QueuePtr Queue::New(Device& device, const uint32_t queueFamilyIndex, const uint3
 
 
 
+// -----------------------------------------------------------------------------
+KRUST_VKOBJ_LIFETIME(QueryPool);
+
+QueryPoolPtr QueryPool::New(
+  Device&                             device,
+  const VkQueryType                   queryType,
+  const uint32_t                      queryCount,
+  const VkQueryPipelineStatisticFlags pipelineStatistics)
+{
+  return new QueryPool(device, QueryPoolCreateInfo(0, queryType, queryCount, pipelineStatistics));
+}
+
+
+
 // -----------------------------------------------------------------------------
 KRUST_VKOBJ_LIFETIME(Semaphore)
 
@@ -549,6 +717,14 @@ SemaphorePtr Semaphore::New(Device& device)
   return new Semaphore { device, SemaphoreCreateInfo(0) };
 }
 
+SemaphorePtr Semaphore::NewTimeline(Device& device, const uint64_t initialValue)
+{
+  auto typeInfo = SemaphoreTypeCreateInfo(VK_SEMAPHORE_TYPE_TIMELINE, initialValue);
+  auto info = SemaphoreCreateInfo(0);
+  info.pNext = &typeInfo;
+  return new Semaphore { device, info };
+}
+
 
 
 // -----------------------------------------------------------------------------
@@ -559,4 +735,9 @@ ShaderModulePtr ShaderModule::New(Device& device, const VkShaderModuleCreateFlag
   return new ShaderModule { device, ShaderModuleCreateInfo(flags, byte_size(src), &src[0]) };
 }
 
+ShaderModulePtr ShaderModule::New(Device& device, const VkShaderModuleCreateFlags flags, const span<const uint32_t> code)
+{
+  return new ShaderModule { device, ShaderModuleCreateInfo(flags, code.size_bytes(), code.data()) };
+}
+
 }
@@ -24,7 +24,9 @@
 // Internal includes
 #include "krust/public-api/vulkan-objects-fwd.h"
 #include "krust/public-api/ref-object.h"
+#include "krust/public-api/object-pool.h"
 #include <krust/public-api/vulkan_types_and_macros.h>
+#include "krust-kernel/public-api/span.h"
 
 // External includes:
 #include <vector>
@@ -68,17 +70,33 @@ namespace Krust
 
 
 
+namespace Internal { template<class T> class RetireList; }
+
 /* ----------------------------------------------------------------------- *//**
  * Base class for all ownership wrappers for Vulkan API objects.
+ * The wrappers are allocated from size-class pools rather than the general heap.
+ * When a QueueJanitor has deferred destruction enabled, wrappers whose last
+ * reference is dropped are queued on it to be destroyed in bulk once the GPU
+ * has finished the latest submit, rather than being destroyed in place.
  **/
-class VulkanObject : public RefObject
+class VulkanObject : public RefObject, public PooledObject
 {
 public:
   VulkanObject() {}
+protected:
+  /** For wrappers of per-frame transients which never leave their thread. */
+  explicit VulkanObject(const RefCountPolicy policy) : RefObject(policy) {}
+  void Retire() const override;
 private:
   // Ban copying objects:
   VulkanObject(const VulkanObject&) = delete;
   VulkanObject& operator=(const VulkanObject&) = delete;
+
+  template<class T> friend class Internal::RetireList;
+  /// Link to the next object awaiting deferred destruction.
+  mutable const VulkanObject* mNextRetired = nullptr;
+  /// The submit that must complete before this can be destroyed.
+  mutable uint64_t mRetireEpoch = 0;
 };
 
 
@@ -257,11 +275,16 @@ private:
  */
 class CommandBuffer : public VulkanObject
 {
-  CommandBuffer(CommandPool& pool, VkCommandBufferLevel level);
+  CommandBuffer(CommandPool& pool, VkCommandBufferLevel level, RefCountPolicy policy);
   /// Used in bulk allocation by Allocate.
   explicit CommandBuffer(CommandPool& pool, VkCommandBuffer vkHandle);
 public:
-  static CommandBufferPtr New(CommandPool& pool, VkCommandBufferLevel level);
+  /**
+   * @param policy Pass RefCountPolicy::ThreadConfined for a command buffer
+   * which is recorded, submitted, waited for, and dropped on one thread, such
+   * as a one-shot blocking upload, to skip the atomic reference counting.
+   */
+  static CommandBufferPtr New(CommandPool& pool, VkCommandBufferLevel level, RefCountPolicy policy = RefCountPolicy::Shared);
   static void Allocate(CommandPool& pool, VkCommandBufferLevel level, unsigned number, std::vector<CommandBufferPtr>& outCommandBuffers);
   ~CommandBuffer();
   operator VkCommandBuffer() const { return mCommandBuffer;  }
@@ -298,16 +321,21 @@ private:
  * @brief A handle to a Compute Pipeline, wrapped to allow RAII management of its
  * lifetime.
  *
- * @todo Add a factory function which works with pipeline caches.
  * @todo Consider a single Pipeline object to map directly to VkPipeline.
  */
 class ComputePipeline : public VulkanObject
 {
   /** Hidden constructor to prevent users doing naked `new`s.*/
-  ComputePipeline(Device& device, const VkComputePipelineCreateInfo& createInfo);
+  ComputePipeline(Device& device, const VkComputePipelineCreateInfo& createInfo, VkPipelineCache pipelineCache);
 public:
-  /** Creation function to return new ComputePipelines via smart pointers. */
-  static ComputePipelinePtr New(Device& device, const VkComputePipelineCreateInfo& createInfo);
+  /**
+   * Creation function to return new ComputePipelines via smart pointers.
+   * @param pipelineCache A cache to look the compiled pipeline up in and add it
+   * to, or VK_NULL_HANDLE, the default, to compile it from scratch. Pass
+   * IO::Application::mPipelineCache, or one from LoadPipelineCache(), to reuse
+   * pipelines compiled by earlier runs.
+   */
+  static ComputePipelinePtr New(Device& device, const VkComputePipelineCreateInfo& createInfo, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
   ~ComputePipeline();
  /**
    * Operator to allow the object to be used in raw Vulkan API calls and avoid
@@ -367,13 +395,21 @@ class DescriptorSetLayout : public VulkanObject
   DescriptorSetLayout(Device& device, const VkDescriptorSetLayoutCreateInfo& createInfo);
 public:
   static DescriptorSetLayoutPtr New(Device& device, VkDescriptorSetLayoutCreateFlags flags,  uint32_t bindingCount,  const VkDescriptorSetLayoutBinding* pBindings);
+  /// For layouts needing extension structures, e.g. binding flags.
+  static DescriptorSetLayoutPtr New(Device& device, const VkDescriptorSetLayoutCreateInfo& createInfo);
   ~DescriptorSetLayout();
   operator VkDescriptorSetLayout() const { return mDescriptorSetLayout; }
   const VkDescriptorSetLayout* GetDescriptorSetLayoutAddress() const { return &mDescriptorSetLayout; }
   VkDescriptorSetLayout*       GetDescriptorSetLayoutAddress()       { return &mDescriptorSetLayout; }
+  VkDescriptorSetLayoutCreateFlags GetFlags() const { return mFlags; }
+  /// @return The number of descriptors of each type a set with this layout
+  /// needs from a pool, in increasing order of type.
+  const std::vector<VkDescriptorPoolSize>& GetPoolSizes() const { return mPoolSizes; }
 private:
   DevicePtr mDevice;
   VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
+  VkDescriptorSetLayoutCreateFlags mFlags = 0;
+  std::vector<VkDescriptorPoolSize> mPoolSizes;
 };
 
 
@@ -405,6 +441,57 @@ private:
 
 
 
+/* ----------------------------------------------------------------------- *//**
+ * @brief A handle to a descriptor update template, which writes all the
+ * descriptors of a set from one block of host memory laid out as its entries
+ * describe, instead of from an array of VkWriteDescriptorSet built per update.
+ *
+ * Templates can also push the descriptors straight into a command buffer with
+ * VK_KHR_push_descriptor so no descriptor set needs to be allocated at all.
+ */
+class DescriptorUpdateTemplate : public VulkanObject
+{
+  DescriptorUpdateTemplate(Device& device, const VkDescriptorUpdateTemplateCreateInfo& createInfo, PipelineLayout* pipelineLayout);
+public:
+  /// A template for updating sets allocated with the given layout.
+  static DescriptorUpdateTemplatePtr New(
+    Device& device,
+    const DescriptorSetLayout& setLayout,
+    uint32_t entryCount,
+    const VkDescriptorUpdateTemplateEntry* pEntries);
+
+  /**
+   * A template for pushing the descriptors of one set of a pipeline layout.
+   * The layout of that set must have been created with
+   * VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR and
+   * VK_KHR_push_descriptor must be enabled on the device.
+   */
+  static DescriptorUpdateTemplatePtr NewPush(
+    Device& device,
+    VkPipelineBindPoint bindPoint,
+    PipelineLayout& pipelineLayout,
+    uint32_t set,
+    uint32_t entryCount,
+    const VkDescriptorUpdateTemplateEntry* pEntries);
+
+  ~DescriptorUpdateTemplate();
+  operator VkDescriptorUpdateTemplate() const { return mDescriptorUpdateTemplate; }
+
+  /// Write the descriptors of a set from data laid out as the entries describe.
+  void Update(VkDescriptorSet set, const void* data) const;
+  /// Record the descriptors into a command buffer. Only for templates made with NewPush().
+  void Push(VkCommandBuffer commandBuffer, const void* data) const;
+
+private:
+  DevicePtr mDevice;
+  /// The layout pushes are made to, for templates made by NewPush().
+  PipelineLayoutPtr mPipelineLayout;
+  VkDescriptorUpdateTemplate mDescriptorUpdateTemplate = VK_NULL_HANDLE;
+  uint32_t mSet = 0;
+};
+
+
+
 /* ----------------------------------------------------------------------- *//**
  * @brief A handle to a block of memory on a device.
  *
@@ -420,9 +507,21 @@ public:
   ~DeviceMemory();
   operator VkDeviceMemory() const { return mDeviceMemory; }
   Device& GetDevice() const { return *mDevice; }
+  /**
+   * Map the whole allocation into the host address space the first time this
+   * is called and leave it mapped until the memory is freed.
+   * The memory must have come from a HOST_VISIBLE memory type.
+   * @return The host address of the start of the allocation, or null if the
+   * map failed. A failure is logged but not passed to the error policy.
+   */
+  void* GetPersistentMapping();
+  /// @return The persistent host mapping if there is one, else null.
+  void* GetMappedAddress() const { return mMappedAddress; }
 private:
   DevicePtr mDevice;
   VkDeviceMemory mDeviceMemory = VK_NULL_HANDLE;
+  /// Host address of the whole allocation while it is persistently mapped.
+  void* mMappedAddress = nullptr;
 };
 
 
@@ -502,8 +601,10 @@ public:
    *
    * Only call this once since, as the spec tells us, "Once bound, the memory
    * binding is immutable for the lifetime of the resource."
+   * @return The result of vkBindImageMemory(), which is also passed to the
+   * error policy if it failed.
    */
-  void BindMemory(DeviceMemory& memory, VkDeviceSize offset);
+  VkResult BindMemory(DeviceMemory& memory, VkDeviceSize offset);
 private:
   /// The GPU device this image is tied to. Keep it alive as long as this image is.
   DevicePtr mDevice;
@@ -548,6 +649,42 @@ private:
 
 
 
+/* ----------------------------------------------------------------------- *//**
+ * @brief A handle to a pipeline cache, wrapped to allow RAII management of its
+ * lifetime.
+ *
+ * Pass it to pipeline creation so pipelines compiled before, by this run or
+ * by an earlier one whose data it was created from, are reused rather than
+ * compiled again.
+ * @see LoadPipelineCache() and SavePipelineCache() in pipeline-cache-file.h
+ * for persisting the data between runs.
+ */
+class PipelineCache : public VulkanObject
+{
+  PipelineCache(Device& device, const VkPipelineCacheCreateInfo& createInfo);
+public:
+  /**
+   * @param initialDataSize The size of data previously returned by GetData(),
+   * or zero for an empty cache.
+   */
+  static PipelineCachePtr New(
+    Device&                    device,
+    size_t                     initialDataSize = 0,
+    const void*                pInitialData = nullptr,
+    VkPipelineCacheCreateFlags flags = 0);
+  ~PipelineCache();
+  operator VkPipelineCache() const { return mPipelineCache; }
+  Device& GetDevice() const { return *mDevice; }
+  /// @return The cache's contents, starting with a VkPipelineCacheHeaderVersionOne,
+  /// or an empty vector on failure.
+  std::vector<uint8_t> GetData() const;
+private:
+  DevicePtr mDevice;
+  VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+};
+
+
+
 /* ----------------------------------------------------------------------- *//**
  * @brief A handle to a pipeline layout, wrapped to allow RAII management of its
  * lifetime.
@@ -592,6 +729,35 @@ private:
 
 
 
+/* ----------------------------------------------------------------------- *//**
+ * @brief A handle to a pool of queries, wrapped to allow RAII management of its
+ * lifetime.
+ *
+ * Used for GPU timestamps and pipeline statistics.
+ */
+class QueryPool : public VulkanObject
+{
+  QueryPool(Device& device, const VkQueryPoolCreateInfo& createInfo);
+public:
+  /**
+   * @param pipelineStatistics The counters each query of a
+   * VK_QUERY_TYPE_PIPELINE_STATISTICS pool gathers. Ignored for other types.
+   */
+  static QueryPoolPtr New(
+    Device&                       device,
+    VkQueryType                   queryType,
+    uint32_t                      queryCount,
+    VkQueryPipelineStatisticFlags pipelineStatistics = 0);
+  ~QueryPool();
+  operator VkQueryPool() const { return mQueryPool; }
+  Device& GetDevice() const { return *mDevice; }
+private:
+  DevicePtr mDevice;
+  VkQueryPool mQueryPool = VK_NULL_HANDLE;
+};
+
+
+
 /* ----------------------------------------------------------------------- *//**
  * @brief A handle to an instance of Vulkan's VkSemaphore API object.
  */
@@ -606,6 +772,12 @@ public:
    * @return Smart pointer wrapper to keep the Semaphore alive.
    */
   static SemaphorePtr New(Device& device);
+  /**
+   * @brief Creator for timeline semaphores (Vulkan 1.2 or
+   * VK_KHR_timeline_semaphore with the timelineSemaphore feature enabled).
+   * @param initialValue The value of the semaphore's payload on creation.
+   */
+  static SemaphorePtr NewTimeline(Device& device, uint64_t initialValue);
   ~Semaphore();
   operator VkSemaphore() const { return mSemaphore; }
   const VkSemaphore* GetVkSemaphoreAddress() const { return &mSemaphore; }
@@ -640,6 +812,11 @@ public:
    * @return Smart pointer wrapper to keep the ShaderModule alive.
    */
   static ShaderModulePtr New(Device& device, VkShaderModuleCreateFlags flags, const ShaderBuffer& src);
+  /**
+   * @brief Creator taking SPIR-V words from anywhere, such as an array built
+   * into the binary or a MappedSpirV, without copying them first.
+   */
+  static ShaderModulePtr New(Device& device, VkShaderModuleCreateFlags flags, span<const uint32_t> code);
   ~ShaderModule();
   operator VkShaderModule() const { return mShaderModule; }
 
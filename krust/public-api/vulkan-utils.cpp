@@ -29,6 +29,7 @@
 #include "krust/public-api/krust-assertions.h"
 #include "krust/public-api/vulkan_struct_init.h"
 #include "krust/public-api/vulkan-objects.h"
+#include "krust/public-api/trace.h"
 #include "krust/internal/krust-internal.h"
 #include <krust/public-api/vulkan.h>
 
@@ -95,7 +96,8 @@ VkResult ApplyImageBarrierBlocking(
   Krust::Device& device, VkImage image, VkQueue queue, Krust::CommandPool& pool,
   const VkImageMemoryBarrier& barrier)
 {
-  auto commandBuffer = CommandBuffer::New(pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  // Never leaves this thread as we wait for it to execute before returning:
+  auto commandBuffer = CommandBuffer::New(pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, RefCountPolicy::ThreadConfined);
 
   auto commandBufferInheritanceInfo = CommandBufferInheritanceInfo();
     commandBufferInheritanceInfo.renderPass = nullptr,
@@ -220,6 +222,40 @@ FindMemoryTypeWithAndWithout(
   return ConditionalValue<uint32_t>(0, false);
 }
 
+ConditionalValue<uint32_t>
+FindDirectUploadMemoryType(
+  const VkPhysicalDeviceMemoryProperties& memoryProperties,
+  const uint32_t candidateTypeBitset,
+  const VkDeviceSize size)
+{
+  constexpr VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  const uint32_t count = std::min(uint32_t(VK_MAX_MEMORY_TYPES), memoryProperties.memoryTypeCount);
+  uint32_t bestType = 0;
+  VkDeviceSize bestHeapSize = 0;
+  for(uint32_t memoryType = 0; memoryType < count; ++memoryType)
+  {
+    if(candidateTypeBitset & (1u << memoryType))
+    {
+      const VkMemoryType& type = memoryProperties.memoryTypes[memoryType];
+      if((type.propertyFlags & properties) == properties)
+      {
+        const VkDeviceSize heapSize = memoryProperties.memoryHeaps[type.heapIndex].size;
+        if(heapSize >= size && heapSize > bestHeapSize)
+        {
+          bestType = memoryType;
+          bestHeapSize = heapSize;
+        }
+      }
+    }
+  }
+  if(bestHeapSize == 0)
+  {
+    KRUST_LOG_DEBUG << "No device-local, host-visible memory type with a heap big enough for " << size << " bytes among the allowed types in the flag set (" << candidateTypeBitset << ")." << endlog;
+    return ConditionalValue<uint32_t>(0, false);
+  }
+  return ConditionalValue<uint32_t>(bestType, true);
+}
+
 bool IsDepthFormat(const VkFormat format)
 {
   // Use this to find out the new number if the assert below fires:
@@ -955,6 +991,7 @@ ScopedDeviceMemoryOwner::~ScopedDeviceMemoryOwner()
 
 ShaderBuffer loadSpirV(const char* const filename)
 {
+  KRUST_TRACE_SCOPE("loadSpirV");
   ShaderBuffer spirv;
   if(std::ifstream is{filename, std::ios::binary | std::ios::ate}) {
     auto size = is.tellg();
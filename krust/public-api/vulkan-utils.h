@@ -180,6 +180,33 @@ FindMemoryTypeWithAndWithout(
   VkMemoryPropertyFlags properties,
   VkMemoryPropertyFlags avoided_properties);
 
+/**
+ * @brief Looks for a memory type which is both device local and host visible
+ * and whose heap is large enough to hold a resource of the given size, so that
+ * the host can write the resource directly into GPU memory rather than going
+ * through a staging buffer and a copy.
+ *
+ * On systems with resizable BAR the device-local heap is host visible in its
+ * entirety. Without it, any such heap is typically a 256 MB window, so large
+ * resources will fail this test and should fall back to staging.
+ * Among qualifying types, the one with the largest heap is preferred.
+ * @param[in] memoryProperties The device memory properties that should be
+ *            examined.
+ * @param[in] candidateTypeBitset A set of bits: if bit x of this is set then
+ *            type x in the device's list of memory types can be considered.
+ *            Usually VkMemoryRequirements::memoryTypeBits for the resource.
+ * @param[in] size The number of bytes the resource needs.
+ * @returns A pair of the index of a compatible memory type and true if one
+ *          could be found, or a pair of an undefined value and false otherwise.
+ *          Failure is not logged as a warning since staging is the normal
+ *          fallback.
+ */
+ConditionalValue<uint32_t>
+FindDirectUploadMemoryType(
+  const VkPhysicalDeviceMemoryProperties& memoryProperties,
+  uint32_t candidateTypeBitset,
+  VkDeviceSize size);
+
 /**
  * @brief Determines whether format argument is usable for a depth buffer.
  */
@@ -349,6 +376,7 @@ struct ScopedImageOwner
 
 /**
  * Simple synchronous load of a SPIR-V shader from a file.
+ * @see MappedSpirV for loading without a copy.
  */
 ShaderBuffer loadSpirV(const char* const filename);
 
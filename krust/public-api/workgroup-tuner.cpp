@@ -0,0 +1,265 @@
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "krust/public-api/workgroup-tuner.h"
+
+// Internal includes:
+#include "krust/internal/replace-file.h"
+#include "krust/public-api/krust-assertions.h"
+#include "krust/public-api/logging.h"
+
+// External includes:
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace Krust
+{
+
+namespace
+{
+
+std::filesystem::path SizesPath(const uint8_t (&deviceUUID)[VK_UUID_SIZE], const std::string& directory)
+{
+  return std::filesystem::path(directory.empty() ? "." : directory) / WorkgroupSizesFilename(deviceUUID);
+}
+
+/// One line per kernel: its name, then the x and y of its best workgroup size.
+std::vector<std::pair<std::string, WorkgroupSize>> ReadSizes(const std::filesystem::path& path)
+{
+  std::vector<std::pair<std::string, WorkgroupSize>> sizes;
+  std::ifstream is{path};
+  std::string line;
+  while(std::getline(is, line))
+  {
+    std::istringstream fields{line};
+    std::pair<std::string, WorkgroupSize> entry;
+    if(fields >> entry.first >> entry.second.x >> entry.second.y && entry.second.x > 0 && entry.second.y > 0)
+    {
+      sizes.push_back(entry);
+    }
+  }
+  return sizes;
+}
+
+}
+
+WorkgroupSpecialization::WorkgroupSpecialization(const WorkgroupSize size) :
+  mSize(size)
+{
+  mEntries[0] = { WORKGROUP_X_CONSTANT_ID, offsetof(WorkgroupSize, x), sizeof(uint32_t) };
+  mEntries[1] = { WORKGROUP_Y_CONSTANT_ID, offsetof(WorkgroupSize, y), sizeof(uint32_t) };
+  mInfo = { 2, mEntries, sizeof(mSize), &mSize };
+}
+
+bool WorkgroupSizeFits(const WorkgroupSize size, const VkPhysicalDeviceLimits& limits)
+{
+  return size.x <= limits.maxComputeWorkGroupSize[0] &&
+         size.y <= limits.maxComputeWorkGroupSize[1] &&
+         uint64_t(size.x) * size.y <= limits.maxComputeWorkGroupInvocations;
+}
+
+std::vector<WorkgroupSize> WorkgroupSizeCandidates(const VkPhysicalDeviceLimits& limits)
+{
+  std::vector<WorkgroupSize> candidates;
+  for(const WorkgroupSize size : WORKGROUP_SIZE_CANDIDATES)
+  {
+    if(WorkgroupSizeFits(size, limits))
+    {
+      candidates.push_back(size);
+    }
+  }
+  return candidates;
+}
+
+std::string WorkgroupSizesFilename(const uint8_t (&deviceUUID)[VK_UUID_SIZE])
+{
+  char uuid[VK_UUID_SIZE * 2 + 1];
+  for(unsigned i = 0; i < VK_UUID_SIZE; ++i)
+  {
+    snprintf(uuid + i * 2, 3, "%02x", deviceUUID[i]);
+  }
+  return std::string("krust-workgroups-") + uuid + ".txt";
+}
+
+bool LoadWorkgroupSize(const uint8_t (&deviceUUID)[VK_UUID_SIZE], const std::string& directory, const std::string& kernel, WorkgroupSize& size)
+{
+  for(const auto& entry : ReadSizes(SizesPath(deviceUUID, directory)))
+  {
+    if(entry.first == kernel)
+    {
+      size = entry.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SaveWorkgroupSize(const uint8_t (&deviceUUID)[VK_UUID_SIZE], const std::string& directory, const std::string& kernel, const WorkgroupSize size)
+{
+  if(kernel.empty() || kernel.find_first_of(" \t\n") != std::string::npos)
+  {
+    KRUST_LOG_WARN << "Can't save a workgroup size for kernel \"" << kernel << "\" as its name has whitespace in it." << endlog;
+    return false;
+  }
+  const auto path = SizesPath(deviceUUID, directory);
+  auto sizes = ReadSizes(path);
+  auto existing = std::find_if(sizes.begin(), sizes.end(), [&kernel](const auto& entry){ return entry.first == kernel; });
+  if(existing != sizes.end())
+  {
+    existing->second = size;
+  }
+  else
+  {
+    sizes.push_back({ kernel, size });
+  }
+
+  std::ostringstream os;
+  for(const auto& entry : sizes)
+  {
+    os << entry.first << ' ' << entry.second.x << ' ' << entry.second.y << '\n';
+  }
+  const std::string text = os.str();
+  return Internal::ReplaceFile(path, text.data(), text.size(), "workgroup sizes");
+}
+
+WorkgroupTuner::WorkgroupTuner(
+  Device& device,
+  const uint32_t numCandidates,
+  const uint32_t numSlots,
+  const float timestampPeriod,
+  const uint32_t timestampValidBits,
+  const unsigned samplesPerCandidate) :
+  mDevice(&device),
+  mQueries(QueryPool::New(device, VK_QUERY_TYPE_TIMESTAMP, numSlots * 2)),
+  mMillisecondsPerTick(timestampPeriod * 1e-6),
+  mTimestampMask(timestampValidBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << timestampValidBits) - 1),
+  mSamplesPerCandidate(samplesPerCandidate),
+  mSamples(numCandidates),
+  mSlotCandidates(numSlots, NO_CANDIDATE)
+{
+  KRUST_ASSERT1(numCandidates > 0, "Nothing to tune.");
+  KRUST_ASSERT1(timestampValidBits > 0, "The queue doesn't support timestamps.");
+}
+
+WorkgroupTunerPtr WorkgroupTuner::New(
+  Device& device,
+  const uint32_t numCandidates,
+  const uint32_t numSlots,
+  const float timestampPeriod,
+  const uint32_t timestampValidBits,
+  const unsigned samplesPerCandidate)
+{
+  return new WorkgroupTuner { device, numCandidates, numSlots, timestampPeriod, timestampValidBits, samplesPerCandidate };
+}
+
+bool WorkgroupTuner::IsTuning() const
+{
+  return std::any_of(mSamples.begin(), mSamples.end(),
+    [this](const std::vector<double>& samples){ return samples.size() < mSamplesPerCandidate; });
+}
+
+void WorkgroupTuner::Collect(const uint32_t slot)
+{
+  const uint32_t candidate = slot < mSlotCandidates.size() ? mSlotCandidates[slot] : NO_CANDIDATE;
+  if(candidate == NO_CANDIDATE)
+  {
+    return;
+  }
+  mSlotCandidates[slot] = NO_CANDIDATE;
+
+  uint64_t ticks[2];
+  const VkResult result = vkGetQueryPoolResults(*mDevice, *mQueries, slot * 2, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if(result != VK_SUCCESS)
+  {
+    KRUST_LOG_WARN << "Timestamps for workgroup tuning not available: " << result << endlog;
+    return;
+  }
+  const uint64_t elapsed = ((ticks[1] & mTimestampMask) - (ticks[0] & mTimestampMask)) & mTimestampMask;
+  mSamples[candidate].push_back(elapsed * mMillisecondsPerTick);
+  if(!IsTuning())
+  {
+    mBest = GetBest();
+  }
+}
+
+uint32_t WorkgroupTuner::Begin(const VkCommandBuffer commandBuffer, const uint32_t slot)
+{
+  if(mBest != NO_CANDIDATE)
+  {
+    return mBest;
+  }
+  // Slots beyond those the tuner was made for, e.g. from a swapchain recreated
+  // with more images, are left out of the timing:
+  if(!IsTuning() || slot >= mSlotCandidates.size())
+  {
+    return GetBest();
+  }
+  const uint32_t candidate = mNextCandidate;
+  mNextCandidate = (mNextCandidate + 1) % uint32_t(mSamples.size());
+  mSlotCandidates[slot] = candidate;
+
+  vkCmdResetQueryPool(commandBuffer, *mQueries, slot * 2, 2);
+  // Written once all earlier compute work has finished:
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, *mQueries, slot * 2);
+  return candidate;
+}
+
+void WorkgroupTuner::End(const VkCommandBuffer commandBuffer, const uint32_t slot)
+{
+  if(slot < mSlotCandidates.size() && mSlotCandidates[slot] != NO_CANDIDATE)
+  {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, *mQueries, slot * 2 + 1);
+  }
+}
+
+uint32_t WorkgroupTuner::GetBest() const
+{
+  uint32_t best = 0;
+  double bestTime = 0;
+  for(uint32_t candidate = 0; candidate < mSamples.size(); ++candidate)
+  {
+    const double time = GetMedianMilliseconds(candidate);
+    if(time > 0 && (bestTime == 0 || time < bestTime))
+    {
+      best = candidate;
+      bestTime = time;
+    }
+  }
+  return best;
+}
+
+double WorkgroupTuner::GetMedianMilliseconds(const uint32_t candidate) const
+{
+  std::vector<double> samples = mSamples[candidate];
+  if(samples.empty())
+  {
+    return 0;
+  }
+  const auto middle = samples.begin() + samples.size() / 2;
+  std::nth_element(samples.begin(), middle, samples.end());
+  return *middle;
+}
+
+} /* namespace Krust */
@@ -0,0 +1,217 @@
+#ifndef KRUST_PUBLIC_API_WORKGROUP_TUNER_H_INCLUDED_E26EF
+#define KRUST_PUBLIC_API_WORKGROUP_TUNER_H_INCLUDED_E26EF
+
+// Copyright (c) 2024 Andrew Helge Cox
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file Picking the workgroup shape a 2D compute kernel runs fastest with on
+ * the GPU at hand by timing the candidates on the real workload, and
+ * remembering the winner for the next run.
+ *
+ * Kernels which can be tuned declare their workgroup size through
+ * specialization constants WORKGROUP_X_CONSTANT_ID and
+ * WORKGROUP_Y_CONSTANT_ID and have one pipeline compiled per candidate size.
+ */
+
+// Internal includes:
+#include "krust/public-api/vulkan-objects.h"
+#include "krust-kernel/public-api/span.h"
+
+// External includes:
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Krust
+{
+
+/** The x and y dimensions of a workgroup. */
+struct WorkgroupSize
+{
+  uint32_t x = 8;
+  uint32_t y = 8;
+};
+
+inline bool operator==(const WorkgroupSize& a, const WorkgroupSize& b) { return a.x == b.x && a.y == b.y; }
+inline bool operator!=(const WorkgroupSize& a, const WorkgroupSize& b) { return !(a == b); }
+
+/// Specialization constants a tunable kernel takes its workgroup size from.
+constexpr uint32_t WORKGROUP_X_CONSTANT_ID = 0;
+constexpr uint32_t WORKGROUP_Y_CONSTANT_ID = 1;
+
+/// Shapes worth trying for a kernel over the pixels of an image. The square
+/// ones suit coherent memory access while the wide ones suit GPUs whose
+/// subgroups are best filled by whole rows.
+inline constexpr WorkgroupSize WORKGROUP_SIZE_CANDIDATES[] = {
+  { 8, 8 }, { 16, 8 }, { 16, 16 }, { 32, 4 }, { 64, 1 }
+};
+
+/**
+ * @return True if a device can run workgroups of the size. The spec only
+ * promises 128 invocations in a workgroup, so the larger candidates may not.
+ */
+bool WorkgroupSizeFits(WorkgroupSize size, const VkPhysicalDeviceLimits& limits);
+
+/** @return Those of WORKGROUP_SIZE_CANDIDATES a device can run. */
+std::vector<WorkgroupSize> WorkgroupSizeCandidates(const VkPhysicalDeviceLimits& limits);
+
+/** @return The number of workgroups needed to cover a number of invocations. */
+inline uint32_t NumWorkgroups(const uint32_t invocations, const uint32_t workgroupSize)
+{
+  return (invocations + workgroupSize - 1) / workgroupSize;
+}
+
+/**
+ * @brief Specialization info setting a kernel's workgroup size.
+ *
+ * The info points into this object so it can't be copied. PipelineCompiler
+ * takes its own copy so a temporary is fine to pass to that.
+ */
+class WorkgroupSpecialization
+{
+public:
+  explicit WorkgroupSpecialization(WorkgroupSize size);
+  WorkgroupSpecialization(const WorkgroupSpecialization&) = delete;
+  WorkgroupSpecialization& operator=(const WorkgroupSpecialization&) = delete;
+
+  const VkSpecializationInfo* Get() const { return &mInfo; }
+
+private:
+  WorkgroupSize mSize;
+  VkSpecializationMapEntry mEntries[2];
+  VkSpecializationInfo mInfo;
+};
+
+/**
+ * @return The name of the file tuned workgroup sizes for a device are kept in.
+ * @param deviceUUID From VkPhysicalDeviceIDProperties.
+ */
+std::string WorkgroupSizesFilename(const uint8_t (&deviceUUID)[VK_UUID_SIZE]);
+
+/**
+ * Look up the workgroup size saved by SaveWorkgroupSize() for a kernel on a
+ * device.
+ * @param directory The directory to look in, or empty for the current one.
+ * @return False if no size has been saved for the kernel.
+ */
+bool LoadWorkgroupSize(const uint8_t (&deviceUUID)[VK_UUID_SIZE], const std::string& directory, const std::string& kernel, WorkgroupSize& size);
+
+/**
+ * Record the best workgroup size for a kernel on a device, keeping those saved
+ * for other kernels.
+ * @return True if the file was written.
+ */
+bool SaveWorkgroupSize(const uint8_t (&deviceUUID)[VK_UUID_SIZE], const std::string& directory, const std::string& kernel, WorkgroupSize size);
+
+
+class WorkgroupTuner;
+using WorkgroupTunerPtr = IntrusivePointer<WorkgroupTuner>;
+
+/* ----------------------------------------------------------------------- *//**
+ * @brief Times alternative versions of a dispatch across frames using GPU
+ * timestamps and picks the fastest.
+ *
+ * Each frame in flight gets a slot with its own pair of timestamp queries. A
+ * frame asks which candidate to record with by calling Begin() just before
+ * its dispatch and End() just after. Once the GPU has finished the frame,
+ * Collect() reads its timing back. Candidates are taken in turn until each
+ * has been timed the requested number of times and the one with the lowest
+ * median time wins, the median ignoring the odd frame slowed by something
+ * else the system was doing.
+ *
+ * Run on the real workload, the timings include the effect of workgroup shape
+ * on cache behaviour and divergence in the shader which synthetic benchmarks
+ * miss.
+ */
+class WorkgroupTuner : public RefObject
+{
+  /** Hidden constructor to prevent users doing naked `new`s.*/
+  WorkgroupTuner(Device& device, uint32_t numCandidates, uint32_t numSlots, float timestampPeriod, uint32_t timestampValidBits, unsigned samplesPerCandidate);
+
+  // Ban copying objects:
+  WorkgroupTuner(const WorkgroupTuner&) = delete;
+  WorkgroupTuner& operator=(const WorkgroupTuner&) = delete;
+
+public:
+  /**
+   * @param numSlots The number of frames which can be in flight at once.
+   * @param timestampPeriod From VkPhysicalDeviceLimits: nanoseconds per tick.
+   * @param timestampValidBits From the VkQueueFamilyProperties of the queue the
+   * dispatches are submitted to. Must not be zero.
+   */
+  static WorkgroupTunerPtr New(
+    Device&  device,
+    uint32_t numCandidates,
+    uint32_t numSlots,
+    float    timestampPeriod,
+    uint32_t timestampValidBits,
+    unsigned samplesPerCandidate = 8);
+
+  /** @return True until every candidate has been timed enough. */
+  bool IsTuning() const;
+
+  /**
+   * Read back the timing of the dispatch last recorded in a slot.
+   * Call once the GPU has finished with the slot's commands, for example after
+   * waiting on its fence, and before Begin() records into it again.
+   */
+  void Collect(uint32_t slot);
+
+  /**
+   * Record the timestamp before a dispatch.
+   * @return The candidate to record the dispatch with.
+   */
+  uint32_t Begin(VkCommandBuffer commandBuffer, uint32_t slot);
+
+  /** Record the timestamp after the dispatch. */
+  void End(VkCommandBuffer commandBuffer, uint32_t slot);
+
+  /**
+   * @return The candidate with the lowest median time so far. Once tuning is
+   * over Begin() returns the winner without recomputing it.
+   */
+  uint32_t GetBest() const;
+
+  /** @return The median time of a candidate so far, or zero if it has not been timed. */
+  double GetMedianMilliseconds(uint32_t candidate) const;
+
+private:
+  static constexpr uint32_t NO_CANDIDATE = ~0u;
+
+  DevicePtr mDevice;
+  QueryPoolPtr mQueries;
+  double mMillisecondsPerTick;
+  uint64_t mTimestampMask;
+  unsigned mSamplesPerCandidate;
+  /// Times taken by each candidate so far.
+  std::vector<std::vector<double>> mSamples;
+  /// The candidate recorded into each slot and not yet collected.
+  std::vector<uint32_t> mSlotCandidates;
+  /// The next candidate to hand out, taken round-robin.
+  uint32_t mNextCandidate = 0;
+  /// The winner, picked once the last sample needed has been collected.
+  uint32_t mBest = NO_CANDIDATE;
+};
+
+} /* namespace Krust */
+
+#endif /* KRUST_PUBLIC_API_WORKGROUP_TUNER_H_INCLUDED_E26EF */
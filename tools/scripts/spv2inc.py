@@ -0,0 +1,48 @@
+# A script to read a compiled SPIR-V shader and output its words as an array in
+# a C++ header so the shader can be built into a binary rather than loaded from
+# the working directory at runtime.
+#
+# Usage:
+#
+#     python3 tools/scripts/spv2inc.py rt1.comp.spv spirv/rt1.comp.spv.h
+#
+# The array is named after the shader with the ".spv" dropped and other dots
+# replaced by underscores, so rt1.comp.spv becomes Krust::Spirv::rt1_comp.
+import os
+import struct
+import sys
+
+SPIRV_MAGIC = 0x07230203
+WORDS_PER_LINE = 8
+
+spv_filename = sys.argv[1]
+header_filename = sys.argv[2]
+
+base = os.path.basename(spv_filename)
+if base.endswith(".spv"):
+    base = base[:-4]
+symbol = base.replace(".", "_").replace("-", "_")
+
+with open(spv_filename, "rb") as handle:
+    code = handle.read()
+
+if len(code) % 4 != 0:
+    sys.exit(f"spv2inc: \"{spv_filename}\" is {len(code)} bytes which is not a whole number of 32 bit words.")
+words = struct.unpack(f"<{len(code) // 4}I", code)
+if len(words) == 0 or words[0] != SPIRV_MAGIC:
+    sys.exit(f"spv2inc: \"{spv_filename}\" does not start with the SPIR-V magic number.")
+
+os.makedirs(os.path.dirname(os.path.abspath(header_filename)), exist_ok=True)
+with open(header_filename, "w") as out:
+    out.write(f"// Generated from {os.path.basename(spv_filename)} by tools/scripts/spv2inc.py. Do not edit.\n")
+    out.write("#pragma once\n")
+    out.write("#include <cstdint>\n\n")
+    out.write("namespace Krust::Spirv\n{\n\n")
+    # Aligned beyond the four bytes required so the words can be handed
+    # straight to vkCreateShaderModule and hashed or copied a vector at a time:
+    out.write(f"alignas(16) inline constexpr uint32_t {symbol}[{len(words)}] = {{\n")
+    for i in range(0, len(words), WORDS_PER_LINE):
+        line = ", ".join(f"0x{word:08x}u" for word in words[i:i + WORDS_PER_LINE])
+        out.write(f"    {line},\n")
+    out.write("};\n\n")
+    out.write("} /* namespace Krust::Spirv */\n")